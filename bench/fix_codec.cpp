@@ -0,0 +1,129 @@
+/**
+ * Messages per second of the FIX codec on one core.
+ *
+ * usage: extra_fix_codec [messages per run]
+ *
+ * Parsing runs over a stream of execution reports held in one buffer, as a session reading a burst
+ * would see it, and over the same stream received 1448 bytes at a time into a compacted buffer.
+ * Encoding builds new order singles with a fresh SendingTime each.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "extra/Fix.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::fix;
+
+namespace
+{
+std::string execution_report(Encoder & encoder, uint64_t seq)
+{
+	encoder.begin("8", seq, "20261019-08:00:00.000");
+	encoder.add(37, "7f3e2b8c-0d4a");
+	encoder.add(ClOrdID, "ord-" + std::to_string(seq));
+	encoder.add(17, "exec-" + std::to_string(seq));
+	encoder.add(150, 'F');
+	encoder.add(39, '1');
+	encoder.add(Symbol, "BTC-USDT");
+	encoder.add(Side, '1');
+	encoder.add(OrderQty, 5);
+	encoder.add_fixed(Price, 6512345000000, 8);
+	encoder.add(32, 2);
+	encoder.add_fixed(31, 6512340000000, 8);
+	encoder.add(151, 3);
+	encoder.add(14, 2);
+	encoder.add_fixed(6, 6512340000000, 8);
+	encoder.add(TransactTime, "20261019-08:00:00.000123");
+	return std::string(encoder.finish());
+}
+
+template <typename F>
+double measure(size_t messages, F && f)
+{
+	auto begin = std::chrono::steady_clock::now();
+	f();
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	return messages / elapsed;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	if (messages == 0)
+		return EXIT_FAILURE;
+
+	Encoder venue("FIX.4.4", "VENUE", "CLIENT");
+	std::string stream;
+	constexpr size_t burst = 1024;
+	for (size_t i = 0; i < burst; i++)
+		stream += execution_report(venue, i + 1);
+	auto runs = (messages + burst - 1) / burst;
+
+	Parser parser;
+	size_t parsed = 0;
+	uint64_t sum = 0;
+	auto whole = measure(runs * burst, [&]
+	{
+		for (size_t r = 0; r < runs; r++)
+		{
+			std::string_view raw = stream;
+			while (parser.parse(raw) == ParseResult::Complete)
+			{
+				int64_t price;
+				parsed += parser.find_fixed(Price, price, 8);
+				sum += price + parser.find(ClOrdID).size();
+				parser.reset();
+			}
+		}
+	});
+
+	std::string buffer;
+	auto split = measure(runs * burst, [&]
+	{
+		for (size_t r = 0; r < runs; r++)
+		{
+			for (size_t offset = 0; offset < stream.size(); offset += 1448)
+			{
+				buffer.append(stream, offset, 1448);
+				std::string_view raw = buffer;
+				while (parser.parse(raw) == ParseResult::Complete)
+				{
+					int64_t price;
+					parsed += parser.find_fixed(Price, price, 8);
+					sum += price + parser.find(ClOrdID).size();
+					parser.reset();
+				}
+				buffer.erase(0, buffer.size() - raw.size());
+			}
+		}
+	});
+
+	Encoder client("FIX.4.4", "CLIENT", "VENUE");
+	size_t encoded = 0;
+	auto encode = measure(runs * burst, [&]
+	{
+		char now[timestamp_length];
+		for (size_t i = 0; i < runs * burst; i++)
+		{
+			format_timestamp(std::chrono::system_clock::now(), now);
+			client.begin("D", i + 1, std::string_view(now, sizeof(now)));
+			client.add(ClOrdID, i);
+			client.add(Symbol, "BTC-USDT");
+			client.add(Side, '1');
+			client.add(OrderQty, 5);
+			client.add(OrdType, '2');
+			client.add_fixed(Price, 6512345000000, 8);
+			client.add(TimeInForce, '1');
+			client.add(TransactTime, std::string_view(now, sizeof(now)));
+			encoded += client.finish().size();
+		}
+	});
+
+	std::printf("message %zu bytes, parse whole %.0f msg/s, parse 1448 %.0f msg/s, encode %.0f msg/s (%llu)\n",
+		stream.size() / burst, whole, split, encode, static_cast<unsigned long long>(sum + encoded));
+	return parsed == 2 * runs * burst ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,202 @@
+/**
+ * End-to-end time to fetch and decode a large snapshot from HttpServer over loopback.
+ *
+ * usage: extra_http_fetch [megabytes] [fetches]
+ *
+ * The snapshot is reference data as JSON lines, served as is and gzip encoded. The client keeps one
+ * blocking connection and hands the body to a sink, decoded on the fly while received, so neither
+ * the encoded nor the decoded body is buffered whole. Reports wire bytes, and best and mean time per
+ * fetch with the decoded throughput.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "extra/HttpServer.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::http;
+
+namespace
+{
+std::string make_snapshot(size_t size)
+{
+	std::string s;
+	s.reserve(size + 256);
+	char line[256];
+	for (size_t i = 0; s.size() < size; i++)
+	{
+		auto n = std::snprintf(line, sizeof(line),
+			R"({"symbol":"SYM%06zu-USDT","tickSize":"0.%08zu","lotSize":"%zu.00000000","status":"%s"})" "\n",
+			i, i * 7919 % 100000000, i % 1000 + 1, i % 17 == 0 ? "HALT" : "TRADING");
+		s.append(line, n);
+	}
+	return s;
+}
+
+std::string gzip(const std::string & data)
+{
+	z_stream z{};
+	if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return {};
+
+	std::string out(deflateBound(&z, data.size()), '\0');
+	z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+	z.avail_in = data.size();
+	z.next_out = reinterpret_cast<Bytef *>(out.data());
+	z.avail_out = out.size();
+	auto result = deflate(&z, Z_FINISH);
+	out.resize(z.total_out);
+	deflateEnd(&z);
+	return result == Z_STREAM_END ? out : std::string{};
+}
+
+int connect_loopback(uint16_t port)
+{
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+struct Fetch
+{
+	size_t wire;
+	size_t decoded;
+	uint64_t checksum;
+};
+
+/**
+ * @return false on a connection or parse error
+ */
+bool fetch(int fd, const std::string & uri, HttpResponseV1D1 & resp, std::vector<char> & buffer, Fetch & result)
+{
+	HttpRequestV1D1 req;
+	req.set_method<Method::Get>();
+	req.set_uri(uri);
+	req.append_header("Host", "127.0.0.1");
+	req.append_header("Accept-Encoding", "gzip");
+	auto request = req.format();
+	if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+		return false;
+
+	result = {};
+	resp.reset();
+	resp.set_body_sink([&result](std::string_view piece)
+	{
+		result.decoded += piece.size();
+		result.checksum += static_cast<unsigned char>(piece.back());
+	});
+	while (true)
+	{
+		auto n = recv(fd, buffer.data(), buffer.size(), 0);
+		if (n <= 0)
+			return false;
+
+		result.wire += n;
+		std::string_view raw(buffer.data(), n);
+		auto parsed = resp.parse(raw);
+		if (parsed == ParseResult::Error)
+			return false;
+
+		if (parsed == ParseResult::Complete)
+			return true;
+	}
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50;
+	size_t fetches = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5;
+	if (megabytes == 0 || fetches == 0 || !HttpResponseBasic::is_content_decoding_supported())
+		return EXIT_FAILURE;
+
+	auto snapshot = make_snapshot(megabytes * 1024 * 1024);
+	auto encoded = gzip(snapshot);
+	if (encoded.empty())
+		return EXIT_FAILURE;
+
+	auto poller = poller_create();
+	if (poller == nullptr)
+		return EXIT_FAILURE;
+
+	int status = EXIT_SUCCESS;
+	{
+		HttpServer server(poller, [&](const HttpRequestParser & request, HttpResponseWriter & response)
+		{
+			response.append_header("Content-Type", "application/x-ndjson");
+			if (request.get_uri() == "/gzip")
+			{
+				response.append_header("Content-Encoding", "gzip");
+				response.set_body_once(encoded);
+			}
+			else
+				response.set_body_once(snapshot);
+		});
+		if (!server.listen("127.0.0.1", 0))
+			return EXIT_FAILURE;
+
+		std::atomic<bool> stop{false};
+		std::thread loop([&]
+		{
+			while (!stop.load(std::memory_order::relaxed))
+				poller_go(poller);
+		});
+
+		int fd = connect_loopback(server.get_port());
+		if (fd < 0)
+			status = EXIT_FAILURE;
+
+		HttpResponseV1D1 resp;
+		std::vector<char> buffer(256 * 1024);
+		std::printf("%-10s %12s %12s %10s %10s %10s\n", "encoding", "wire MB", "decoded MB", "best ms", "mean ms",
+			"MB/s");
+		for (const char * uri: {"/identity", "/gzip"})
+		{
+			Fetch result{};
+			double best = 1e9;
+			double total = 0;
+			for (size_t i = 0; status == EXIT_SUCCESS && i < fetches; i++)
+			{
+				auto begin = std::chrono::steady_clock::now();
+				if (!fetch(fd, uri, resp, buffer, result) || result.decoded != snapshot.size())
+				{
+					std::printf("%-10s failed\n", uri + 1);
+					status = EXIT_FAILURE;
+					break;
+				}
+				auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+				best = std::min(best, elapsed);
+				total += elapsed;
+			}
+			if (status == EXIT_SUCCESS)
+				std::printf("%-10s %12.1f %12.1f %10.1f %10.1f %10.1f\n", uri + 1, result.wire / 1e6,
+					result.decoded / 1e6, best * 1e3, total / fetches * 1e3, snapshot.size() / best / 1e6);
+		}
+		if (fd >= 0)
+			close(fd);
+
+		stop = true;
+		loop.join();
+	}
+	poller_destroy(poller);
+	return status;
+}
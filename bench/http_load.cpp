@@ -0,0 +1,154 @@
+/**
+ * Load generator for HttpServer over loopback.
+ *
+ * usage: extra_http_load [connections] [requests per connection] [pipeline depth]
+ *
+ * The server runs on its own thread and poller. Each client thread keeps one blocking connection
+ * and sends batches of pipeline depth requests, reading all responses before the next batch.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "extra/HttpServer.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::http;
+
+namespace
+{
+int connect_loopback(uint16_t port)
+{
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @return number of responses received
+ */
+size_t run_client(uint16_t port, size_t requests, size_t depth)
+{
+	int fd = connect_loopback(port);
+	if (fd < 0)
+		return 0;
+
+	HttpRequestV1D1 req;
+	req.set_method<Method::Get>();
+	req.set_uri("/ping");
+	req.append_header("Host", "127.0.0.1");
+	std::string batch;
+	for (size_t i = 0; i < depth; i++)
+		batch += req.format();
+
+	HttpResponseV1D1 resp;
+	std::vector<char> buffer(64 * 1024);
+	size_t received = 0;
+	while (received < requests)
+	{
+		size_t count = std::min(depth, requests - received);
+		auto length = batch.size() / depth * count;
+		if (::send(fd, batch.data(), length, MSG_NOSIGNAL) != static_cast<ssize_t>(length))
+			break;
+
+		size_t done = 0;
+		while (done < count)
+		{
+			auto n = recv(fd, buffer.data(), buffer.size(), 0);
+			if (n <= 0)
+			{
+				close(fd);
+				return received + done;
+			}
+
+			std::string_view raw(buffer.data(), n);
+			while (!raw.empty())
+			{
+				auto result = resp.parse(raw);
+				if (result == ParseResult::Error)
+				{
+					close(fd);
+					return received + done;
+				}
+
+				if (result == ParseResult::Complete)
+				{
+					done++;
+					resp.reset();
+				}
+			}
+		}
+		received += done;
+	}
+	close(fd);
+	return received;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t connections = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8;
+	size_t requests = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20000;
+	size_t depth = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 16;
+	if (connections == 0 || depth == 0)
+		return EXIT_FAILURE;
+
+	auto poller = poller_create();
+	if (poller == nullptr)
+		return EXIT_FAILURE;
+
+	std::atomic<size_t> total{0};
+	double elapsed;
+	{
+		HttpServer server(poller, [](const HttpRequestParser &, HttpResponseWriter & response)
+		{
+			response.append_header("Content-Type", "text/plain");
+			response.set_body_once("pong");
+		});
+		if (!server.listen("127.0.0.1", 0))
+			return EXIT_FAILURE;
+
+		std::atomic<bool> stop{false};
+		std::thread loop([&]
+		{
+			while (!stop.load(std::memory_order::relaxed))
+				poller_go(poller);
+		});
+
+		auto begin = std::chrono::steady_clock::now();
+		std::vector<std::thread> clients;
+		for (size_t i = 0; i < connections; i++)
+			clients.emplace_back([&] { total += run_client(server.get_port(), requests, depth); });
+
+		for (auto & t: clients)
+			t.join();
+
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		stop = true;
+		loop.join();
+	}
+	poller_destroy(poller);
+
+	std::printf("connections %zu, depth %zu, responses %zu, %.3f s, %.0f requests/s, %.0f ns/request\n",
+		connections, depth, total.load(), elapsed, total.load() / elapsed, elapsed * 1e9 / total.load());
+	return total.load() == connections * requests ? EXIT_SUCCESS : EXIT_FAILURE;
+}
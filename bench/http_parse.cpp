@@ -0,0 +1,206 @@
+/**
+ * Throughput of HttpResponseBasic::parse over response corpora.
+ *
+ * usage: extra_http_parse [megabytes per run]
+ *
+ * Each corpus is a stream of pipelined responses fed to one parser in chunks, the way recv() hands
+ * them over, under several split patterns. Reports bytes/s, ns/response and heap allocations per
+ * response, counted by replacing the global operator new. The first pass over a stream is a warm-up
+ * and not counted, so allocations show the steady state of a reused parser.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "extra/HttpBasic.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::http;
+
+namespace
+{
+size_t allocations = 0;
+}
+
+void * operator new(size_t size)
+{
+	allocations++;
+	if (auto p = std::malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace
+{
+struct Corpus
+{
+	std::string name;
+	std::string stream;
+	size_t responses;
+};
+
+/**
+ * Shaped after a REST order book snapshot of a crypto exchange behind a CDN.
+ */
+std::string exchange_response()
+{
+	std::string body = R"({"lastUpdateId":1027024,"bids":[)";
+	for (int i = 0; i < 10; i++)
+		body += R"(["4.00000000","431.00000000"],)";
+	body.back() = ']';
+	body += R"(,"asks":[)";
+	for (int i = 0; i < 10; i++)
+		body += R"(["4.00000200","12.00000000"],)";
+	body.back() = ']';
+	body += '}';
+
+	return "HTTP/1.1 200 OK\r\n"
+	       "Content-Type: application/json;charset=UTF-8\r\n"
+	       "Content-Length: " + std::to_string(body.size()) + "\r\n"
+	       "Connection: keep-alive\r\n"
+	       "Date: Mon, 19 Oct 2026 08:00:00 GMT\r\n"
+	       "Server: nginx\r\n"
+	       "x-mbx-uuid: 6f3e2b8c-0d4a-4c1e-9b57-1a2b3c4d5e6f\r\n"
+	       "x-mbx-used-weight: 5\r\n"
+	       "x-mbx-used-weight-1m: 5\r\n"
+	       "Strict-Transport-Security: max-age=31536000; includeSubdomains\r\n"
+	       "X-Frame-Options: SAMEORIGIN\r\n"
+	       "X-Xss-Protection: 1; mode=block\r\n"
+	       "X-Content-Type-Options: nosniff\r\n"
+	       "Content-Security-Policy: default-src 'self'\r\n"
+	       "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+	       "Pragma: no-cache\r\n"
+	       "Expires: 0\r\n"
+	       "Access-Control-Allow-Origin: *\r\n"
+	       "Access-Control-Allow-Methods: GET, HEAD, OPTIONS\r\n"
+	       "X-Cache: Miss from cloudfront\r\n"
+	       "Via: 1.1 0123456789abcdef0123456789abcdef.cloudfront.net (CloudFront)\r\n"
+	       "X-Amz-Cf-Pop: NRT57-P3\r\n"
+	       "X-Amz-Cf-Id: Qx2b8c0d4a4c1e9b571a2b3c4d5e6fQx2b8c0d4a4c1e9b57==\r\n"
+	       "\r\n" + body;
+}
+
+std::string synthetic_response(size_t header_count, size_t body_size)
+{
+	std::string s = "HTTP/1.1 200 OK\r\n";
+	for (size_t i = 0; i < header_count; i++)
+		s += "X-Header-" + std::to_string(i) + ": value-" + std::to_string(i * 7919) + "\r\n";
+	s += "Content-Length: " + std::to_string(body_size) + "\r\n\r\n";
+	s += std::string(body_size, 'x');
+	return s;
+}
+
+Corpus make_corpus(std::string name, const std::string & response, size_t responses)
+{
+	Corpus corpus{std::move(name), {}, responses};
+	for (size_t i = 0; i < responses; i++)
+		corpus.stream += response;
+	return corpus;
+}
+
+/**
+ * Chunk sizes of a split pattern, 0 meaning the whole stream at once.
+ */
+struct Split
+{
+	const char * name;
+	std::vector<size_t> sizes;
+};
+
+std::vector<Split> make_splits()
+{
+	std::vector<Split> splits{{"whole", {0}}, {"1", {1}}, {"7", {7}}, {"1448", {1448}}, {"random", {}}};
+	std::mt19937 random(42);
+	std::uniform_int_distribution<size_t> size(1, 4096);
+	for (int i = 0; i < 1024; i++)
+		splits.back().sizes.push_back(size(random));
+	return splits;
+}
+
+/**
+ * @return responses completed, or 0 on a parse error
+ */
+size_t parse_stream(HttpResponseV1D1 & response, const std::string & stream, const Split & split)
+{
+	size_t completed = 0;
+	size_t offset = 0;
+	size_t i = 0;
+	while (offset < stream.size())
+	{
+		auto chunk = split.sizes[i++ % split.sizes.size()];
+		std::string_view raw = std::string_view(stream).substr(offset, chunk == 0 ? stream.size() : chunk);
+		offset += raw.size();
+		while (!raw.empty())
+		{
+			auto result = response.parse(raw);
+			if (result == ParseResult::Error)
+				return 0;
+
+			if (result == ParseResult::Complete)
+			{
+				completed++;
+				response.reset();
+			}
+		}
+	}
+	return completed;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+	if (megabytes == 0)
+		return EXIT_FAILURE;
+
+	std::vector<Corpus> corpora;
+	corpora.push_back(make_corpus("exchange", exchange_response(), 64));
+	corpora.push_back(make_corpus("204", "HTTP/1.1 204 No Content\r\nDate: Mon, 19 Oct 2026 08:00:00 GMT\r\n\r\n", 256));
+	for (size_t headers: {0, 8, 32, 64})
+		corpora.push_back(make_corpus("headers-" + std::to_string(headers), synthetic_response(headers, 256), 64));
+	corpora.push_back(make_corpus("body-64k", synthetic_response(8, 64 * 1024), 16));
+
+	std::printf("%-12s %-8s %10s %12s %14s\n", "corpus", "split", "MB/s", "ns/response", "allocs/response");
+	int status = EXIT_SUCCESS;
+	for (const auto & corpus: corpora)
+	{
+		for (const auto & split: make_splits())
+		{
+			HttpResponseV1D1 response;
+			if (parse_stream(response, corpus.stream, split) != corpus.responses)
+			{
+				std::printf("%-12s %-8s failed\n", corpus.name.c_str(), split.name);
+				status = EXIT_FAILURE;
+				continue;
+			}
+
+			size_t runs = std::max<size_t>(1, megabytes * 1024 * 1024 / corpus.stream.size());
+			size_t completed = 0;
+			allocations = 0;
+			auto begin = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < runs; i++)
+				completed += parse_stream(response, corpus.stream, split);
+			auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			auto counted = allocations;
+
+			std::printf("%-12s %-8s %10.1f %12.1f %14.3f\n", corpus.name.c_str(), split.name,
+				runs * corpus.stream.size() / elapsed / 1e6, elapsed * 1e9 / completed,
+				static_cast<double>(counted) / completed);
+		}
+	}
+	return status;
+}
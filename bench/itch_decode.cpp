@@ -0,0 +1,176 @@
+/**
+ * Messages per second of the ITCH decoder on one core.
+ *
+ * usage: extra_itch_decode [messages per run]
+ *
+ * A day-like mix of order book messages is framed into MoldUDP64 packets of at most 1400 bytes, then
+ * decoded packet by packet into a running aggregate, and again published into a Channel cell per
+ * message as a feed handler would.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "extra/Itch.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::itch;
+using binary::Overloaded;
+
+namespace
+{
+void put(std::string & s, uint64_t value, size_t size)
+{
+	for (size_t i = size; i > 0; i--)
+		s += static_cast<char>(value >> (8 * (i - 1)));
+}
+
+std::string message(uint64_t i)
+{
+	std::string m;
+	auto type = "AAAADDDEEXUC"[i % 12];
+	m += type;
+	put(m, i % 8000, 2);
+	put(m, 0, 2);
+	put(m, 34200000000000 + i * 1000, 6);
+	put(m, i, 8);
+	switch (type)
+	{
+	case 'A':
+		m += i % 2 ? 'B' : 'S';
+		put(m, 100 + i % 900, 4);
+		m += "AAPL    ";
+		put(m, 1895000 + i % 1000 * 100, 4);
+		break;
+	case 'E':
+		put(m, 100, 4);
+		put(m, i, 8);
+		break;
+	case 'C':
+		put(m, 100, 4);
+		put(m, i, 8);
+		m += 'Y';
+		put(m, 1895100, 4);
+		break;
+	case 'X':
+		put(m, 50, 4);
+		break;
+	case 'U':
+		put(m, i + 1, 8);
+		put(m, 200, 4);
+		put(m, 1895200, 4);
+		break;
+	default:
+		break;
+	}
+	return m;
+}
+
+struct Quote
+{
+	uint64_t reference;
+	uint64_t timestamp;
+	int64_t price;
+	int64_t shares;
+};
+
+template <typename F>
+double measure(size_t messages, F && f)
+{
+	auto begin = std::chrono::steady_clock::now();
+	f();
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	return messages / elapsed;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+	if (messages == 0)
+		return EXIT_FAILURE;
+
+	std::vector<std::string> packets;
+	std::string packet;
+	constexpr size_t day = 1000000;
+	size_t bytes = 0;
+	for (uint64_t i = 0; i < day; i++)
+	{
+		auto m = message(i);
+		if (packet.size() + 2 + m.size() > 1400)
+		{
+			packets.push_back(std::move(packet));
+			packet.clear();
+		}
+		if (packet.empty())
+		{
+			packet = "SESSION001";
+			put(packet, i + 1, 8);
+			put(packet, 0, 2);
+		}
+		put(packet, m.size(), 2);
+		packet += m;
+		bytes += m.size();
+	}
+	packets.push_back(std::move(packet));
+	auto runs = (messages + day - 1) / day;
+
+	uint64_t sum = 0;
+	size_t decoded = 0;
+	auto aggregate = Overloaded{
+		[&](const AddOrder & m) { sum += m.price() * m.shares(); decoded++; },
+		[&](const OrderExecuted & m) { sum += m.executed_shares(); decoded++; },
+		[&](const OrderExecutedWithPrice & m) { sum += m.execution_price(); decoded++; },
+		[&](const OrderCancel & m) { sum -= m.cancelled_shares(); decoded++; },
+		[&](const OrderDelete & m) { sum ^= m.order_reference(); decoded++; },
+		[&](const OrderReplace & m) { sum += m.price() ^ m.new_order_reference(); decoded++; },
+	};
+	auto decode = measure(runs * day, [&]
+	{
+		for (size_t r = 0; r < runs; r++)
+		{
+			for (const auto & p: packets)
+			{
+				std::string_view raw(p);
+				raw.remove_prefix(binary::MoldUdp64::length);
+				if (Decoder::decode(raw, aggregate) != ParseResult::Complete)
+					std::abort();
+			}
+		}
+	});
+
+	extra::kernel::Channel<Quote> channel("extra-itch-decode", 0, day + 1);
+	if (!channel.create())
+		return EXIT_FAILURE;
+
+	auto publish = binary::to_channel(channel, Overloaded{
+		[](const AddOrder & m, Quote & q)
+		{
+			q = Quote{m.order_reference(), m.timestamp(), m.price(), m.side() == 'B' ? m.shares() : -int64_t(m.shares())};
+		},
+		[](const OrderExecuted & m, Quote & q)
+		{
+			q = Quote{m.order_reference(), m.timestamp(), 0, -int64_t(m.executed_shares())};
+		},
+		[](const OrderDelete & m, Quote & q)
+		{
+			q = Quote{m.order_reference(), m.timestamp(), 0, 0};
+		},
+	});
+	// The channel never recycles cells, so one day only
+	auto channel_rate = measure(day * 8 / 12, [&]
+	{
+		for (const auto & p: packets)
+		{
+			std::string_view raw(p);
+			raw.remove_prefix(binary::MoldUdp64::length);
+			Decoder::decode(raw, publish);
+		}
+	});
+
+	std::printf("%zu packets, %.1f bytes/message, decode %.0f msg/s, into channel %.0f msg/s (%llu)\n",
+		packets.size(), double(bytes) / day, decode, channel_rate, static_cast<unsigned long long>(sum));
+	return decoded == runs * day ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,103 @@
+/**
+ * Decoding cost of typical REST bodies with json::Document.
+ *
+ * usage: extra_json_parse [iterations]
+ *
+ * Each body is parsed, then the fields a trading handler needs are pulled into integers and fixed
+ * point, the way an order ack or a book snapshot is consumed. Reports MB/s and ns/message.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "extra/Json.h"
+
+using namespace extra::protocol::json;
+
+namespace
+{
+std::string book_snapshot(int depth)
+{
+	std::string body = R"({"lastUpdateId":1027024,"E":1589436922972,"T":1589436922959,"bids":[)";
+	for (int i = 0; i < depth; i++)
+		body += R"([")" + std::to_string(4000 - i) + R"(.12000000","431.00000000"],)";
+	body.back() = ']';
+	body += R"(,"asks":[)";
+	for (int i = 0; i < depth; i++)
+		body += R"([")" + std::to_string(4001 + i) + R"(.12000000","12.50000000"],)";
+	body.back() = ']';
+	body += '}';
+	return body;
+}
+
+const std::string order_ack = R"({"symbol":"BTCUSDT","orderId":28,"orderListId":-1,)"
+	R"("clientOrderId":"6gCrw2kRUAF9CvJDGP16IP","transactTime":1507725176595,"price":"0.00000000",)"
+	R"("origQty":"10.00000000","executedQty":"10.00000000","cummulativeQuoteQty":"10.00000000",)"
+	R"("status":"FILLED","timeInForce":"GTC","type":"MARKET","side":"SELL","workingTime":1507725176595,)"
+	R"("selfTradePreventionMode":"NONE","fills":[{"price":"4000.00000000","qty":"1.00000000",)"
+	R"("commission":"4.00000000","commissionAsset":"USDT","tradeId":56}]})";
+
+int64_t decode_book(Document & document, const std::string & body)
+{
+	if (!document.parse(body))
+		return -1;
+
+	int64_t checksum = 0;
+	auto root = document.root();
+	for (auto side: {root["bids"], root["asks"]})
+	{
+		for (auto level: side.get_array())
+		{
+			int64_t price = 0;
+			int64_t quantity = 0;
+			auto array = level.get_array();
+			auto iter = array.begin();
+			(*iter).get_fixed(price, 8);
+			(*++iter).get_fixed(quantity, 8);
+			checksum += price ^ quantity;
+		}
+	}
+	return checksum;
+}
+
+int64_t decode_ack(Document & document, const std::string & body)
+{
+	if (!document.parse(body))
+		return -1;
+
+	auto root = document.root();
+	int64_t id = 0;
+	int64_t executed = 0;
+	std::string_view status;
+	root["orderId"].get(id);
+	root["executedQty"].get_fixed(executed, 8);
+	root["status"].get(status);
+	return id + executed + static_cast<int64_t>(status.size());
+}
+
+template <typename Decode>
+void run(const char * name, const std::string & body, size_t iterations, Decode decode)
+{
+	Document document;
+	int64_t checksum = 0;
+	auto begin = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++)
+		checksum += decode(document, body);
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	std::printf("%-10s %6zu bytes %10.1f MB/s %10.1f ns/message (checksum %lld)\n", name, body.size(),
+		body.size() * iterations / elapsed / 1e6, elapsed * 1e9 / iterations, static_cast<long long>(checksum));
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+	if (iterations == 0)
+		return EXIT_FAILURE;
+
+	run("ack", order_ack, iterations, decode_ack);
+	run("book-5", book_snapshot(5), iterations, decode_book);
+	run("book-100", book_snapshot(100), iterations / 10, decode_book);
+	return EXIT_SUCCESS;
+}
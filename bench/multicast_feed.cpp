@@ -0,0 +1,211 @@
+/**
+ * MoldUDP64 feed over loopback multicast into a Channel.
+ *
+ * usage: extra_multicast_feed [packets] [burst] [batch]
+ *
+ * Packets of AddOrder messages, up to 1400 bytes as on the wire, are sent on line A and line B, A losing
+ * one packet in a hundred, in bursts of burst packets per line from the thread running the poller. The
+ * receiver arbitrates the lines and decodes each AddOrder into a Channel cell. Reports packets delivered
+ * per second of poller busy time, which leaves out sending, and percentiles of the wire-to-channel
+ * latency, from the kernel receive timestamp to the cell written, sending included. Then the same for lone
+ * packets, one per line at a time. A batch of 1 receives a datagram per call as recv() would.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "extra/Itch.h"
+#include "extra/Multicast.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::multicast;
+
+namespace
+{
+constexpr const char * groups[] = {"239.255.51.1", "239.255.51.2"};
+
+void put(std::string & s, uint64_t value, size_t size)
+{
+	for (size_t i = size; i > 0; i--)
+		s += static_cast<char>(value >> (8 * (i - 1)));
+}
+
+std::string add_order(uint64_t i)
+{
+	std::string m = "A";
+	put(m, i % 8000, 2);
+	put(m, 0, 2);
+	put(m, 34200000000000 + i * 1000, 6);
+	put(m, i, 8);
+	m += i % 2 ? 'B' : 'S';
+	put(m, 100 + i % 900, 4);
+	m += "AAPL    ";
+	put(m, 1895000 + i % 1000 * 100, 4);
+	return m;
+}
+
+/* Packets of whole messages, numbered from 1 */
+std::vector<std::string> make_packets(size_t count, size_t & messages)
+{
+	std::vector<std::string> packets;
+	uint64_t sequence = 1;
+	for (size_t p = 0; p < count; p++)
+	{
+		std::string packet = "SESSION001";
+		put(packet, sequence, 8);
+		put(packet, 0, 2);
+		uint16_t n = 0;
+		for (auto m = add_order(sequence + n); packet.size() + 2 + m.size() <= 1400; m = add_order(sequence + ++n))
+		{
+			put(packet, m.size(), 2);
+			packet += m;
+		}
+		packet[18] = static_cast<char>(n >> 8);
+		packet[19] = static_cast<char>(n);
+		sequence += n;
+		packets.push_back(std::move(packet));
+	}
+	messages = sequence - 1;
+	return packets;
+}
+
+struct Quote
+{
+	uint64_t reference;
+	uint64_t received_ns;
+	int64_t price;
+	int64_t shares;
+};
+
+uint64_t realtime_ns()
+{
+	timespec now{};
+	clock_gettime(CLOCK_REALTIME, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void report(const char * name, double rate, std::vector<uint32_t> & latencies)
+{
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double p)
+	{
+		return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))] / 1e3;
+	};
+	std::printf("%-7s %12.0f %10.1f %10.1f %10.1f\n", name, rate, percentile(0.5), percentile(0.99), percentile(0.999));
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	size_t burst = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 32;
+	size_t batch = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 64;
+	if (count == 0 || burst == 0 || batch == 0)
+		return EXIT_FAILURE;
+
+	size_t messages = 0;
+	auto packets = make_packets(count, messages);
+	// The channel never recycles cells, so one cell per message
+	extra::kernel::Channel<Quote> channel("extra-multicast-feed", 0, messages + 1);
+	if (!channel.create())
+		return EXIT_FAILURE;
+
+	std::vector<uint32_t> latencies;
+	latencies.reserve(messages);
+	auto publish = decode_to_channel<itch::Decoder>(channel, [&](const itch::AddOrder & m, const Packet & p, Quote & q)
+	{
+		q = Quote{m.order_reference(), p.received_ns, m.price(), m.side() == 'B' ? m.shares() : -int64_t(m.shares())};
+		latencies.push_back(static_cast<uint32_t>(realtime_ns() - p.received_ns));
+	});
+
+	auto poller = poller_create();
+	Receiver::Options options;
+	options.batch = batch;
+	for (int line = 0; line < 2; line++)
+	{
+		auto & l = line == 0 ? options.a : options.b;
+		l.group = groups[line];
+		l.interface = "127.0.0.1";
+	}
+	Receiver receiver(poller, options, publish);
+	if (!poller || !receiver.open())
+		return EXIT_FAILURE;
+
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	in_addr loopback{htonl(INADDR_LOOPBACK)};
+	int one = 1;
+	setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+	setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &one, sizeof(one));
+	sockaddr_in lines[2]{};
+	for (int line = 0; line < 2; line++)
+	{
+		lines[line].sin_family = AF_INET;
+		lines[line].sin_port = htons(receiver.get_port(line));
+		inet_pton(AF_INET, groups[line], &lines[line].sin_addr);
+	}
+
+	// Both lines of a packet, A missing every hundredth
+	size_t sent = 0;
+	auto send = [&](size_t p)
+	{
+		for (int line = 0; line < 2; line++)
+		{
+			if (line == 0 && p % 100 == 99)
+				continue;
+
+			sendto(fd, packets[p].data(), packets[p].size(), 0, reinterpret_cast<sockaddr *>(&lines[line]), sizeof(sockaddr_in));
+			sent++;
+		}
+	};
+	auto drain = [&]
+	{
+		const auto & stats = receiver.get_stats();
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (stats.lines[0].packets + stats.lines[1].packets < sent && std::chrono::steady_clock::now() < deadline)
+			poller_go(poller);
+	};
+
+	std::printf("%zu packets of %.1f messages, bursts of %zu, batch %zu\n%-7s %12s %10s %10s %10s\n", count,
+		double(messages) / count, burst, batch, "", "packets/s", "p50 us", "p99 us", "p99.9 us");
+	poller_stats before{};
+	poller_stats after{};
+	size_t half = count / 2;
+	poller_get_stats(&before, poller);
+	for (size_t p = 0; p < half; p += burst)
+	{
+		for (size_t i = p; i < std::min(p + burst, half); i++)
+			send(i);
+		drain();
+	}
+	poller_get_stats(&after, poller);
+	auto delivered = receiver.get_stats().delivered;
+	report("burst", delivered / ((after.busy_ns - before.busy_ns) / 1e9), latencies);
+
+	latencies.clear();
+	poller_get_stats(&before, poller);
+	for (size_t p = half; p < count; p++)
+	{
+		send(p);
+		drain();
+	}
+	poller_get_stats(&after, poller);
+	report("lone", (receiver.get_stats().delivered - delivered) / ((after.busy_ns - before.busy_ns) / 1e9), latencies);
+
+	const auto & stats = receiver.get_stats();
+	std::printf("delivered %llu, gaps %llu, A gaps %llu, B duplicates %llu\n",
+		static_cast<unsigned long long>(stats.delivered), static_cast<unsigned long long>(stats.gaps),
+		static_cast<unsigned long long>(stats.lines[0].gaps), static_cast<unsigned long long>(stats.lines[1].duplicates));
+	receiver.close();
+	close(fd);
+	poller_destroy(poller);
+	return stats.delivered == count && stats.gaps == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,200 @@
+/**
+ * Connection churn on one poller, counting allocations.
+ *
+ * usage: extra_poller_churn [connections per wave] [waves]
+ *
+ * Each wave adds both ends of socket pairs as buffered handles, marks two heartbeat timeouts on each
+ * client, echoes one message per connection, then deletes and closes them all, as a reconnect storm
+ * would. malloc and friends are wrapped to count the calls made while the poller runs. Reports
+ * connections per second and calls per connection after a few waves of warm-up, which leave buffers
+ * with the handles in the pools. Pools are grown on demand, then reserved up front by poller_reserve(),
+ * once with epoll and once with io_uring.
+ */
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "extra/poller.h"
+
+extern "C"
+{
+void * __libc_malloc(size_t size);
+void * __libc_calloc(size_t count, size_t size);
+void * __libc_realloc(void * p, size_t size);
+void * __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void * p);
+}
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+size_t allocations = 0;
+}
+
+extern "C"
+{
+void * malloc(size_t size)
+{
+	allocations++;
+	return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size)
+{
+	allocations++;
+	return __libc_calloc(count, size);
+}
+
+void * realloc(void * p, size_t size)
+{
+	allocations++;
+	return __libc_realloc(p, size);
+}
+
+int posix_memalign(void ** p, size_t alignment, size_t size)
+{
+	allocations++;
+	*p = __libc_memalign(alignment, size);
+	return *p ? 0 : ENOMEM;
+}
+
+void free(void * p)
+{
+	__libc_free(p);
+}
+}
+
+namespace
+{
+constexpr char message[] = "heartbeat\n";
+constexpr size_t message_size = sizeof(message) - 1;
+constexpr int warm_up = 5;
+
+struct Connection
+{
+	int fds[2] = {-1, -1};
+	size_t echoed = 0;
+};
+
+size_t on_server_data(handle_t * handle, void *, const char * data, size_t size)
+{
+	poller_send(data, size, handle);
+	return size;
+}
+
+size_t on_client_data(handle_t *, void * context, const char *, size_t size)
+{
+	if (size < message_size)
+		return 0;
+
+	static_cast<Connection *>(context)->echoed++;
+	return message_size;
+}
+
+void on_timeout(handle_t *, void *, int)
+{
+}
+
+bool wave(poller_t * poller, std::vector<Connection> & connections)
+{
+	size_t echoed = 0;
+	for (auto & connection: connections)
+	{
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, connection.fds) != 0)
+			return false;
+
+		connection.echoed = 0;
+		handle_param server{};
+		server.fd = connection.fds[0];
+		server.on_data = on_server_data;
+		handle_param client{};
+		client.fd = connection.fds[1];
+		client.context = &connection;
+		client.on_data = on_client_data;
+		client.on_timeout = on_timeout;
+		handle_t * handle;
+		if (poller_add(&server, poller) == nullptr || (handle = poller_add(&client, poller)) == nullptr
+			|| poller_mark(0, 30000, handle, poller) != 0 || poller_mark(1, 60000, handle, poller) != 0
+			|| poller_send(message, message_size, handle) != 0)
+			return false;
+	}
+
+	auto deadline = Clock::now() + std::chrono::seconds(10);
+	while (echoed < connections.size() && Clock::now() < deadline)
+	{
+		poller_go(poller);
+		echoed = 0;
+		for (const auto & connection: connections)
+			echoed += connection.echoed;
+	}
+
+	for (auto & connection: connections)
+	{
+		for (int fd: connection.fds)
+		{
+			poller_del(fd, poller);
+			close(fd);
+		}
+	}
+	// Lets the deleted handles go back to the pools
+	for (int i = 0; i < 10; i++)
+		poller_go(poller);
+	return echoed == connections.size();
+}
+
+int run(int flags, bool reserve, size_t count, int waves)
+{
+	auto poller = poller_create_ex(flags);
+	if (poller == nullptr || (reserve && poller_reserve(2 * count, 2 * count, poller) != 0))
+		return EXIT_FAILURE;
+
+	std::vector<Connection> connections(count);
+	for (int i = 0; i < warm_up; i++)
+	{
+		if (!wave(poller, connections))
+			return EXIT_FAILURE;
+	}
+
+	auto before = allocations;
+	auto begin = Clock::now();
+	for (int i = warm_up; i < waves; i++)
+	{
+		if (!wave(poller, connections))
+			return EXIT_FAILURE;
+	}
+	auto elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+	auto total = double(count) * (waves - warm_up);
+	poller_stats stats{};
+	poller_get_stats(&stats, poller);
+	std::printf("%-9s %-9s %14.0f %16.3f %20llu\n", poller_flags(poller) & POLLER_URING ? "io_uring" : "epoll",
+		reserve ? "reserved" : "on demand", total / elapsed, (allocations - before) / total, stats.allocations);
+	poller_destroy(poller);
+	return EXIT_SUCCESS;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+	int waves = argc > 2 ? std::atoi(argv[2]) : 50;
+	if (count == 0 || waves <= warm_up)
+		return EXIT_FAILURE;
+
+	std::printf("%-9s %-9s %14s %16s %20s\n", "backend", "pools", "connections/s", "mallocs/conn", "poller allocations");
+	int status = EXIT_SUCCESS;
+	for (int flags: {0, POLLER_URING})
+	{
+		for (bool reserve: {false, true})
+		{
+			if (run(flags, reserve, count, waves) != EXIT_SUCCESS)
+				status = EXIT_FAILURE;
+		}
+	}
+	return status;
+}
@@ -0,0 +1,216 @@
+/**
+ * Many loopback connections on one poller.
+ *
+ * usage: extra_poller_connections [connections] [waves]
+ *
+ * Raises the limit of descriptors as far as allowed, caps the connections to fit, both ends of each
+ * being in the process, and spreads the clients over 127.0.0.x source addresses so that ephemeral ports
+ * last. Reports the time to connect them all, the memory per connection, and the rate of waves of one
+ * echoed message per connection, once with epoll and once with io_uring.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "extra/poller.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t message_size = 32;
+constexpr size_t clients_per_address = 25000;
+
+struct State
+{
+	poller_t * poller;
+	int listener;
+	size_t accepted = 0;
+	size_t connected = 0;
+	size_t echoed = 0;
+	std::vector<int> fds;
+};
+
+size_t echo(handle_t * handle, void *, const char * data, size_t size)
+{
+	poller_send(data, size, handle);
+	return size;
+}
+
+void on_accept(handle_t *, void * context)
+{
+	auto state = static_cast<State *>(context);
+	int fd;
+	while ((fd = accept4(state->listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		handle_param param{};
+		param.fd = fd;
+		param.on_data = echo;
+		if (poller_add(&param, state->poller) == nullptr)
+		{
+			close(fd);
+			continue;
+		}
+		state->fds.push_back(fd);
+		state->accepted++;
+	}
+}
+
+struct Client
+{
+	State * state;
+	handle_t * handle = nullptr;
+
+	static void on_writable(handle_t *, void * context)
+	{
+		static_cast<Client *>(context)->state->connected++;
+	}
+
+	static size_t on_data(handle_t *, void * context, const char *, size_t size)
+	{
+		if (size < message_size)
+			return 0;
+
+		static_cast<Client *>(context)->state->echoed++;
+		return message_size;
+	}
+};
+
+size_t resident_kb()
+{
+	long pages = 0;
+	if (auto file = std::fopen("/proc/self/statm", "r"))
+	{
+		if (std::fscanf(file, "%*d %ld", &pages) != 1)
+			pages = 0;
+		std::fclose(file);
+	}
+	return static_cast<size_t>(pages) * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+template <typename Predicate>
+bool run_until(poller_t * poller, Predicate predicate, Clock::duration limit)
+{
+	auto deadline = Clock::now() + limit;
+	while (!predicate() && Clock::now() < deadline)
+		poller_go(poller);
+	return predicate();
+}
+
+int run(int flags, size_t count, int waves)
+{
+	State state{poller_create_ex(flags), socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0), 0, 0, 0, {}};
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(sa);
+	if (state.poller == nullptr || bind(state.listener, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0
+		|| listen(state.listener, 65535) != 0
+		|| getsockname(state.listener, reinterpret_cast<sockaddr *>(&sa), &length) != 0)
+		return EXIT_FAILURE;
+
+	handle_param listen_param{};
+	listen_param.fd = state.listener;
+	listen_param.context = &state;
+	listen_param.on_readable = on_accept;
+	if (poller_add(&listen_param, state.poller) == nullptr)
+		return EXIT_FAILURE;
+
+	auto memory = resident_kb();
+	auto begin = Clock::now();
+	std::vector<std::unique_ptr<Client>> clients;
+	for (size_t i = 0; i < count; i++)
+	{
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		sockaddr_in source{};
+		source.sin_family = AF_INET;
+		source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + static_cast<uint32_t>(i / clients_per_address));
+		if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&source), sizeof(source)) != 0
+			|| (connect(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0 && errno != EINPROGRESS))
+		{
+			std::printf("%s: connection %zu: %s\n", flags ? "io_uring" : "epoll", i, std::strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		clients.push_back(std::make_unique<Client>(Client{&state}));
+		handle_param param{};
+		param.fd = fd;
+		param.context = clients.back().get();
+		param.on_writable = Client::on_writable;
+		param.on_data = Client::on_data;
+		clients.back()->handle = poller_add(&param, state.poller);
+		if (clients.back()->handle == nullptr)
+			return EXIT_FAILURE;
+		state.fds.push_back(fd);
+		// Keep the backlog short
+		if (i % 256 == 255)
+			poller_go(state.poller);
+	}
+
+	if (!run_until(state.poller, [&] { return state.accepted == count && state.connected >= count; },
+		std::chrono::seconds(60)))
+		return EXIT_FAILURE;
+	auto setup = std::chrono::duration<double>(Clock::now() - begin).count();
+	memory = resident_kb() - std::min(memory, resident_kb());
+
+	char message[message_size] = {};
+	double best = 0;
+	for (int wave = 0; wave < waves; wave++)
+	{
+		state.echoed = 0;
+		auto start = Clock::now();
+		for (auto & client: clients)
+			poller_send(message, sizeof(message), client->handle);
+		if (!run_until(state.poller, [&] { return state.echoed == count; }, std::chrono::seconds(60)))
+			return EXIT_FAILURE;
+		best = std::max(best, count / std::chrono::duration<double>(Clock::now() - start).count());
+	}
+
+	std::printf("%-9s %12zu %10.2f %12.1f %16.0f\n", poller_flags(state.poller) & POLLER_URING ? "io_uring" : "epoll",
+		count, setup, double(memory) / count, best);
+	poller_destroy(state.poller);
+	// Reset rather than left in TIME_WAIT, holding the ports
+	linger reset{1, 0};
+	for (auto fd: state.fds)
+	{
+		setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+		close(fd);
+	}
+	close(state.listener);
+	return EXIT_SUCCESS;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	int waves = argc > 2 ? std::atoi(argv[2]) : 5;
+	if (count == 0 || waves <= 0)
+		return EXIT_FAILURE;
+
+	rlimit limit{};
+	getrlimit(RLIMIT_NOFILE, &limit);
+	limit.rlim_cur = std::max<rlim_t>(limit.rlim_cur, std::min<rlim_t>(2 * count + 64, limit.rlim_max));
+	setrlimit(RLIMIT_NOFILE, &limit);
+	if (2 * count + 64 > limit.rlim_cur)
+	{
+		count = (limit.rlim_cur - 64) / 2;
+		std::printf("descriptors limited to %llu, %zu connections\n", static_cast<unsigned long long>(limit.rlim_cur),
+			count);
+	}
+
+	std::printf("%-9s %12s %10s %12s %16s\n", "backend", "connections", "connect s", "KB/conn", "echoes/s");
+	int epoll = run(0, count, waves);
+	int uring = run(POLLER_URING, count, waves);
+	return epoll == EXIT_SUCCESS && uring == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
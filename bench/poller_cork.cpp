@@ -0,0 +1,193 @@
+/**
+ * Bursts of small replies, written one by one or corked.
+ *
+ * usage: extra_poller_cork [seconds per run]
+ *
+ * A client sends a burst of 16-byte requests over a stream socket pair, or a pair of loopback UDP sockets
+ * connected to each other, and waits for all the replies before the next. The server replies to each
+ * request with a poller_send() of its own, from the on_data of the read that brought it, as an order
+ * gateway acknowledges a burst of orders. Client and server each run a poller of their own, in turn on one
+ * thread. Reports replies per second, writes of the server per reply and round trips in microseconds, for
+ * bursts of 1 and 16, with cork 0 and 100 microseconds, over both kinds of sockets with epoll and over
+ * stream sockets with io_uring, which queues all output anyway.
+ * A lone request, a burst of 1, should take as long corked as not.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "extra/poller.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t message_size = 16;
+
+struct Server
+{
+	static size_t on_data(handle_t * handle, void *, const char * data, size_t size)
+	{
+		size_t consumed = size - size % message_size;
+		for (size_t i = 0; i < consumed; i += message_size)
+			poller_send(data + i, message_size, handle);
+		return consumed;
+	}
+};
+
+struct Client
+{
+	int type;
+	size_t burst;
+	size_t received = 0;
+	size_t rounds = 0;
+	char requests[16 * message_size] = {};
+
+	void send(handle_t * handle)
+	{
+		// Datagrams one request each
+		if (type == SOCK_STREAM)
+			poller_send(requests, burst * message_size, handle);
+		else
+		{
+			for (size_t i = 0; i < burst; i++)
+				poller_send(requests, message_size, handle);
+		}
+	}
+
+	static size_t on_data(handle_t * handle, void * context, const char *, size_t size)
+	{
+		auto client = static_cast<Client *>(context);
+		size_t consumed = size - size % message_size;
+		client->received += consumed / message_size;
+		if (client->received == client->burst)
+		{
+			client->received = 0;
+			client->rounds++;
+			client->send(handle);
+		}
+		return consumed;
+	}
+};
+
+/* Unix datagram sockets queue few datagrams, UDP ones as many as their buffer holds */
+int connect_pair(int type, int fds[2])
+{
+	if (type == SOCK_STREAM)
+		return socketpair(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+
+	sockaddr_in sa[2]{};
+	socklen_t length = sizeof(sockaddr_in);
+	for (int i = 0; i < 2; i++)
+	{
+		fds[i] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		sa[i].sin_family = AF_INET;
+		sa[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (fds[i] < 0 || bind(fds[i], reinterpret_cast<sockaddr *>(&sa[i]), length) != 0
+			|| getsockname(fds[i], reinterpret_cast<sockaddr *>(&sa[i]), &length) != 0)
+			return -1;
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		if (connect(fds[i], reinterpret_cast<sockaddr *>(&sa[1 - i]), length) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+handle_t * add(int fd, int cork, void * context, size_t (* on_data)(handle_t *, void *, const char *, size_t),
+	poller_t * poller)
+{
+	handle_param param{};
+	param.fd = fd;
+	param.context = context;
+	param.on_data = on_data;
+	param.cork = cork;
+	return poller_add(&param, poller);
+}
+
+int run(int flags, int type, int cork, size_t burst, double seconds)
+{
+	int fds[2];
+	if (connect_pair(type, fds) != 0)
+		return EXIT_FAILURE;
+
+	auto server_poller = poller_create_ex(flags);
+	auto client_poller = poller_create_ex(flags);
+	Server server;
+	Client client{type, burst};
+	handle_t * client_handle = nullptr;
+	if (!server_poller || !client_poller || !add(fds[0], cork, &server, Server::on_data, server_poller)
+		|| !(client_handle = add(fds[1], 0, &client, Client::on_data, client_poller)))
+		return EXIT_FAILURE;
+
+	auto go = [&]
+	{
+		poller_go(client_poller);
+		poller_go(server_poller);
+	};
+	// Connected, then warm up
+	for (int i = 0; i < 10; i++)
+		go();
+	client.send(client_handle);
+	auto warm_up = Clock::now() + std::chrono::milliseconds(100);
+	while (Clock::now() < warm_up)
+		go();
+
+	poller_stats before{};
+	poller_stats after{};
+	poller_get_stats(&before, server_poller);
+	size_t rounds = client.rounds;
+	auto begin = Clock::now();
+	auto end = begin + std::chrono::duration<double>(seconds);
+	while (Clock::now() < end)
+		go();
+	double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+	poller_get_stats(&after, server_poller);
+	rounds = client.rounds - rounds;
+
+	std::printf("%-9s %-7s %5d %6zu %12.0f %10.3f %10.2f\n", poller_flags(server_poller) & POLLER_URING ? "io_uring" : "epoll",
+		type == SOCK_STREAM ? "stream" : "udp", cork, burst, rounds * burst / elapsed,
+		double(after.writes - before.writes) / double(rounds * burst), elapsed * 1e6 / double(rounds));
+	poller_destroy(server_poller);
+	poller_destroy(client_poller);
+	close(fds[0]);
+	close(fds[1]);
+	return rounds > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	double seconds = argc > 1 ? std::strtod(argv[1], nullptr) : 1.0;
+	if (seconds <= 0)
+		return EXIT_FAILURE;
+
+	std::printf("%-9s %-7s %5s %6s %12s %10s %10s\n", "backend", "socket", "cork", "burst", "replies/s", "writes/msg",
+		"round us");
+	int status = EXIT_SUCCESS;
+	for (int flags: {0, POLLER_URING})
+	{
+		for (int type: {SOCK_STREAM, SOCK_DGRAM})
+		{
+			if (flags & POLLER_URING && type == SOCK_DGRAM)
+				continue;
+
+			for (size_t burst: {1, 16})
+			{
+				for (int cork: {0, 100})
+				{
+					if (run(flags, type, cork, burst, seconds) != EXIT_SUCCESS)
+						status = EXIT_FAILURE;
+				}
+			}
+		}
+	}
+	return status;
+}
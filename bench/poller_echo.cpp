@@ -0,0 +1,217 @@
+/**
+ * Round trips of the buffered poller over loopback TCP.
+ *
+ * usage: extra_poller_echo [seconds per run] [message bytes]
+ *
+ * The echo server and the clients share one poller and one thread, so the figures are those of the
+ * engine and the loopback stack rather than of the scheduler. For each connection count the client
+ * keeps one message in flight per connection, stamped with its send time, and sends the next as soon
+ * as the echo is back. Reports round trips per second, latency percentiles across all connections, and
+ * the share of the time spent in the kernel, once with epoll and once with io_uring.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "extra/poller.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+size_t echo(handle_t * handle, void *, const char * data, size_t size)
+{
+	poller_send(data, size, handle);
+	return size;
+}
+
+struct Server
+{
+	poller_t * poller;
+	int listener;
+	uint16_t port;
+	std::vector<int> connections;
+
+	static void on_accept(handle_t *, void * context)
+	{
+		auto server = static_cast<Server *>(context);
+		int fd;
+		while ((fd = accept4(server->listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+		{
+			int one = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			handle_param param{};
+			param.fd = fd;
+			param.on_data = echo;
+			if (poller_add(&param, server->poller) == nullptr)
+				close(fd);
+			else
+				server->connections.push_back(fd);
+		}
+	}
+};
+
+struct Client
+{
+	int fd;
+	handle_t * handle;
+	size_t message_size;
+	bool * running;
+	bool started;
+	std::vector<uint32_t> * latencies;
+	std::unique_ptr<char[]> message;
+
+	void send_next()
+	{
+		auto now = Clock::now().time_since_epoch().count();
+		std::memcpy(message.get(), &now, sizeof(now));
+		poller_send(message.get(), message_size, handle);
+	}
+
+	static size_t on_data(handle_t *, void * context, const char * data, size_t size)
+	{
+		auto client = static_cast<Client *>(context);
+		if (size < client->message_size)
+			return 0;
+
+		Clock::rep sent;
+		std::memcpy(&sent, data, sizeof(sent));
+		client->latencies->push_back(static_cast<uint32_t>((Clock::now().time_since_epoch().count() - sent) / 1000));
+		if (*client->running)
+			client->send_next();
+		return client->message_size;
+	}
+
+	static void on_writable(handle_t *, void * context)
+	{
+		auto client = static_cast<Client *>(context);
+		if (!client->started && *client->running)
+		{
+			client->started = true;
+			client->send_next();
+		}
+	}
+};
+
+double cpu_seconds(int who)
+{
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	auto & time = who == 0 ? usage.ru_utime : usage.ru_stime;
+	return time.tv_sec + time.tv_usec / 1e6;
+}
+
+int run(int flags, double seconds, size_t message_size)
+{
+	Server server{poller_create_ex(flags), socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0), 0, {}};
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(sa);
+	if (server.poller == nullptr || bind(server.listener, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0
+		|| listen(server.listener, 1024) != 0
+		|| getsockname(server.listener, reinterpret_cast<sockaddr *>(&sa), &length) != 0)
+		return EXIT_FAILURE;
+
+	handle_param listen_param{};
+	listen_param.fd = server.listener;
+	listen_param.context = &server;
+	listen_param.on_readable = Server::on_accept;
+	if (poller_add(&listen_param, server.poller) == nullptr)
+		return EXIT_FAILURE;
+
+	auto poller = server.poller;
+	int status = EXIT_SUCCESS;
+	std::printf("%s\n%-12s %14s %10s %10s %10s %8s\n", poller_flags(poller) & POLLER_URING ? "io_uring" : "epoll",
+		"connections", "round trips/s", "p50 us", "p99 us", "p99.9 us", "kernel");
+	for (size_t count: {1, 4, 16, 64, 256})
+	{
+		bool running = true;
+		std::vector<uint32_t> latencies;
+		latencies.reserve(4 * 1024 * 1024);
+		std::vector<std::unique_ptr<Client>> clients;
+		for (size_t i = 0; i < count; i++)
+		{
+			int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			int one = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			if (connect(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0 && errno != EINPROGRESS)
+				return EXIT_FAILURE;
+
+			auto client = std::make_unique<Client>(Client{fd, nullptr, message_size, &running, false, &latencies,
+				std::make_unique<char[]>(message_size)});
+			handle_param param{};
+			param.fd = fd;
+			param.context = client.get();
+			param.on_writable = Client::on_writable;
+			param.on_data = Client::on_data;
+			client->handle = poller_add(&param, poller);
+			if (client->handle == nullptr)
+				return EXIT_FAILURE;
+			clients.push_back(std::move(client));
+		}
+
+		auto user = cpu_seconds(0);
+		auto kernel = cpu_seconds(1);
+		auto begin = Clock::now();
+		auto deadline = begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+		while (Clock::now() < deadline)
+			poller_go(poller);
+		auto elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+		auto round_trips = latencies.size();
+		user = cpu_seconds(0) - user;
+		kernel = cpu_seconds(1) - kernel;
+		running = false;
+		for (int i = 0; i < 1000; i++)
+			poller_go(poller);
+
+		for (auto & client: clients)
+		{
+			poller_del(client->fd, poller);
+			close(client->fd);
+		}
+
+		if (round_trips == 0)
+		{
+			std::printf("%-12zu failed\n", count);
+			status = EXIT_FAILURE;
+			continue;
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+		auto percentile = [&](double p) { return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))]; };
+		std::printf("%-12zu %14.0f %10u %10u %10u %7.0f%%\n", count, round_trips / elapsed, percentile(0.5),
+			percentile(0.99), percentile(0.999), 100 * kernel / (user + kernel));
+	}
+
+	poller_destroy(poller);
+	for (auto fd: server.connections)
+		close(fd);
+	close(server.listener);
+	return status;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	double seconds = argc > 1 ? std::strtod(argv[1], nullptr) : 1.0;
+	size_t message_size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64;
+	if (seconds <= 0 || message_size < sizeof(Clock::rep))
+		return EXIT_FAILURE;
+
+	int epoll = run(0, seconds, message_size);
+	int uring = run(POLLER_URING, seconds, message_size);
+	return epoll == EXIT_SUCCESS && uring == EXIT_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
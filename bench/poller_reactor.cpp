@@ -0,0 +1,217 @@
+/**
+ * Loopback echo over reactor groups of growing size.
+ *
+ * usage: extra_poller_reactor [seconds per run] [connections]
+ *
+ * The server is a reactor of n loops with a SO_REUSEPORT listener each, the clients another of n loops,
+ * connections dispatched round-robin, each keeping one message in flight. Loops are pinned to the CPUs
+ * in turn, server then clients. Reports messages echoed per second for n = 1, 2, 4 and 8, and the ratio
+ * to n = 1, which only scales with cores to run the loops on.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "extra/reactor.h"
+
+namespace
+{
+constexpr size_t message_size = 64;
+
+struct alignas(64) Counter
+{
+	std::atomic<uint64_t> value{0};
+};
+
+struct Group
+{
+	reactor_t * reactor = nullptr;
+	std::vector<Counter> counters;
+	std::atomic<bool> running{true};
+	std::mutex mutex;
+	std::vector<int> fds;
+
+	explicit Group(size_t loops)
+		: counters(loops)
+	{
+	}
+
+	void keep(int fd)
+	{
+		std::lock_guard lock(mutex);
+		fds.push_back(fd);
+	}
+
+	~Group()
+	{
+		if (reactor)
+			reactor_destroy(reactor);
+		// Reset rather than left in TIME_WAIT, holding the ports
+		linger reset{1, 0};
+		for (int fd: fds)
+		{
+			setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+			close(fd);
+		}
+	}
+};
+
+size_t echo(handle_t * handle, void *, const char * data, size_t size)
+{
+	poller_send(data, size, handle);
+	return size;
+}
+
+void on_accept(int fd, poller_t * poller, void * context)
+{
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	handle_param param{};
+	param.fd = fd;
+	param.on_data = echo;
+	if (poller_add(&param, poller) == nullptr)
+		close(fd);
+	else
+		static_cast<Group *>(context)->keep(fd);
+}
+
+struct Client
+{
+	Group * group;
+	bool started = false;
+	char message[message_size] = {};
+
+	static void on_writable(handle_t * handle, void * context)
+	{
+		auto client = static_cast<Client *>(context);
+		if (!client->started)
+		{
+			client->started = true;
+			poller_send(client->message, message_size, handle);
+		}
+	}
+
+	static size_t on_data(handle_t * handle, void * context, const char *, size_t size)
+	{
+		auto client = static_cast<Client *>(context);
+		if (size < message_size)
+			return 0;
+
+		client->group->counters[reactor_current(client->group->reactor)].value.fetch_add(1, std::memory_order_relaxed);
+		if (client->group->running.load(std::memory_order_relaxed))
+			poller_send(client->message, message_size, handle);
+		return message_size;
+	}
+
+	static void add(int fd, poller_t * poller, void * context)
+	{
+		handle_param param{};
+		param.fd = fd;
+		param.context = context;
+		param.on_writable = on_writable;
+		param.on_data = on_data;
+		poller_add(&param, poller);
+	}
+};
+
+double run(int loops, size_t connections, double seconds)
+{
+	// Destroyed after the reactors, which stop first
+	std::vector<std::unique_ptr<Client>> states;
+	Group server(loops);
+	Group clients(loops);
+	auto cpu_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<int> server_cpus;
+	std::vector<int> client_cpus;
+	for (int i = 0; i < loops; i++)
+	{
+		server_cpus.push_back(i % cpu_count);
+		client_cpus.push_back((loops + i) % cpu_count);
+	}
+
+	reactor_config config{};
+	config.loops = loops;
+	config.poller.mode = POLLER_ADAPTIVE;
+	config.poller.timeout = -1;
+	config.poller.spin = 50;
+	config.cpus = server_cpus.data();
+	config.policy = REACTOR_REUSEPORT;
+	server.reactor = reactor_create(&config);
+	config.cpus = client_cpus.data();
+	config.policy = REACTOR_ROUND_ROBIN;
+	clients.reactor = reactor_create(&config);
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (!server.reactor || !clients.reactor
+		|| reactor_listen(reinterpret_cast<sockaddr *>(&sa), sizeof(sa), on_accept, &server, server.reactor) != 0
+		|| reactor_start(server.reactor) != 0 || reactor_start(clients.reactor) != 0)
+		return -1;
+
+	for (size_t i = 0; i < connections; i++)
+	{
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (connect(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0 && errno != EINPROGRESS)
+			return -1;
+
+		states.push_back(std::make_unique<Client>(Client{&clients}));
+		clients.keep(fd);
+		while (reactor_dispatch(fd, Client::add, states.back().get(), clients.reactor) < 0)
+			std::this_thread::yield();
+	}
+
+	// Warm up, then count
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	auto total = [&]
+	{
+		uint64_t sum = 0;
+		for (auto & counter: clients.counters)
+			sum += counter.value.load(std::memory_order_relaxed);
+		return sum;
+	};
+	auto before = total();
+	auto begin = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	auto rate = (total() - before) / std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	clients.running = false;
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	return rate;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	double seconds = argc > 1 ? std::strtod(argv[1], nullptr) : 2.0;
+	size_t connections = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64;
+	if (seconds <= 0 || connections == 0)
+		return EXIT_FAILURE;
+
+	std::printf("%u CPUs, %zu connections\n%-6s %14s %8s\n", std::thread::hardware_concurrency(), connections, "loops",
+		"messages/s", "scaling");
+	double base = 0;
+	for (int loops: {1, 2, 4, 8})
+	{
+		auto rate = run(loops, connections, seconds);
+		if (rate < 0)
+		{
+			std::printf("%-6d failed\n", loops);
+			return EXIT_FAILURE;
+		}
+		base = base > 0 ? base : rate;
+		std::printf("%-6d %14.0f %7.2fx\n", loops, rate, rate / base);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/**
+ * Tasks submitted to a poller from another thread.
+ *
+ * usage: extra_poller_submit [probes] [tasks]
+ *
+ * A producer thread submits probes one at a time, stamped with the time of submission, and waits for
+ * each to run on the thread of the poller before pausing and submitting the next, so that a blocking
+ * poller has gone to sleep by then. Reports percentiles of the latency from submission to run, then the
+ * rate of tasks submitted back to back, for each mode of the poller, once with epoll and once with
+ * io_uring.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "extra/poller.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+struct Probe
+{
+	Clock::time_point submitted;
+	uint32_t latency_ns;
+	std::atomic<bool> done;
+
+	static void run(void * context)
+	{
+		auto probe = static_cast<Probe *>(context);
+		probe->latency_ns = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			Clock::now() - probe->submitted).count());
+		probe->done.store(true, std::memory_order_release);
+	}
+};
+
+size_t ran = 0;
+
+void count(void *)
+{
+	ran++;
+}
+
+void submit(void (* task)(void *), void * context, poller_t * poller)
+{
+	while (poller_submit(task, context, poller) != 0)
+		std::this_thread::yield();
+}
+
+int run(int flags, int mode, size_t probe_count, size_t task_count)
+{
+	auto poller = poller_create_ex(flags);
+	poller_config config{};
+	config.mode = mode;
+	config.timeout = -1;
+	config.spin = 50;
+	if (poller == nullptr || poller_set_config(&config, poller) != 0)
+		return EXIT_FAILURE;
+
+	std::atomic<bool> stop{false};
+	std::vector<Probe> probes(probe_count);
+	ran = 0;
+	std::thread producer([&]
+	{
+		for (auto & probe: probes)
+		{
+			probe.submitted = Clock::now();
+			submit(Probe::run, &probe, poller);
+			while (!probe.done.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+		for (size_t i = 0; i < task_count; i++)
+			submit(count, nullptr, poller);
+		// The last one, as the loop may be blocked
+		submit([](void * context) { static_cast<std::atomic<bool> *>(context)->store(true); }, &stop, poller);
+	});
+
+	Clock::time_point begin;
+	while (!probes.back().done.load(std::memory_order_acquire))
+		poller_go(poller);
+	begin = Clock::now();
+	while (!stop.load())
+		poller_go(poller);
+	auto rate = ran / std::chrono::duration<double>(Clock::now() - begin).count();
+	producer.join();
+	poller_destroy(poller);
+
+	std::vector<uint32_t> latencies;
+	for (const auto & probe: probes)
+		latencies.push_back(probe.latency_ns);
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double p) { return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))] / 1e3; };
+	const char * modes[] = {"spin", "block", "adaptive"};
+	std::printf("%-9s %-9s %10.1f %10.1f %10.1f %14.0f\n", flags & POLLER_URING ? "io_uring" : "epoll", modes[mode],
+		percentile(0.5), percentile(0.99), percentile(0.999), rate);
+	return ran == task_count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t probes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+	size_t tasks = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+	if (probes == 0)
+		return EXIT_FAILURE;
+
+	std::printf("%-9s %-9s %10s %10s %10s %14s\n", "backend", "mode", "p50 us", "p99 us", "p99.9 us", "tasks/s");
+	int status = EXIT_SUCCESS;
+	for (int flags: {0, POLLER_URING})
+	{
+		for (int mode: {POLLER_SPIN, POLLER_BLOCK, POLLER_ADAPTIVE})
+		{
+			if (run(flags, mode, probes, tasks) != EXIT_SUCCESS)
+				status = EXIT_FAILURE;
+		}
+	}
+	return status;
+}
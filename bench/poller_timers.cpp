@@ -0,0 +1,129 @@
+/**
+ * Cost of poller marks with many armed at once.
+ *
+ * usage: extra_poller_timers [rounds]
+ *
+ * Timers are spread over a thousand handles, armed with heartbeat-like timeouts of 1 to 60 seconds,
+ * re-armed at random as traffic would, cancelled, and once more armed to expire within 50 ms while
+ * the poller runs. Built twice: extra_poller_timers with the timing wheel, extra_poller_timers_tree
+ * with every mark in the tree of the poller.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "extra/poller.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+constexpr int handle_count = 1000;
+
+size_t fired = 0;
+
+void on_timeout(handle_t *, void *, int)
+{
+	fired++;
+}
+
+double ns_per(size_t count, Clock::time_point begin)
+{
+	return std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / count;
+}
+}
+
+int main(int argc, char * argv[])
+{
+	int rounds = argc > 1 ? std::atoi(argv[1]) : 1;
+	if (rounds <= 0)
+		return EXIT_FAILURE;
+
+#if defined(TIMER_WHEEL) && TIMER_WHEEL == 0
+	std::printf("tree\n");
+#else
+	std::printf("wheel\n");
+#endif
+	std::printf("%-10s %12s %12s %12s %12s\n", "timers", "arm ns", "re-arm ns", "cancel ns",
+		"expire ns");
+	for (size_t timers: {10000, 100000, 1000000})
+	{
+		double arm = 0;
+		double rearm = 0;
+		double cancel = 0;
+		double expire = 0;
+		for (int round = 0; round < rounds; round++)
+		{
+			auto poller = poller_create();
+			std::vector<handle_t *> handles;
+			std::vector<int> fds;
+			for (int i = 0; i < handle_count; i++)
+			{
+				handle_param param{};
+				param.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				fds.push_back(param.fd);
+				param.on_timeout = on_timeout;
+				handles.push_back(poller_add(&param, poller));
+				if (handles.back() == nullptr)
+					return EXIT_FAILURE;
+			}
+
+			std::mt19937 random(round);
+			std::vector<int> timeouts(timers);
+			std::vector<int> picks(timers);
+			for (size_t i = 0; i < timers; i++)
+			{
+				timeouts[i] = 1000 + static_cast<int>(random() % 59000);
+				picks[i] = static_cast<int>(random() % timers);
+			}
+
+			auto begin = Clock::now();
+			for (size_t i = 0; i < timers; i++)
+				poller_mark(static_cast<int>(i / handle_count), timeouts[i], handles[i % handle_count], poller);
+			arm += ns_per(timers, begin);
+
+			begin = Clock::now();
+			for (size_t i = 0; i < timers; i++)
+			{
+				auto pick = static_cast<size_t>(picks[i]);
+				poller_mark(static_cast<int>(pick / handle_count), timeouts[i], handles[pick % handle_count], poller);
+			}
+			rearm += ns_per(timers, begin);
+
+			begin = Clock::now();
+			for (size_t i = 0; i < timers; i++)
+				poller_mark(static_cast<int>(i / handle_count), -1, handles[i % handle_count], poller);
+			cancel += ns_per(timers, begin);
+
+			for (size_t i = 0; i < timers; i++)
+				poller_mark(static_cast<int>(i / handle_count), timeouts[i] % 50, handles[i % handle_count], poller);
+			// Only the calls that fire something count, the others are the cost of polling
+			fired = 0;
+			Clock::duration spent{};
+			auto deadline = Clock::now() + std::chrono::seconds(5);
+			while (fired < timers && Clock::now() < deadline)
+			{
+				auto before = fired;
+				begin = Clock::now();
+				poller_go(poller);
+				if (fired > before)
+					spent += Clock::now() - begin;
+			}
+			if (fired < timers)
+				return EXIT_FAILURE;
+			expire += std::chrono::duration<double, std::nano>(spent).count() / timers;
+
+			poller_destroy(poller);
+			for (auto fd: fds)
+				close(fd);
+		}
+		std::printf("%-10zu %12.1f %12.1f %12.1f %12.1f\n", timers, arm / rounds, rearm / rounds, cancel / rounds,
+			expire / rounds);
+	}
+	return EXIT_SUCCESS;
+}
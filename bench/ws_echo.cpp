@@ -0,0 +1,159 @@
+/**
+ * WebSocketClient against a local echo server over loopback.
+ *
+ * usage: extra_ws_echo [messages] [payload size] [window]
+ *
+ * Reports per-frame round trip latency with one message in flight, then throughput with a window
+ * of messages in flight.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "extra/WebSocket.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::ws;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+void echo(int listener)
+{
+	int fd = accept(listener, nullptr, nullptr);
+	if (fd < 0)
+		return;
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	std::vector<char> buffer(256 * 1024);
+	std::string input;
+	http::HttpRequestParser request;
+	ssize_t n;
+	while ((n = recv(fd, buffer.data(), buffer.size(), 0)) > 0)
+	{
+		input.append(buffer.data(), n);
+		std::string_view raw = input;
+		if (request.parse(raw) == ParseResult::Complete)
+		{
+			std::string output;
+			http::HttpResponseWriter writer(output, true);
+			writer.set_status<http::Status::_101>();
+			writer.append_header("Upgrade", "websocket");
+			writer.append_header("Connection", "Upgrade");
+			writer.append_header("Sec-WebSocket-Accept", accept_key(request.find_header("Sec-WebSocket-Key")));
+			output += "\r\n";
+			::send(fd, output.data(), output.size(), MSG_NOSIGNAL);
+			input.erase(0, input.size() - raw.size());
+			break;
+		}
+	}
+
+	FrameParser parser(true);
+	std::string output;
+	do
+	{
+		std::string_view raw = input;
+		output.clear();
+		while (!raw.empty() && parser.parse(raw) == ParseResult::Complete)
+		{
+			if (parser.get_opcode() == Opcode::Close)
+			{
+				close(fd);
+				return;
+			}
+			encode_frame(output, parser.get_opcode(), parser.get_payload());
+			parser.reset();
+		}
+		::send(fd, output.data(), output.size(), MSG_NOSIGNAL);
+	} while ((n = recv(fd, buffer.data(), buffer.size(), 0)) > 0 && (input.assign(buffer.data(), n), true));
+	close(fd);
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	size_t payload_size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64;
+	size_t window = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 64;
+	if (messages == 0 || window == 0)
+		return EXIT_FAILURE;
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(sa);
+	bind(listener, reinterpret_cast<sockaddr *>(&sa), sizeof(sa));
+	listen(listener, 1);
+	getsockname(listener, reinterpret_cast<sockaddr *>(&sa), &length);
+	std::thread server(echo, listener);
+
+	auto poller = poller_create();
+	if (poller == nullptr)
+		return EXIT_FAILURE;
+
+	size_t received = 0;
+	bool open = false;
+	{
+		WebSocketClient client(poller,
+			[&](Opcode, std::string_view) { received++; },
+			[&](State state) { open = state == State::Success; });
+		if (!client.connect("127.0.0.1", ntohs(sa.sin_port), "/echo"))
+			return EXIT_FAILURE;
+
+		while (!open)
+			poller_go(poller);
+
+		std::string payload(payload_size, 'x');
+		size_t latency_samples = std::min<size_t>(messages, 10000);
+		std::vector<double> latencies;
+		latencies.reserve(latency_samples);
+		for (size_t i = 0; i < latency_samples; i++)
+		{
+			auto begin = Clock::now();
+			client.send(Opcode::Binary, payload);
+			while (received == i)
+				poller_go(poller);
+			latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - begin).count());
+		}
+		std::sort(latencies.begin(), latencies.end());
+		std::printf("latency: %zu frames of %zu bytes, p50 %.0f ns, p99 %.0f ns, max %.0f ns\n",
+			latencies.size(), payload_size, latencies[latencies.size() / 2],
+			latencies[latencies.size() * 99 / 100], latencies.back());
+
+		received = 0;
+		size_t sent = 0;
+		auto begin = Clock::now();
+		while (received < messages)
+		{
+			while (sent < messages && sent - received < window)
+			{
+				client.send(Opcode::Binary, payload);
+				sent++;
+			}
+			poller_go(poller);
+		}
+		auto elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+		std::printf("throughput: %zu frames of %zu bytes, window %zu, %.0f frames/s, %.1f MB/s\n",
+			messages, payload_size, window, messages / elapsed, messages * payload_size / elapsed / 1e6);
+
+		client.close();
+		while (client.is_open())
+			poller_go(poller);
+	}
+	poller_destroy(poller);
+	server.join();
+	close(listener);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/**
+ * Fuzz target of HttpResponseBasic::parse.
+ *
+ * The first byte picks a chunk size, the rest is parsed as a response stream twice: whole, and
+ * split into chunks of that size. Both runs must agree on every response, so state carried across
+ * parse() calls is checked along with crashes and sanitizer reports. Under Clang this is a libFuzzer
+ * target, otherwise replay.cpp runs the inputs given on the command line.
+ */
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "extra/HttpBasic.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::http;
+
+namespace
+{
+/**
+ * @return status, header count and body size of each response, then how the stream ended
+ */
+std::string summarize(std::string_view input, size_t chunk)
+{
+	std::string summary;
+	HttpResponseV1D1 response;
+	while (!input.empty())
+	{
+		auto raw = input.substr(0, chunk);
+		input.remove_prefix(raw.size());
+		while (!raw.empty())
+		{
+			auto result = response.parse(raw);
+			if (result == ParseResult::Error)
+				return summary + "error";
+
+			if (result == ParseResult::Complete)
+			{
+				summary += response.get_status() + ' ' + std::to_string(response.get_headers().size()) + ' '
+				           + std::to_string(response.get_body().size()) + ';';
+				response.reset();
+			}
+		}
+	}
+	return summary + (response.eof() ? "eof" : "incomplete");
+}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+	if (size == 0)
+		return 0;
+
+	size_t chunk = data[0] % 64 + 1;
+	std::string_view input(reinterpret_cast<const char *>(data + 1), size - 1);
+	if (summarize(input, input.size()) != summarize(input, chunk))
+		std::abort();
+	return 0;
+}
@@ -0,0 +1,49 @@
+/**
+ * Run a fuzz target over corpus files or directories, for compilers without libFuzzer.
+ *
+ * usage: extra_http_response_fuzz <file or directory>...
+ */
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size);
+
+namespace
+{
+void replay(const std::filesystem::path & path)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::string input{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+	LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+}
+}
+
+int main(int argc, char * argv[])
+{
+	size_t count = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::filesystem::is_directory(argv[i]))
+		{
+			for (const auto & entry: std::filesystem::recursive_directory_iterator(argv[i]))
+			{
+				if (entry.is_regular_file())
+				{
+					replay(entry.path());
+					count++;
+				}
+			}
+		}
+		else
+		{
+			replay(argv[i]);
+			count++;
+		}
+	}
+	std::printf("%zu inputs replayed\n", count);
+	return 0;
+}
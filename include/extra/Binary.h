@@ -0,0 +1,307 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include <unistd.h>
+
+#include "Channel.h"
+#include "Protocol.h"
+
+namespace extra::protocol::binary
+{
+template <typename U>
+constexpr U byteswap(U value)
+{
+	if constexpr (sizeof(U) == 1)
+		return value;
+	else if constexpr (sizeof(U) == 2)
+		return __builtin_bswap16(value);
+	else if constexpr (sizeof(U) == 4)
+		return __builtin_bswap32(value);
+	else
+		return __builtin_bswap64(value);
+}
+
+/**
+ * Read a T stored in byte order E at p, which needs no alignment.
+ */
+template <typename T, std::endian E>
+T load(const char * p)
+{
+	static_assert(std::is_trivially_copyable_v<T> && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4
+		|| sizeof(T) == 8));
+	using U = std::conditional_t<sizeof(T) == 1, uint8_t, std::conditional_t<sizeof(T) == 2, uint16_t,
+		std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+	U u;
+	std::memcpy(&u, p, sizeof(u));
+	if constexpr (E != std::endian::native)
+		u = byteswap(u);
+	return std::bit_cast<T>(u);
+}
+
+/**
+ * Zero-copy view of a record of Length bytes in byte order E.
+ *
+ * Fields are read in place at their offset, which is checked against Length at compile time. A layout
+ * is described once by deriving and naming the fields, see Itch.h.
+ */
+template <size_t Length, std::endian E = std::endian::big>
+class Layout
+{
+public:
+	constexpr static size_t length = Length;
+	constexpr static std::endian endian = E;
+
+protected:
+	const char * data;
+
+public:
+	explicit Layout(const char * data_)
+		: data{data_}
+	{
+	}
+
+	[[nodiscard]] std::string_view get_bytes() const
+	{
+		return std::string_view(data, Length);
+	}
+
+	template <typename T, size_t Offset>
+	[[nodiscard]] T get() const
+	{
+		static_assert(Offset + sizeof(T) <= Length, "field beyond the layout");
+		return load<T, E>(data + Offset);
+	}
+
+	/**
+	 * Unsigned integer of an odd width, the 6 byte timestamps of ITCH for example.
+	 */
+	template <size_t Offset, size_t Bytes>
+	[[nodiscard]] uint64_t get_uint() const
+	{
+		static_assert(Bytes > 0 && Bytes <= 8 && Offset + Bytes <= Length, "field beyond the layout");
+		uint64_t value = 0;
+		for (size_t i = 0; i < Bytes; i++)
+		{
+			auto byte = static_cast<uint8_t>(data[Offset + (E == std::endian::big ? i : Bytes - 1 - i)]);
+			value = value << 8 | byte;
+		}
+		return value;
+	}
+
+	/**
+	 * Space padded text with the padding dropped.
+	 */
+	template <size_t Offset, size_t Size>
+	[[nodiscard]] std::string_view get_alpha() const
+	{
+		static_assert(Offset + Size <= Length, "field beyond the layout");
+		std::string_view s(data + Offset, Size);
+		auto end = s.find_last_not_of(' ');
+		return s.substr(0, end == std::string_view::npos ? 0 : end + 1);
+	}
+};
+
+/**
+ * Layout of a message identified by its first byte.
+ */
+template <char Type, size_t Length, std::endian E = std::endian::big>
+class Message : public Layout<Length, E>
+{
+public:
+	constexpr static char type = Type;
+
+	using Layout<Length, E>::Layout;
+};
+
+enum class Framing
+{
+	/**
+	 * Each message preceded by its length in 2 bytes, as in MoldUDP64 packets and SoupBinTCP.
+	 */
+	LengthPrefixed,
+	/**
+	 * Messages back to back, lengths known from their types.
+	 */
+	Packed,
+};
+
+/**
+ * Decoder of a schema of message layouts, dispatching through a table built at compile time.
+ *
+ * The first byte of a message indexes 256 entries holding its layout length and the call into the
+ * handler with the typed view, so decoding one message is a bounds check and an indirect call. The
+ * handler is a callable overloaded on the views it wants, Overloaded or a constrained generic lambda,
+ * other types are skipped without being looked at. Views are valid during the call.
+ */
+template <Framing F, typename... Messages>
+class Decoder
+{
+	static_assert(sizeof...(Messages) > 0);
+
+public:
+	constexpr static std::endian endian = std::tuple_element_t<0, std::tuple<Messages...>>::endian;
+
+	static_assert(((Messages::endian == endian) && ...), "messages of one byte order");
+
+private:
+	template <typename Handler>
+	struct Entry
+	{
+		void (* call)(const char *, Handler &);
+		size_t length;
+	};
+
+	template <typename Handler, typename M>
+	static void call(const char * p, Handler & handler)
+	{
+		handler(M{p});
+	}
+
+	template <typename Handler>
+	constexpr static auto make_table()
+	{
+		std::array<Entry<Handler>, 256> table{};
+		auto add = [&table]<typename M>(M *)
+		{
+			if constexpr (std::is_invocable_v<Handler &, const M &>)
+				table[static_cast<uint8_t>(M::type)] = {&call<Handler, M>, M::length};
+			else
+				table[static_cast<uint8_t>(M::type)] = {nullptr, M::length};
+		};
+		(add(static_cast<Messages *>(nullptr)), ...);
+		return table;
+	}
+
+	template <typename Handler>
+	constexpr static std::array<Entry<Handler>, 256> table = make_table<Handler>();
+
+	constexpr static bool unique_types()
+	{
+		std::array<bool, 256> seen{};
+		for (auto type: {static_cast<uint8_t>(Messages::type)...})
+		{
+			if (seen[type])
+				return false;
+			seen[type] = true;
+		}
+		return true;
+	}
+
+	static_assert(unique_types(), "message types must differ");
+
+public:
+	Decoder() = delete;
+
+	/**
+	 * Decode the whole messages of raw, consuming them.
+	 * @return Complete once raw is consumed, Incomplete with a partial message left, Error on a
+	 * message shorter than its layout or, packed, of an unknown type, raw left at the message
+	 */
+	template <typename Handler>
+	static ParseResult decode(std::string_view & raw, Handler && handler)
+	{
+		using H = std::remove_reference_t<Handler>;
+		const auto & entries = table<H>;
+		auto p = raw.data();
+		auto end = p + raw.size();
+		auto result = ParseResult::Incomplete;
+		while (true)
+		{
+			size_t prefix = 0;
+			size_t size;
+			if constexpr (F == Framing::LengthPrefixed)
+			{
+				prefix = 2;
+				if (end - p < 3)
+					break;
+				size = load<uint16_t, endian>(p);
+			}
+			else
+			{
+				if (p == end)
+					break;
+				size = entries[static_cast<uint8_t>(*p)].length;
+			}
+
+			if (static_cast<size_t>(end - p) < prefix + size)
+				break;
+
+			const auto & entry = entries[static_cast<uint8_t>(p[prefix])];
+			if (size == 0 || size < entry.length)
+			{
+				result = ParseResult::Error;
+				break;
+			}
+
+			if (entry.call != nullptr)
+				entry.call(p + prefix, handler);
+			p += prefix + size;
+		}
+
+		raw.remove_prefix(p - raw.data());
+		return result == ParseResult::Error ? result : raw.empty() ? ParseResult::Complete : ParseResult::Incomplete;
+	}
+};
+
+/**
+ * Handler out of lambdas, one per message view.
+ */
+template <typename... Fs>
+struct Overloaded : Fs ...
+{
+	using Fs::operator()...;
+};
+
+template <typename... Fs>
+Overloaded(Fs...) -> Overloaded<Fs...>;
+
+/**
+ * Header of a MoldUDP64 downstream packet, followed by count length-prefixed messages numbered from
+ * sequence.
+ */
+class MoldUdp64 : public Layout<20>
+{
+public:
+	using Layout::Layout;
+
+	[[nodiscard]] std::string_view session() const
+	{
+		return std::string_view(data, 10);
+	}
+
+	[[nodiscard]] uint64_t sequence() const
+	{
+		return get<uint64_t, 10>();
+	}
+
+	[[nodiscard]] uint16_t count() const
+	{
+		return get<uint16_t, 18>();
+	}
+};
+
+/**
+ * Adapt a handler decoding each message into a channel cell in place.
+ * @param decode void(const M &, T &) for the views to publish, other messages are skipped
+ */
+template <typename T, typename Decode>
+auto to_channel(kernel::Channel<T> & channel, Decode decode)
+{
+	return [&channel, decode = std::move(decode)]<typename M>(const M & message) mutable
+		requires std::is_invocable_v<Decode &, const M &, T &>
+	{
+		auto it = channel.write_iterator();
+		decode(message, *it);
+	};
+}
+
+}
@@ -1,9 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <cassert>
+#include <string>
+
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
+#include "Schema.h"
 #include "Util.h"
 
 namespace extra::kernel
@@ -27,6 +33,8 @@ private:
 		size_t cell_size;
 		size_t capacity;
 		int state_;
+		unsigned schema_version;
+		uint64_t schema_hashes[max_schema_versions];
 	};
 
 	alignas(util::cache_line_size) size_t last;
@@ -55,7 +63,7 @@ private:
 	}
 
 public:
-	bool initialize(size_t mark_, size_t content_size_, size_t capacity_)
+	bool initialize(size_t mark_, size_t content_size_, size_t capacity_, const SchemaStamp & stamp)
 	{
 		int expected = state_available;
 		int desired = state_not_available;
@@ -66,17 +74,37 @@ public:
 		mark = mark_;
 		cell_size = calculate_cell_size(content_size_);
 		capacity = capacity_;
+		schema_version = stamp.version;
+		std::copy_n(stamp.hashes, max_schema_versions, schema_hashes);
 		last = 0;
 		unused = 1;
 		s.store(state_available, std::memory_order::release);
 		return true;
 	}
 
-	bool check(size_t mark_, size_t content_size_)
+	/**
+	 * Payloads with a schema match if the hashes of the older of both versions agree, others by cell size.
+	 * Writing takes the very version of the creator, whose cells a newer payload would overrun.
+	 */
+	bool check(size_t mark_, size_t content_size_, const SchemaStamp & stamp, bool writing)
+	{
+		if (std::atomic_ref{state_}.load(std::memory_order::acquire) != state_available || mark != mark_)
+			return false;
+
+		if (stamp.version == 0 || schema_version == 0)
+			return stamp.version == schema_version && cell_size == calculate_cell_size(content_size_);
+
+		if (writing && stamp.version != schema_version)
+			return false;
+
+		auto v = std::min(stamp.version, schema_version);
+		return schema_hashes[v - 1] == stamp.hashes[v - 1];
+	}
+
+	[[nodiscard]]
+	unsigned get_schema_version() const
 	{
-		return std::atomic_ref{state_}.load(std::memory_order::acquire) == state_available
-		       && mark == mark_
-		       && cell_size == calculate_cell_size(content_size_);
+		return schema_version;
 	}
 
 	size_t allocate()
@@ -163,7 +191,8 @@ private:
 public:
 	ChannelShm() = delete;
 
-	static ChannelLayout * create(const std::string & name, unsigned long version, size_t content_size, size_t capacity)
+	static ChannelLayout * create(const std::string & name, unsigned long version, size_t content_size, size_t capacity,
+		const SchemaStamp & stamp)
 	{
 		auto filename = get_filename(name, version);
 		auto mark = get_mark(name, version);
@@ -173,11 +202,11 @@ public:
 			if (auto size = ChannelLayout::total_size(content_size, capacity);
 				ftruncate(fd, static_cast<off_t>(size)) != -1)
 			{
-				if (auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0); p != MAP_FAILED)
+				if (auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); p != MAP_FAILED)
 				{
 					close(fd);
 					if (auto layout = reinterpret_cast<ChannelLayout *>(p);
-						layout->initialize(mark, content_size, capacity))
+						layout->initialize(mark, content_size, capacity, stamp))
 						return layout;
 
 					munmap(p, size);
@@ -189,27 +218,33 @@ public:
 		return nullptr;
 	}
 
-	static ChannelLayout * attach(const std::string & name, unsigned long version, size_t content_size)
+	/**
+	 * A channel failing the check is left to its creator.
+	 */
+	static ChannelLayout * attach(const std::string & name, unsigned long version, size_t content_size,
+		const SchemaStamp & stamp, bool writing)
 	{
 		auto filename = get_filename(name, version);
 		auto mark = get_mark(name, version);
 
 		if (auto fd = shm_open(filename.data(), O_RDWR, S_IRUSR | S_IWUSR); fd != -1)
 		{
-			if (struct stat st{}; fstat(fd, &st) != -1)
+			struct stat st{};
+			void * p = MAP_FAILED;
+			auto size = static_cast<size_t>(0);
+			if (fstat(fd, &st) != -1 && static_cast<size_t>(st.st_size) >= sizeof(ChannelLayout))
 			{
-				auto size = static_cast<size_t>(st.st_size);
-				if (auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0); p != MAP_FAILED)
-				{
-					close(fd);
-					if (auto layout = reinterpret_cast<ChannelLayout *>(p); layout->check(mark, content_size))
-						return layout;
+				size = static_cast<size_t>(st.st_size);
+				p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			}
+			close(fd);
+			if (p != MAP_FAILED)
+			{
+				if (auto layout = reinterpret_cast<ChannelLayout *>(p); layout->check(mark, content_size, stamp, writing))
+					return layout;
 
-					munmap(p, size);
-				}
-				close(fd);
+				munmap(p, size);
 			}
-			shm_unlink(filename.data());
 		}
 		return nullptr;
 	}
@@ -320,8 +355,10 @@ private:
 	std::string name;
 	unsigned long version;
 	constexpr static size_t content_size = sizeof(T);
+	constexpr static detail::SchemaStamp stamp = detail::stamp_of<T>();
 	size_t capacity;
 	detail::ChannelLayout * layout;
+	bool writing;
 
 public:
 	using WriteIterator = ChannelWriteIterator<T>;
@@ -329,7 +366,7 @@ public:
 
 public:
 	Channel(std::string name_, unsigned long version_, size_t capacity_)
-		: name{std::move(name_)}, version{version_}, capacity{capacity_}, layout{nullptr}
+		: name{std::move(name_)}, version{version_}, capacity{capacity_}, layout{nullptr}, writing{false}
 	{
 	}
 
@@ -346,16 +383,41 @@ public:
 
 	bool create()
 	{
-		layout = detail::ChannelShm::create(name, version, content_size, capacity);
+		layout = detail::ChannelShm::create(name, version, content_size, capacity, stamp);
+		writing = good();
 		return good();
 	}
 
-	bool attach()
+	/**
+	 * With a Payload, attach to channels written with any version of its schema sharing the older one.
+	 * Writing is only sound with the version the channel was created with, see writable().
+	 * @param write fail unless writable
+	 */
+	bool attach(bool write = false)
 	{
-		layout = detail::ChannelShm::attach(name, version, content_size);
+		layout = detail::ChannelShm::attach(name, version, content_size, stamp, write);
+		writing = good() && layout->get_schema_version() == stamp.version;
 		return good();
 	}
 
+	/**
+	 * @return true if created here, or attached with the schema version of the creator
+	 */
+	[[nodiscard]]
+	bool writable() const
+	{
+		return writing;
+	}
+
+	/**
+	 * @return schema version of the writer, 0 without a schema
+	 */
+	[[nodiscard]]
+	unsigned schema_version() const
+	{
+		return layout->get_schema_version();
+	}
+
 	void detach()
 	{
 		if (good())
@@ -364,6 +426,7 @@ public:
 
 	auto write_iterator()
 	{
+		assert(writing);
 		return WriteIterator{layout};
 	}
 
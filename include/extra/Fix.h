@@ -0,0 +1,220 @@
+#pragma once
+
+#include <charconv>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Protocol.h"
+
+namespace extra::protocol::fix
+{
+constexpr char SOH = '\x01';
+
+enum Tag : uint32_t
+{
+	BeginSeqNo = 7,
+	BeginString = 8,
+	BodyLength = 9,
+	CheckSum = 10,
+	ClOrdID = 11,
+	EndSeqNo = 16,
+	MsgSeqNum = 34,
+	MsgType = 35,
+	NewSeqNo = 36,
+	OrderQty = 38,
+	OrdType = 40,
+	PossDupFlag = 43,
+	Price = 44,
+	RefSeqNum = 45,
+	SenderCompID = 49,
+	SendingTime = 52,
+	Side = 54,
+	Symbol = 55,
+	TargetCompID = 56,
+	Text = 58,
+	TimeInForce = 59,
+	TransactTime = 60,
+	EncryptMethod = 98,
+	HeartBtInt = 108,
+	TestReqID = 112,
+	OrigSendingTime = 122,
+	GapFillFlag = 123,
+	ResetSeqNumFlag = 141,
+	RefTagID = 371,
+	RefMsgType = 372,
+	SessionRejectReason = 373,
+};
+
+/**
+ * Sum of bytes modulo 256 as in CheckSum(10), 16 or 32 bytes per step with SAD instructions.
+ */
+uint8_t checksum(std::string_view data);
+
+/**
+ * Length of a UTCTimestamp with milliseconds, "20261019-08:00:00.000".
+ */
+constexpr size_t timestamp_length = 21;
+
+/**
+ * Render time as a UTCTimestamp with milliseconds into out, timestamp_length bytes.
+ */
+void format_timestamp(std::chrono::system_clock::time_point time, char * out);
+
+struct Field
+{
+	uint32_t tag;
+	std::string_view value;
+};
+
+/**
+ * Incremental, zero-copy parser of FIX tag=value messages.
+ *
+ * As with HttpRequestParser, call parse() with all unconsumed bytes of the connection. Once
+ * BeginString and BodyLength are read the whole message length is known, so Incomplete consumes
+ * nothing and the next call only checks whether enough bytes arrived. Complete consumes exactly one
+ * message, after its CheckSum and BodyLength are verified, and indexes every field with SIMD scans
+ * for SOH and '='. Values are views into the parsed buffer, valid until it is modified.
+ *
+ * Fields are kept in order so repeating groups can be walked by index. The first occurrence of tags
+ * below tag_table_size is found through a flat array, others by a linear search. Data fields
+ * following their length field, RawData(96) after RawDataLength(95) for example, may contain SOH.
+ */
+class Parser
+{
+public:
+	constexpr static size_t message_length_limit = 1024 * 1024;
+	constexpr static size_t field_count_limit = 65535;
+	constexpr static size_t tag_table_size = 10000;
+
+private:
+	std::vector<Field> fields;
+	std::unique_ptr<uint16_t[]> slots;
+	std::string_view message;
+	size_t message_length;
+	bool failed;
+
+public:
+	Parser();
+
+	/**
+	 * After Complete or Error, call reset() before parsing the next message.
+	 */
+	ParseResult parse(std::string_view & raw);
+
+	void reset();
+
+	/**
+	 * @return the whole message including BeginString and CheckSum
+	 */
+	[[nodiscard]] std::string_view get_message() const
+	{
+		return message;
+	}
+
+	[[nodiscard]] std::string_view get_msg_type() const
+	{
+		return fields[2].value;
+	}
+
+	[[nodiscard]] size_t get_field_count() const
+	{
+		return fields.size();
+	}
+
+	[[nodiscard]] const Field & get_field(size_t i) const
+	{
+		return fields[i];
+	}
+
+	/**
+	 * @return index of the first field with tag, or get_field_count() if absent
+	 */
+	[[nodiscard]] size_t find_index(uint32_t tag) const;
+
+	/**
+	 * @return value of the first field with tag, empty if absent as FIX values never are
+	 */
+	[[nodiscard]] std::string_view find(uint32_t tag) const
+	{
+		auto i = find_index(tag);
+		return i == fields.size() ? std::string_view{} : fields[i].value;
+	}
+
+	/**
+	 * @return false if absent or not an integer
+	 */
+	bool find(uint32_t tag, int64_t & value) const;
+
+	bool find(uint32_t tag, uint64_t & value) const;
+
+	/**
+	 * Fixed point with scale fractional digits, see json::parse_fixed().
+	 */
+	bool find_fixed(uint32_t tag, int64_t & value, int scale) const;
+
+private:
+	bool parse_prefix(std::string_view raw);
+
+	bool parse_fields(std::string_view raw);
+};
+
+/**
+ * Encoder of the outbound messages of one session.
+ *
+ * BeginString, SenderCompID and TargetCompID are rendered once at construction. A message is built in
+ * place after a gap kept for BeginString and BodyLength, which finish() fills right-aligned once the
+ * length is known, so the body is never moved.
+ */
+class Encoder
+{
+private:
+	std::string begin_string;
+	std::string comp_ids;
+	std::string buffer;
+	size_t gap;
+
+public:
+	Encoder(std::string_view begin_string_, std::string_view sender_comp_id, std::string_view target_comp_id);
+
+	/**
+	 * Start a message with its standard header.
+	 */
+	void begin(std::string_view msg_type, uint64_t seq_num, std::string_view sending_time);
+
+	void add(uint32_t tag, std::string_view value);
+
+	/**
+	 * Integers in decimal, char as itself and bool as Y or N.
+	 */
+	template <std::integral I>
+	void add(uint32_t tag, I value)
+	{
+		if constexpr (std::same_as<I, bool>)
+			add(tag, std::string_view(value ? "Y" : "N", 1));
+		else if constexpr (std::same_as<I, char>)
+			add(tag, std::string_view(&value, 1));
+		else
+		{
+			char digits[24];
+			add(tag, std::string_view(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr - digits));
+		}
+	}
+
+	/**
+	 * Decimal of a fixed point value with scale fractional digits, trailing zeros dropped.
+	 */
+	void add_fixed(uint32_t tag, int64_t value, int scale);
+
+	/**
+	 * Complete BodyLength and CheckSum.
+	 * @return the message, valid until the next begin()
+	 */
+	std::string_view finish();
+};
+
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Fix.h"
+#include "poller.h"
+
+namespace extra::protocol::fix
+{
+/**
+ * Sequence numbers and outbound messages of one session, in a memory-mapped file.
+ *
+ * The file is a header with both next sequence numbers, an index of offset and length by MsgSeqNum,
+ * and the message bytes appended in order. Everything is written in place, so after a crash the
+ * session resumes from whatever the page cache kept, and resends are served from mapped memory.
+ * Once the index or the bytes are full messages are no longer kept and are gap filled on resend,
+ * as admin messages always are. sync() is only needed to survive a crash of the host.
+ */
+class SequenceStore
+{
+public:
+	struct Options
+	{
+		size_t message_capacity = 1024 * 1024;
+		size_t byte_capacity = 256 * 1024 * 1024;
+	};
+
+private:
+	struct Header;
+
+	struct Slot
+	{
+		uint64_t offset;
+		uint64_t length;
+	};
+
+	int fd;
+	char * base;
+	size_t mapped;
+	Header * header;
+	Slot * slots;
+	char * data;
+
+public:
+	SequenceStore();
+
+	SequenceStore(const SequenceStore &) = delete;
+
+	SequenceStore & operator=(const SequenceStore &) = delete;
+
+	~SequenceStore();
+
+	/**
+	 * Map the file, created sparse with the capacities of options if empty or absent. An existing file
+	 * keeps the capacities it was created with.
+	 * @return false with errno set, EINVAL if the file is not a store
+	 */
+	bool open(const std::string & path, Options options);
+
+	bool open(const std::string & path)
+	{
+		return open(path, Options{});
+	}
+
+	void close();
+
+	[[nodiscard]] bool is_open() const
+	{
+		return base != nullptr;
+	}
+
+	[[nodiscard]] uint64_t next_inbound() const;
+
+	void set_next_inbound(uint64_t seq);
+
+	[[nodiscard]] uint64_t next_outbound() const;
+
+	/**
+	 * Record the message sent with next_outbound() and advance it, empty for one never resent.
+	 */
+	void store(std::string_view message);
+
+	/**
+	 * @return the message sent with seq, empty if not kept
+	 */
+	[[nodiscard]] std::string_view find(uint64_t seq) const;
+
+	/**
+	 * Both sequence numbers back to 1, messages dropped.
+	 */
+	void reset();
+
+	/**
+	 * Write dirty pages through, msync(MS_SYNC).
+	 */
+	bool sync();
+};
+
+/**
+ * Initiator side of a FIX session driven by poller_go(), over a SequenceStore.
+ *
+ * Logon is sent once connected. Heartbeats are sent after heartbeat_interval without output, and a
+ * TestRequest after 1.2 intervals without input, the connection being dropped if the next interval
+ * passes silent too. Timers are poller marks of the connection handle, HeartBtInt(108) carries the
+ * interval rounded up to seconds.
+ *
+ * Inbound sequence numbers are checked for every message. A gap is answered with one ResendRequest
+ * to infinity and messages beyond it are dropped until filled, a MsgSeqNum too low without
+ * PossDupFlag is a Logout. ResendRequest is served from the store, application messages with
+ * PossDupFlag and OrigSendingTime, runs of admin or unkept messages as one SequenceReset-GapFill.
+ * TestRequest, Heartbeat, SequenceReset and Logout are handled here, everything else goes to the
+ * message callback, the parser being valid during the call.
+ */
+class Session
+{
+public:
+	enum class Status
+	{
+		Disconnected,
+		Connecting,
+		LogonSent,
+		Active,
+		LogoutSent,
+	};
+
+	struct Options
+	{
+		std::string begin_string = "FIX.4.4";
+		std::string sender_comp_id;
+		std::string target_comp_id;
+		std::chrono::milliseconds heartbeat_interval{30000};
+		/**
+		 * Also bounds the wait for the Logout answer.
+		 */
+		std::chrono::milliseconds logon_timeout{10000};
+		/**
+		 * Reset the store and send ResetSeqNumFlag(141) on Logon.
+		 */
+		bool reset_on_logon = false;
+	};
+
+	using MessageCallback = std::function<void(const Parser &)>;
+
+	using StatusCallback = std::function<void(Status)>;
+
+private:
+	enum Timer
+	{
+		LogonTimer,
+		HeartbeatTimer,
+		InboundTimer,
+	};
+
+	constexpr static size_t read_size = 64 * 1024;
+	constexpr static size_t input_capacity = Parser::message_length_limit + read_size;
+
+	using Clock = std::chrono::steady_clock;
+
+	poller_t * poller;
+	SequenceStore & store;
+	Options options;
+	MessageCallback on_message;
+	StatusCallback on_status;
+	int fd;
+	handle_t * handle;
+	Status status;
+	Encoder encoder;
+	Parser parser;
+	Parser replay;
+	std::unique_ptr<char[]> input;
+	size_t input_size;
+	std::string output;
+	size_t output_offset;
+	Clock::time_point last_sent;
+	Clock::time_point last_received;
+	bool test_request_pending;
+	uint64_t test_request_count;
+	/**
+	 * MsgSeqNum that made us send a ResendRequest, 0 when not recovering.
+	 */
+	uint64_t resend_target;
+
+public:
+	Session(poller_t * poller_, SequenceStore & store_, Options options_, MessageCallback on_message_,
+		StatusCallback on_status_);
+
+	Session(const Session &) = delete;
+
+	Session & operator=(const Session &) = delete;
+
+	~Session();
+
+	/**
+	 * Start connecting then log on, progress is reported through the status callback.
+	 * @param address numeric IPv4 address
+	 */
+	bool connect(const std::string & address, uint16_t port);
+
+	/**
+	 * Start an application message with the header filled, add fields then call send().
+	 */
+	Encoder & prepare(std::string_view msg_type);
+
+	/**
+	 * Send and store the prepared message, which takes the next outbound MsgSeqNum.
+	 * @return false, the sequence number untouched, unless Active
+	 */
+	bool send();
+
+	/**
+	 * Send Logout, the connection is dropped on the answer or after logon_timeout.
+	 */
+	void logout(std::string_view text = {});
+
+	[[nodiscard]] Status get_status() const
+	{
+		return status;
+	}
+
+private:
+	void begin(std::string_view msg_type, uint64_t seq);
+
+	/**
+	 * Finish the message being encoded and send it with the next outbound MsgSeqNum, kept in the store
+	 * for resend unless admin.
+	 */
+	void transmit(bool admin);
+
+	void write(std::string_view message);
+
+	void send_logon();
+
+	void send_heartbeat(std::string_view test_request_id);
+
+	void send_logout(std::string_view text);
+
+	void send_gap_fill(uint64_t seq, uint64_t new_seq);
+
+	void resend(uint64_t begin_seq, uint64_t end_seq);
+
+	void receive();
+
+	/**
+	 * @return false if the connection is gone
+	 */
+	bool handle_message();
+
+	void handle_admin(std::string_view msg_type);
+
+	void expire(int timer);
+
+	void mark(Timer timer, Clock::duration timeout);
+
+	void change(Status status_);
+
+	void flush();
+
+	void fail();
+
+	static void on_readable(handle_t * handle, void * context);
+
+	static void on_writable(handle_t * handle, void * context);
+
+	static void on_timeout(handle_t * handle, void * context, int ack);
+};
+
+}
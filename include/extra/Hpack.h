@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace extra::protocol::hpack
+{
+/**
+ * Append the Huffman code of in, RFC 7541 Appendix B.
+ */
+void huffman_encode(std::string_view in, std::string & out);
+
+[[nodiscard]] size_t huffman_length(std::string_view in);
+
+/**
+ * @return false on EOS inside the string or invalid padding
+ */
+bool huffman_decode(std::string_view in, std::string & out);
+
+/**
+ * Static and dynamic table in one index space, 1 to 61 static, 62 onwards dynamic newest first.
+ */
+class Table
+{
+public:
+	constexpr static size_t static_count = 61;
+	constexpr static size_t entry_overhead = 32;
+	constexpr static size_t default_max_size = 4096;
+
+private:
+	struct Entry
+	{
+		std::string name;
+		std::string value;
+	};
+
+	std::deque<Entry> entries;
+	size_t size;
+	size_t max_size;
+
+public:
+	Table()
+		: entries{}, size{0}, max_size{default_max_size}
+	{
+	}
+
+	void insert(std::string_view name, std::string_view value);
+
+	void set_max_size(size_t max_size_);
+
+	[[nodiscard]] size_t get_max_size() const
+	{
+		return max_size;
+	}
+
+	[[nodiscard]] size_t get_size() const
+	{
+		return size;
+	}
+
+	/**
+	 * @return false if index is out of range
+	 */
+	bool get(size_t index, std::string_view & name, std::string_view & value) const;
+
+	/**
+	 * @return index of the best match, full match preferred, 0 if the name is nowhere
+	 */
+	size_t find(std::string_view name, std::string_view value, bool & value_match) const;
+
+private:
+	void evict(size_t limit);
+};
+
+class Decoder
+{
+public:
+	using Callback = std::function<void(std::string_view, std::string_view)>;
+
+private:
+	Table table;
+	size_t max_size_limit;
+	std::string name;
+	std::string value;
+
+public:
+	/**
+	 * @param max_size_limit_ SETTINGS_HEADER_TABLE_SIZE advertised to the peer
+	 */
+	explicit Decoder(size_t max_size_limit_ = Table::default_max_size)
+		: table{}, max_size_limit{max_size_limit_}, name{}, value{}
+	{
+	}
+
+	/**
+	 * Decode a complete header block, views passed to on_header are valid during the call.
+	 * @return false on COMPRESSION_ERROR
+	 */
+	bool decode(std::string_view block, const Callback & on_header);
+
+	[[nodiscard]] const Table & get_table() const
+	{
+		return table;
+	}
+
+private:
+	bool decode_string(std::string_view & block, std::string & out);
+};
+
+class Encoder
+{
+private:
+	Table table;
+	size_t pending_max_size;
+	bool size_update;
+
+public:
+	Encoder()
+		: table{}, pending_max_size{Table::default_max_size}, size_update{false}
+	{
+	}
+
+	/**
+	 * Follow SETTINGS_HEADER_TABLE_SIZE of the peer, a size update is emitted with the next block.
+	 */
+	void set_max_size(size_t max_size)
+	{
+		pending_max_size = max_size;
+		size_update = true;
+	}
+
+	/**
+	 * Call once at the start of each header block.
+	 */
+	void begin(std::string & out);
+
+	/**
+	 * Fully indexed headers take one or two bytes. Others are added to the dynamic table, except
+	 * sensitive ones which are never indexed.
+	 */
+	void encode(std::string & out, std::string_view name, std::string_view value, bool sensitive = false);
+
+	[[nodiscard]] const Table & get_table() const
+	{
+		return table;
+	}
+};
+
+void encode_integer(std::string & out, uint8_t first, int prefix, uint64_t value);
+
+/**
+ * @return false if truncated or overflowing
+ */
+bool decode_integer(std::string_view & in, int prefix, uint64_t & value);
+
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "Hpack.h"
+#include "HttpBasic.h"
+#include "poller.h"
+
+namespace extra::protocol::http
+{
+namespace h2
+{
+enum class FrameType : uint8_t
+{
+	Data = 0x0,
+	Headers = 0x1,
+	Priority = 0x2,
+	RstStream = 0x3,
+	Settings = 0x4,
+	PushPromise = 0x5,
+	Ping = 0x6,
+	Goaway = 0x7,
+	WindowUpdate = 0x8,
+	Continuation = 0x9,
+};
+
+enum Flag : uint8_t
+{
+	EndStream = 0x1,
+	Ack = 0x1,
+	EndHeaders = 0x4,
+	Padded = 0x8,
+	Priority = 0x20,
+};
+
+enum class Setting : uint16_t
+{
+	HeaderTableSize = 0x1,
+	EnablePush = 0x2,
+	MaxConcurrentStreams = 0x3,
+	InitialWindowSize = 0x4,
+	MaxFrameSize = 0x5,
+	MaxHeaderListSize = 0x6,
+};
+
+enum class ErrorCode : uint32_t
+{
+	NoError = 0x0,
+	ProtocolError = 0x1,
+	InternalError = 0x2,
+	FlowControlError = 0x3,
+	SettingsTimeout = 0x4,
+	StreamClosed = 0x5,
+	FrameSizeError = 0x6,
+	RefusedStream = 0x7,
+	Cancel = 0x8,
+	CompressionError = 0x9,
+};
+
+constexpr std::string_view preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr size_t frame_header_length = 9;
+constexpr uint32_t default_window_size = 65535;
+constexpr uint32_t max_window_size = 0x7fffffff;
+constexpr uint32_t default_max_frame_size = 16384;
+constexpr uint32_t max_frame_size_limit = 0xffffff;
+/* Stream identifiers are 31 bits, a connection out of them opens no more streams */
+constexpr uint32_t max_stream_id = 0x7fffffff;
+
+struct FrameHeader
+{
+	uint32_t length;
+	FrameType type;
+	uint8_t flags;
+	uint32_t stream_id;
+};
+
+void encode_frame_header(std::string & output, const FrameHeader & header);
+
+void encode_frame(std::string & output, FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload);
+
+/**
+ * Split a byte stream into frames.
+ *
+ * parse() stops after each complete frame, leaving following bytes in the view. A frame wholly
+ * inside the view is returned as a view into it, otherwise it is copied into the parser. Call
+ * reset() after each Complete.
+ */
+class FrameParser
+{
+private:
+	uint32_t max_frame_size;
+	std::string buffer;
+	FrameHeader header;
+	std::string_view payload;
+	bool complete;
+
+public:
+	explicit FrameParser(uint32_t max_frame_size_ = default_max_frame_size)
+		: max_frame_size{max_frame_size_}, buffer{}, header{}, payload{}, complete{false}
+	{
+	}
+
+	/**
+	 * @return Error on a frame larger than max_frame_size, FRAME_SIZE_ERROR
+	 */
+	ParseResult parse(std::string_view & raw);
+
+	void reset()
+	{
+		if (complete)
+			buffer.clear();
+		complete = false;
+		payload = {};
+	}
+
+	[[nodiscard]] const FrameHeader & get_header() const
+	{
+		return header;
+	}
+
+	[[nodiscard]] std::string_view get_payload() const
+	{
+		return payload;
+	}
+};
+
+}
+
+/**
+ * HTTP/2 client over cleartext TCP with prior knowledge (RFC 9113 3.3), driven by poller_go().
+ *
+ * Concurrent requests are multiplexed as streams on one connection, those beyond the peer's
+ * SETTINGS_MAX_CONCURRENT_STREAMS wait in a queue. Request bodies are sent within the connection
+ * and stream send windows, received data is acknowledged with WINDOW_UPDATE once half a window is
+ * consumed. Server push is disabled. Streams in flight fail when the connection breaks or is reset,
+ * they are never replayed.
+ */
+class Http2Client
+{
+public:
+	using Callback = std::function<void(State, Error, HttpResponseV2 *)>;
+
+	struct Options
+	{
+		uint32_t initial_window_size = 16 * 1024 * 1024;
+		uint32_t max_frame_size = h2::default_max_frame_size;
+		size_t header_table_size = hpack::Table::default_max_size;
+	};
+
+private:
+	struct Stream
+	{
+		uint32_t id;
+		Callback callback;
+		HttpResponseV2 response;
+		std::string body;
+		size_t body_offset;
+		int64_t send_window;
+		int64_t receive_window;
+	};
+
+	struct Pending
+	{
+		HttpRequestV2 request;
+		Callback callback;
+		HttpResponseBasic::BodySink sink;
+	};
+
+	constexpr static size_t input_capacity = 64 * 1024;
+	constexpr static uint32_t assumed_max_concurrent_streams = 100;
+
+	poller_t * poller;
+	Options options;
+	int fd;
+	bool connected;
+	bool goaway;
+	std::string authority;
+	uint32_t next_stream_id;
+
+	uint32_t peer_max_concurrent_streams;
+	uint32_t peer_initial_window_size;
+	uint32_t peer_max_frame_size;
+	int64_t send_window;
+	int64_t receive_window;
+
+	hpack::Encoder encoder;
+	hpack::Decoder decoder;
+	h2::FrameParser parser;
+	uint32_t continuation_stream;
+	bool continuation_end_stream;
+	std::string header_block;
+
+	std::unordered_map<uint32_t, std::unique_ptr<Stream>> streams;
+	std::deque<Pending> pending;
+	std::string output;
+	size_t output_offset;
+	std::unique_ptr<char[]> input;
+
+public:
+	Http2Client(poller_t * poller_, Options options_);
+
+	explicit Http2Client(poller_t * poller_)
+		: Http2Client(poller_, Options{})
+	{
+	}
+
+	Http2Client(const Http2Client &) = delete;
+
+	Http2Client & operator=(const Http2Client &) = delete;
+
+	~Http2Client();
+
+	/**
+	 * Start connecting, the preface and SETTINGS are sent once connected.
+	 * @param address numeric IPv4 address
+	 */
+	bool connect(const std::string & address, uint16_t port);
+
+	/**
+	 * Requests sent before the connection completes are queued. A response body over the body length
+	 * limit resets its stream, unless sink takes the body, see HttpResponseBasic::set_body_sink().
+	 * @return false if not connected or going away, callback will not be called then
+	 */
+	bool send(const HttpRequestV2 & request, Callback callback, HttpResponseBasic::BodySink sink = {});
+
+	[[nodiscard]] size_t stream_count() const
+	{
+		return streams.size();
+	}
+
+	[[nodiscard]] size_t pending_count() const
+	{
+		return pending.size();
+	}
+
+	[[nodiscard]] bool is_connected() const
+	{
+		return fd >= 0;
+	}
+
+private:
+	void open_stream(const HttpRequestV2 & request, Callback callback, HttpResponseBasic::BodySink sink);
+
+	void encode_headers(const HttpRequestV2 & request, std::string & block);
+
+	void write_data(Stream & stream);
+
+	void dispatch_pending();
+
+	void receive();
+
+	/**
+	 * @return false if the connection is gone
+	 */
+	bool process(const h2::FrameHeader & header, std::string_view payload);
+
+	bool finish_headers(uint32_t stream_id, bool end_stream);
+
+	bool apply_settings(std::string_view payload);
+
+	void complete(uint32_t stream_id);
+
+	void reset_stream(uint32_t stream_id, State state, Error error);
+
+	/**
+	 * Top the receive window back up to target once half of it is consumed.
+	 */
+	void window_update(uint32_t stream_id, int64_t & window, uint32_t target);
+
+	void flush();
+
+	/**
+	 * Send GOAWAY with code, then fail the connection.
+	 */
+	void connection_error(h2::ErrorCode code);
+
+	void fail(State state, Error error);
+
+	static void on_readable(handle_t * handle, void * context);
+
+	static void on_writable(handle_t * handle, void * context);
+};
+
+}
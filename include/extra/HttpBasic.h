@@ -1,15 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <charconv>
+#include <cstdint>
 #include <cstring>
-#include <sstream>
+#include <functional>
+#include <memory>
 #include <unordered_map>
+#include <vector>
+
+#include <sys/uio.h>
 
 #include "Protocol.h"
 #include "HttpConst.h"
 
 namespace extra::protocol::http
 {
+class Inflater;
+
 class HttpRequestBasic : public Request
 {
 private:
@@ -67,42 +77,140 @@ public:
 			append_header("Content-Length", std::to_string(body.size()));
 	}
 
+	[[nodiscard]] size_t size() const
+	{
+		return method.size() + SP.size() + uri.size() + SP.size() + version.size() + CRLF.size()
+		       + headers.size() + CRLF.size() + body.size();
+	}
+
+	/**
+	 * Serialize into a caller-provided buffer, no allocation involved.
+	 * @return bytes written, or 0 if capacity is less than size()
+	 */
+	size_t format_into(char * buffer, size_t capacity) const
+	{
+		const size_t total = size();
+		if (capacity < total)
+			return 0;
+
+		for (const auto & part: parts())
+		{
+			std::memcpy(buffer, part.data(), part.size());
+			buffer += part.size();
+		}
+		return total;
+	}
+
+	constexpr static size_t iov_count = 9;
+
+	/**
+	 * Point iov at method, uri, version, header block and body in place, ready for writev().
+	 * The request must outlive the iovec and stay unmodified until written.
+	 * @return total bytes referred by iov
+	 */
+	size_t format_iov(struct iovec (& iov)[iov_count]) const
+	{
+		size_t total = 0;
+		size_t i = 0;
+		for (const auto & part: parts())
+		{
+			iov[i].iov_base = const_cast<char *>(part.data());
+			iov[i].iov_len = part.size();
+			total += part.size();
+			i++;
+		}
+		return total;
+	}
+
 	[[nodiscard]] std::string format() const override
 	{
-		std::ostringstream oss;
-		oss << method << " " << uri << " " << version << CRLF << headers << CRLF << body;
-		return oss.str();
+		std::string s(size(), '\0');
+		format_into(s.data(), s.size());
+		return s;
+	}
+
+protected:
+	[[nodiscard]] const std::string & get_method() const
+	{
+		return method;
+	}
+
+	[[nodiscard]] const std::string & get_uri() const
+	{
+		return uri;
+	}
+
+	/**
+	 * @return headers as appended, each line ending with CRLF
+	 */
+	[[nodiscard]] const std::string & get_header_block() const
+	{
+		return headers;
+	}
+
+	[[nodiscard]] const std::string & get_body() const
+	{
+		return body;
+	}
+
+private:
+	[[nodiscard]] std::array<std::string_view, iov_count> parts() const
+	{
+		return {method, SP, uri, SP, version, CRLF, headers, CRLF, body};
 	}
 };
 
 class HttpResponseBasic : public Response
 {
 public:
+	/**
+	 * Transparent, so that headers are looked up by literal or view without building a key.
+	 */
 	class CaseInsensitiveHash
 	{
 	public:
-		size_t operator()(std::string s) const
+		using is_transparent = void;
+
+		/**
+		 * FNV-1a over lower-cased bytes, without copying the key.
+		 */
+		size_t operator()(std::string_view s) const
 		{
-			for (auto & c: s)
+			size_t h = 14695981039346656037ull;
+			for (auto c: s)
 			{
-				if (std::isupper(c))
+				if (c >= 'A' && c <= 'Z')
 					c -= 'A' - 'a';
+				h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
 			}
-			return std::hash<std::string>{}(s);
+			return h;
 		}
 	};
 
 	class CaseInsensitiveEqualTo
 	{
 	public:
-		bool operator()(const std::string & lhs, const std::string & rhs) const
+		using is_transparent = void;
+
+		/**
+		 * Compares whole strings, strcasecmp() would stop at an embedded NUL and disagree with the hash.
+		 */
+		bool operator()(std::string_view lhs, std::string_view rhs) const
 		{
-			return strcasecmp(lhs.data(), rhs.data()) == 0;
+			return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char l, char r)
+			{
+				return (l >= 'A' && l <= 'Z' ? l - 'A' + 'a' : l) == (r >= 'A' && r <= 'Z' ? r - 'A' + 'a' : r);
+			});
 		}
 	};
 
 	using HeaderMap = std::unordered_map<std::string, std::string, CaseInsensitiveHash, CaseInsensitiveEqualTo>;
 
+	/**
+	 * Receives the body piece by piece, decoded if the response is encoded.
+	 */
+	using BodySink = std::function<void(std::string_view)>;
+
 private:
 	std::string version;
 	std::string status;
@@ -111,15 +219,28 @@ private:
 	std::string body;
 
 private:
+	using HeaderNode = HeaderMap::node_type;
+
 	constexpr static size_t line_initial_capacity = 1024;
 	constexpr static size_t body_initial_capacity = 1024;
 	constexpr static size_t status_line_length_limit = 1024;
 	constexpr static size_t header_length_limit = 1024;
+	constexpr static size_t header_count_limit = 128;
 	constexpr static size_t body_length_limit = 1024 * 1024;
 
 	std::string line;
 	std::string key;
+	std::vector<HeaderNode> spare_headers;
+	size_t header_count;
 	size_t content_length;
+	size_t body_received;
+	size_t chunk_remaining;
+	BodySink sink;
+	std::unique_ptr<Inflater> inflater;
+	bool content_decoding;
+	bool decoding;
+	bool head_request;
+	bool chunked;
 	constexpr static size_t content_length_unknown = 0;
 	constexpr static size_t content_length_unlimited = -1;
 	enum
@@ -127,18 +248,56 @@ private:
 		ParsingStatusLine,
 		ParsingHeader,
 		ParsingBody,
+		ParsingChunkSize,
+		ParsingChunkData,
+		ParsingTrailer,
+		ParsingCR,
 		ParsingLF,
+		ParsingDone,
+		ParsingFailed,
 	} parsing, will_parse;
 
 public:
-	HttpResponseBasic()
-		: version{}, status{}, phrase{}, headers{}, body{}
-		, line{}, key{}, content_length{content_length_unknown}
-		, parsing{ParsingStatusLine}, will_parse{ParsingStatusLine}
+	HttpResponseBasic();
+
+	~HttpResponseBasic();
+
+	HttpResponseBasic(HttpResponseBasic &&) noexcept;
+
+	HttpResponseBasic & operator=(HttpResponseBasic &&) noexcept;
+
+	/**
+	 * Hand the body over to sink as it arrives instead of keeping it, get_body() stays empty and the
+	 * body length limit no longer applies. Kept across reset().
+	 */
+	void set_body_sink(BodySink sink_)
 	{
-		line.reserve(line_initial_capacity);
+		sink = std::move(sink_);
 	}
 
+	/**
+	 * Decode gzip and deflate Content-Encoding while parsing, on by default. Only the body changes,
+	 * headers are kept as received. Kept across reset().
+	 */
+	void set_content_decoding(bool enabled)
+	{
+		content_decoding = enabled;
+	}
+
+	/**
+	 * Parse the next message as the response to a HEAD request, which has no body whatever its
+	 * Content-Length says. Cleared by reset().
+	 */
+	void set_head_request(bool head)
+	{
+		head_request = head;
+	}
+
+	/**
+	 * @return false if built without zlib, encoded bodies are then left as received
+	 */
+	[[nodiscard]] static bool is_content_decoding_supported();
+
 
 	[[nodiscard]] const std::string & get_version() const
 	{
@@ -165,17 +324,119 @@ public:
 		return body;
 	}
 
-	bool parse(std::string_view &) override;
+	/**
+	 * Stops right after the body once the message is complete, leaving following bytes in the view.
+	 * After Complete or Error, call reset() before parsing the next message.
+	 */
+	ParseResult parse(std::string_view &) override;
+
+	/**
+	 * Prepare for the next message on the same connection.
+	 * Capacity of line, body and header nodes is kept, so steady-state parsing allocates nothing.
+	 */
+	void reset()
+	{
+		version.clear();
+		status.clear();
+		phrase.clear();
+		while (!headers.empty())
+			spare_headers.push_back(headers.extract(headers.begin()));
+		body.clear();
+		line.clear();
+		key.clear();
+		header_count = 0;
+		content_length = content_length_unknown;
+		body_received = 0;
+		chunk_remaining = 0;
+		decoding = false;
+		head_request = false;
+		chunked = false;
+		parsing = ParsingStatusLine;
+		will_parse = ParsingStatusLine;
+	}
+
+	/**
+	 * @return true if the body is complete according to its Content-Length or chunked framing
+	 */
+	[[nodiscard]] bool is_complete() const
+	{
+		return parsing == ParsingDone
+		       || (parsing == ParsingBody && content_length != content_length_unlimited
+		           && body_received == content_length);
+	}
+
+	/**
+	 * Notify the connection is closed.
+	 * @return true if the response is complete, either by Content-Length or delimited by close
+	 */
+	bool eof() override
+	{
+		if (parsing == ParsingDone)
+			return true;
+
+		if (parsing != ParsingBody)
+			return false;
+
+		if (content_length != content_length_unlimited)
+			return body_received == content_length;
+
+		// A truncated encoded body is not complete even if delimited by close
+		return !decoding || inflater_finished();
+	}
+
+protected:
+	/**
+	 * Fill the response from a framing other than HTTP/1.x, parse() is not used then.
+	 */
+	void set_status_line(std::string_view version_, std::string_view status_)
+	{
+		version = version_;
+		status = status_;
+	}
+
+	void add_header(std::string_view key_, std::string_view value_)
+	{
+		key = key_;
+		insert_header(value_);
+	}
+
+	/**
+	 * @return false over the body length limit, which a body sink lifts
+	 */
+	[[nodiscard]] bool append_body(std::string_view data)
+	{
+		return deliver(data);
+	}
 
 private:
 
+	bool parse_cr(std::string_view &);
+
 	bool parse_lf(std::string_view &);
 
+	bool resolve_content_length();
+
 	bool parse_status_line(std::string_view &);
 
 	bool parse_header(std::string_view &);
 
+	void insert_header(std::string_view value);
+
 	bool parse_body(std::string_view &);
+
+	bool parse_chunk_size(std::string_view &);
+
+	bool parse_chunk_data(std::string_view &);
+
+	bool parse_trailer(std::string_view &);
+
+	bool consume(std::string_view data);
+
+	bool resolve_content_encoding();
+
+	bool deliver(std::string_view data);
+
+	[[nodiscard]] bool inflater_finished() const;
 };
 
 class HttpRequestV1D0 : protected HttpRequestBasic
@@ -185,6 +446,10 @@ public:
 	using HttpRequestBasic::set_uri;
 	using HttpRequestBasic::append_header;
 	using HttpRequestBasic::set_body_once;
+	using HttpRequestBasic::size;
+	using HttpRequestBasic::format_into;
+	using HttpRequestBasic::iov_count;
+	using HttpRequestBasic::format_iov;
 	using HttpRequestBasic::format;
 
 	HttpRequestV1D0()
@@ -198,14 +463,25 @@ class HttpResponseV1D0 : public HttpResponseBasic
 {
 };
 
+template <typename T>
+class HttpCache;
+
 class HttpRequestV1D1 : protected HttpRequestBasic
 {
+	template <typename T>
+	friend class HttpCache;
+
 public:
 	using HttpRequestBasic::set_method;
 	using HttpRequestBasic::set_uri;
 	using HttpRequestBasic::append_header;
 	using HttpRequestBasic::set_body_once;
+	using HttpRequestBasic::size;
+	using HttpRequestBasic::format_into;
+	using HttpRequestBasic::iov_count;
+	using HttpRequestBasic::format_iov;
 	using HttpRequestBasic::format;
+	using HttpRequestBasic::get_method;
 
 	HttpRequestV1D1()
 		: HttpRequestBasic()
@@ -217,10 +493,245 @@ public:
 class HttpResponseV1D1 : public HttpResponseBasic
 {
 public:
+	/**
+	 * Connections are persistent in HTTP/1.1 unless closed explicitly.
+	 */
 	bool is_keep_alive() const
 	{
 		auto iter = get_headers().find("Connection");
-		return iter != get_headers().end() && CaseInsensitiveEqualTo{}(iter->second, "Keep-Alive");
+		return iter == get_headers().end() || !CaseInsensitiveEqualTo{}(iter->second, "close");
+	}
+};
+
+class Http2Client;
+
+/**
+ * Request sent as an HTTP/2 stream, see Http2Client. Headers are appended as for HTTP/1.1, the
+ * client lowercases their names and drops connection-specific ones.
+ */
+class HttpRequestV2 : protected HttpRequestBasic
+{
+	friend class Http2Client;
+
+public:
+	using HttpRequestBasic::set_method;
+	using HttpRequestBasic::set_uri;
+	using HttpRequestBasic::append_header;
+	using HttpRequestBasic::set_body_once;
+
+	HttpRequestV2()
+		: HttpRequestBasic()
+	{
+		HttpRequestBasic::set_version<Version::_2>();
+	}
+};
+
+/**
+ * Filled by Http2Client from HEADERS and DATA frames, get_status() is the :status pseudo-header.
+ */
+class HttpResponseV2 : public HttpResponseBasic
+{
+	friend class Http2Client;
+};
+
+/**
+ * Incremental, zero-copy parser of HTTP/1.x requests, the server side counterpart of HttpResponseBasic.
+ *
+ * Unlike HttpResponseBasic, bytes are not copied: call parse() with all unconsumed bytes of the
+ * connection. Incomplete consumes nothing, and the next call resumes scanning where the last one
+ * stopped. Complete consumes exactly one message. Results are views into the last parsed buffer,
+ * valid until it is modified.
+ */
+class HttpRequestParser
+{
+public:
+	struct Header
+	{
+		std::string_view key;
+		std::string_view value;
+	};
+
+	constexpr static size_t header_count_limit = 64;
+	constexpr static size_t head_length_limit = 8 * 1024;
+	constexpr static size_t body_length_limit = 1024 * 1024;
+
+private:
+	struct Span
+	{
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	const char * base;
+	Span method;
+	Span uri;
+	Span version;
+	std::array<Span, header_count_limit * 2> header_spans;
+	size_t header_count;
+	size_t scanned;
+	size_t head_length;
+	size_t content_length;
+	bool keep_alive;
+	bool failed;
+
+public:
+	HttpRequestParser()
+	{
+		reset();
+	}
+
+	ParseResult parse(std::string_view & raw);
+
+	void reset()
+	{
+		base = nullptr;
+		method = uri = version = {};
+		header_count = 0;
+		scanned = 0;
+		head_length = 0;
+		content_length = 0;
+		keep_alive = false;
+		failed = false;
+	}
+
+	[[nodiscard]] std::string_view get_method() const
+	{
+		return view(method);
+	}
+
+	[[nodiscard]] std::string_view get_uri() const
+	{
+		return view(uri);
+	}
+
+	[[nodiscard]] std::string_view get_version() const
+	{
+		return view(version);
+	}
+
+	[[nodiscard]] size_t get_header_count() const
+	{
+		return header_count;
+	}
+
+	[[nodiscard]] Header get_header(size_t i) const
+	{
+		return {view(header_spans[i * 2]), view(header_spans[i * 2 + 1])};
+	}
+
+	/**
+	 * Case-insensitive linear lookup, requests carry few headers.
+	 * @return empty view if not found
+	 */
+	[[nodiscard]] std::string_view find_header(std::string_view key) const;
+
+	[[nodiscard]] std::string_view get_body() const
+	{
+		return {base + head_length, content_length};
+	}
+
+	[[nodiscard]] bool is_keep_alive() const
+	{
+		return keep_alive;
+	}
+
+private:
+	[[nodiscard]] std::string_view view(Span span) const
+	{
+		return {base + span.offset, span.length};
+	}
+
+	bool parse_head(std::string_view head);
+};
+
+/**
+ * Appends one HTTP/1.1 response to an output buffer, the server side counterpart of HttpRequestBasic.
+ * Status line defaults to 200 if not set before the first header or body.
+ */
+class HttpResponseWriter
+{
+private:
+	std::string & output;
+	bool keep_alive;
+	enum
+	{
+		WritingStatusLine,
+		WritingHeader,
+		WritingDone,
+	} writing;
+
+public:
+	HttpResponseWriter(std::string & output_, bool keep_alive_)
+		: output{output_}, keep_alive{keep_alive_}, writing{WritingStatusLine}
+	{
+	}
+
+	template <Status s>
+	void set_status()
+	{
+		assert(writing == WritingStatusLine);
+		output += StatusLine<Version::_1_1, s>;
+		writing = WritingHeader;
+	}
+
+	void set_status(Status s)
+	{
+		assert(writing == WritingStatusLine);
+		output += status_line<Version::_1_1>(s);
+		writing = WritingHeader;
+	}
+
+	void append_header(std::string_view key, std::string_view value)
+	{
+		default_status();
+		assert(writing == WritingHeader);
+		output += key;
+		output += ": ";
+		output += value;
+		output += CRLF;
+	}
+
+	void set_keep_alive(bool keep_alive_)
+	{
+		keep_alive = keep_alive_;
+	}
+
+	[[nodiscard]] bool is_keep_alive() const
+	{
+		return keep_alive;
+	}
+
+	void set_body_once(std::string_view body)
+	{
+		default_status();
+		assert(writing == WritingHeader);
+		if (!keep_alive)
+			output += "Connection: close\r\n";
+
+		char digits[24];
+		auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), body.size());
+		output += "Content-Length: ";
+		output.append(digits, end);
+		output += CRLF;
+		output += CRLF;
+		output += body;
+		writing = WritingDone;
+	}
+
+	/**
+	 * Complete the response with an empty body if the handler did not.
+	 */
+	void finish()
+	{
+		if (writing != WritingDone)
+			set_body_once({});
+	}
+
+private:
+	void default_status()
+	{
+		if (writing == WritingStatusLine)
+			set_status<Status::_200>();
 	}
 };
 
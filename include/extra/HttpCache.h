@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "HttpClient.h"
+
+namespace extra::protocol::http
+{
+/**
+ * Conditional-request cache in front of HttpClient, for reference data polled far more often than it
+ * changes.
+ *
+ * A 200 response to GET carrying ETag or Last-Modified is parsed once into a T and kept with its
+ * validators. The next GET of the same host and uri is sent with If-None-Match and If-Modified-Since,
+ * and a 304 is answered with the cached object, nothing parsed. Entries are charged their key,
+ * validators and body size, and evicted least recently used first beyond capacity. Every request
+ * still reaches the server: freshness lifetimes and Vary are ignored.
+ *
+ * The cache must outlive the requests sent through it.
+ */
+template <typename T>
+class HttpCache
+{
+public:
+	/**
+	 * @return the parsed body, nullptr if malformed
+	 */
+	using Parser = std::function<std::shared_ptr<const T>(const HttpResponseV1D1 &)>;
+
+	/**
+	 * The object is fresh on 200, cached on 304, and nullptr otherwise or with ParseError.
+	 */
+	using Callback = std::function<void(State, Error, const HttpResponseV1D1 *, std::shared_ptr<const T>)>;
+
+	struct Options
+	{
+		size_t capacity = 16 * 1024 * 1024;
+	};
+
+private:
+	struct Entry
+	{
+		std::string key;
+		std::string etag;
+		std::string last_modified;
+		std::shared_ptr<const T> object;
+		size_t cost;
+	};
+
+	using EntryList = std::list<Entry>;
+
+	HttpClient & client;
+	Parser parser;
+	Options options;
+	/**
+	 * Most recently used first, indexed by views of the keys they own.
+	 */
+	EntryList entries;
+	std::unordered_map<std::string_view, typename EntryList::iterator> index;
+	size_t used;
+	size_t hits;
+	size_t misses;
+
+public:
+	HttpCache(HttpClient & client_, Parser parser_, Options options_)
+		: client{client_}, parser{std::move(parser_)}, options{options_}, entries{}, index{}, used{0}, hits{0}
+		, misses{0}
+	{
+	}
+
+	HttpCache(HttpClient & client_, Parser parser_)
+		: HttpCache(client_, std::move(parser_), Options{})
+	{
+	}
+
+	HttpCache(const HttpCache &) = delete;
+
+	HttpCache & operator=(const HttpCache &) = delete;
+
+	/**
+	 * Other methods than GET go through uncached, their 200 responses are parsed all the same.
+	 * @see HttpClient::send()
+	 */
+	bool send(const std::string & address, uint16_t port, const HttpRequestV1D1 & request, Callback callback)
+	{
+		std::string key;
+		if (request.get_method() == MethodString<Method::Get>)
+			key = request.get_method() + ' ' + address + ':' + std::to_string(port) + request.get_uri();
+
+		std::shared_ptr<const T> cached;
+		const auto iter = index.find(key);
+		if (iter == index.end())
+			return client.send(address, port, request, wrap(std::move(key), std::move(cached), std::move(callback)));
+
+		const auto & entry = *iter->second;
+		cached = entry.object;
+		auto conditional = request;
+		if (!entry.etag.empty())
+			conditional.append_header("If-None-Match", entry.etag);
+		if (!entry.last_modified.empty())
+			conditional.append_header("If-Modified-Since", entry.last_modified);
+		return client.send(address, port, conditional, wrap(std::move(key), std::move(cached), std::move(callback)));
+	}
+
+	void clear()
+	{
+		index.clear();
+		entries.clear();
+		used = 0;
+	}
+
+	[[nodiscard]] size_t size() const
+	{
+		return entries.size();
+	}
+
+	/**
+	 * @return charged size of all entries, at most the capacity
+	 */
+	[[nodiscard]] size_t used_bytes() const
+	{
+		return used;
+	}
+
+	/**
+	 * @return responses answered from the cache on 304
+	 */
+	[[nodiscard]] size_t hit_count() const
+	{
+		return hits;
+	}
+
+	/**
+	 * @return 200 responses parsed
+	 */
+	[[nodiscard]] size_t miss_count() const
+	{
+		return misses;
+	}
+
+private:
+	HttpClient::Callback wrap(std::string key, std::shared_ptr<const T> cached, Callback callback)
+	{
+		return [this, key = std::move(key), cached = std::move(cached), callback = std::move(callback)]
+			(State state, Error error, HttpResponseV1D1 * response)
+		{
+			complete(key, cached, callback, state, error, response);
+		};
+	}
+
+	void complete(const std::string & key, const std::shared_ptr<const T> & cached, const Callback & callback,
+		State state, Error error, const HttpResponseV1D1 * response)
+	{
+		if (state != State::Success || response == nullptr)
+		{
+			callback(state, error, response, nullptr);
+			return;
+		}
+
+		const auto & status = response->get_status();
+		if (status == StatusString<Status::_304> && cached)
+		{
+			// Served even if evicted meanwhile, it was valid when asked for
+			hits++;
+			revalidate(key, *response);
+			callback(state, error, response, cached);
+			return;
+		}
+
+		if (status != StatusString<Status::_200>)
+		{
+			if (status == StatusString<Status::_404>)
+				erase(key);
+			callback(state, error, response, nullptr);
+			return;
+		}
+
+		misses++;
+		auto object = parser(*response);
+		if (!object)
+		{
+			erase(key);
+			callback(state, ParseError, response, nullptr);
+			return;
+		}
+
+		if (!key.empty())
+			store(key, *response, object);
+		callback(state, error, response, std::move(object));
+	}
+
+	/**
+	 * Move the entry to the front, taking validators the 304 may have updated.
+	 */
+	void revalidate(const std::string & key, const HttpResponseV1D1 & response)
+	{
+		const auto iter = index.find(key);
+		if (iter == index.end())
+			return;
+
+		entries.splice(entries.begin(), entries, iter->second);
+		auto & entry = entries.front();
+		const auto & headers = response.get_headers();
+		if (const auto etag = headers.find("ETag"); etag != headers.end())
+			replace(entry, entry.etag, etag->second);
+		if (const auto last_modified = headers.find("Last-Modified"); last_modified != headers.end())
+			replace(entry, entry.last_modified, last_modified->second);
+		evict();
+	}
+
+	void store(const std::string & key, const HttpResponseV1D1 & response, std::shared_ptr<const T> object)
+	{
+		erase(key);
+		const auto & headers = response.get_headers();
+		if (const auto iter = headers.find("Cache-Control");
+			iter != headers.end() && iter->second.find("no-store") != std::string::npos)
+			return;
+
+		const auto etag = headers.find("ETag");
+		const auto last_modified = headers.find("Last-Modified");
+		if (etag == headers.end() && last_modified == headers.end())
+			return;
+
+		Entry entry{key, etag == headers.end() ? std::string{} : etag->second,
+			last_modified == headers.end() ? std::string{} : last_modified->second, std::move(object), 0};
+		entry.cost = entry.key.size() + entry.etag.size() + entry.last_modified.size() + response.get_body().size();
+		if (entry.cost > options.capacity)
+			return;
+
+		used += entry.cost;
+		entries.push_front(std::move(entry));
+		index.emplace(entries.front().key, entries.begin());
+		evict();
+	}
+
+	void replace(Entry & entry, std::string & field, const std::string & value)
+	{
+		entry.cost = entry.cost - field.size() + value.size();
+		used = used - field.size() + value.size();
+		field = value;
+	}
+
+	void erase(const std::string & key)
+	{
+		const auto iter = index.find(key);
+		if (iter == index.end())
+			return;
+
+		auto entry = iter->second;
+		index.erase(iter);
+		used -= entry->cost;
+		entries.erase(entry);
+	}
+
+	void evict()
+	{
+		while (used > options.capacity)
+		{
+			index.erase(entries.back().key);
+			used -= entries.back().cost;
+			entries.pop_back();
+		}
+	}
+};
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "HttpBasic.h"
+#include "poller.h"
+
+namespace extra::protocol::http
+{
+/**
+ * Asynchronous HTTP/1.1 client driven by poller_go().
+ *
+ * Keeps a pool of persistent connections per host. Each connection carries up to pipeline_depth
+ * requests in flight, responses are matched to requests in order. Requests exceeding the pool wait
+ * in a per host queue. Requests in flight on a broken connection fail, they are never replayed.
+ */
+class HttpClient
+{
+public:
+	using Callback = std::function<void(State, Error, HttpResponseV1D1 *)>;
+
+	struct Options
+	{
+		size_t max_connections_per_host = 4;
+		size_t pipeline_depth = 1;
+	};
+
+	/**
+	 * How the response to a request takes its body, see HttpResponseBasic::set_body_sink() and
+	 * set_content_decoding(). With a sink the body length limit no longer applies.
+	 */
+	struct BodyOptions
+	{
+		HttpResponseBasic::BodySink sink;
+		bool content_decoding = true;
+	};
+
+private:
+	struct Host;
+
+	struct InFlight
+	{
+		Callback callback;
+		/* Its response has no body */
+		bool head;
+		BodyOptions body;
+	};
+
+	struct Connection
+	{
+		HttpClient * client;
+		Host * host;
+		int fd;
+		bool connected;
+		bool closed;
+		std::string output;
+		size_t output_offset;
+		std::deque<InFlight> in_flight;
+		HttpResponseV1D1 response;
+	};
+
+	struct Pending
+	{
+		HttpRequestV1D1 request;
+		Callback callback;
+		BodyOptions body;
+	};
+
+	struct Host
+	{
+		std::string address;
+		uint16_t port;
+		std::vector<std::unique_ptr<Connection>> connections;
+		std::deque<Pending> pending;
+	};
+
+	constexpr static size_t read_buffer_size = 64 * 1024;
+
+	poller_t * poller;
+	Options options;
+	std::unordered_map<std::string, std::unique_ptr<Host>> hosts;
+	std::unique_ptr<char[]> read_buffer;
+
+public:
+	HttpClient(poller_t * poller_, Options options_);
+
+	explicit HttpClient(poller_t * poller_)
+		: HttpClient(poller_, Options{})
+	{
+	}
+
+	HttpClient(const HttpClient &) = delete;
+
+	HttpClient & operator=(const HttpClient &) = delete;
+
+	~HttpClient();
+
+	/**
+	 * @param address numeric IPv4 address
+	 * @return false if no connection can be opened, callback will not be called then
+	 */
+	bool send(const std::string & address, uint16_t port, const HttpRequestV1D1 & request, Callback callback);
+
+	/**
+	 * As above, the response taking its body as body says.
+	 */
+	bool send(const std::string & address, uint16_t port, const HttpRequestV1D1 & request, Callback callback,
+		BodyOptions body);
+
+	[[nodiscard]] size_t connection_count() const;
+
+private:
+	Host & host_of(const std::string & address, uint16_t port);
+
+	Connection * pick(Host & host);
+
+	Connection * open(Host & host);
+
+	/**
+	 * Format request into the output of connection, written at once if connected.
+	 */
+	void enqueue(Connection & connection, const HttpRequestV1D1 & request, Callback callback, BodyOptions body);
+
+	/**
+	 * Set the response of connection up for the request first in flight, once before parsing it.
+	 */
+	static void prepare(Connection & connection);
+
+	void flush(Connection & connection);
+
+	void receive(Connection & connection);
+
+	void fail(Connection & connection, State state, Error error);
+
+	void remove(Connection & connection);
+
+	void dispatch_pending(Host & host);
+
+	static void on_readable(handle_t * handle, void * context);
+
+	static void on_writable(handle_t * handle, void * context);
+};
+
+}
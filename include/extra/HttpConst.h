@@ -1,7 +1,34 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <string_view>
+#include <utility>
+
 namespace extra::protocol::http
 {
+namespace detail
+{
+/**
+ * Concatenate constexpr string_views at compile time.
+ */
+template <const std::string_view & ... parts>
+class Join
+{
+private:
+	constexpr static auto storage = []
+	{
+		std::array<char, (parts.size() + ... + 0)> a{};
+		auto out = a.begin();
+		((out = std::copy(parts.begin(), parts.end(), out)), ...);
+		return a;
+	}();
+
+public:
+	constexpr static std::string_view value{storage.data(), storage.size()};
+};
+}
+
 enum class Version
 {
 	_0_9,
@@ -69,15 +96,129 @@ enum class Status
 	_305,
 	_307,
 	_308,
+	_400,
+	_401,
+	_403,
+	_404,
+	_405,
+	_408,
+	_411,
+	_413,
+	_429,
+	_431,
+	_500,
+	_501,
+	_503,
+	_505,
 };
 
 template <Status>
 constexpr inline std::string_view StatusString;
 
+template <> constexpr inline std::string_view StatusString<Status::_100> = "100";
+template <> constexpr inline std::string_view StatusString<Status::_101> = "101";
+template <> constexpr inline std::string_view StatusString<Status::_102> = "102";
 template <> constexpr inline std::string_view StatusString<Status::_200> = "200";
+template <> constexpr inline std::string_view StatusString<Status::_201> = "201";
+template <> constexpr inline std::string_view StatusString<Status::_202> = "202";
+template <> constexpr inline std::string_view StatusString<Status::_203> = "203";
+template <> constexpr inline std::string_view StatusString<Status::_204> = "204";
+template <> constexpr inline std::string_view StatusString<Status::_205> = "205";
+template <> constexpr inline std::string_view StatusString<Status::_206> = "206";
+template <> constexpr inline std::string_view StatusString<Status::_207> = "207";
+template <> constexpr inline std::string_view StatusString<Status::_208> = "208";
+template <> constexpr inline std::string_view StatusString<Status::_226> = "226";
+template <> constexpr inline std::string_view StatusString<Status::_300> = "300";
+template <> constexpr inline std::string_view StatusString<Status::_301> = "301";
+template <> constexpr inline std::string_view StatusString<Status::_302> = "302";
+template <> constexpr inline std::string_view StatusString<Status::_303> = "303";
+template <> constexpr inline std::string_view StatusString<Status::_304> = "304";
+template <> constexpr inline std::string_view StatusString<Status::_305> = "305";
+template <> constexpr inline std::string_view StatusString<Status::_307> = "307";
+template <> constexpr inline std::string_view StatusString<Status::_308> = "308";
+template <> constexpr inline std::string_view StatusString<Status::_400> = "400";
+template <> constexpr inline std::string_view StatusString<Status::_401> = "401";
+template <> constexpr inline std::string_view StatusString<Status::_403> = "403";
+template <> constexpr inline std::string_view StatusString<Status::_404> = "404";
+template <> constexpr inline std::string_view StatusString<Status::_405> = "405";
+template <> constexpr inline std::string_view StatusString<Status::_408> = "408";
+template <> constexpr inline std::string_view StatusString<Status::_411> = "411";
+template <> constexpr inline std::string_view StatusString<Status::_413> = "413";
+template <> constexpr inline std::string_view StatusString<Status::_429> = "429";
+template <> constexpr inline std::string_view StatusString<Status::_431> = "431";
+template <> constexpr inline std::string_view StatusString<Status::_500> = "500";
+template <> constexpr inline std::string_view StatusString<Status::_501> = "501";
+template <> constexpr inline std::string_view StatusString<Status::_503> = "503";
+template <> constexpr inline std::string_view StatusString<Status::_505> = "505";
+
+template <Status>
+constexpr inline std::string_view StatusPhrase;
+
+template <> constexpr inline std::string_view StatusPhrase<Status::_100> = "Continue";
+template <> constexpr inline std::string_view StatusPhrase<Status::_101> = "Switching Protocols";
+template <> constexpr inline std::string_view StatusPhrase<Status::_102> = "Processing";
+template <> constexpr inline std::string_view StatusPhrase<Status::_200> = "OK";
+template <> constexpr inline std::string_view StatusPhrase<Status::_201> = "Created";
+template <> constexpr inline std::string_view StatusPhrase<Status::_202> = "Accepted";
+template <> constexpr inline std::string_view StatusPhrase<Status::_203> = "Non-Authoritative Information";
+template <> constexpr inline std::string_view StatusPhrase<Status::_204> = "No Content";
+template <> constexpr inline std::string_view StatusPhrase<Status::_205> = "Reset Content";
+template <> constexpr inline std::string_view StatusPhrase<Status::_206> = "Partial Content";
+template <> constexpr inline std::string_view StatusPhrase<Status::_207> = "Multi-Status";
+template <> constexpr inline std::string_view StatusPhrase<Status::_208> = "Already Reported";
+template <> constexpr inline std::string_view StatusPhrase<Status::_226> = "IM Used";
+template <> constexpr inline std::string_view StatusPhrase<Status::_300> = "Multiple Choices";
+template <> constexpr inline std::string_view StatusPhrase<Status::_301> = "Moved Permanently";
+template <> constexpr inline std::string_view StatusPhrase<Status::_302> = "Found";
+template <> constexpr inline std::string_view StatusPhrase<Status::_303> = "See Other";
+template <> constexpr inline std::string_view StatusPhrase<Status::_304> = "Not Modified";
+template <> constexpr inline std::string_view StatusPhrase<Status::_305> = "Use Proxy";
+template <> constexpr inline std::string_view StatusPhrase<Status::_307> = "Temporary Redirect";
+template <> constexpr inline std::string_view StatusPhrase<Status::_308> = "Permanent Redirect";
+template <> constexpr inline std::string_view StatusPhrase<Status::_400> = "Bad Request";
+template <> constexpr inline std::string_view StatusPhrase<Status::_401> = "Unauthorized";
+template <> constexpr inline std::string_view StatusPhrase<Status::_403> = "Forbidden";
+template <> constexpr inline std::string_view StatusPhrase<Status::_404> = "Not Found";
+template <> constexpr inline std::string_view StatusPhrase<Status::_405> = "Method Not Allowed";
+template <> constexpr inline std::string_view StatusPhrase<Status::_408> = "Request Timeout";
+template <> constexpr inline std::string_view StatusPhrase<Status::_411> = "Length Required";
+template <> constexpr inline std::string_view StatusPhrase<Status::_413> = "Content Too Large";
+template <> constexpr inline std::string_view StatusPhrase<Status::_429> = "Too Many Requests";
+template <> constexpr inline std::string_view StatusPhrase<Status::_431> = "Request Header Fields Too Large";
+template <> constexpr inline std::string_view StatusPhrase<Status::_500> = "Internal Server Error";
+template <> constexpr inline std::string_view StatusPhrase<Status::_501> = "Not Implemented";
+template <> constexpr inline std::string_view StatusPhrase<Status::_503> = "Service Unavailable";
+template <> constexpr inline std::string_view StatusPhrase<Status::_505> = "HTTP Version Not Supported";
 
+constexpr inline size_t StatusCount = static_cast<size_t>(Status::_505) + 1;
+
+constexpr inline std::string_view SP = " ";
 constexpr inline char CR = '\r';
 constexpr inline char LF = '\n';
 constexpr inline std::string_view CRLF = "\r\n";
 
+template <Version v, Status s>
+constexpr inline std::string_view StatusLine = detail::Join<VersionString<v>, SP, StatusString<s>, SP, StatusPhrase<s>, CRLF>::value;
+
+namespace detail
+{
+template <Version v, size_t ... I>
+constexpr auto make_status_lines(std::index_sequence<I...>)
+{
+	return std::array<std::string_view, sizeof...(I)>{StatusLine<v, static_cast<Status>(I)>...};
+}
+
+template <Version v>
+constexpr inline auto status_lines = make_status_lines<v>(std::make_index_sequence<StatusCount>{});
+}
+
+/**
+ * Runtime lookup of the status line rendered at compile time, e.g. "HTTP/1.1 200 OK\r\n".
+ */
+template <Version v>
+constexpr std::string_view status_line(Status s)
+{
+	return detail::status_lines<v>[static_cast<size_t>(s)];
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include "HttpBasic.h"
+#include "poller.h"
+
+namespace extra::protocol::http
+{
+/**
+ * HTTP/1.x server driven by poller_go(), for small internal endpoints.
+ *
+ * Each readable edge is drained into a per connection buffer, every complete request in it is handed
+ * to the handler, and all responses produced are written with a single send. Pipelined requests are
+ * answered in order. Malformed requests get 400 and the connection closed. A peer leaving more than
+ * output_size_limit of responses unread is neither read from nor served until it takes them.
+ */
+class HttpServer
+{
+public:
+	using Handler = std::function<void(const HttpRequestParser &, HttpResponseWriter &)>;
+
+private:
+	struct Connection
+	{
+		HttpServer * server;
+		int fd;
+		std::unique_ptr<char[]> input;
+		size_t input_begin;
+		size_t input_end;
+		size_t input_capacity;
+		std::string output;
+		size_t output_offset;
+		bool closing;
+		/* Over output_size_limit, resumed by on_writable */
+		bool paused;
+		HttpRequestParser parser;
+	};
+
+	constexpr static size_t input_initial_capacity = 16 * 1024;
+	constexpr static size_t input_capacity_limit = HttpRequestParser::head_length_limit
+	                                               + HttpRequestParser::body_length_limit;
+	/* Responses not yet taken by the peer, as MAX_BUFFER_SIZE of poller buffers */
+	constexpr static size_t output_size_limit = 16 * 1024 * 1024;
+
+	poller_t * poller;
+	Handler handler;
+	int listener;
+	uint16_t port;
+	std::unordered_map<int, std::unique_ptr<Connection>> connections;
+
+public:
+	HttpServer(poller_t * poller_, Handler handler_);
+
+	HttpServer(const HttpServer &) = delete;
+
+	HttpServer & operator=(const HttpServer &) = delete;
+
+	~HttpServer();
+
+	/**
+	 * @param address numeric IPv4 address
+	 * @param port 0 to pick an ephemeral one, see get_port()
+	 */
+	bool listen(const std::string & address, uint16_t port_, int backlog = 1024);
+
+	[[nodiscard]] uint16_t get_port() const
+	{
+		return port;
+	}
+
+	[[nodiscard]] size_t connection_count() const
+	{
+		return connections.size();
+	}
+
+private:
+	void accept_all();
+
+	/**
+	 * @return false if the connection is gone
+	 */
+	bool receive(Connection & connection);
+
+	void serve(Connection & connection);
+
+	/**
+	 * @return false if the connection is gone
+	 */
+	bool flush(Connection & connection);
+
+	void remove(Connection & connection);
+
+	static size_t unsent(const Connection & connection)
+	{
+		return connection.output.size() - connection.output_offset;
+	}
+
+	static void on_accept(handle_t * handle, void * context);
+
+	static void on_readable(handle_t * handle, void * context);
+
+	static void on_writable(handle_t * handle, void * context);
+};
+
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <charconv>
+#include <cstring>
+#include <string>
+
+#include <sys/uio.h>
+
+#include "HttpConst.h"
+
+namespace extra::protocol::http
+{
+/**
+ * Request whose constant bytes are rendered once.
+ *
+ * Layout on the wire:
+ *   [METHOD uri_prefix][uri_suffix][ VERSION CRLF headers Content-Length: ][length CRLF CRLF][body]
+ *
+ * Headers whose value changes per request are reserved as fixed-width slots and patched in place.
+ * Values shorter than the slot are padded with spaces, which is trailing OWS to any HTTP parser.
+ */
+template <Method m, Version v>
+class HttpRequestTemplate
+{
+public:
+	class Slot
+	{
+	private:
+		size_t offset;
+		size_t width;
+
+		friend class HttpRequestTemplate;
+
+		Slot(size_t offset_, size_t width_)
+			: offset{offset_}, width{width_}
+		{
+		}
+
+	public:
+		[[nodiscard]] size_t get_width() const
+		{
+			return width;
+		}
+	};
+
+	constexpr static std::string_view line_prefix = detail::Join<MethodString<m>, SP>::value;
+	constexpr static std::string_view line_suffix = detail::Join<SP, VersionString<v>, CRLF>::value;
+	constexpr static std::string_view content_length_key = "Content-Length: ";
+	constexpr static size_t iov_count = 5;
+
+private:
+	std::string rendered;
+	size_t split;
+	bool sealed;
+	std::array<char, 24> tail;
+	size_t tail_size;
+
+public:
+	explicit HttpRequestTemplate(std::string_view uri_prefix)
+		: rendered{}, split{0}, sealed{false}, tail{}, tail_size{0}
+	{
+		rendered.reserve(512);
+		rendered += line_prefix;
+		rendered += uri_prefix;
+		split = rendered.size();
+		rendered += line_suffix;
+	}
+
+	void append_header(std::string_view key, std::string_view value)
+	{
+		assert(!sealed);
+		rendered += key;
+		rendered += ": ";
+		rendered += value;
+		rendered += CRLF;
+	}
+
+	Slot append_slot(std::string_view key, size_t width)
+	{
+		assert(!sealed);
+		rendered += key;
+		rendered += ": ";
+		Slot slot{rendered.size(), width};
+		rendered.append(width, ' ');
+		rendered += CRLF;
+		return slot;
+	}
+
+	/**
+	 * Finish the constant part. No header can be appended afterwards.
+	 */
+	void seal()
+	{
+		if (!sealed)
+		{
+			rendered += content_length_key;
+			sealed = true;
+		}
+	}
+
+	void patch(const Slot & slot, std::string_view value)
+	{
+		assert(value.size() <= slot.width);
+		auto p = rendered.data() + slot.offset;
+		std::memcpy(p, value.data(), value.size());
+		std::memset(p + value.size(), ' ', slot.width - value.size());
+	}
+
+	[[nodiscard]] size_t size(std::string_view uri_suffix, std::string_view body)
+	{
+		render_tail(body.size());
+		return rendered.size() + uri_suffix.size() + tail_size + body.size();
+	}
+
+	/**
+	 * @return bytes written, or 0 if capacity is not enough
+	 */
+	size_t format_into(char * buffer, size_t capacity, std::string_view uri_suffix, std::string_view body)
+	{
+		const size_t total = size(uri_suffix, body);
+		if (capacity < total)
+			return 0;
+
+		for (const auto & part: parts(uri_suffix, body))
+		{
+			std::memcpy(buffer, part.data(), part.size());
+			buffer += part.size();
+		}
+		return total;
+	}
+
+	/**
+	 * The iovec refers to this template, uri_suffix and body, all must stay untouched until written.
+	 * @return total bytes referred by iov
+	 */
+	size_t format_iov(struct iovec (& iov)[iov_count], std::string_view uri_suffix, std::string_view body)
+	{
+		const size_t total = size(uri_suffix, body);
+		size_t i = 0;
+		for (const auto & part: parts(uri_suffix, body))
+		{
+			iov[i].iov_base = const_cast<char *>(part.data());
+			iov[i].iov_len = part.size();
+			i++;
+		}
+		return total;
+	}
+
+	[[nodiscard]] std::string format(std::string_view uri_suffix, std::string_view body)
+	{
+		std::string s(size(uri_suffix, body), '\0');
+		format_into(s.data(), s.size(), uri_suffix, body);
+		return s;
+	}
+
+private:
+	void render_tail(size_t content_length)
+	{
+		seal();
+		auto [end, ec] = std::to_chars(tail.data(), tail.data() + tail.size(), content_length);
+		assert(ec == std::errc{});
+		*end++ = CR;
+		*end++ = LF;
+		*end++ = CR;
+		*end++ = LF;
+		tail_size = end - tail.data();
+	}
+
+	[[nodiscard]] std::array<std::string_view, iov_count> parts(std::string_view uri_suffix, std::string_view body) const
+	{
+		std::string_view r = rendered;
+		return {r.substr(0, split), uri_suffix, r.substr(split), {tail.data(), tail_size}, body};
+	}
+};
+
+}
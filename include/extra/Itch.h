@@ -0,0 +1,263 @@
+#pragma once
+
+#include "Binary.h"
+
+namespace extra::protocol::itch
+{
+/**
+ * Layouts of the order book messages of Nasdaq TotalView-ITCH 5.0, big-endian, prices with 4 decimals.
+ */
+template <char Type, size_t Length>
+class ItchMessage : public binary::Message<Type, Length>
+{
+protected:
+	using Base = binary::Message<Type, Length>;
+
+public:
+	using Base::Base;
+
+	[[nodiscard]] uint16_t stock_locate() const
+	{
+		return Base::template get<uint16_t, 1>();
+	}
+
+	[[nodiscard]] uint16_t tracking_number() const
+	{
+		return Base::template get<uint16_t, 3>();
+	}
+
+	/**
+	 * @return nanoseconds since midnight
+	 */
+	[[nodiscard]] uint64_t timestamp() const
+	{
+		return Base::template get_uint<5, 6>();
+	}
+};
+
+class SystemEvent : public ItchMessage<'S', 12>
+{
+public:
+	using ItchMessage::ItchMessage;
+
+	[[nodiscard]] char event_code() const
+	{
+		return get<char, 11>();
+	}
+};
+
+class AddOrder : public ItchMessage<'A', 36>
+{
+public:
+	using ItchMessage::ItchMessage;
+
+	[[nodiscard]] uint64_t order_reference() const
+	{
+		return get<uint64_t, 11>();
+	}
+
+	[[nodiscard]] char side() const
+	{
+		return get<char, 19>();
+	}
+
+	[[nodiscard]] uint32_t shares() const
+	{
+		return get<uint32_t, 20>();
+	}
+
+	[[nodiscard]] std::string_view stock() const
+	{
+		return get_alpha<24, 8>();
+	}
+
+	[[nodiscard]] uint32_t price() const
+	{
+		return get<uint32_t, 32>();
+	}
+};
+
+class AddOrderMpid : public ItchMessage<'F', 40>
+{
+public:
+	using ItchMessage::ItchMessage;
+
+	[[nodiscard]] uint64_t order_reference() const
+	{
+		return get<uint64_t, 11>();
+	}
+
+	[[nodiscard]] char side() const
+	{
+		return get<char, 19>();
+	}
+
+	[[nodiscard]] uint32_t shares() const
+	{
+		return get<uint32_t, 20>();
+	}
+
+	[[nodiscard]] std::string_view stock() const
+	{
+		return get_alpha<24, 8>();
+	}
+
+	[[nodiscard]] uint32_t price() const
+	{
+		return get<uint32_t, 32>();
+	}
+
+	[[nodiscard]] std::string_view attribution() const
+	{
+		return get_alpha<36, 4>();
+	}
+};
+
+class OrderExecuted : public ItchMessage<'E', 31>
+{
+public:
+	using ItchMessage::ItchMessage;
+
+	[[nodiscard]] uint64_t order_reference() const
+	{
+		return get<uint64_t, 11>();
+	}
+
+	[[nodiscard]] uint32_t executed_shares() const
+	{
+		return get<uint32_t, 19>();
+	}
+
+	[[nodiscard]] uint64_t match_number() const
+	{
+		return get<uint64_t, 23>();
+	}
+};
+
+class OrderExecutedWithPrice : public ItchMessage<'C', 36>
+{
+public:
+	using ItchMessage::ItchMessage;
+
+	[[nodiscard]] uint64_t order_reference() const
+	{
+		return get<uint64_t, 11>();
+	}
+
+	[[nodiscard]] uint32_t executed_shares() const
+	{
+		return get<uint32_t, 19>();
+	}
+
+	[[nodiscard]] uint64_t match_number() const
+	{
+		return get<uint64_t, 23>();
+	}
+
+	[[nodiscard]] bool printable() const
+	{
+		return get<char, 31>() == 'Y';
+	}
+
+	[[nodiscard]] uint32_t execution_price() const
+	{
+		return get<uint32_t, 32>();
+	}
+};
+
+class OrderCancel : public ItchMessage<'X', 23>
+{
+public:
+	using ItchMessage::ItchMessage;
+
+	[[nodiscard]] uint64_t order_reference() const
+	{
+		return get<uint64_t, 11>();
+	}
+
+	[[nodiscard]] uint32_t cancelled_shares() const
+	{
+		return get<uint32_t, 19>();
+	}
+};
+
+class OrderDelete : public ItchMessage<'D', 19>
+{
+public:
+	using ItchMessage::ItchMessage;
+
+	[[nodiscard]] uint64_t order_reference() const
+	{
+		return get<uint64_t, 11>();
+	}
+};
+
+class OrderReplace : public ItchMessage<'U', 35>
+{
+public:
+	using ItchMessage::ItchMessage;
+
+	[[nodiscard]] uint64_t original_order_reference() const
+	{
+		return get<uint64_t, 11>();
+	}
+
+	[[nodiscard]] uint64_t new_order_reference() const
+	{
+		return get<uint64_t, 19>();
+	}
+
+	[[nodiscard]] uint32_t shares() const
+	{
+		return get<uint32_t, 27>();
+	}
+
+	[[nodiscard]] uint32_t price() const
+	{
+		return get<uint32_t, 31>();
+	}
+};
+
+class Trade : public ItchMessage<'P', 44>
+{
+public:
+	using ItchMessage::ItchMessage;
+
+	[[nodiscard]] uint64_t order_reference() const
+	{
+		return get<uint64_t, 11>();
+	}
+
+	[[nodiscard]] char side() const
+	{
+		return get<char, 19>();
+	}
+
+	[[nodiscard]] uint32_t shares() const
+	{
+		return get<uint32_t, 20>();
+	}
+
+	[[nodiscard]] std::string_view stock() const
+	{
+		return get_alpha<24, 8>();
+	}
+
+	[[nodiscard]] uint32_t price() const
+	{
+		return get<uint32_t, 32>();
+	}
+
+	[[nodiscard]] uint64_t match_number() const
+	{
+		return get<uint64_t, 36>();
+	}
+};
+
+/**
+ * Decoder of the messages of a MoldUDP64 packet after its header, or of a SoupBinTCP stream.
+ */
+using Decoder = binary::Decoder<binary::Framing::LengthPrefixed, SystemEvent, AddOrder, AddOrderMpid,
+	OrderExecuted, OrderExecutedWithPrice, OrderCancel, OrderDelete, OrderReplace, Trade>;
+
+}
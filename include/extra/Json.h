@@ -0,0 +1,321 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace extra::protocol::json
+{
+enum class Type : uint8_t
+{
+	Invalid,
+	Object,
+	Array,
+	String,
+	Number,
+	True,
+	False,
+	Null,
+};
+
+/**
+ * Decode a decimal into fixed point with scale fractional digits, "4.0000020" at scale 8 is 400000200.
+ * @return false on overflow, exponents, or nonzero digits beyond scale as they would be lost
+ */
+bool parse_fixed(std::string_view s, int scale, int64_t & value);
+
+class Document;
+
+class Object;
+
+class Array;
+
+/**
+ * Handle of a value inside a Document, two words and trivially copyable. Accessors decode on
+ * demand and return false on type mismatch, an Invalid value (from a missing key, for example)
+ * fails every accessor.
+ */
+class Value
+{
+private:
+	const Document * document;
+	uint32_t i;
+
+public:
+	Value()
+		: document{nullptr}, i{0}
+	{
+	}
+
+	Value(const Document * document_, uint32_t i_)
+		: document{document_}, i{i_}
+	{
+	}
+
+	[[nodiscard]] Type type() const;
+
+	[[nodiscard]] bool is_valid() const
+	{
+		return document != nullptr;
+	}
+
+	[[nodiscard]] bool is_null() const
+	{
+		return type() == Type::Null;
+	}
+
+	/**
+	 * @return text of a scalar as in the document, strings with their quotes
+	 */
+	[[nodiscard]] std::string_view raw() const;
+
+	/**
+	 * Contents of a string without unescaping, enough for keys, symbols and ids.
+	 */
+	bool get(std::string_view & value) const;
+
+	/**
+	 * Contents of a string with escapes decoded into UTF-8.
+	 */
+	bool get_string(std::string & value) const;
+
+	bool get(int64_t & value) const;
+
+	bool get(uint64_t & value) const;
+
+	bool get(double & value) const;
+
+	bool get(bool & value) const;
+
+	/**
+	 * Fixed point of a number, or of a string holding one as many venues quote prices.
+	 * @see parse_fixed()
+	 */
+	bool get_fixed(int64_t & value, int scale) const;
+
+	[[nodiscard]] Object get_object() const;
+
+	[[nodiscard]] Array get_array() const;
+
+	/**
+	 * Field of an object, Invalid if missing or not an object.
+	 */
+	Value operator[](std::string_view key) const;
+
+	/**
+	 * Element of an array, Invalid if out of range or not an array. Linear, prefer iterating.
+	 */
+	Value operator[](size_t index) const;
+
+private:
+	friend class Object;
+
+	friend class Array;
+
+	[[nodiscard]] uint32_t next() const;
+};
+
+/**
+ * Forward iteration over the fields of an object, skipping nested values in constant time.
+ */
+class Object
+{
+public:
+	struct Field
+	{
+		std::string_view key;
+		Value value;
+	};
+
+	class Iterator
+	{
+	private:
+		const Document * document;
+		uint32_t i;
+
+	public:
+		Iterator(const Document * document_, uint32_t i_)
+			: document{document_}, i{i_}
+		{
+		}
+
+		Field operator*() const;
+
+		Iterator & operator++();
+
+		bool operator==(const Iterator & other) const
+		{
+			return i == other.i;
+		}
+	};
+
+private:
+	const Document * document;
+	uint32_t first;
+	uint32_t last;
+
+public:
+	Object()
+		: document{nullptr}, first{0}, last{0}
+	{
+	}
+
+	Object(const Document * document_, uint32_t first_, uint32_t last_)
+		: document{document_}, first{first_}, last{last_}
+	{
+	}
+
+	[[nodiscard]] Iterator begin() const
+	{
+		return {document, first};
+	}
+
+	[[nodiscard]] Iterator end() const
+	{
+		return {document, last};
+	}
+
+	[[nodiscard]] Value find(std::string_view key) const;
+};
+
+class Array
+{
+public:
+	class Iterator
+	{
+	private:
+		const Document * document;
+		uint32_t i;
+
+	public:
+		Iterator(const Document * document_, uint32_t i_)
+			: document{document_}, i{i_}
+		{
+		}
+
+		Value operator*() const
+		{
+			return {document, i};
+		}
+
+		Iterator & operator++();
+
+		bool operator==(const Iterator & other) const
+		{
+			return i == other.i;
+		}
+	};
+
+private:
+	const Document * document;
+	uint32_t first;
+	uint32_t last;
+
+public:
+	Array()
+		: document{nullptr}, first{0}, last{0}
+	{
+	}
+
+	Array(const Document * document_, uint32_t first_, uint32_t last_)
+		: document{document_}, first{first_}, last{last_}
+	{
+	}
+
+	[[nodiscard]] Iterator begin() const
+	{
+		return {document, first};
+	}
+
+	[[nodiscard]] Iterator end() const
+	{
+		return {document, last};
+	}
+
+	[[nodiscard]] bool empty() const
+	{
+		return first == last;
+	}
+};
+
+/**
+ * On-demand JSON document.
+ *
+ * Parsing indexes the position of every structural character and the start of every scalar outside
+ * strings, 64 bytes per step with SSE2 or AVX2 compares, then checks the grammar over the index and
+ * links each bracket to its match. No tree is built: values are decoded only when asked for, and
+ * unwanted nested values are skipped in one step. The index is kept across parses, so a reused
+ * document allocates nothing in the steady state.
+ *
+ * A body may be given whole, and is then referred in place, or appended in fragments as they are
+ * received, copied and indexed block by block.
+ */
+class Document
+{
+private:
+	friend class Value;
+
+	friend class Object;
+
+	friend class Array;
+
+	constexpr static size_t block_size = 64;
+
+	std::string_view json;
+	std::string buffer;
+	std::vector<uint32_t> structurals;
+	size_t structural_count;
+	std::vector<uint32_t> jumps;
+	std::vector<uint32_t> stack;
+	size_t indexed;
+	uint64_t in_string;
+	bool escape;
+	uint64_t scalar;
+	bool valid;
+
+public:
+	Document();
+
+	/**
+	 * @param json_ must outlive the document, or the next parse()
+	 * @return false if the document is not well-formed
+	 */
+	bool parse(std::string_view json_);
+
+	/**
+	 * Start over for a streamed document.
+	 */
+	void clear();
+
+	void append(std::string_view fragment);
+
+	/**
+	 * @return false if the appended document is not well-formed
+	 */
+	bool finish();
+
+	/**
+	 * @return Invalid unless the last parse() or finish() succeeded
+	 */
+	[[nodiscard]] Value root() const
+	{
+		return valid ? Value(this, 0) : Value();
+	}
+
+private:
+	void reset_index();
+
+	/**
+	 * Index whole blocks of json not indexed yet, and the remaining tail if final.
+	 */
+	void index(bool final);
+
+	void index_block(const char * block, size_t base);
+
+	bool build();
+
+	[[nodiscard]] std::string_view token(uint32_t i) const;
+};
+
+}
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "Binary.h"
+#include "Channel.h"
+#include "poller.h"
+
+namespace extra::protocol::multicast
+{
+/**
+ * MoldUDP64 packet delivered in sequence, views valid during the call.
+ */
+struct Packet
+{
+	std::string_view session;
+	/* Sequence number of the first message */
+	uint64_t sequence;
+	uint16_t count;
+	/* Length-prefixed messages, without those the other line delivered already */
+	std::string_view messages;
+	/* Line it came first on, 0 for A and 1 for B */
+	int line;
+	/* Nanoseconds of CLOCK_REALTIME the kernel received the datagram at, 0 without a timestamp */
+	uint64_t received_ns;
+};
+
+/**
+ * MoldUDP64 feed received on line A and optionally line B carrying the same packets, arbitrated into
+ * one stream in sequence, driven by poller_go().
+ *
+ * Each line is a UDP socket bound to the group and port and joined to the group on its interface. A
+ * readable line is drained with recvmmsg(), batch datagrams at a time into buffers allocated once with
+ * the receiver, each with its receive time from SO_TIMESTAMPNS, or from SO_TIMESTAMPING with hardware
+ * timestamps where the NIC has them enabled.
+ *
+ * The first arrival of each packet is delivered and the copy of the other line dropped. A packet beyond
+ * the next sequence number is a gap of its line. It is held, copied into one of hold buffers, as long
+ * as the other line may still fill the gap: until the other line is beyond the gap too, hold packets
+ * are held or hold_timeout passes. Then the messages missing on both lines are reported to the gap
+ * callback and skipped. The stream starts with the first packet received. Heartbeats and the end of
+ * session, packets without messages, move the lines along and are not delivered.
+ */
+class Receiver
+{
+public:
+	struct Line
+	{
+		/* Numeric IPv4 group, empty for none, line A being required */
+		std::string group;
+		/* 0 to have one picked, see get_port() */
+		uint16_t port = 0;
+		/* Numeric IPv4 address of the interface joined on */
+		std::string interface = "0.0.0.0";
+		/* Unless empty, packets of this source only */
+		std::string source;
+	};
+
+	struct Options
+	{
+		Line a;
+		Line b;
+		/* Datagrams of one recvmmsg() */
+		size_t batch = 64;
+		/* Longer datagrams are dropped */
+		size_t packet_size = 2048;
+		size_t hold = 64;
+		/* Rounded up to milliseconds, the resolution of poller marks */
+		std::chrono::milliseconds hold_timeout{2};
+		/* SO_RCVBUF of each line, 0 to leave the default */
+		int receive_buffer = 4 * 1024 * 1024;
+		bool hardware_timestamps = false;
+	};
+
+	struct LineStats
+	{
+		uint64_t packets;
+		/* Dropped as delivered already from the other line, or given up on */
+		uint64_t duplicates;
+		/* Gaps of the line, and the messages missing in them */
+		uint64_t gaps;
+		uint64_t missing;
+	};
+
+	struct Stats
+	{
+		LineStats lines[2];
+		/* Packets with messages delivered */
+		uint64_t delivered;
+		/* Gaps of both lines, and the messages lost in them */
+		uint64_t gaps;
+		uint64_t lost;
+	};
+
+	using PacketCallback = std::function<void(const Packet &)>;
+
+	/* Messages from first to last, excluded, missing on both lines */
+	using GapCallback = std::function<void(uint64_t first, uint64_t last)>;
+
+private:
+	struct Socket
+	{
+		Receiver * receiver;
+		int line;
+		int fd;
+		handle_t * handle;
+		uint16_t port;
+		/* Sequence number after the furthest packet of the line, 0 before the first */
+		uint64_t next;
+	};
+
+	struct Held
+	{
+		uint64_t sequence;
+		size_t slot;
+		size_t size;
+		int line;
+		uint64_t received_ns;
+	};
+
+	constexpr static size_t control_size = CMSG_SPACE(3 * sizeof(timespec));
+
+	poller_t * poller;
+	Options options;
+	PacketCallback on_packet;
+	GapCallback on_gap;
+	Socket sockets[2];
+	std::unique_ptr<char[]> buffers;
+	std::unique_ptr<char[]> controls;
+	std::unique_ptr<mmsghdr[]> messages;
+	std::unique_ptr<iovec[]> iov;
+	std::unique_ptr<char[]> hold_buffers;
+	/* By sequence number */
+	std::vector<Held> held;
+	std::vector<size_t> free_slots;
+	bool holding;
+	/* Sequence number of the next message delivered, 0 before the first packet */
+	uint64_t next;
+	Stats stats;
+
+public:
+	Receiver(poller_t * poller_, Options options_, PacketCallback on_packet_, GapCallback on_gap_ = nullptr);
+
+	Receiver(const Receiver &) = delete;
+
+	Receiver & operator=(const Receiver &) = delete;
+
+	~Receiver();
+
+	/**
+	 * Bind and join the lines, the stream starting over.
+	 * @return false with errno set, EINVAL for options or addresses not valid
+	 */
+	bool open();
+
+	void close();
+
+	[[nodiscard]] bool is_open() const
+	{
+		return sockets[0].fd >= 0;
+	}
+
+	/**
+	 * @return port bound by line 0 or 1, 0 if not open
+	 */
+	[[nodiscard]] uint16_t get_port(int line) const
+	{
+		return sockets[line].port;
+	}
+
+	[[nodiscard]] uint64_t next_sequence() const
+	{
+		return next;
+	}
+
+	[[nodiscard]] const Stats & get_stats() const
+	{
+		return stats;
+	}
+
+private:
+	bool open_line(Socket & socket, const Line & line);
+
+	void receive(Socket & socket);
+
+	void arrive(int line, const char * data, size_t size, uint64_t received_ns);
+
+	void hold(int line, const char * data, size_t size, uint64_t received_ns);
+
+	/**
+	 * Deliver held packets in sequence, skipping gaps once no line may fill them or force is set.
+	 */
+	void release(bool force);
+
+	void deliver(int line, const char * data, size_t size, uint64_t received_ns);
+
+	static void on_readable(handle_t * handle, void * context);
+
+	static void on_timeout(handle_t * handle, void * context, int ack);
+};
+
+/**
+ * Adapt a packet callback writing each packet into a channel cell in place.
+ * @param decode void(const Packet &, T &)
+ */
+template <typename T, typename Decode>
+Receiver::PacketCallback to_channel(kernel::Channel<T> & channel, Decode decode)
+{
+	return [&channel, decode = std::move(decode)](const Packet & packet) mutable
+	{
+		auto it = channel.write_iterator();
+		decode(packet, *it);
+	};
+}
+
+/**
+ * Adapt a packet callback decoding its messages with Decoder, binary::Decoder of a LengthPrefixed schema,
+ * each into a channel cell in place.
+ * @param decode void(const M &, const Packet &, T &) for the views to publish, other messages are skipped
+ */
+template <typename Decoder, typename T, typename Decode>
+Receiver::PacketCallback decode_to_channel(kernel::Channel<T> & channel, Decode decode)
+{
+	return [&channel, decode = std::move(decode)](const Packet & packet) mutable
+	{
+		auto publish = [&]<typename M>(const M & message)
+			requires std::is_invocable_v<Decode &, const M &, const Packet &, T &>
+		{
+			auto it = channel.write_iterator();
+			decode(message, packet, *it);
+		};
+		auto raw = packet.messages;
+		Decoder::decode(raw, publish);
+	};
+}
+
+}
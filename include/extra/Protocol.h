@@ -21,6 +21,13 @@ enum Error : int
 	ParseError,
 };
 
+enum class ParseResult : int
+{
+	Incomplete,
+	Complete,
+	Error,
+};
+
 class Request
 {
 	[[nodiscard]] virtual std::string format() const = 0;
@@ -28,14 +35,12 @@ class Request
 
 class Response
 {
-	virtual bool parse(std::string_view &) = 0;
+	virtual ParseResult parse(std::string_view &) = 0;
 
-	/*
 	virtual bool eof()
 	{
 		return false;
 	}
-	 */
 };
 
 }
\ No newline at end of file
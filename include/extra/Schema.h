@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+namespace extra::kernel
+{
+/**
+ * String literal as a template argument.
+ */
+template <size_t N>
+struct FixedName
+{
+	char value[N];
+
+	constexpr FixedName(const char (& s)[N])
+		: value{}
+	{
+		std::copy_n(s, N, value);
+	}
+
+	[[nodiscard]] constexpr std::string_view view() const
+	{
+		return std::string_view(value, N - 1);
+	}
+};
+
+constexpr static inline unsigned max_schema_versions = 16;
+
+namespace detail
+{
+constexpr uint64_t fnv1a(uint64_t h, std::string_view s)
+{
+	for (auto c: s)
+	{
+		h ^= static_cast<uint8_t>(c);
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+constexpr uint64_t fnv1a(uint64_t h, uint64_t value)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		h ^= static_cast<uint8_t>(value >> (8 * i));
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+/**
+ * Kind, size and extents of a type, so that changing the type of a field changes the hash.
+ */
+template <typename T>
+constexpr uint64_t type_code(uint64_t h)
+{
+	if constexpr (std::is_array_v<T>)
+		return type_code<std::remove_extent_t<T>>(fnv1a(fnv1a(h, "[]"), std::extent_v<T>));
+	else
+	{
+		const char * kind = std::is_same_v<T, bool> ? "b" : std::is_same_v<T, char> ? "c"
+			: std::is_floating_point_v<T> ? "f" : std::is_enum_v<T> ? "e" : std::is_signed_v<T> ? "i"
+			: std::is_unsigned_v<T> ? "u" : "s";
+		return fnv1a(fnv1a(h, kind), sizeof(T));
+	}
+}
+}
+
+/**
+ * Field of a Payload at an explicit offset, added in schema version Since.
+ */
+template <FixedName Name, typename T, size_t Offset, unsigned Since = 1>
+struct Field
+{
+	static_assert(std::is_trivially_copyable_v<T>, "fields are copied between processes as bytes");
+	static_assert(Offset % alignof(T) == 0, "misaligned field");
+	static_assert(Since > 0 && Since <= max_schema_versions);
+
+	using type = T;
+	constexpr static auto name = Name;
+	constexpr static size_t offset = Offset;
+	constexpr static size_t end = Offset + sizeof(T);
+	constexpr static unsigned since = Since;
+};
+
+/**
+ * Fixed-layout Channel payload described by its fields, read and written in place.
+ *
+ * Fields are declared in offset order and a version only appends fields after those of earlier
+ * versions, both checked at compile time, so the layout of every version is a prefix of the next.
+ * hash(v) covers the name and the name, type and offset of each field up to version v. Channel keeps
+ * the hashes of the writer in its header and lets a reader of any version attach when both agree on
+ * the older one: fields of later versions than the writer's, see Channel::schema_version(), must not
+ * be read.
+ *
+ *     using Order = Payload<"Order", Field<"id", int64_t, 0>, Field<"price", int64_t, 8>,
+ *         Field<"venue", char[8], 16, 2>>;
+ *     order.get<"price">() = 100;
+ */
+template <FixedName Name, typename... Fields>
+class Payload
+{
+	static_assert(sizeof...(Fields) > 0);
+
+public:
+	constexpr static unsigned version = std::max({Fields::since...});
+	constexpr static size_t alignment = std::max({alignof(typename Fields::type)...});
+	constexpr static size_t size = (std::max({Fields::end...}) + alignment - 1) / alignment * alignment;
+
+private:
+	constexpr static std::array<std::string_view, sizeof...(Fields)> names{Fields::name.view()...};
+
+	constexpr static bool well_formed()
+	{
+		constexpr std::array<size_t, sizeof...(Fields)> offsets{Fields::offset...};
+		constexpr std::array<size_t, sizeof...(Fields)> ends{Fields::end...};
+		constexpr std::array<unsigned, sizeof...(Fields)> versions{Fields::since...};
+		for (size_t i = 1; i < sizeof...(Fields); i++)
+		{
+			if (ends[i - 1] > offsets[i] || versions[i - 1] > versions[i])
+				return false;
+		}
+		for (size_t i = 0; i < sizeof...(Fields); i++)
+		{
+			for (size_t j = i + 1; j < sizeof...(Fields); j++)
+			{
+				if (names[i] == names[j])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	static_assert(well_formed(), "fields must be uniquely named, in offset order, not overlapping, "
+		"and appended by later versions");
+
+	template <FixedName N>
+	constexpr static size_t index_of()
+	{
+		constexpr auto i = static_cast<size_t>(std::find(names.begin(), names.end(), N.view()) - names.begin());
+		static_assert(i < sizeof...(Fields), "no such field");
+		return i;
+	}
+
+	template <FixedName N>
+	using field_of = std::tuple_element_t<index_of<N>(), std::tuple<Fields...>>;
+
+	alignas(alignment) unsigned char bytes[size];
+
+public:
+	constexpr static uint64_t hash(unsigned v)
+	{
+		auto h = detail::fnv1a(14695981039346656037ull, Name.view());
+		((h = Fields::since <= v
+			? detail::type_code<typename Fields::type>(detail::fnv1a(detail::fnv1a(h, Fields::name.view()),
+				Fields::offset))
+			: h), ...);
+		return h;
+	}
+
+	template <FixedName N>
+	constexpr static unsigned since()
+	{
+		return field_of<N>::since;
+	}
+
+	template <FixedName N>
+	[[nodiscard]] const auto & get() const
+	{
+		using F = field_of<N>;
+		return *reinterpret_cast<const typename F::type *>(bytes + F::offset);
+	}
+
+	template <FixedName N>
+	[[nodiscard]] auto & get()
+	{
+		using F = field_of<N>;
+		return *reinterpret_cast<typename F::type *>(bytes + F::offset);
+	}
+};
+
+namespace detail
+{
+template <typename T>
+concept Schematic = requires
+{
+	{ T::version } -> std::convertible_to<unsigned>;
+	{ T::hash(1u) } -> std::same_as<uint64_t>;
+};
+
+/**
+ * Schema hashes of every version of T, version 0 for payloads without a schema.
+ */
+struct SchemaStamp
+{
+	unsigned version;
+	uint64_t hashes[max_schema_versions];
+};
+
+template <typename T>
+constexpr SchemaStamp stamp_of()
+{
+	SchemaStamp stamp{};
+	if constexpr (Schematic<T>)
+	{
+		stamp.version = T::version;
+		for (unsigned v = 1; v <= T::version; v++)
+			stamp.hashes[v - 1] = T::hash(v);
+	}
+	return stamp;
+}
+}
+
+}
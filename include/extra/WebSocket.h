@@ -0,0 +1,229 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+#include "Channel.h"
+#include "HttpBasic.h"
+#include "poller.h"
+
+namespace extra::protocol::ws
+{
+enum class Opcode : uint8_t
+{
+	Continuation = 0x0,
+	Text = 0x1,
+	Binary = 0x2,
+	Close = 0x8,
+	Ping = 0x9,
+	Pong = 0xA,
+};
+
+/**
+ * @return random base64 Sec-WebSocket-Key
+ */
+std::string make_key();
+
+/**
+ * @return Sec-WebSocket-Accept for key, base64(SHA-1(key + GUID)) as RFC 6455 4.2.2
+ */
+std::string accept_key(std::string_view key);
+
+void make_handshake(http::HttpRequestV1D1 & request, std::string_view host, std::string_view uri, std::string_view key);
+
+bool verify_handshake(const http::HttpResponseV1D1 & response, std::string_view key);
+
+/**
+ * XOR size bytes of in with the 4 byte masking key into out, in and out may be the same.
+ * @param phase position of in[0] within the message, modulo 4
+ *
+ * 16 bytes per step with SSE2, 32 with AVX2, 8 bytes per step otherwise.
+ */
+void apply_mask(char * out, const char * in, size_t size, const uint8_t (& key)[4], size_t phase = 0);
+
+/**
+ * Append one frame to output, masked if key is given as clients must do.
+ */
+void encode_frame(std::string & output, Opcode opcode, std::string_view payload, bool fin = true,
+	const uint8_t (* key)[4] = nullptr);
+
+/**
+ * Incremental frame parser with fragmented message reassembly.
+ *
+ * parse() stops after each complete message or control frame, leaving following bytes in the view.
+ * Control frames may arrive between fragments of a message, reset() after each Complete keeps the
+ * partially reassembled message. An unmasked, unfragmented frame wholly inside the view is returned
+ * as a view into it without copying; otherwise the payload is copied (and unmasked) into the parser.
+ * Text messages and close reasons are checked to be UTF-8, see get_close_code() on Error.
+ */
+class FrameParser
+{
+public:
+	constexpr static size_t message_length_limit = 16 * 1024 * 1024;
+
+private:
+	uint8_t header[14];
+	size_t header_size;
+	size_t header_length;
+
+	bool fin;
+	Opcode opcode;
+	bool masked;
+	uint8_t key[4];
+	size_t payload_length;
+	size_t payload_received;
+
+	Opcode message_opcode;
+	std::string message;
+	std::string control;
+	std::string_view payload;
+	Opcode completed;
+	bool complete;
+	bool failed;
+	bool from_client;
+	uint16_t close_code;
+
+public:
+	/**
+	 * @param from_client_ parse frames of a client, which must be masked, rather than those of a server,
+	 * which must not
+	 */
+	explicit FrameParser(bool from_client_ = false);
+
+	ParseResult parse(std::string_view & raw);
+
+	void reset()
+	{
+		complete = false;
+		payload = {};
+	}
+
+	[[nodiscard]] Opcode get_opcode() const
+	{
+		return completed;
+	}
+
+	[[nodiscard]] std::string_view get_payload() const
+	{
+		return payload;
+	}
+
+	/**
+	 * @return status code to close the connection with after Error, 1002, 1007 or 1009 as RFC 6455 7.4.1
+	 */
+	[[nodiscard]] uint16_t get_close_code() const
+	{
+		return close_code;
+	}
+
+private:
+	bool parse_header(std::string_view & raw);
+
+	bool parse_payload(std::string_view & raw);
+
+	void finish_frame();
+
+	bool validate();
+};
+
+/**
+ * WebSocket client driven by poller_go().
+ *
+ * Pings are answered automatically, a close frame is echoed then the connection is shut down.
+ * Text, binary and pong messages go to the message callback, payload views are valid during the call.
+ */
+class WebSocketClient
+{
+public:
+	using MessageCallback = std::function<void(Opcode, std::string_view)>;
+
+	/* Success once upgraded, NetworkError when failed or closed */
+	using StateCallback = std::function<void(State)>;
+
+private:
+	constexpr static size_t input_capacity = 64 * 1024;
+
+	poller_t * poller;
+	MessageCallback on_message;
+	StateCallback on_state;
+	int fd;
+	bool connected;
+	bool open;
+	bool closing;
+	std::string key;
+	uint64_t mask_state;
+	std::string pending;
+	std::string output;
+	size_t output_offset;
+	std::unique_ptr<char[]> input;
+	http::HttpResponseV1D1 handshake;
+	FrameParser parser;
+
+public:
+	WebSocketClient(poller_t * poller_, MessageCallback on_message_, StateCallback on_state_);
+
+	WebSocketClient(const WebSocketClient &) = delete;
+
+	WebSocketClient & operator=(const WebSocketClient &) = delete;
+
+	~WebSocketClient();
+
+	/**
+	 * Start connecting and upgrading, completion is reported through the state callback.
+	 * @param address numeric IPv4 address
+	 */
+	bool connect(const std::string & address, uint16_t port, std::string_view uri);
+
+	/**
+	 * Frames sent before the upgrade completes are queued.
+	 */
+	bool send(Opcode opcode, std::string_view payload);
+
+	void close(uint16_t code = 1000);
+
+	[[nodiscard]] bool is_open() const
+	{
+		return open;
+	}
+
+private:
+	void next_mask(uint8_t (& k)[4]);
+
+	void receive();
+
+	/**
+	 * Both parsers copy partial messages, so raw is always consumed and the input buffer never
+	 * has to hold more than one read.
+	 * @return false if the connection is gone
+	 */
+	bool process(std::string_view & raw);
+
+	void flush();
+
+	void fail();
+
+	static void on_readable(handle_t * handle, void * context);
+
+	static void on_writable(handle_t * handle, void * context);
+};
+
+/**
+ * Adapt a message callback writing each decoded message into a channel cell in place.
+ * @param decode void(Opcode, std::string_view, T &)
+ */
+template <typename T, typename Decode>
+WebSocketClient::MessageCallback to_channel(kernel::Channel<T> & channel, Decode decode)
+{
+	return [&channel, decode = std::move(decode)](Opcode opcode, std::string_view payload)
+	{
+		auto it = channel.write_iterator();
+		decode(opcode, payload, *it);
+	};
+}
+
+}
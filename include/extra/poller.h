@@ -0,0 +1,186 @@
+#ifndef EXTRA_POLLER_H
+#define EXTRA_POLLER_H
+
+#include <stddef.h>
+
+typedef struct poller poller_t;
+
+/* Flags of poller_create_ex() */
+#define POLLER_URING 0x1
+
+/* Modes of poller_config */
+#define POLLER_SPIN 0
+#define POLLER_BLOCK 1
+#define POLLER_ADAPTIVE 2
+
+typedef struct handle handle_t;
+
+struct handle_param
+{
+	int fd;
+	void * context;
+
+	/* Called once per edge, drain the fd until EAGAIN. Also called on EPOLLHUP and EPOLLERR. Unused if buffered. */
+	void (* on_readable)(handle_t * handle, void * context);
+
+	/*
+	 * Called once per edge, write until EAGAIN or nothing left.
+	 * If buffered, called once first writable, connected that is, then each time queued output is written out.
+	 */
+	void (* on_writable)(handle_t * handle, void * context);
+
+	/* Called once per mark expired, with the ack it was marked with. See poller_mark(). */
+	void (* on_timeout)(handle_t * handle, void * context, int ack);
+
+	/*
+	 * Setting it makes the handle buffered: the poller reads until EAGAIN into a buffer of the handle and
+	 * calls it after each read with all bytes not consumed yet. Returns how many it consumed, the rest is
+	 * kept and passed again, in front of the next bytes read. Output goes through poller_send().
+	 */
+	size_t (* on_data)(handle_t * handle, void * context, const char * data, size_t size);
+
+	/*
+	 * Buffered only, one of these is called once when the connection ends, with the errno value for errors.
+	 * The handle stays registered until poller_del().
+	 */
+	void (* on_error)(handle_t * handle, void * context, int error);
+
+	void (* on_close)(handle_t * handle, void * context);
+
+	/*
+	 * Buffered only, with epoll: microseconds output of poller_send() may be held for, to go out with what
+	 * follows in one system call, sendmmsg() for datagrams. Held output is written out by the end of the
+	 * poller_go() it was sent from, or the start of the next one, and by the send that finds it held longer
+	 * or 64 KB of it. 0 writes at once. io_uring queues all output and sends it once per poller_go() anyway.
+	 */
+	int cork;
+};
+
+struct poller_config
+{
+	/*
+	 * POLLER_SPIN, the default, poller_go() never blocks. POLLER_BLOCK, it blocks until an event, the next
+	 * mark due or timeout. POLLER_ADAPTIVE, it spins as long as there was work in the last spin
+	 * microseconds, then blocks.
+	 */
+	int mode;
+
+	/* Most events handled by one poller_go(), 0 for the default and maximum, MAX_EVENTS (1024). */
+	int batch;
+
+	/* Longest block in milliseconds, -1 for no limit */
+	int timeout;
+
+	int spin;
+
+	/* SO_BUSY_POLL microseconds set on the sockets added from then on, 0 to leave them alone */
+	int busy_poll;
+};
+
+/* Counted by poller_go(), idle is the time blocked or finding nothing to do. */
+struct poller_stats
+{
+	unsigned long long wakeups;
+	/* Events, marks and tasks handled */
+	unsigned long long events;
+	unsigned long long idle_ns;
+	unsigned long long busy_ns;
+	/* Handles, marks, buffers and table grown by allocating from the system, see poller_reserve() */
+	unsigned long long allocations;
+	/* Writes of output, system calls with epoll, sends submitted with io_uring */
+	unsigned long long writes;
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @return NULL in case of error
+ */
+poller_t * poller_create();
+
+/**
+ * With POLLER_URING the poller runs on io_uring rather than epoll, the same API and callbacks.
+ * Buffered handles receive with multishot receives into buffers registered with the kernel, and
+ * output is sent by the kernel, with the submissions of a poller_go() batched into one system call.
+ * poller_go() reads completions without one. Falls back to epoll, where the kernel does not support
+ * io_uring or the features used, Linux 5.19.
+ * @return NULL in case of error
+ */
+poller_t * poller_create_ex(int flags);
+
+/**
+ * @return the flags in effect, without POLLER_URING after falling back to epoll
+ */
+int poller_flags(const poller_t * poller);
+
+void poller_destroy(poller_t * poller);
+
+handle_t * poller_add(const struct handle_param * param, poller_t * poller);
+
+/**
+ * Safe to call from a callback, even on the handle being dispatched.
+ * The fd is not closed.
+ */
+void poller_del(int fd, poller_t * poller);
+
+/**
+ * Handle a batch of events, a batch of tasks and the marks due, blocking first as configured.
+ */
+void poller_go(poller_t * poller);
+
+/**
+ * Have task(context) run by poller_go(), on the thread running the poller. The only function safe to call
+ * from other threads, any number of them, while it runs. Tasks run in the order submitted, and a poller
+ * blocked is woken up by one write to an eventfd of the poller, however many tasks are submitted
+ * meanwhile. Tasks not run yet when the poller is destroyed are dropped.
+ * @return 0, or -1 with errno EAGAIN when TASK_QUEUE_SIZE (4096) tasks are waiting to run already
+ */
+int poller_submit(void (* task)(void * context), void * context, poller_t * poller);
+
+/**
+ * @return 0, or -1 with errno EINVAL
+ */
+int poller_set_config(const struct poller_config * config, poller_t * poller);
+
+void poller_get_stats(struct poller_stats * stats, const poller_t * poller);
+
+/**
+ * Allocate room for handles and marks up front, at startup, so that poller_add(), poller_del() and
+ * poller_mark() allocate nothing until more are in use at once. Both are kept in pools of the poller
+ * and reused rather than freed, as are the buffers of buffered handles, up to their initial size.
+ * @return 0, or -1 with errno ENOMEM
+ */
+int poller_reserve(size_t handles, size_t marks, poller_t * poller);
+
+/**
+ * Arm a timeout identified by ack on handle, on_timeout is called once timeout milliseconds have
+ * passed, from poller_go(). Marking an armed ack again re-arms it, a negative timeout disarms it.
+ * Marks are dropped with the handle by poller_del().
+ * @return 0, or -1 with errno set
+ */
+int poller_mark(int ack, int timeout, handle_t * handle, poller_t * poller);
+
+/**
+ * Write to a buffered handle, queueing what the socket does not take at once. The queue is written out on
+ * EPOLLOUT edges, on_writable is called when it is empty again. With io_uring all of it is queued, sent from
+ * poller_go(), and on_writable is called each time it is written out.
+ * @return 0, or -1 with errno set: ENOBUFS beyond the queue limit, EPIPE once ended
+ */
+int poller_send(const void * data, size_t size, handle_t * handle);
+
+/**
+ * Write out what poller_send() queued now, output held by cork included, rather than by the end of
+ * poller_go(). With io_uring the send is submitted at once.
+ * @return 0, or -1 with errno set as for poller_send()
+ */
+int poller_flush(handle_t * handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //EXTRA_POLLER_H
@@ -0,0 +1,114 @@
+#ifndef EXTRA_REACTOR_H
+#define EXTRA_REACTOR_H
+
+#include <sys/socket.h>
+
+#include "poller.h"
+
+typedef struct reactor reactor_t;
+
+/* Policies of reactor_config */
+#define REACTOR_ROUND_ROBIN 0
+#define REACTOR_HASH 1
+#define REACTOR_REUSEPORT 2
+
+/* Called on the thread of the loop a connection goes to, which adds it to poller or closes it. */
+typedef void (* reactor_accept_t)(int fd, poller_t * poller, void * context);
+
+struct reactor_config
+{
+	/* Loops, each a poller run by a thread of its own */
+	int loops;
+
+	/* CPU each loop is pinned to, NULL for none */
+	const int * cpus;
+
+	/* Of poller_create_ex() */
+	int flags;
+
+	/*
+	 * Of each poller, as by poller_set_config(). POLLER_SPIN, the default, takes a core per loop, and so do
+	 * the other modes with timeout 0: -1 lets them block as long as there is nothing to do.
+	 */
+	struct poller_config poller;
+
+	/*
+	 * How connections are spread over the loops. REACTOR_ROUND_ROBIN, or REACTOR_HASH of the peer address,
+	 * by reactor_dispatch(), with listeners on the first loop. REACTOR_REUSEPORT, a listener per loop bound
+	 * with SO_REUSEPORT and the kernel spreading connections by their addresses, reactor_dispatch() round-robin.
+	 */
+	int policy;
+
+	/* Unless NULL, reactor_dispatch() goes to the loop it returns instead, from 0 to loops - 1 */
+	int (* pick)(int fd, void * context);
+
+	/* Called on the thread of each loop once started and before it ends, to set up and close what it owns */
+	void (* on_start)(int loop, poller_t * poller, void * context);
+	void (* on_stop)(int loop, poller_t * poller, void * context);
+
+	void * context;
+};
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Group of pollers run each by a thread of its own, created stopped.
+ * @return NULL in case of error
+ */
+reactor_t * reactor_create(const struct reactor_config * config);
+
+/**
+ * Listen on address, before reactor_start(), handing connections accepted to on_accept as the policy has
+ * it. Address is updated to the one bound, with the port picked for port 0.
+ * @return 0, or -1 with errno set
+ */
+int reactor_listen(struct sockaddr * address, socklen_t length, reactor_accept_t on_accept, void * context,
+	reactor_t * reactor);
+
+/**
+ * @return 0, or -1 with errno set, the loops started stopped again
+ */
+int reactor_start(reactor_t * reactor);
+
+/**
+ * Stop the loops, each calling on_stop on its thread, and destroy the pollers. Not from a loop.
+ * Descriptors of the handles are not closed, but those of the listeners, and those dispatched or migrated
+ * to a loop that stopped before calling on_accept for them.
+ */
+void reactor_destroy(reactor_t * reactor);
+
+int reactor_loops(const reactor_t * reactor);
+
+poller_t * reactor_poller(int loop, const reactor_t * reactor);
+
+/**
+ * @return the loop of the calling thread, -1 for none
+ */
+int reactor_current(const reactor_t * reactor);
+
+/**
+ * Hand fd to the loop the policy picks, on_accept called on its thread, at once if it is the calling one.
+ * From any thread once started.
+ * @return the loop, or -1 with errno set, EAGAIN for too many tasks submitted to it already
+ */
+int reactor_dispatch(int fd, reactor_accept_t on_accept, void * context, reactor_t * reactor);
+
+/**
+ * Move fd from the loop of the calling thread to loop, to balance load: it is deleted from the poller
+ * of the calling thread, then on_arrive is called on the thread of loop to add it again. Marks, input not
+ * consumed and output not written out yet of a buffered handle stay behind, so move it between messages.
+ * Nothing is done for the loop of the calling thread.
+ * @return 0, or -1 with errno set: EINVAL from a thread not a loop, EAGAIN as for reactor_dispatch(), on_arrive
+ * then called at once for the loop of the calling thread
+ */
+int reactor_migrate(int fd, int loop, reactor_accept_t on_arrive, void * context, reactor_t * reactor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //EXTRA_REACTOR_H
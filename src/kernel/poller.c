@@ -1,136 +1,2038 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 
 #include <errno.h>
 #include <malloc.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define HAVE_URING 1
+#endif
+
 #include "poller.h"
 #include "list.h"
 #include "rbtree.h"
 
-#ifndef MAX_FD
-#define MAX_FD 1024
+/* Initial size of the table of handles, indexed by fd and grown to the highest one added. */
+#ifndef HANDLE_TABLE_SIZE
+#define HANDLE_TABLE_SIZE 1024
+#endif
+
+#ifndef MAX_EVENTS
+#define MAX_EVENTS 1024
+#endif
+
+/* Most tasks submitted and not run yet, a power of 2. See poller_submit(). */
+#ifndef TASK_QUEUE_SIZE
+#define TASK_QUEUE_SIZE 4096
+#endif
+
+/* Objects of a chunk a slab allocates once it runs out. See struct slab. */
+#ifndef SLAB_CHUNK
+#define SLAB_CHUNK 64
+#endif
+
+/* Initial size of the buffers of buffered handles, and the least room read into. */
+#ifndef BUFFER_SIZE
+#define BUFFER_SIZE 65536
+#endif
+
+/* A message not consumed or output queued beyond this ends the connection. */
+#ifndef MAX_BUFFER_SIZE
+#define MAX_BUFFER_SIZE (16 * 1024 * 1024)
+#endif
+
+/* Most datagrams of a handle written by one sendmmsg(). */
+#ifndef SEND_BATCH
+#define SEND_BATCH 64
+#endif
+
+/*
+ * Marks are kept in a hierarchical timing wheel of millisecond ticks: WHEEL_LEVELS levels of
+ * WHEEL_SIZE slots, each slot of a level spanning a whole turn of the level below. Marks further
+ * than the wheel spans, about 4.6 hours by default, or all of them with TIMER_WHEEL 0, are kept
+ * ordered by expiry in a tree of the poller instead.
+ */
+#ifndef TIMER_WHEEL
+#define TIMER_WHEEL 1
 #endif
 
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+
+/*
+ * Pool of objects of one size, handles or pieces, carved out of cache-line aligned chunks and recycled
+ * through an intrusive free list, so that adds, deletes and marks allocate nothing once the pool has
+ * grown to the most in use at once. Chunks are freed with the poller only.
+ */
+struct slab
+{
+	size_t size;
+	struct slist_head free;
+	size_t available;
+	struct slist_head chunks;
+	size_t chunk_count;
+};
+
+/* Ready to run once seq is its position in the queue + 1, free for the position seq. */
+struct task
+{
+	size_t seq;
+	void (* run)(void * context);
+	void * context;
+};
+
+/*
+ * Bounded multi-producer single-consumer queue of tasks. A producer claims the cell at tail by
+ * compare-and-swap, fills it and publishes it through its seq; the loop runs cells from head in order
+ * and hands each back to the producers of the next turn. Fields of each side in cache lines of their own.
+ */
+struct tasks
+{
+	size_t tail __attribute__((aligned(64)));
+	/* Set by the loop before it may block, cleared by the producer that wakes it up */
+	int sleeping __attribute__((aligned(64)));
+	size_t head __attribute__((aligned(64)));
+	int fd;
+	struct task cells[TASK_QUEUE_SIZE];
+};
+
+struct buffer
+{
+	char * data;
+	size_t begin;
+	size_t end;
+	size_t capacity;
+};
+
 struct piece
 {
 	int seq;
-	struct timespec timeout;
+	/* Of the wheel, -1 in the tree */
+	int level;
+	/* Tick of CLOCK_MONOTONIC, in milliseconds, from which it is due */
+	uint64_t expires;
+	struct handle * handle;
 	struct rb_node in_handle;
-	struct rb_node in_poller;
+	union
+	{
+		struct list_head in_slot;
+		struct rb_node in_poller;
+	};
 };
 
+/* What dispatching an event reads comes first, in one cache line with the callbacks it calls. */
 struct handle
 {
+	/* Of the add, tells events of the handle from those of one deleted before with the same fd */
+	unsigned generation;
+	int deleted;
+	int closed;
+	/* Buffered and waiting for EPOLLOUT, to call on_writable once written out. */
+	int blocked;
 	struct handle_param data;
+	struct poller * poller;
+	struct buffer input;
+	struct buffer output;
 	struct rb_root pieces;
-	struct rb_node in_poller;
+	struct list_head dead;
+	/* io_uring only: output handed to the kernel, left alone until the send completes */
+	struct buffer sending;
+	/* In the flushing list of the poller, with epoll for output held by cork */
+	struct list_head flush;
+	int flushing;
+	/* Of SOCK_DGRAM, with the lengths of the datagrams queued as uint32_t, to write them one by one */
+	int datagram;
+	struct buffer lengths;
+	/* Nanoseconds of CLOCK_MONOTONIC the output held was first queued at */
+	uint64_t corked_at;
+	/* io_uring only: operations not completed yet, the handle is freed once none are left */
+	int inflight;
+	/* io_uring only: first writable, connected that is */
+	int ready;
+	/* io_uring only: in the table of registered files */
+	int fixed;
 };
 
+_Static_assert(offsetof(struct handle, data.on_data) + sizeof(void *) <= 64, "hot fields beyond a cache line");
+
+struct uring;
+
 struct poller
 {
 	int pfd;
-	struct rb_root handles;
+	/* Instead of pfd, unless NULL */
+	struct uring * uring;
+	/* Handles with output queued, to be sent with io_uring, held by cork with epoll */
+	struct list_head flushing;
+	/* Indexed by fd */
+	struct handle ** handles;
+	size_t handle_capacity;
+	unsigned generation;
+	struct slab handle_slab;
+	struct slab piece_slab;
+	struct tasks * tasks;
+	/* Marks beyond the wheel */
 	struct rb_root pieces;
+	struct list_head dead_handles;
+	/* Next tick the wheel runs */
+	uint64_t clock;
+	size_t wheel_count;
+	/* Above level 0 */
+	size_t upper_count;
+	struct list_head wheel[WHEEL_LEVELS][WHEEL_SIZE];
+	struct poller_config config;
+	struct poller_stats stats;
+	/* Nanoseconds of CLOCK_MONOTONIC the last poller_go() with work ended at */
+	uint64_t last_work;
 };
 
 
-static struct handle * handle_create(const struct handle_param * param)
+static void slab_init(size_t size, struct slab * slab)
 {
-	struct handle * handle;
+	slab->size = (size + 63) & ~(size_t) 63;
+	INIT_SLIST_HEAD(&slab->free);
+	slab->available = 0;
+	INIT_SLIST_HEAD(&slab->chunks);
+	slab->chunk_count = 0;
+}
+
+/* Adds count zeroed objects to the free list, in a chunk led by a cache line of its own. */
+static int slab_grow(size_t count, struct slab * slab)
+{
+	char * chunk;
+	size_t i;
 
-	if ((unsigned) param->fd > MAX_FD)
+	if (count > (SIZE_MAX - 64) / slab->size || posix_memalign((void **) &chunk, 64, 64 + count * slab->size) != 0)
 	{
-		errno = param->fd < 0 ? EBADF : EMFILE;
+		errno = ENOMEM;
+		return -1;
+	}
+
+	memset(chunk, 0, 64 + count * slab->size);
+	slist_add_head((struct slist_node *) chunk, &slab->chunks);
+	slab->chunk_count++;
+	for (i = count; i > 0; i--)
+		slist_add_head((struct slist_node *) (chunk + 64 + (i - 1) * slab->size), &slab->free);
+	slab->available += count;
+	return 0;
+}
+
+/* Objects come back as they were freed, but for their first bytes, the link of the free list. */
+static void * slab_alloc(struct slab * slab)
+{
+	struct slist_node * object;
+
+	if (slist_empty(&slab->free) && slab_grow(SLAB_CHUNK, slab) != 0)
 		return NULL;
+
+	object = slab->free.first.next;
+	slist_del_head(&slab->free);
+	slab->available--;
+	return object;
+}
+
+static void slab_free(void * object, struct slab * slab)
+{
+	slist_add_head((struct slist_node *) object, &slab->free);
+	slab->available++;
+}
+
+static void slab_destroy(struct slab * slab)
+{
+	struct slist_node * chunk;
+
+	while (!slist_empty(&slab->chunks))
+	{
+		chunk = slab->chunks.first.next;
+		slist_del_head(&slab->chunks);
+		free(chunk);
+	}
+}
+
+/* Emptied, and kept for the next handle of the slab unless grown beyond the initial size. */
+static void buffer_release(struct buffer * buffer)
+{
+	if (buffer->capacity > BUFFER_SIZE)
+	{
+		free(buffer->data);
+		buffer->data = NULL;
+		buffer->capacity = 0;
 	}
+	buffer->begin = 0;
+	buffer->end = 0;
+}
 
-	handle = (struct handle *) malloc(sizeof(struct handle));
-	if (handle)
+static struct handle * handle_create(const struct handle_param * param, struct poller * poller)
+{
+	struct handle * handle;
+
+	if (param->fd < 0)
 	{
-		handle->data = *param;
-		// TODO: list, timeout
+		errno = EBADF;
+		return NULL;
 	}
+
+	handle = (struct handle *) slab_alloc(&poller->handle_slab);
+	if (!handle)
+		return NULL;
+
+	/* The buffers are those left by the last handle in the slab, if any, empty */
+	handle->generation = ++poller->generation;
+	handle->data = *param;
+	handle->pieces = RB_ROOT;
+	handle->deleted = 0;
+	handle->closed = 0;
+	handle->blocked = 1;
+	handle->poller = poller;
+	handle->flushing = 0;
+	handle->datagram = 0;
+	handle->inflight = 0;
+	handle->ready = 0;
+	handle->fixed = 0;
 	return handle;
 }
 
 static void handle_destroy(struct handle * handle)
 {
-	free(handle);
-	// TODO: list
+	buffer_release(&handle->input);
+	buffer_release(&handle->output);
+	buffer_release(&handle->sending);
+	buffer_release(&handle->lengths);
+	slab_free(handle, &handle->poller->handle_slab);
 }
 
-static void handle_read(struct handle * handle)
+/* So that fd indexes the table */
+static int handle_table_grow(size_t fd, struct poller * poller)
 {
-	// TODO
+	size_t capacity = poller->handle_capacity;
+	struct handle ** handles;
+
+	if (fd < capacity)
+		return 0;
+
+	while (capacity <= fd)
+		capacity *= 2;
+
+	poller->stats.allocations++;
+	handles = (struct handle **) realloc(poller->handles, capacity * sizeof(struct handle *));
+	if (!handles)
+		return -1;
+
+	memset(handles + poller->handle_capacity, 0, (capacity - poller->handle_capacity) * sizeof(struct handle *));
+	poller->handles = handles;
+	poller->handle_capacity = capacity;
+	return 0;
 }
 
-static void handle_write(struct handle * handle)
+static struct handle * handle_find(int fd, struct poller * poller)
 {
-	// TODO
+	return fd >= 0 && (size_t) fd < poller->handle_capacity ? poller->handles[fd] : NULL;
 }
 
-poller_t * poller_create()
+static int handle_insert(struct handle * handle, struct poller * poller)
 {
-	struct poller * poller = (struct poller *) malloc(sizeof(struct poller));
-	if (poller)
+	size_t fd = (size_t) handle->data.fd;
+
+	if (handle_table_grow(fd, poller) != 0)
+		return -1;
+
+	if (poller->handles[fd])
 	{
-		poller->pfd = epoll_create(1);
-		if (poller->pfd >= 0)
-			return poller;
+		errno = EEXIST;
+		return -1;
+	}
 
-		free(poller);
+	poller->handles[fd] = handle;
+	return 0;
+}
+
+static void handle_remove(struct handle * handle, struct poller * poller)
+{
+	poller->handles[handle->data.fd] = NULL;
+}
+
+static uint64_t monotonic_ns()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t monotonic_tick()
+{
+	return monotonic_ns() / 1000000;
+}
+
+static struct piece * piece_find(int seq, struct handle * handle)
+{
+	struct rb_node * p = handle->pieces.rb_node;
+	struct piece * piece;
+
+	while (p)
+	{
+		piece = rb_entry(p, struct piece, in_handle);
+		if (seq < piece->seq)
+			p = p->rb_left;
+		else if (seq > piece->seq)
+			p = p->rb_right;
+		else
+			return piece;
 	}
-	return poller;
+	return NULL;
 }
 
-void poller_destroy(poller_t * poller)
+static void piece_insert_handle(struct piece * piece, struct handle * handle)
 {
-	close(poller->pfd);
-	free(poller);
+	struct rb_node ** p = &handle->pieces.rb_node;
+	struct rb_node * parent = NULL;
+
+	while (*p)
+	{
+		parent = *p;
+		if (piece->seq < rb_entry(parent, struct piece, in_handle)->seq)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&piece->in_handle, parent, p);
+	rb_insert_color(&piece->in_handle, &handle->pieces);
 }
 
+/* Ordered by expiry, equal ones in order of marking. */
+static void piece_insert_poller(struct piece * piece, struct poller * poller)
+{
+	struct rb_node ** p = &poller->pieces.rb_node;
+	struct rb_node * parent = NULL;
 
-handle_t * poller_add(const struct handle_param * param, poller_t * poller)
+	while (*p)
+	{
+		parent = *p;
+		if (piece->expires < rb_entry(parent, struct piece, in_poller)->expires)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&piece->in_poller, parent, p);
+	rb_insert_color(&piece->in_poller, &poller->pieces);
+}
+
+/* Into the slot of the lowest level whose turn reaches its expiry, counted from the clock of the wheel. */
+static void piece_schedule(struct piece * piece, struct poller * poller)
 {
-	struct epoll_event event;
-	struct handle * handle;
+	uint64_t expires = piece->expires > poller->clock ? piece->expires : poller->clock;
+	uint64_t delta = expires - poller->clock;
+	int level = 0;
 
-	handle = handle_create(param);
-	if (handle)
+	while (level < WHEEL_LEVELS && delta >= (uint64_t) 1 << (WHEEL_BITS * (level + 1)))
+		level++;
+
+	if (!TIMER_WHEEL || level == WHEEL_LEVELS)
 	{
-		event.events = EPOLLIN | EPOLLOUT | EPOLLET;
-		event.data.ptr = handle;
+		piece->level = -1;
+		piece_insert_poller(piece, poller);
+		return;
+	}
 
-		if (!epoll_ctl(poller->pfd, EPOLL_CTL_ADD, handle->data.fd, &event))
-			return handle;
+	piece->level = level;
+	list_add_tail(&piece->in_slot, &poller->wheel[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK]);
+	poller->wheel_count++;
+	if (level > 0)
+		poller->upper_count++;
+}
 
-		handle_destroy(handle);
+static void piece_unschedule(struct piece * piece, struct poller * poller)
+{
+	if (piece->level >= 0)
+	{
+		list_del(&piece->in_slot);
+		poller->wheel_count--;
+		if (piece->level > 0)
+			poller->upper_count--;
 	}
-	return NULL;
+	else
+		rb_erase(&piece->in_poller, &poller->pieces);
 }
 
-#ifndef MAX_EVENTS
-#define MAX_EVENTS 1024
-#endif
+static void piece_remove(struct piece * piece, struct poller * poller)
+{
+	rb_erase(&piece->in_handle, &piece->handle->pieces);
+	piece_unschedule(piece, poller);
+	slab_free(piece, &poller->piece_slab);
+}
 
-void poller_go(poller_t * poller)
+static void handle_unmark(struct handle * handle, struct poller * poller)
 {
-	struct epoll_event events[MAX_EVENTS];
-	struct handle * handle;
-	uint32_t event_type;
-	int event_count;
+	struct rb_node * p;
+
+	while ((p = rb_first(&handle->pieces)) != NULL)
+		piece_remove(rb_entry(p, struct piece, in_handle), poller);
+}
+
+/* Make room for size more bytes after end, moving the pending bytes to the front first. */
+static int buffer_reserve(struct buffer * buffer, size_t size, struct poller * poller)
+{
+	size_t pending = buffer->end - buffer->begin;
+	size_t capacity;
+	char * data;
+
+	if (buffer->capacity - buffer->end >= size)
+		return 0;
+
+	if (buffer->begin > 0)
+	{
+		memmove(buffer->data, buffer->data + buffer->begin, pending);
+		buffer->begin = 0;
+		buffer->end = pending;
+		if (buffer->capacity - buffer->end >= size)
+			return 0;
+	}
+
+	capacity = buffer->capacity ? buffer->capacity : BUFFER_SIZE;
+	while (capacity - pending < size)
+		capacity *= 2;
+	if (capacity > MAX_BUFFER_SIZE)
+	{
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	poller->stats.allocations++;
+	data = (char *) realloc(buffer->data, capacity);
+	if (!data)
+		return -1;
+
+	buffer->data = data;
+	buffer->capacity = capacity;
+	return 0;
+}
+
+static void uring_cancel(struct handle * handle);
+
+static void handle_end(struct handle * handle, int error)
+{
+	if (handle->closed)
+		return;
+
+	handle->closed = 1;
+	uring_cancel(handle);
+	if (error == 0 && handle->data.on_close)
+		handle->data.on_close(handle, handle->data.context);
+	else if (error != 0 && handle->data.on_error)
+		handle->data.on_error(handle, handle->data.context, error);
+}
+
+static void handle_receive(struct handle * handle)
+{
+	struct buffer * input = &handle->input;
+	size_t consumed;
+	ssize_t n;
+
+	while (!handle->deleted && !handle->closed)
+	{
+		if (buffer_reserve(input, BUFFER_SIZE / 4, handle->poller) != 0)
+		{
+			handle_end(handle, errno == ENOBUFS ? EMSGSIZE : errno);
+			return;
+		}
+
+		n = read(handle->data.fd, input->data + input->end, input->capacity - input->end);
+		if (n > 0)
+		{
+			input->end += n;
+			consumed = handle->data.on_data(handle, handle->data.context, input->data + input->begin,
+				input->end - input->begin);
+			input->begin += consumed < input->end - input->begin ? consumed : input->end - input->begin;
+			if (input->begin == input->end)
+				input->begin = input->end = 0;
+		}
+		else if (n == 0)
+			handle_end(handle, 0);
+		else if (errno == EINTR)
+			continue;
+		else if (errno == EAGAIN)
+			return;
+		else
+			handle_end(handle, errno);
+	}
+}
+
+/* Append to the output, as one more datagram for SOCK_DGRAM. */
+static int handle_queue(const void * data, size_t size, struct handle * handle)
+{
+	struct buffer * output = &handle->output;
+	struct buffer * lengths = &handle->lengths;
+	uint32_t length = (uint32_t) size;
+
+	if (buffer_reserve(output, size, handle->poller) != 0
+		|| (handle->datagram && buffer_reserve(lengths, sizeof(length), handle->poller) != 0))
+		return -1;
+
+	memcpy(output->data + output->end, data, size);
+	output->end += size;
+	if (handle->datagram)
+	{
+		memcpy(lengths->data + lengths->end, &length, sizeof(length));
+		lengths->end += sizeof(length);
+	}
+	return 0;
+}
+
+/* Datagrams queued go SEND_BATCH at a time, pointed at where they are in the output. */
+static int handle_flush_datagrams(struct handle * handle)
+{
+	struct buffer * output = &handle->output;
+	struct buffer * lengths = &handle->lengths;
+	struct mmsghdr messages[SEND_BATCH];
+	struct iovec iov[SEND_BATCH];
+	size_t offset;
+	uint32_t length;
+	int count;
 	int i;
+	int n;
 
-	event_count = epoll_wait(poller->pfd, events, MAX_EVENTS, 0);
-	for (i = 0; i < event_count; i++)
+	while (lengths->begin < lengths->end)
 	{
-		event_type = events[i].events;
-		handle = (struct handle *) events[i].data.ptr;
-		if ((event_type & EPOLLOUT) == EPOLLOUT)
-			handle_write(handle);
+		offset = output->begin;
+		memset(messages, 0, sizeof(messages));
+		for (count = 0; count < SEND_BATCH && lengths->begin + count * sizeof(length) < lengths->end; count++)
+		{
+			memcpy(&length, lengths->data + lengths->begin + count * sizeof(length), sizeof(length));
+			iov[count].iov_base = output->data + offset;
+			iov[count].iov_len = length;
+			messages[count].msg_hdr.msg_iov = &iov[count];
+			messages[count].msg_hdr.msg_iovlen = 1;
+			offset += length;
+		}
 
-		if ((event_type & EPOLLIN) == EPOLLIN)
-			handle_read(handle);
+		/* A lone datagram, as it would have been sent at once */
+		if (count == 1)
+			n = send(handle->data.fd, iov[0].iov_base, iov[0].iov_len, MSG_NOSIGNAL | MSG_DONTWAIT) < 0 ? -1 : 1;
+		else
+			n = sendmmsg(handle->data.fd, messages, (unsigned) count, MSG_NOSIGNAL | MSG_DONTWAIT);
+		handle->poller->stats.writes++;
+		if (n > 0)
+		{
+			for (i = 0; i < n; i++)
+				output->begin += iov[i].iov_len;
+			lengths->begin += n * sizeof(length);
+		}
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && errno == EAGAIN)
+			return 1;
+		else
+			return -1;
+	}
+
+	output->begin = output->end = 0;
+	lengths->begin = lengths->end = 0;
+	return 0;
+}
+
+/* @return 0 once written out, 1 if waiting for EPOLLOUT, -1 with errno set on error */
+static int handle_flush(struct handle * handle)
+{
+	struct buffer * output = &handle->output;
+	ssize_t n;
+
+	if (handle->datagram)
+		return handle_flush_datagrams(handle);
+
+	/* Queued output is contiguous, one send() for all of it, the part not taken left in place */
+	while (output->begin < output->end)
+	{
+		n = send(handle->data.fd, output->data + output->begin, output->end - output->begin,
+			MSG_NOSIGNAL | MSG_DONTWAIT);
+		handle->poller->stats.writes++;
+		if (n > 0)
+			output->begin += n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && errno == EAGAIN)
+			return 1;
+		else
+			return -1;
+	}
+
+	output->begin = output->end = 0;
+	return 0;
+}
+
+/* Write out the output held by cork. @return as handle_flush(), the handle blocked for 1 */
+static int handle_uncork(struct handle * handle)
+{
+	int result;
+
+	if (handle->flushing)
+	{
+		list_del(&handle->flush);
+		handle->flushing = 0;
+	}
+
+	if (handle->blocked || handle->closed)
+		return 0;
+
+	result = handle_flush(handle);
+	if (result > 0)
+		handle->blocked = 1;
+	return result;
+}
+
+static void handle_read(struct handle * handle)
+{
+	if (handle->data.on_data)
+		handle_receive(handle);
+	else if (handle->data.on_readable)
+		handle->data.on_readable(handle, handle->data.context);
+}
+
+static void handle_write(struct handle * handle)
+{
+	int result;
+
+	if (!handle->data.on_data)
+	{
+		if (handle->data.on_writable)
+			handle->data.on_writable(handle, handle->data.context);
+		return;
+	}
+
+	if (handle->closed || !handle->blocked)
+		return;
+
+	result = handle_flush(handle);
+	if (result < 0)
+		handle_end(handle, errno);
+	else if (result == 0)
+	{
+		handle->blocked = 0;
+		if (handle->data.on_writable)
+			handle->data.on_writable(handle, handle->data.context);
+	}
+}
+
+static void handle_timeout(struct handle * handle, int ack)
+{
+	if (handle->data.on_timeout)
+		handle->data.on_timeout(handle, handle->data.context, ack);
+}
+
+/* Handles deleted during dispatching are freed after the whole batch, so later events of the batch stay valid. */
+static void poller_reap(struct poller * poller)
+{
+	struct list_head * pos;
+	struct list_head * next;
+	struct handle * handle;
+
+	list_for_each_safe(pos, next, &poller->dead_handles)
+	{
+		handle = list_entry(pos, struct handle, dead);
+		/* With io_uring, not before the kernel is done with its buffers */
+		if (handle->inflight == 0)
+		{
+			list_del(&handle->dead);
+			handle_destroy(handle);
+		}
+	}
+}
+
+#ifdef HAVE_URING
+
+/*
+ * Submission queue entries. The completion queue has sixteen times as many, so that a wave of receives
+ * across thousands of handles does not overflow it.
+ */
+#ifndef URING_ENTRIES
+#define URING_ENTRIES 1024
+#endif
+
+/* Most registered files, descriptors above are used as they are. */
+#ifndef URING_FILES
+#define URING_FILES 65536
+#endif
+
+/* Buffers the kernel picks from for multishot receives, a power of 2. */
+#ifndef URING_BUFFER_COUNT
+#define URING_BUFFER_COUNT 256
+#endif
+
+#ifndef URING_BUFFER_SIZE
+#define URING_BUFFER_SIZE 16384
+#endif
+
+#define URING_BUFFER_GROUP 0
+
+/* Operations of a handle, in the low bits of the user data of their entries */
+enum
+{
+	URING_POLL = 0,
+	URING_CONNECT = 1,
+	URING_RECV = 2,
+	URING_SEND = 3,
+	URING_OPS = 4
+};
+
+struct uring
+{
+	int fd;
+	/* Slot fd of the table of registered files holds fd, for fd below */
+	unsigned files;
+	unsigned sq_entries;
+	unsigned sq_mask;
+	unsigned sq_tail;
+	unsigned * sq_head_shared;
+	unsigned * sq_tail_shared;
+	unsigned * sq_flags;
+	struct io_uring_sqe * sqes;
+	unsigned cq_mask;
+	unsigned * cq_head;
+	unsigned * cq_tail;
+	struct io_uring_cqe * cqes;
+	void * rings;
+	size_t rings_size;
+	size_t sqes_size;
+	/* Provided buffers, registered as a ring of group URING_BUFFER_GROUP */
+	struct io_uring_buf_ring * buffers;
+	char * buffer_data;
+	uint16_t buffer_tail;
+};
+
+static int uring_register(struct uring * ring, unsigned opcode, const void * arg, unsigned count)
+{
+	return (int) syscall(__NR_io_uring_register, ring->fd, opcode, arg, count);
+}
+
+static int uring_enter(struct uring * ring, unsigned submit, unsigned flags)
+{
+	return (int) syscall(__NR_io_uring_enter, ring->fd, submit, 0, flags, NULL, 0);
+}
+
+static void uring_destroy(struct uring * ring)
+{
+	if (ring->buffers)
+		munmap(ring->buffers, URING_BUFFER_COUNT * sizeof(struct io_uring_buf));
+	free(ring->buffer_data);
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->rings)
+		munmap(ring->rings, ring->rings_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+	free(ring);
+}
+
+static void uring_recycle(uint16_t bid, struct uring * ring)
+{
+	struct io_uring_buf * buf = &ring->buffers->bufs[ring->buffer_tail & (URING_BUFFER_COUNT - 1)];
+
+	buf->addr = (uint64_t) (uintptr_t) (ring->buffer_data + (size_t) bid * URING_BUFFER_SIZE);
+	buf->len = URING_BUFFER_SIZE;
+	buf->bid = bid;
+	__atomic_store_n(&ring->buffers->tail, ++ring->buffer_tail, __ATOMIC_RELEASE);
+}
+
+/*
+ * Needs single mmap rings, fast poll, a sparse table of registered files and provided buffer rings,
+ * Linux 5.19 that is. Anything missing and the poller uses epoll.
+ */
+static struct uring * uring_create()
+{
+	struct io_uring_params params;
+	struct io_uring_buf_reg reg;
+	struct io_uring_rsrc_register files;
+	struct uring * ring;
+	struct rlimit limit;
+	size_t sq_size;
+	size_t cq_size;
+	unsigned i;
+
+	ring = (struct uring *) calloc(1, sizeof(struct uring));
+	if (!ring)
+		return NULL;
+
+	memset(&params, 0, sizeof(params));
+	/* Completions are posted when the poller enters the kernel next, instead of interrupting it */
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG;
+	params.cq_entries = URING_ENTRIES * 16;
+	ring->fd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+	if (ring->fd < 0 || (params.features & (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL
+		| IORING_FEAT_EXT_ARG)) != (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL
+		| IORING_FEAT_EXT_ARG))
+		goto fail;
+
+	sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+	ring->rings = mmap(NULL, ring->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+		IORING_OFF_SQ_RING);
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe *) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->rings == MAP_FAILED || ring->sqes == MAP_FAILED)
+	{
+		ring->rings = ring->rings == MAP_FAILED ? NULL : ring->rings;
+		ring->sqes = ring->sqes == MAP_FAILED ? NULL : ring->sqes;
+		goto fail;
 	}
+
+	ring->sq_entries = params.sq_entries;
+	ring->sq_mask = *(unsigned *) ((char *) ring->rings + params.sq_off.ring_mask);
+	ring->sq_head_shared = (unsigned *) ((char *) ring->rings + params.sq_off.head);
+	ring->sq_tail_shared = (unsigned *) ((char *) ring->rings + params.sq_off.tail);
+	ring->sq_flags = (unsigned *) ((char *) ring->rings + params.sq_off.flags);
+	ring->sq_tail = *ring->sq_tail_shared;
+	for (i = 0; i < params.sq_entries; i++)
+		((unsigned *) ((char *) ring->rings + params.sq_off.array))[i] = i;
+	ring->cq_mask = *(unsigned *) ((char *) ring->rings + params.cq_off.ring_mask);
+	ring->cq_head = (unsigned *) ((char *) ring->rings + params.cq_off.head);
+	ring->cq_tail = (unsigned *) ((char *) ring->rings + params.cq_off.tail);
+	ring->cqes = (struct io_uring_cqe *) ((char *) ring->rings + params.cq_off.cqes);
+
+	/* The kernel takes no more than the limit of descriptors */
+	ring->files = URING_FILES;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < ring->files)
+		ring->files = (unsigned) limit.rlim_cur;
+
+	memset(&files, 0, sizeof(files));
+	files.nr = ring->files;
+	files.flags = IORING_RSRC_REGISTER_SPARSE;
+	if (uring_register(ring, IORING_REGISTER_FILES2, &files, sizeof(files)) != 0)
+		goto fail;
+
+	ring->buffers = (struct io_uring_buf_ring *) mmap(NULL, URING_BUFFER_COUNT * sizeof(struct io_uring_buf),
+		PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ring->buffer_data = (char *) malloc((size_t) URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+	if (ring->buffers == MAP_FAILED || !ring->buffer_data)
+	{
+		ring->buffers = ring->buffers == MAP_FAILED ? NULL : ring->buffers;
+		goto fail;
+	}
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t) (uintptr_t) ring->buffers;
+	reg.ring_entries = URING_BUFFER_COUNT;
+	reg.bgid = URING_BUFFER_GROUP;
+	if (uring_register(ring, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+		goto fail;
+
+	for (i = 0; i < URING_BUFFER_COUNT; i++)
+		uring_recycle((uint16_t) i, ring);
+	return ring;
+
+fail:
+	uring_destroy(ring);
+	return NULL;
+}
+
+/* Submits the queue when full. @return NULL if still full */
+static struct io_uring_sqe * uring_sqe(struct uring * ring)
+{
+	struct io_uring_sqe * sqe;
+
+	if (ring->sq_tail - __atomic_load_n(ring->sq_head_shared, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+	{
+		__atomic_store_n(ring->sq_tail_shared, ring->sq_tail, __ATOMIC_RELEASE);
+		uring_enter(ring, ring->sq_entries, 0);
+		if (ring->sq_tail - __atomic_load_n(ring->sq_head_shared, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+			return NULL;
+	}
+
+	sqe = &ring->sqes[ring->sq_tail++ & ring->sq_mask];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	return sqe;
+}
+
+/* One system call for all entries queued since the last one, none if there are none. */
+static void uring_submit(struct uring * ring)
+{
+	unsigned pending;
+
+	__atomic_store_n(ring->sq_tail_shared, ring->sq_tail, __ATOMIC_RELEASE);
+	pending = ring->sq_tail - __atomic_load_n(ring->sq_head_shared, __ATOMIC_ACQUIRE);
+	if (pending > 0 || (__atomic_load_n(ring->sq_flags, __ATOMIC_RELAXED) & (IORING_SQ_CQ_OVERFLOW | IORING_SQ_TASKRUN)))
+		uring_enter(ring, pending, IORING_ENTER_GETEVENTS);
+}
+
+/* Submits, then waits for a completion at most timeout milliseconds, -1 for no limit. */
+static void uring_wait(struct uring * ring, int timeout)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned pending;
+
+	if (*ring->cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return;
+
+	__atomic_store_n(ring->sq_tail_shared, ring->sq_tail, __ATOMIC_RELEASE);
+	pending = ring->sq_tail - __atomic_load_n(ring->sq_head_shared, __ATOMIC_ACQUIRE);
+	memset(&arg, 0, sizeof(arg));
+	if (timeout >= 0)
+	{
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (long long) (timeout % 1000) * 1000000;
+		arg.ts = (uint64_t) (uintptr_t) &ts;
+	}
+	syscall(__NR_io_uring_enter, ring->fd, pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+		sizeof(arg));
+}
+
+static int uring_arm(int op, struct handle * handle)
+{
+	struct uring * ring = handle->poller->uring;
+	struct io_uring_sqe * sqe = uring_sqe(ring);
+	uint32_t events;
+
+	if (!sqe)
+	{
+		errno = EBUSY;
+		return -1;
+	}
+
+	sqe->fd = handle->data.fd;
+	sqe->flags = handle->fixed ? IOSQE_FIXED_FILE : 0;
+	sqe->user_data = (uint64_t) (uintptr_t) handle | op;
+	switch (op)
+	{
+	case URING_POLL:
+	case URING_CONNECT:
+		/* Multishot polls are edge triggered */
+		events = op == URING_POLL ? EPOLLIN | EPOLLOUT : EPOLLOUT;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		events = (events << 16) | (events >> 16);
+#endif
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = events;
+		sqe->len = op == URING_POLL ? IORING_POLL_ADD_MULTI : 0;
+		break;
+	case URING_RECV:
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags |= IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BUFFER_GROUP;
+		break;
+	default:
+		sqe->opcode = IORING_OP_SEND;
+		sqe->addr = (uint64_t) (uintptr_t) (handle->sending.data + handle->sending.begin);
+		sqe->len = (uint32_t) (handle->sending.end - handle->sending.begin);
+		sqe->msg_flags = MSG_NOSIGNAL;
+		handle->poller->stats.writes++;
+		break;
+	}
+
+	handle->inflight++;
+	return 0;
+}
+
+static void uring_cancel(struct handle * handle)
+{
+	struct io_uring_sqe * sqe;
+	int op;
+
+	if (!handle->poller->uring || handle->inflight == 0)
+		return;
+
+	for (op = 0; op < URING_OPS; op++)
+	{
+		sqe = uring_sqe(handle->poller->uring);
+		if (!sqe)
+			return;
+
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = (uint64_t) (uintptr_t) handle | op;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+	}
+}
+
+/*
+ * Sets slot fd of the table of registered files, read from *value when submitted. Submitted with the
+ * entries after it, rather than with a system call of its own.
+ */
+static int uring_update(int fd, const int * value, unsigned flags, struct uring * ring)
+{
+	struct io_uring_sqe * sqe = uring_sqe(ring);
+
+	if (!sqe)
+	{
+		errno = EBUSY;
+		return -1;
+	}
+
+	sqe->opcode = IORING_OP_FILES_UPDATE;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t) (uintptr_t) value;
+	sqe->len = 1;
+	sqe->off = (uint64_t) fd;
+	sqe->flags = flags;
+	return 0;
+}
+
+static int uring_add(struct handle * handle)
+{
+	struct uring * ring = handle->poller->uring;
+
+	/* The first operation waits for the file, and fails with it */
+	if ((unsigned) handle->data.fd < ring->files && ring->sq_entries - (ring->sq_tail
+		- __atomic_load_n(ring->sq_head_shared, __ATOMIC_ACQUIRE)) >= 2)
+	{
+		if (uring_update(handle->data.fd, &handle->data.fd, IOSQE_IO_LINK, ring) != 0)
+			return -1;
+
+		handle->fixed = 1;
+	}
+
+	/* Buffered handles receive once connected */
+	return uring_arm(handle->data.on_data ? URING_CONNECT : URING_POLL, handle);
+}
+
+static void uring_del(struct handle * handle)
+{
+	static const int none = -1;
+
+	uring_cancel(handle);
+	if (handle->flushing)
+	{
+		list_del(&handle->flush);
+		handle->flushing = 0;
+	}
+
+	if (!handle->fixed)
+		return;
+
+	/* In-flight operations keep their reference to the file */
+	uring_update(handle->data.fd, &none, 0, handle->poller->uring);
+}
+
+static void uring_queue(struct handle * handle)
+{
+	if (!handle->flushing && handle->ready && handle->output.end > handle->output.begin)
+	{
+		handle->flushing = 1;
+		list_add_tail(&handle->flush, &handle->poller->flushing);
+	}
+}
+
+static int uring_send(const void * data, size_t size, struct handle * handle)
+{
+	struct buffer * output = &handle->output;
+
+	if (buffer_reserve(output, size, handle->poller) != 0)
+		return -1;
+
+	memcpy(output->data + output->end, data, size);
+	output->end += size;
+	uring_queue(handle);
+	return 0;
+}
+
+/* Queued output becomes the output in flight, unless some is already. */
+static int uring_flush_handle(struct handle * handle)
+{
+	struct buffer swap;
+
+	if (handle->sending.end == 0)
+	{
+		swap = handle->sending;
+		handle->sending = handle->output;
+		handle->output = swap;
+		if (uring_arm(URING_SEND, handle) != 0)
+		{
+			handle->output = handle->sending;
+			handle->sending = swap;
+			return -1;
+		}
+	}
+
+	list_del(&handle->flush);
+	handle->flushing = 0;
+	return 0;
+}
+
+static void uring_flush(struct poller * poller)
+{
+	while (!list_empty(&poller->flushing))
+	{
+		if (uring_flush_handle(list_entry(poller->flushing.next, struct handle, flush)) != 0)
+			break;
+	}
+}
+
+/* Bytes in a provided buffer go to on_data in place unless bytes not consumed yet are ahead of them. */
+static void uring_receive(const char * data, size_t size, struct handle * handle)
+{
+	struct buffer * input = &handle->input;
+	size_t consumed;
+
+	if (input->begin == input->end)
+	{
+		consumed = handle->data.on_data(handle, handle->data.context, data, size);
+		if (consumed >= size || handle->deleted || handle->closed)
+			return;
+
+		data += consumed;
+		size -= consumed;
+	}
+
+	if (buffer_reserve(input, size, handle->poller) != 0)
+	{
+		handle_end(handle, errno == ENOBUFS ? EMSGSIZE : errno);
+		return;
+	}
+
+	memcpy(input->data + input->end, data, size);
+	if (input->end == input->begin)
+	{
+		input->end += size;
+		return;
+	}
+
+	input->end += size;
+	consumed = handle->data.on_data(handle, handle->data.context, input->data + input->begin,
+		input->end - input->begin);
+	input->begin += consumed < input->end - input->begin ? consumed : input->end - input->begin;
+	if (input->begin == input->end)
+		input->begin = input->end = 0;
+}
+
+static void uring_sent(int res, struct handle * handle)
+{
+	struct buffer * sending = &handle->sending;
+
+	if (res < 0)
+	{
+		if (res != -ECANCELED)
+			handle_end(handle, -res);
+		return;
+	}
+
+	sending->begin += res;
+	if (sending->begin < sending->end)
+	{
+		if (uring_arm(URING_SEND, handle) != 0)
+			handle_end(handle, errno);
+		return;
+	}
+
+	/* All output is queued, so each time it is written out */
+	sending->begin = sending->end = 0;
+	if (handle->output.end > handle->output.begin)
+		uring_queue(handle);
+	else if (handle->data.on_writable)
+		handle->data.on_writable(handle, handle->data.context);
+}
+
+static void uring_complete(const struct io_uring_cqe * cqe, struct poller * poller)
+{
+	struct handle * handle = (struct handle *) (uintptr_t) (cqe->user_data & ~(uint64_t) (URING_OPS - 1));
+	int op = (int) (cqe->user_data & (URING_OPS - 1));
+	uint16_t bid;
+
+	/* Cancellations and file updates */
+	if (!handle)
+		return;
+
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+		handle->inflight--;
+
+	if (op == URING_RECV && (cqe->flags & IORING_CQE_F_BUFFER))
+	{
+		bid = (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+		if (!handle->deleted && !handle->closed && cqe->res > 0)
+			uring_receive(poller->uring->buffer_data + (size_t) bid * URING_BUFFER_SIZE, cqe->res, handle);
+		uring_recycle(bid, poller->uring);
+	}
+
+	if (handle->deleted || handle->closed)
+		return;
+
+	switch (op)
+	{
+	case URING_POLL:
+		if (cqe->res > 0 && (cqe->res & EPOLLOUT))
+			handle_write(handle);
+		if (cqe->res > 0 && !handle->deleted && (cqe->res & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+			handle_read(handle);
+		if (!(cqe->flags & IORING_CQE_F_MORE) && !handle->deleted)
+			uring_arm(URING_POLL, handle);
+		break;
+	case URING_CONNECT:
+		if (cqe->res < 0)
+		{
+			handle_end(handle, -cqe->res);
+			break;
+		}
+
+		handle->ready = 1;
+		if (uring_arm(URING_RECV, handle) != 0)
+		{
+			handle_end(handle, errno);
+			break;
+		}
+
+		/* Errors of connecting come with the first receive */
+		if (!(cqe->res & EPOLLERR) && handle->data.on_writable)
+			handle->data.on_writable(handle, handle->data.context);
+		if (!handle->deleted)
+			uring_queue(handle);
+		break;
+	case URING_RECV:
+		if (cqe->res == 0)
+			handle_end(handle, 0);
+		else if (cqe->res < 0 && cqe->res != -ENOBUFS)
+			handle_end(handle, -cqe->res);
+		else if (!(cqe->flags & IORING_CQE_F_MORE) && !handle->deleted && !handle->closed)
+			uring_arm(URING_RECV, handle);
+		break;
+	default:
+		uring_sent(cqe->res, handle);
+		break;
+	}
+}
+
+/* Completions are read from the shared ring, the system call is only for submitting. */
+/* @return the number of completions handled, at most batch */
+static int uring_go(int batch, struct poller * poller)
+{
+	struct uring * ring = poller->uring;
+	struct io_uring_cqe cqe;
+	unsigned head = *ring->cq_head;
+	unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	int count = 0;
+
+	while (head != tail && count < batch)
+	{
+		cqe = ring->cqes[head & ring->cq_mask];
+		__atomic_store_n(ring->cq_head, ++head, __ATOMIC_RELEASE);
+		uring_complete(&cqe, poller);
+		count++;
+	}
+	return count;
+}
+
+#else
+
+static struct uring * uring_create()
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+static void uring_destroy(struct uring * ring) {}
+static void uring_wait(struct uring * ring, int timeout) {}
+static void uring_submit(struct uring * ring) {}
+static void uring_cancel(struct handle * handle) {}
+static int uring_add(struct handle * handle) { return -1; }
+static void uring_del(struct handle * handle) {}
+static int uring_send(const void * data, size_t size, struct handle * handle) { return -1; }
+static int uring_flush_handle(struct handle * handle) { return -1; }
+static void uring_flush(struct poller * poller) {}
+static int uring_go(int batch, struct poller * poller) { return 0; }
+
+#endif
+
+/* Edge of the eventfd written by poller_submit(), the tasks run from poller_go() anyway. */
+static void tasks_wake(handle_t * handle, void * context)
+{
+	uint64_t count;
+
+	(void) context;
+	while (read(handle->data.fd, &count, sizeof(count)) < 0 && errno == EINTR)
+		;
+}
+
+static int tasks_create(struct poller * poller)
+{
+	struct handle_param param;
+	struct tasks * tasks;
+	size_t i;
+
+	if (posix_memalign((void **) &tasks, 64, sizeof(struct tasks)) != 0)
+		return -1;
+
+	poller->tasks = tasks;
+	tasks->tail = 0;
+	tasks->sleeping = 0;
+	tasks->head = 0;
+	for (i = 0; i < TASK_QUEUE_SIZE; i++)
+		tasks->cells[i].seq = i;
+
+	tasks->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (tasks->fd < 0)
+		return -1;
+
+	memset(&param, 0, sizeof(param));
+	param.fd = tasks->fd;
+	param.on_readable = tasks_wake;
+	return poller_add(&param, poller) ? 0 : -1;
+}
+
+static int tasks_pending(const struct tasks * tasks)
+{
+	return __atomic_load_n(&tasks->cells[tasks->head & (TASK_QUEUE_SIZE - 1)].seq, __ATOMIC_ACQUIRE)
+		== tasks->head + 1;
+}
+
+/* Runs up to batch tasks, each cell free for the next turn before its task runs. */
+static int tasks_run(int batch, struct tasks * tasks)
+{
+	struct task * cell;
+	void (* run)(void * context);
+	void * context;
+	int count = 0;
+
+	while (count < batch && tasks_pending(tasks))
+	{
+		cell = &tasks->cells[tasks->head & (TASK_QUEUE_SIZE - 1)];
+		run = cell->run;
+		context = cell->context;
+		__atomic_store_n(&cell->seq, tasks->head + TASK_QUEUE_SIZE, __ATOMIC_RELEASE);
+		tasks->head++;
+		run(context);
+		count++;
+	}
+	return count;
+}
+
+/*
+ * Before blocking: sleeping is stored before the queue is checked, and producers store their task
+ * before checking sleeping, so either the loop sees the task or the producer sees it sleeping.
+ * @return 0 for not blocking after all
+ */
+static int tasks_sleep(int timeout, struct tasks * tasks)
+{
+	if (timeout == 0)
+		return 0;
+
+	__atomic_store_n(&tasks->sleeping, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (tasks_pending(tasks))
+	{
+		__atomic_store_n(&tasks->sleeping, 0, __ATOMIC_RELAXED);
+		return 0;
+	}
+	return timeout;
+}
+
+poller_t * poller_create()
+{
+	return poller_create_ex(0);
+}
+
+poller_t * poller_create_ex(int flags)
+{
+	struct poller * poller = (struct poller *) malloc(sizeof(struct poller));
+	int level;
+	int slot;
+
+	if (poller)
+	{
+		poller->handles = (struct handle **) calloc(HANDLE_TABLE_SIZE, sizeof(struct handle *));
+		poller->uring = flags & POLLER_URING ? uring_create() : NULL;
+		poller->pfd = poller->uring ? -1 : epoll_create(1);
+		if (poller->handles && (poller->uring || poller->pfd >= 0))
+		{
+			INIT_LIST_HEAD(&poller->flushing);
+			poller->handle_capacity = HANDLE_TABLE_SIZE;
+			poller->generation = 0;
+			slab_init(sizeof(struct handle), &poller->handle_slab);
+			slab_init(sizeof(struct piece), &poller->piece_slab);
+			poller->pieces = RB_ROOT;
+			INIT_LIST_HEAD(&poller->dead_handles);
+			poller->clock = monotonic_tick();
+			poller->wheel_count = 0;
+			poller->upper_count = 0;
+			memset(&poller->config, 0, sizeof(poller->config));
+			poller->config.mode = POLLER_SPIN;
+			poller->config.batch = MAX_EVENTS;
+			poller->config.timeout = -1;
+			memset(&poller->stats, 0, sizeof(poller->stats));
+			poller->last_work = 0;
+			for (level = 0; level < WHEEL_LEVELS; level++)
+			{
+				for (slot = 0; slot < WHEEL_SIZE; slot++)
+					INIT_LIST_HEAD(&poller->wheel[level][slot]);
+			}
+			poller->tasks = NULL;
+			if (tasks_create(poller) == 0)
+				return poller;
+
+			poller_destroy(poller);
+			return NULL;
+		}
+
+		if (poller->uring)
+			uring_destroy(poller->uring);
+		if (poller->pfd >= 0)
+			close(poller->pfd);
+		free(poller->handles);
+		free(poller);
+	}
+	return NULL;
+}
+
+int poller_flags(const poller_t * poller)
+{
+	return poller->uring ? POLLER_URING : 0;
+}
+
+void poller_destroy(poller_t * poller)
+{
+	struct slist_node * pos;
+	struct handle * handle;
+	size_t fd;
+
+	/* The kernel lets go of the buffers of the handles with the ring */
+	if (poller->uring)
+		uring_destroy(poller->uring);
+
+	for (fd = 0; fd < poller->handle_capacity; fd++)
+	{
+		handle = poller->handles[fd];
+		if (handle)
+		{
+			handle_unmark(handle, poller);
+			handle_destroy(handle);
+		}
+	}
+	free(poller->handles);
+
+	while (!list_empty(&poller->dead_handles))
+	{
+		handle = list_entry(poller->dead_handles.next, struct handle, dead);
+		list_del(&handle->dead);
+		handle_destroy(handle);
+	}
+
+	/* Every handle is back in the slab, with the buffers it kept */
+	slist_for_each(pos, &poller->handle_slab.free)
+	{
+		handle = (struct handle *) pos;
+		free(handle->input.data);
+		free(handle->output.data);
+		free(handle->sending.data);
+		free(handle->lengths.data);
+	}
+	slab_destroy(&poller->handle_slab);
+	slab_destroy(&poller->piece_slab);
+
+	/* Its handle went with the others */
+	if (poller->tasks)
+	{
+		if (poller->tasks->fd >= 0)
+			close(poller->tasks->fd);
+		free(poller->tasks);
+	}
+
+	if (poller->pfd >= 0)
+		close(poller->pfd);
+	free(poller);
+}
+
+
+handle_t * poller_add(const struct handle_param * param, poller_t * poller)
+{
+	struct epoll_event event;
+	struct handle * handle;
+	socklen_t length = sizeof(int);
+	int type;
+
+	handle = handle_create(param, poller);
+	if (handle)
+	{
+		/* Not for every kind of descriptor, nor above net.core.busy_poll without CAP_NET_ADMIN */
+		if (poller->config.busy_poll > 0)
+			setsockopt(handle->data.fd, SOL_SOCKET, SO_BUSY_POLL, &poller->config.busy_poll, sizeof(int));
+
+		if (handle_insert(handle, poller) == 0)
+		{
+			if (poller->uring)
+			{
+				if (uring_add(handle) == 0)
+					return handle;
+
+				handle_remove(handle, poller);
+				handle_destroy(handle);
+				return NULL;
+			}
+
+			/* Datagrams queued are written one by one, their boundaries kept */
+			if (handle->data.on_data && getsockopt(handle->data.fd, SOL_SOCKET, SO_TYPE, &type, &length) == 0)
+				handle->datagram = type == SOCK_DGRAM;
+
+			event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+			event.data.u64 = (uint64_t) handle->generation << 32 | (uint32_t) handle->data.fd;
+
+			if (!epoll_ctl(poller->pfd, EPOLL_CTL_ADD, handle->data.fd, &event))
+				return handle;
+
+			handle_remove(handle, poller);
+		}
+
+		handle_destroy(handle);
+	}
+	return NULL;
+}
+
+void poller_del(int fd, poller_t * poller)
+{
+	struct handle * handle = handle_find(fd, poller);
+
+	if (handle)
+	{
+		if (poller->uring)
+			uring_del(handle);
+		else
+		{
+			epoll_ctl(poller->pfd, EPOLL_CTL_DEL, fd, NULL);
+			if (handle->flushing)
+			{
+				list_del(&handle->flush);
+				handle->flushing = 0;
+			}
+		}
+		handle_remove(handle, poller);
+		handle_unmark(handle, poller);
+		handle->deleted = 1;
+		list_add_tail(&handle->dead, &poller->dead_handles);
+	}
+}
+
+int poller_mark(int ack, int timeout, handle_t * handle, poller_t * poller)
+{
+	struct piece * piece;
+
+	if (handle->deleted)
+	{
+		errno = EBADF;
+		return -1;
+	}
+
+	piece = piece_find(ack, handle);
+	if (timeout < 0)
+	{
+		if (piece)
+			piece_remove(piece, poller);
+		return 0;
+	}
+
+	if (piece)
+		piece_unschedule(piece, poller);
+	else
+	{
+		piece = (struct piece *) slab_alloc(&poller->piece_slab);
+		if (!piece)
+			return -1;
+
+		piece->seq = ack;
+		piece->handle = handle;
+		piece_insert_handle(piece, handle);
+	}
+
+	/* The current tick has partly passed already */
+	piece->expires = monotonic_tick() + timeout + 1;
+	piece_schedule(piece, poller);
+	return 0;
+}
+
+/* Marks of the slot of level for the current turn, due within the turn of the level below, move down. */
+static void wheel_cascade(int level, struct poller * poller)
+{
+	struct list_head * slot = &poller->wheel[level][(poller->clock >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	struct piece * piece;
+	LIST_HEAD(moving);
+
+	list_splice_init(slot, &moving);
+	while (!list_empty(&moving))
+	{
+		piece = list_entry(moving.next, struct piece, in_slot);
+		piece_unschedule(piece, poller);
+		piece_schedule(piece, poller);
+	}
+}
+
+static void piece_expire(struct piece * piece, struct poller * poller)
+{
+	struct handle * handle = piece->handle;
+	int ack = piece->seq;
+
+	piece_remove(piece, poller);
+	handle_timeout(handle, ack);
+}
+
+/* Only marks expired before the call fire, those re-armed by a callback wait for the next one. */
+static int poller_expire(struct poller * poller)
+{
+	uint64_t now = monotonic_tick();
+	struct rb_node * p;
+	struct piece * piece;
+	LIST_HEAD(expired);
+	int count = 0;
+	int level;
+
+	/* Nothing to cascade or expire on the way */
+	if (poller->wheel_count == 0 && poller->clock <= now)
+		poller->clock = now + 1;
+
+	while (poller->clock <= now)
+	{
+		for (level = 1; level < WHEEL_LEVELS; level++)
+		{
+			if ((poller->clock & (((uint64_t) 1 << (WHEEL_BITS * level)) - 1)) != 0)
+				break;
+
+			wheel_cascade(level, poller);
+		}
+
+		/* The clock moves first, so that a mark re-armed by a callback lands in a later slot. */
+		list_splice_init(&poller->wheel[0][poller->clock & WHEEL_MASK], &expired);
+		poller->clock++;
+		while (!list_empty(&expired))
+		{
+			piece_expire(list_entry(expired.next, struct piece, in_slot), poller);
+			count++;
+		}
+	}
+
+	while ((p = rb_first(&poller->pieces)) != NULL)
+	{
+		piece = rb_entry(p, struct piece, in_poller);
+		if (piece->expires > now)
+			break;
+
+		piece_expire(piece, poller);
+		count++;
+	}
+	return count;
+}
+
+/*
+ * Tick of the next mark due, or of the next turn of level 0 if marks above may move down then.
+ * UINT64_MAX if none.
+ */
+static uint64_t poller_next_due(struct poller * poller)
+{
+	uint64_t due = UINT64_MAX;
+	uint64_t tick;
+	int i;
+
+	if (poller->upper_count > 0)
+		due = (poller->clock + WHEEL_MASK) & ~(uint64_t) WHEEL_MASK;
+
+	if (poller->wheel_count > poller->upper_count)
+	{
+		for (i = 0; i < WHEEL_SIZE; i++)
+		{
+			tick = poller->clock + i;
+			if (!list_empty(&poller->wheel[0][tick & WHEEL_MASK]))
+			{
+				due = tick < due ? tick : due;
+				break;
+			}
+		}
+	}
+
+	if (poller->pieces.rb_node)
+	{
+		tick = rb_entry(rb_first(&poller->pieces), struct piece, in_poller)->expires;
+		due = tick < due ? tick : due;
+	}
+	return due;
+}
+
+/* Milliseconds the next poller_go() may block for, by mode, and no later than the next mark due. */
+static int poller_timeout(uint64_t now, struct poller * poller)
+{
+	int timeout = poller->config.timeout;
+	uint64_t due;
+	uint64_t tick;
+
+	if (poller->config.mode == POLLER_SPIN)
+		return 0;
+
+	if (poller->config.mode == POLLER_ADAPTIVE && now - poller->last_work < (uint64_t) poller->config.spin * 1000)
+		return 0;
+
+	due = poller_next_due(poller);
+	if (due != UINT64_MAX)
+	{
+		tick = now / 1000000;
+		due = due > tick ? due - tick : 0;
+		if (timeout < 0 || due < (uint64_t) timeout)
+			timeout = (int) due;
+	}
+	return timeout;
+}
+
+static void poller_account(uint64_t begin, uint64_t woken, int work, struct poller * poller)
+{
+	uint64_t end = monotonic_ns();
+
+	poller->stats.wakeups++;
+	if (work > 0)
+	{
+		poller->stats.events += work;
+		poller->stats.idle_ns += woken - begin;
+		poller->stats.busy_ns += end - woken;
+		poller->last_work = end;
+	}
+	else
+		poller->stats.idle_ns += end - begin;
+}
+
+/* Output held by cork goes out before blocking and at the end of each poller_go(). */
+static void poller_uncork(struct poller * poller)
+{
+	struct handle * handle;
+
+	while (!list_empty(&poller->flushing))
+	{
+		handle = list_entry(poller->flushing.next, struct handle, flush);
+		if (handle_uncork(handle) < 0)
+			handle_end(handle, errno);
+	}
+}
+
+/* Held for poller_uncork(), but written out at once past the budget of the handle or BUFFER_SIZE queued. */
+static int handle_cork(const void * data, size_t size, struct handle * handle)
+{
+	uint64_t now = monotonic_ns();
+
+	if (handle_queue(data, size, handle) != 0)
+		return -1;
+
+	if (!handle->flushing)
+	{
+		handle->flushing = 1;
+		handle->corked_at = now;
+		list_add_tail(&handle->flush, &handle->poller->flushing);
+	}
+
+	if (now - handle->corked_at < (uint64_t) handle->data.cork * 1000
+		&& handle->output.end - handle->output.begin < BUFFER_SIZE)
+		return 0;
+
+	if (handle_uncork(handle) >= 0)
+		return 0;
+
+	shutdown(handle->data.fd, SHUT_RDWR);
+	return -1;
+}
+
+int poller_send(const void * data, size_t size, handle_t * handle)
+{
+	ssize_t n;
+
+	if (handle->deleted || handle->closed)
+	{
+		errno = EPIPE;
+		return -1;
+	}
+
+	if (handle->poller->uring)
+		return uring_send(data, size, handle);
+
+	if (handle->data.cork > 0 && !handle->blocked)
+		return handle_cork(data, size, handle);
+
+	/* Straight to the socket unless queued output or a connect is pending */
+	while (!handle->blocked && size > 0)
+	{
+		n = send(handle->data.fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+		handle->poller->stats.writes++;
+		if (n > 0)
+		{
+			data = (const char *) data + n;
+			size -= n;
+		}
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && errno == EAGAIN)
+			handle->blocked = 1;
+		else
+		{
+			/* Reported by the following EPOLLHUP, from poller_go() */
+			shutdown(handle->data.fd, SHUT_RDWR);
+			return -1;
+		}
+	}
+
+	if (size == 0)
+		return 0;
+
+	return handle_queue(data, size, handle);
+}
+
+int poller_flush(handle_t * handle)
+{
+	if (handle->deleted || handle->closed)
+	{
+		errno = EPIPE;
+		return -1;
+	}
+
+	if (handle->poller->uring)
+	{
+		if (handle->flushing && uring_flush_handle(handle) != 0)
+			return -1;
+
+		uring_submit(handle->poller->uring);
+		return 0;
+	}
+
+	if (handle_uncork(handle) >= 0)
+		return 0;
+
+	shutdown(handle->data.fd, SHUT_RDWR);
+	return -1;
+}
+
+int poller_set_config(const struct poller_config * config, poller_t * poller)
+{
+	if (config->mode < POLLER_SPIN || config->mode > POLLER_ADAPTIVE || config->batch < 0
+		|| config->batch > MAX_EVENTS || config->spin < 0 || config->busy_poll < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	poller->config = *config;
+	if (poller->config.batch == 0)
+		poller->config.batch = MAX_EVENTS;
+	return 0;
+}
+
+void poller_get_stats(struct poller_stats * stats, const poller_t * poller)
+{
+	*stats = poller->stats;
+	stats->allocations += poller->handle_slab.chunk_count + poller->piece_slab.chunk_count;
+}
+
+int poller_reserve(size_t handles, size_t marks, poller_t * poller)
+{
+	if (handles > poller->handle_slab.available
+		&& slab_grow(handles - poller->handle_slab.available, &poller->handle_slab) != 0)
+		return -1;
+
+	if (marks > poller->piece_slab.available && slab_grow(marks - poller->piece_slab.available, &poller->piece_slab) != 0)
+		return -1;
+
+	/* Descriptors are allocated lowest first, those of as many handles go about as high */
+	return handle_table_grow(handles, poller);
+}
+
+int poller_submit(void (* task)(void * context), void * context, poller_t * poller)
+{
+	struct tasks * tasks = poller->tasks;
+	size_t pos = __atomic_load_n(&tasks->tail, __ATOMIC_RELAXED);
+	struct task * cell;
+	intptr_t diff;
+	uint64_t one = 1;
+
+	for (;;)
+	{
+		cell = &tasks->cells[pos & (TASK_QUEUE_SIZE - 1)];
+		diff = (intptr_t) __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (intptr_t) pos;
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&tasks->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (diff < 0)
+		{
+			/* Not run yet since the last turn */
+			errno = EAGAIN;
+			return -1;
+		}
+		else
+			pos = __atomic_load_n(&tasks->tail, __ATOMIC_RELAXED);
+	}
+
+	cell->run = task;
+	cell->context = context;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	/* See tasks_sleep(), one producer wakes the loop however many submit meanwhile */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&tasks->sleeping, __ATOMIC_RELAXED) && __atomic_exchange_n(&tasks->sleeping, 0, __ATOMIC_ACQ_REL))
+	{
+		while (write(tasks->fd, &one, sizeof(one)) < 0 && errno == EINTR)
+			;
+	}
+	return 0;
+}
+
+void poller_go(poller_t * poller)
+{
+	struct epoll_event events[MAX_EVENTS];
+	struct handle * handle;
+	uint32_t event_type;
+	uint64_t begin = monotonic_ns();
+	uint64_t woken;
+	int timeout = tasks_sleep(poller_timeout(begin, poller), poller->tasks);
+	int event_count;
+	int i;
+
+	if (poller->uring)
+	{
+		if (timeout != 0)
+		{
+			uring_flush(poller);
+			uring_wait(poller->uring, timeout);
+			__atomic_store_n(&poller->tasks->sleeping, 0, __ATOMIC_RELAXED);
+		}
+		woken = monotonic_ns();
+		event_count = uring_go(poller->config.batch, poller);
+		event_count += tasks_run(poller->config.batch, poller->tasks);
+		event_count += poller_expire(poller);
+		uring_flush(poller);
+		uring_submit(poller->uring);
+		poller_reap(poller);
+		poller_account(begin, woken, event_count, poller);
+		return;
+	}
+
+	poller_uncork(poller);
+	event_count = epoll_wait(poller->pfd, events, poller->config.batch, timeout);
+	if (timeout != 0)
+		__atomic_store_n(&poller->tasks->sleeping, 0, __ATOMIC_RELAXED);
+	woken = monotonic_ns();
+	for (i = 0; i < event_count; i++)
+	{
+		event_type = events[i].events;
+		handle = handle_find((int) (uint32_t) events[i].data.u64, poller);
+		/* Deleted earlier in the batch, and the fd maybe added again */
+		if (!handle || handle->generation != (unsigned) (events[i].data.u64 >> 32))
+			continue;
+
+		if (!handle->deleted && (event_type & EPOLLOUT) == EPOLLOUT)
+			handle_write(handle);
+
+		if (!handle->deleted && (event_type & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0)
+			handle_read(handle);
+	}
+
+	event_count = event_count > 0 ? event_count : 0;
+	event_count += tasks_run(poller->config.batch, poller->tasks);
+	event_count += poller_expire(poller);
+	poller_uncork(poller);
+	poller_reap(poller);
+	poller_account(begin, woken, event_count, poller);
 }
@@ -0,0 +1,438 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "reactor.h"
+#include "list.h"
+
+struct loop
+{
+	struct reactor * reactor;
+	int index;
+	poller_t * poller;
+	pthread_t thread;
+	int started;
+	/* Of the thread of the loop only, cleared by the task reactor_destroy() submits */
+	int running;
+};
+
+struct listener
+{
+	struct list_head link;
+	int fd;
+	struct loop * loop;
+	reactor_accept_t on_accept;
+	void * context;
+};
+
+struct reactor
+{
+	struct reactor_config config;
+	struct loop * loops;
+	struct list_head listeners;
+	/* Of REACTOR_ROUND_ROBIN, shared by the threads dispatching */
+	unsigned next;
+	int started;
+	/* Arrivals submitted and not run yet, closed by reactor_destroy() if their loop stopped first */
+	pthread_mutex_t lock;
+	struct list_head arrivals;
+};
+
+/* fd going to a loop, on_accept called there */
+struct arrival
+{
+	struct list_head link;
+	int fd;
+	reactor_accept_t on_accept;
+	void * context;
+	struct loop * loop;
+};
+
+static __thread struct loop * current_loop;
+
+static void * loop_run(void * context)
+{
+	struct loop * loop = (struct loop *) context;
+	const struct reactor_config * config = &loop->reactor->config;
+
+	current_loop = loop;
+	if (config->on_start)
+		config->on_start(loop->index, loop->poller, config->context);
+
+	while (loop->running)
+		poller_go(loop->poller);
+
+	if (config->on_stop)
+		config->on_stop(loop->index, loop->poller, config->context);
+	current_loop = NULL;
+	return NULL;
+}
+
+static void loop_stop(void * context)
+{
+	((struct loop *) context)->running = 0;
+}
+
+static void arrival_run(void * context)
+{
+	struct arrival * arrival = (struct arrival *) context;
+	struct reactor * reactor = arrival->loop->reactor;
+
+	pthread_mutex_lock(&reactor->lock);
+	list_del(&arrival->link);
+	pthread_mutex_unlock(&reactor->lock);
+	arrival->on_accept(arrival->fd, arrival->loop->poller, arrival->context);
+	free(arrival);
+}
+
+static int arrival_submit(int fd, reactor_accept_t on_accept, void * context, struct loop * loop)
+{
+	struct arrival * arrival = (struct arrival *) malloc(sizeof(struct arrival));
+	struct reactor * reactor = loop->reactor;
+	int error;
+
+	if (!arrival)
+		return -1;
+
+	arrival->fd = fd;
+	arrival->on_accept = on_accept;
+	arrival->context = context;
+	arrival->loop = loop;
+	pthread_mutex_lock(&reactor->lock);
+	list_add_tail(&arrival->link, &reactor->arrivals);
+	pthread_mutex_unlock(&reactor->lock);
+	if (poller_submit(arrival_run, arrival, loop->poller) == 0)
+		return 0;
+
+	error = errno;
+	pthread_mutex_lock(&reactor->lock);
+	list_del(&arrival->link);
+	pthread_mutex_unlock(&reactor->lock);
+	free(arrival);
+	errno = error;
+	return -1;
+}
+
+/* FNV-1a of the peer address, port included */
+static unsigned peer_hash(int fd)
+{
+	struct sockaddr_storage address;
+	socklen_t length = sizeof(address);
+	const unsigned char * p = (const unsigned char *) &address;
+	uint32_t hash = 2166136261u;
+	socklen_t i;
+
+	if (getpeername(fd, (struct sockaddr *) &address, &length) != 0)
+		return 0;
+
+	for (i = 0; i < length && i < sizeof(address); i++)
+	{
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static int reactor_pick(int fd, struct reactor * reactor)
+{
+	unsigned loops = (unsigned) reactor->config.loops;
+
+	if (reactor->config.pick)
+		return reactor->config.pick(fd, reactor->config.context);
+
+	if (reactor->config.policy == REACTOR_HASH)
+		return (int) (peer_hash(fd) % loops);
+
+	return (int) (__atomic_fetch_add(&reactor->next, 1, __ATOMIC_RELAXED) % loops);
+}
+
+static void listener_accept(handle_t * handle, void * context)
+{
+	struct listener * listener = (struct listener *) context;
+	int fd;
+
+	(void) handle;
+	while ((fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		if (listener->loop->reactor->config.policy == REACTOR_REUSEPORT)
+			listener->on_accept(fd, listener->loop->poller, listener->context);
+		else if (reactor_dispatch(fd, listener->on_accept, listener->context, listener->loop->reactor) < 0)
+			close(fd);
+	}
+}
+
+static int listener_create(struct sockaddr * address, socklen_t length, reactor_accept_t on_accept, void * context,
+	struct loop * loop)
+{
+	struct listener * listener = (struct listener *) malloc(sizeof(struct listener));
+	struct handle_param param;
+	int one = 1;
+
+	if (!listener)
+		return -1;
+
+	listener->fd = socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	listener->loop = loop;
+	listener->on_accept = on_accept;
+	listener->context = context;
+	memset(&param, 0, sizeof(param));
+	param.fd = listener->fd;
+	param.context = listener;
+	param.on_readable = listener_accept;
+	if (listener->fd >= 0
+		&& setsockopt(listener->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0
+		&& (loop->reactor->config.policy != REACTOR_REUSEPORT
+			|| setsockopt(listener->fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == 0)
+		&& bind(listener->fd, address, length) == 0
+		&& listen(listener->fd, SOMAXCONN) == 0
+		&& getsockname(listener->fd, address, &length) == 0
+		&& poller_add(&param, loop->poller))
+	{
+		list_add_tail(&listener->link, &loop->reactor->listeners);
+		return 0;
+	}
+
+	if (listener->fd >= 0)
+		close(listener->fd);
+	free(listener);
+	return -1;
+}
+
+/*
+ * Waits for the loops started to end. All are told to stop before any is joined, so that they wind down
+ * together. A loop may still hand fds to one stopped already, see reactor_destroy().
+ */
+static void reactor_stop(struct reactor * reactor)
+{
+	struct loop * loop;
+	int i;
+
+	for (i = 0; i < reactor->config.loops; i++)
+	{
+		loop = &reactor->loops[i];
+		if (!loop->started)
+			continue;
+
+		while (poller_submit(loop_stop, loop, loop->poller) != 0)
+			sched_yield();
+	}
+
+	for (i = 0; i < reactor->config.loops; i++)
+	{
+		loop = &reactor->loops[i];
+		if (!loop->started)
+			continue;
+
+		pthread_join(loop->thread, NULL);
+		loop->started = 0;
+	}
+	reactor->started = 0;
+}
+
+reactor_t * reactor_create(const struct reactor_config * config)
+{
+	struct reactor * reactor;
+	struct loop * loop;
+	int i;
+
+	if (config->loops <= 0 || (config->policy != REACTOR_ROUND_ROBIN && config->policy != REACTOR_HASH
+		&& config->policy != REACTOR_REUSEPORT))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	reactor = (struct reactor *) malloc(sizeof(struct reactor));
+	if (!reactor)
+		return NULL;
+
+	reactor->config = *config;
+	reactor->loops = (struct loop *) calloc((size_t) config->loops, sizeof(struct loop));
+	INIT_LIST_HEAD(&reactor->listeners);
+	reactor->next = 0;
+	reactor->started = 0;
+	INIT_LIST_HEAD(&reactor->arrivals);
+	if (!reactor->loops || pthread_mutex_init(&reactor->lock, NULL) != 0)
+	{
+		free(reactor->loops);
+		free(reactor);
+		return NULL;
+	}
+
+	for (i = 0; i < config->loops; i++)
+	{
+		loop = &reactor->loops[i];
+		loop->reactor = reactor;
+		loop->index = i;
+		loop->poller = poller_create_ex(config->flags);
+		if (!loop->poller || poller_set_config(&config->poller, loop->poller) != 0)
+		{
+			reactor_destroy(reactor);
+			return NULL;
+		}
+	}
+	return reactor;
+}
+
+int reactor_listen(struct sockaddr * address, socklen_t length, reactor_accept_t on_accept, void * context,
+	reactor_t * reactor)
+{
+	int loops = reactor->config.policy == REACTOR_REUSEPORT ? reactor->config.loops : 1;
+	int i;
+
+	if (reactor->started)
+	{
+		errno = EBUSY;
+		return -1;
+	}
+
+	/* The first bound picks the port of the others */
+	for (i = 0; i < loops; i++)
+	{
+		if (listener_create(address, length, on_accept, context, &reactor->loops[i]) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+int reactor_start(reactor_t * reactor)
+{
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	struct loop * loop;
+	int error = 0;
+	int i;
+
+	for (i = 0; i < reactor->config.loops && error == 0; i++)
+	{
+		loop = &reactor->loops[i];
+		error = pthread_attr_init(&attr);
+		if (error != 0)
+			break;
+
+		if (reactor->config.cpus)
+		{
+			CPU_ZERO(&cpus);
+			CPU_SET(reactor->config.cpus[i], &cpus);
+			error = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+		}
+		loop->running = 1;
+		if (error == 0)
+			error = pthread_create(&loop->thread, &attr, loop_run, loop);
+		loop->started = error == 0;
+		pthread_attr_destroy(&attr);
+	}
+
+	reactor->started = 1;
+	if (error != 0)
+	{
+		reactor_stop(reactor);
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+void reactor_destroy(reactor_t * reactor)
+{
+	struct listener * listener;
+	struct arrival * arrival;
+	int i;
+
+	reactor_stop(reactor);
+
+	/* Not taken by their loops, their tasks dropped with the pollers */
+	while (!list_empty(&reactor->arrivals))
+	{
+		arrival = list_entry(reactor->arrivals.next, struct arrival, link);
+		list_del(&arrival->link);
+		close(arrival->fd);
+		free(arrival);
+	}
+
+	for (i = 0; i < reactor->config.loops; i++)
+	{
+		if (reactor->loops[i].poller)
+			poller_destroy(reactor->loops[i].poller);
+	}
+
+	while (!list_empty(&reactor->listeners))
+	{
+		listener = list_entry(reactor->listeners.next, struct listener, link);
+		list_del(&listener->link);
+		close(listener->fd);
+		free(listener);
+	}
+
+	pthread_mutex_destroy(&reactor->lock);
+	free(reactor->loops);
+	free(reactor);
+}
+
+int reactor_loops(const reactor_t * reactor)
+{
+	return reactor->config.loops;
+}
+
+poller_t * reactor_poller(int loop, const reactor_t * reactor)
+{
+	return loop >= 0 && loop < reactor->config.loops ? reactor->loops[loop].poller : NULL;
+}
+
+int reactor_current(const reactor_t * reactor)
+{
+	return current_loop && current_loop->reactor == reactor ? current_loop->index : -1;
+}
+
+int reactor_dispatch(int fd, reactor_accept_t on_accept, void * context, reactor_t * reactor)
+{
+	int index = reactor_pick(fd, reactor);
+	struct loop * loop;
+
+	if (index < 0 || index >= reactor->config.loops)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	loop = &reactor->loops[index];
+	if (loop == current_loop)
+		on_accept(fd, loop->poller, context);
+	else if (arrival_submit(fd, on_accept, context, loop) != 0)
+		return -1;
+	return index;
+}
+
+int reactor_migrate(int fd, int loop, reactor_accept_t on_arrive, void * context, reactor_t * reactor)
+{
+	struct loop * from = current_loop;
+	int error;
+
+	if (!from || from->reactor != reactor || loop < 0 || loop >= reactor->config.loops)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (&reactor->loops[loop] == from)
+		return 0;
+
+	/* Deleted first, so that the two loops never both handle it */
+	poller_del(fd, from->poller);
+	if (arrival_submit(fd, on_arrive, context, &reactor->loops[loop]) == 0)
+		return 0;
+
+	/* Back where it was */
+	error = errno;
+	on_arrive(fd, from->poller, context);
+	errno = error;
+	return -1;
+}
@@ -0,0 +1,77 @@
+#include <cerrno>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Connection.h"
+
+namespace extra::protocol
+{
+int open_connection(const std::string & address, uint16_t port, handle_param param, poller_t * poller,
+	handle_t ** handle)
+{
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	if (inet_pton(AF_INET, address.data(), &sa.sin_addr) != 1)
+		return -1;
+
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0 && errno != EINPROGRESS)
+	{
+		close(fd);
+		return -1;
+	}
+
+	param.fd = fd;
+	auto added = poller_add(&param, poller);
+	if (added == nullptr)
+	{
+		close(fd);
+		return -1;
+	}
+
+	if (handle != nullptr)
+		*handle = added;
+	return fd;
+}
+
+bool is_established(int fd)
+{
+	int error = 0;
+	socklen_t length = sizeof(error);
+	return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+}
+
+bool flush_output(int fd, std::string & output, size_t & offset)
+{
+	while (offset < output.size())
+	{
+		auto n = send(fd, output.data() + offset, output.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n > 0)
+			offset += n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && errno == EAGAIN)
+			return true;
+		else
+		{
+			shutdown(fd, SHUT_RDWR);
+			return false;
+		}
+	}
+
+	output.clear();
+	offset = 0;
+	return true;
+}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "poller.h"
+
+namespace extra::protocol
+{
+/**
+ * Start a non-blocking TCP connection without Nagle's delay and add it to poller with param, whose
+ * fd is set. The first writable edge tells how it went, see is_established().
+ * @param address numeric IPv4 address
+ * @param handle if not null, set to the handle added
+ * @return socket, -1 on error
+ */
+int open_connection(const std::string & address, uint16_t port, handle_param param, poller_t * poller,
+	handle_t ** handle = nullptr);
+
+/**
+ * @return true if the connection started on fd is established, called on its first writable edge
+ */
+bool is_established(int fd);
+
+/**
+ * Write output from offset until EAGAIN, the rest is written on the next writable edge, then clear it.
+ * Never drops the connection itself: on error the socket is shut down, and the following EPOLLHUP
+ * reports it to on_readable, where no caller holds the connection.
+ * @return false on error
+ */
+bool flush_output(int fd, std::string & output, size_t & offset);
+
+}
@@ -0,0 +1,500 @@
+#include <cassert>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Fix.h"
+#include "Json.h"
+
+namespace extra::protocol::fix
+{
+namespace
+{
+struct Masks
+{
+	uint64_t soh;
+	uint64_t equals;
+};
+
+/**
+ * One bit per byte of a 64 byte block.
+ */
+Masks classify(const char * block)
+{
+	Masks m{};
+#if defined(__AVX2__)
+	for (int k = 0; k < 2; k++)
+	{
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32 * k));
+		auto bits = [&v](char c)
+		{
+			return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)))));
+		};
+		m.soh |= bits(SOH) << (32 * k);
+		m.equals |= bits('=') << (32 * k);
+	}
+#elif defined(__SSE2__)
+	for (int k = 0; k < 4; k++)
+	{
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * k));
+		auto bits = [&v](char c)
+		{
+			return static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)))));
+		};
+		m.soh |= bits(SOH) << (16 * k);
+		m.equals |= bits('=') << (16 * k);
+	}
+#else
+	for (int k = 0; k < 64; k++)
+	{
+		m.soh |= static_cast<uint64_t>(block[k] == SOH) << k;
+		m.equals |= static_cast<uint64_t>(block[k] == '=') << k;
+	}
+#endif
+	return m;
+}
+
+/**
+ * Finds SOH and '=' in a message. Positions only move forward, so each 64 byte block is classified
+ * once for both, and fields shorter than a block cost a shift and a count of trailing zeros.
+ */
+class Scanner
+{
+private:
+	std::string_view data;
+	size_t base;
+	Masks masks;
+
+public:
+	explicit Scanner(std::string_view data_)
+		: data{data_}, base{std::string_view::npos}, masks{}
+	{
+	}
+
+	size_t find_soh(size_t pos)
+	{
+		return find(pos, &Masks::soh);
+	}
+
+	size_t find_equals(size_t pos)
+	{
+		return find(pos, &Masks::equals);
+	}
+
+private:
+	size_t find(size_t pos, uint64_t Masks::* which)
+	{
+		while (pos < data.size())
+		{
+			auto block = pos & ~size_t{63};
+			if (block != base)
+				load(block);
+
+			if (auto bits = masks.*which >> (pos - block); bits != 0)
+				return pos + __builtin_ctzll(bits);
+
+			pos = block + 64;
+		}
+		return std::string_view::npos;
+	}
+
+	void load(size_t block)
+	{
+		base = block;
+		if (block + 64 <= data.size())
+		{
+			masks = classify(data.data() + block);
+			return;
+		}
+
+		// Zero padding is neither SOH nor '='
+		char tail[64]{};
+		std::memcpy(tail, data.data() + block, data.size() - block);
+		masks = classify(tail);
+	}
+};
+
+/**
+ * @return the data field whose length is given by length_tag, 0 if length_tag is not one
+ */
+uint32_t data_tag_of(uint32_t length_tag)
+{
+	switch (length_tag)
+	{
+	case 90:
+		return 91;
+	case 93:
+		return 89;
+	case 95:
+		return 96;
+	case 212:
+		return 213;
+	case 348:
+		return 349;
+	case 350:
+		return 351;
+	case 352:
+		return 353;
+	case 354:
+		return 355;
+	case 356:
+		return 357;
+	case 358:
+		return 359;
+	case 360:
+		return 361;
+	case 362:
+		return 363;
+	case 364:
+		return 365;
+	case 445:
+		return 446;
+	case 618:
+		return 619;
+	case 621:
+		return 622;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * The whole of s, from_chars() alone would accept a prefix.
+ */
+template <typename T>
+bool parse_integer(std::string_view s, T & value)
+{
+	auto [end, error] = std::from_chars(s.data(), s.data() + s.size(), value);
+	return !s.empty() && error == std::errc{} && end == s.data() + s.size();
+}
+
+/**
+ * Tags are at most a few digits, a plain loop beats from_chars() there.
+ */
+bool parse_tag(std::string_view s, uint32_t & tag)
+{
+	if (s.empty() || s.size() > 9)
+		return false;
+
+	uint32_t v = 0;
+	for (auto c: s)
+	{
+		auto digit = static_cast<uint32_t>(c - '0');
+		if (digit > 9)
+			return false;
+		v = v * 10 + digit;
+	}
+	tag = v;
+	return v != 0;
+}
+
+bool starts_like(std::string_view raw, std::string_view prefix)
+{
+	auto n = std::min(raw.size(), prefix.size());
+	return raw.substr(0, n) == prefix.substr(0, n);
+}
+
+void put_digits(char * out, unsigned value, int width)
+{
+	for (int i = width - 1; i >= 0; i--)
+	{
+		out[i] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	}
+}
+}
+
+uint8_t checksum(std::string_view data)
+{
+	uint64_t sum = 0;
+	size_t i = 0;
+	auto p = data.data();
+#if defined(__AVX2__)
+	auto acc = _mm256_setzero_si256();
+	for (; i + 32 <= data.size(); i += 32)
+	{
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+	}
+	auto half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	sum = _mm_cvtsi128_si64(half) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half));
+#elif defined(__SSE2__)
+	auto acc = _mm_setzero_si128();
+	for (; i + 16 <= data.size(); i += 16)
+	{
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+	}
+	sum = _mm_cvtsi128_si64(acc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+#endif
+	for (; i < data.size(); i++)
+		sum += static_cast<uint8_t>(p[i]);
+	return static_cast<uint8_t>(sum);
+}
+
+void format_timestamp(std::chrono::system_clock::time_point time, char * out)
+{
+	using namespace std::chrono;
+	auto day = floor<days>(time);
+	year_month_day date{day};
+	hh_mm_ss clock{floor<milliseconds>(time - day)};
+	put_digits(out, static_cast<int>(date.year()), 4);
+	put_digits(out + 4, static_cast<unsigned>(date.month()), 2);
+	put_digits(out + 6, static_cast<unsigned>(date.day()), 2);
+	out[8] = '-';
+	put_digits(out + 9, clock.hours().count(), 2);
+	out[11] = ':';
+	put_digits(out + 12, clock.minutes().count(), 2);
+	out[14] = ':';
+	put_digits(out + 15, clock.seconds().count(), 2);
+	out[17] = '.';
+	put_digits(out + 18, clock.subseconds().count(), 3);
+}
+
+Parser::Parser()
+	: fields{}, slots{std::make_unique<uint16_t[]>(tag_table_size)}, message{}, message_length{0}, failed{false}
+{
+	fields.reserve(64);
+}
+
+void Parser::reset()
+{
+	for (const auto & field: fields)
+	{
+		if (field.tag < tag_table_size)
+			slots[field.tag] = 0;
+	}
+	fields.clear();
+	message = {};
+	message_length = 0;
+	failed = false;
+}
+
+ParseResult Parser::parse(std::string_view & raw)
+{
+	if (failed)
+		return ParseResult::Error;
+
+	if (message_length == 0 && !parse_prefix(raw))
+		return failed ? ParseResult::Error : ParseResult::Incomplete;
+
+	if (raw.size() < message_length)
+		return ParseResult::Incomplete;
+
+	if (!parse_fields(raw.substr(0, message_length)))
+	{
+		failed = true;
+		return ParseResult::Error;
+	}
+
+	message = raw.substr(0, message_length);
+	raw.remove_prefix(message_length);
+	return ParseResult::Complete;
+}
+
+/**
+ * Reads BeginString and BodyLength to learn the message length, failing as soon as the bytes
+ * cannot start a message.
+ */
+bool Parser::parse_prefix(std::string_view raw)
+{
+	constexpr size_t prefix_length_limit = 32;
+	auto incomplete = [this, &raw]
+	{
+		failed = raw.size() > prefix_length_limit;
+		return false;
+	};
+	auto fail = [this]
+	{
+		failed = true;
+		return false;
+	};
+
+	if (!starts_like(raw, "8="))
+		return fail();
+
+	auto first = raw.find(SOH);
+	if (first == std::string_view::npos)
+		return incomplete();
+
+	auto rest = raw.substr(first + 1);
+	if (!starts_like(rest, "9="))
+		return fail();
+
+	auto second = rest.find(SOH);
+	if (second == std::string_view::npos)
+		return incomplete();
+
+	size_t length;
+	if (first == 2 || !parse_integer(rest.substr(2, second - 2), length) || length > message_length_limit)
+		return fail();
+
+	message_length = first + 1 + second + 1 + length + 7;
+	return message_length <= message_length_limit || fail();
+}
+
+/**
+ * BodyLength must end right before CheckSum, which is checked before fields are indexed.
+ */
+bool Parser::parse_fields(std::string_view raw)
+{
+	auto end = raw.size() - 7;
+	uint32_t expected;
+	if (raw[end - 1] != SOH || raw.substr(end, 3) != "10=" || raw.back() != SOH
+	    || !parse_integer(raw.substr(end + 3, 3), expected) || checksum(raw.substr(0, end)) != expected)
+		return false;
+
+	Scanner scanner(raw.substr(0, end));
+	uint32_t data_tag = 0;
+	size_t data_length = 0;
+	for (size_t pos = 0; pos < end; )
+	{
+		uint32_t tag;
+		auto equals = scanner.find_equals(pos);
+		if (equals == std::string_view::npos || !parse_tag(raw.substr(pos, equals - pos), tag))
+			return false;
+
+		size_t soh;
+		if (data_tag != 0 && tag == data_tag)
+		{
+			soh = equals + 1 + data_length;
+			if (soh >= end || raw[soh] != SOH)
+				return false;
+		}
+		else
+			soh = scanner.find_soh(equals + 1);
+
+		if (soh == equals + 1 || fields.size() == field_count_limit)
+			return false;
+
+		if (tag < tag_table_size && slots[tag] == 0)
+			slots[tag] = static_cast<uint16_t>(fields.size() + 1);
+		fields.push_back({tag, raw.substr(equals + 1, soh - equals - 1)});
+
+		data_tag = data_tag_of(tag);
+		if (data_tag != 0 && !parse_integer(fields.back().value, data_length))
+			return false;
+
+		pos = soh + 1;
+	}
+
+	slots[CheckSum] = static_cast<uint16_t>(fields.size() + 1);
+	fields.push_back({CheckSum, raw.substr(end + 3, 3)});
+	return fields.size() >= 4 && fields[0].tag == BeginString && fields[1].tag == BodyLength
+	       && fields[2].tag == MsgType && fields.back().tag == CheckSum;
+}
+
+size_t Parser::find_index(uint32_t tag) const
+{
+	if (tag < tag_table_size)
+		return slots[tag] == 0 ? fields.size() : slots[tag] - 1;
+
+	for (size_t i = 0; i < fields.size(); i++)
+	{
+		if (fields[i].tag == tag)
+			return i;
+	}
+	return fields.size();
+}
+
+bool Parser::find(uint32_t tag, int64_t & value) const
+{
+	return parse_integer(find(tag), value);
+}
+
+bool Parser::find(uint32_t tag, uint64_t & value) const
+{
+	return parse_integer(find(tag), value);
+}
+
+bool Parser::find_fixed(uint32_t tag, int64_t & value, int scale) const
+{
+	return json::parse_fixed(find(tag), scale, value);
+}
+
+Encoder::Encoder(std::string_view begin_string_, std::string_view sender_comp_id, std::string_view target_comp_id)
+	: begin_string{}, comp_ids{}, buffer{}, gap{0}
+{
+	begin_string.append("8=").append(begin_string_).append(1, SOH).append("9=");
+	comp_ids.append(1, SOH).append("49=").append(sender_comp_id).append(1, SOH).append("56=").append(target_comp_id)
+		.append(1, SOH).append("34=");
+	// BodyLength of up to 7 digits and its SOH
+	gap = begin_string.size() + 8;
+	buffer.reserve(1024);
+}
+
+void Encoder::begin(std::string_view msg_type, uint64_t seq_num, std::string_view sending_time)
+{
+	buffer.resize(gap);
+	buffer += "35=";
+	buffer += msg_type;
+	buffer += comp_ids;
+	char digits[24];
+	buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), seq_num).ptr);
+	buffer += SOH;
+	buffer += "52=";
+	buffer += sending_time;
+	buffer += SOH;
+}
+
+void Encoder::add(uint32_t tag, std::string_view value)
+{
+	char digits[12];
+	buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), tag).ptr);
+	buffer += '=';
+	buffer += value;
+	buffer += SOH;
+}
+
+void Encoder::add_fixed(uint32_t tag, int64_t value, int scale)
+{
+	assert(scale >= 0 && scale < 19);
+	char digits[48];
+	char * end = digits + sizeof(digits);
+	char * p = end;
+	uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+	bool significant = false;
+	for (int i = 0; i < scale; i++)
+	{
+		char c = static_cast<char>('0' + magnitude % 10);
+		magnitude /= 10;
+		if (significant || c != '0')
+		{
+			*--p = c;
+			significant = true;
+		}
+	}
+	if (significant)
+		*--p = '.';
+	do
+	{
+		*--p = static_cast<char>('0' + magnitude % 10);
+		magnitude /= 10;
+	}
+	while (magnitude != 0);
+	if (value < 0)
+		*--p = '-';
+	add(tag, std::string_view(p, end - p));
+}
+
+std::string_view Encoder::finish()
+{
+	auto length = buffer.size() - gap;
+	assert(length < 10000000);
+	char digits[8];
+	auto n = std::to_chars(digits, digits + sizeof(digits), length).ptr - digits;
+	auto start = gap - 1 - n - begin_string.size();
+	std::memcpy(buffer.data() + start, begin_string.data(), begin_string.size());
+	std::memcpy(buffer.data() + start + begin_string.size(), digits, n);
+	buffer[gap - 1] = SOH;
+
+	auto sum = checksum(std::string_view(buffer).substr(start));
+	char trailer[7] = {'1', '0', '=', static_cast<char>('0' + sum / 100), static_cast<char>('0' + sum / 10 % 10),
+		static_cast<char>('0' + sum % 10), SOH};
+	buffer.append(trailer, sizeof(trailer));
+	return std::string_view(buffer).substr(start);
+}
+
+}
@@ -0,0 +1,623 @@
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Connection.h"
+#include "FixSession.h"
+
+namespace extra::protocol::fix
+{
+namespace
+{
+constexpr uint64_t store_magic = 0x3130515345584946; // "FIXSEQ01"
+constexpr size_t page_size = 4096;
+
+constexpr size_t round_up(size_t n)
+{
+	return (n + page_size - 1) / page_size * page_size;
+}
+}
+
+struct SequenceStore::Header
+{
+	uint64_t magic;
+	uint64_t message_capacity;
+	uint64_t byte_capacity;
+	uint64_t next_inbound;
+	uint64_t next_outbound;
+	uint64_t used_bytes;
+};
+
+SequenceStore::SequenceStore()
+	: fd{-1}, base{nullptr}, mapped{0}, header{nullptr}, slots{nullptr}, data{nullptr}
+{
+}
+
+SequenceStore::~SequenceStore()
+{
+	close();
+}
+
+bool SequenceStore::open(const std::string & path, Options options)
+{
+	close();
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return false;
+
+	struct stat st{};
+	Header existing{};
+	bool created = false;
+	if (fstat(fd, &st) != 0)
+	{
+		close();
+		return false;
+	}
+
+	if (st.st_size == 0)
+	{
+		existing = Header{store_magic, options.message_capacity, options.byte_capacity, 1, 1, 0};
+		created = true;
+	}
+	else if (pread(fd, &existing, sizeof(existing), 0) != sizeof(existing) || existing.magic != store_magic)
+	{
+		close();
+		errno = EINVAL;
+		return false;
+	}
+
+	auto slots_offset = round_up(sizeof(Header));
+	auto data_offset = round_up(slots_offset + existing.message_capacity * sizeof(Slot));
+	auto size = data_offset + round_up(existing.byte_capacity);
+	if (created ? ftruncate(fd, static_cast<off_t>(size)) != 0 : static_cast<size_t>(st.st_size) != size)
+	{
+		close();
+		if (!created)
+			errno = EINVAL;
+		return false;
+	}
+
+	auto address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (address == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	base = static_cast<char *>(address);
+	mapped = size;
+	header = reinterpret_cast<Header *>(base);
+	slots = reinterpret_cast<Slot *>(base + slots_offset);
+	data = base + data_offset;
+	if (created)
+		*header = existing;
+	return true;
+}
+
+void SequenceStore::close()
+{
+	if (base != nullptr)
+		munmap(base, mapped);
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+	base = nullptr;
+	mapped = 0;
+	header = nullptr;
+	slots = nullptr;
+	data = nullptr;
+}
+
+uint64_t SequenceStore::next_inbound() const
+{
+	return header->next_inbound;
+}
+
+void SequenceStore::set_next_inbound(uint64_t seq)
+{
+	header->next_inbound = seq;
+}
+
+uint64_t SequenceStore::next_outbound() const
+{
+	return header->next_outbound;
+}
+
+/**
+ * The sequence number is advanced last, a message written by a process dying before that is
+ * overwritten by the next one taking the same number.
+ */
+void SequenceStore::store(std::string_view message)
+{
+	auto i = header->next_outbound - 1;
+	if (i < header->message_capacity)
+	{
+		if (header->used_bytes + message.size() > header->byte_capacity)
+			message = {};
+		slots[i] = Slot{header->used_bytes, message.size()};
+		std::memcpy(data + header->used_bytes, message.data(), message.size());
+		header->used_bytes += message.size();
+	}
+	header->next_outbound++;
+}
+
+std::string_view SequenceStore::find(uint64_t seq) const
+{
+	if (seq == 0 || seq >= header->next_outbound || seq - 1 >= header->message_capacity)
+		return {};
+
+	const auto & slot = slots[seq - 1];
+	return std::string_view(data + slot.offset, slot.length);
+}
+
+void SequenceStore::reset()
+{
+	header->next_inbound = 1;
+	header->next_outbound = 1;
+	header->used_bytes = 0;
+}
+
+bool SequenceStore::sync()
+{
+	return msync(base, mapped, MS_SYNC) == 0;
+}
+
+Session::Session(poller_t * poller_, SequenceStore & store_, Options options_, MessageCallback on_message_,
+	StatusCallback on_status_)
+	: poller{poller_}, store{store_}, options{std::move(options_)}, on_message{std::move(on_message_)}
+	, on_status{std::move(on_status_)}, fd{-1}, handle{nullptr}, status{Status::Disconnected}
+	, encoder{options.begin_string, options.sender_comp_id, options.target_comp_id}, parser{}, replay{}
+	, input{new char[input_capacity]}, input_size{0}, output{}, output_offset{0}, last_sent{}, last_received{}
+	, test_request_pending{false}, test_request_count{0}, resend_target{0}
+{
+}
+
+Session::~Session()
+{
+	if (fd >= 0)
+	{
+		poller_del(fd, poller);
+		::close(fd);
+	}
+}
+
+bool Session::connect(const std::string & address, uint16_t port)
+{
+	if (fd >= 0 || !store.is_open())
+		return false;
+
+	handle_param param{};
+	param.context = this;
+	param.on_readable = on_readable;
+	param.on_writable = on_writable;
+	param.on_timeout = on_timeout;
+	fd = open_connection(address, port, param, poller, &handle);
+	if (fd < 0)
+		return false;
+
+	input_size = 0;
+	output.clear();
+	output_offset = 0;
+	parser.reset();
+	test_request_pending = false;
+	resend_target = 0;
+	change(Status::Connecting);
+	mark(LogonTimer, options.logon_timeout);
+	return true;
+}
+
+Encoder & Session::prepare(std::string_view msg_type)
+{
+	begin(msg_type, store.next_outbound());
+	return encoder;
+}
+
+bool Session::send()
+{
+	if (status != Status::Active)
+		return false;
+
+	transmit(false);
+	return true;
+}
+
+void Session::logout(std::string_view text)
+{
+	if (status != Status::Active && status != Status::LogonSent)
+	{
+		fail();
+		return;
+	}
+
+	send_logout(text);
+	change(Status::LogoutSent);
+	mark(LogonTimer, options.logon_timeout);
+}
+
+void Session::begin(std::string_view msg_type, uint64_t seq)
+{
+	char now[timestamp_length];
+	format_timestamp(std::chrono::system_clock::now(), now);
+	encoder.begin(msg_type, seq, std::string_view(now, sizeof(now)));
+}
+
+void Session::transmit(bool admin)
+{
+	auto message = encoder.finish();
+	store.store(admin ? std::string_view{} : message);
+	write(message);
+}
+
+void Session::write(std::string_view message)
+{
+	output += message;
+	last_sent = Clock::now();
+	flush();
+}
+
+void Session::send_logon()
+{
+	if (options.reset_on_logon)
+		store.reset();
+
+	auto seconds = std::chrono::ceil<std::chrono::seconds>(options.heartbeat_interval).count();
+	begin("A", store.next_outbound());
+	encoder.add(EncryptMethod, 0);
+	encoder.add(HeartBtInt, seconds > 0 ? seconds : 1);
+	if (options.reset_on_logon)
+		encoder.add(ResetSeqNumFlag, true);
+	transmit(true);
+}
+
+void Session::send_heartbeat(std::string_view test_request_id)
+{
+	begin("0", store.next_outbound());
+	if (!test_request_id.empty())
+		encoder.add(TestReqID, test_request_id);
+	transmit(true);
+}
+
+void Session::send_logout(std::string_view text)
+{
+	begin("5", store.next_outbound());
+	if (!text.empty())
+		encoder.add(Text, text);
+	transmit(true);
+}
+
+/**
+ * Takes the sequence number of the first message skipped, neither advancing nor stored.
+ */
+void Session::send_gap_fill(uint64_t seq, uint64_t new_seq)
+{
+	begin("4", seq);
+	encoder.add(PossDupFlag, true);
+	encoder.add(GapFillFlag, true);
+	encoder.add(NewSeqNo, new_seq);
+	write(encoder.finish());
+}
+
+void Session::resend(uint64_t begin_seq, uint64_t end_seq)
+{
+	auto last = store.next_outbound() - 1;
+	if (end_seq == 0 || end_seq > last)
+		end_seq = last;
+
+	uint64_t gap = 0;
+	for (auto seq = begin_seq; seq <= end_seq; seq++)
+	{
+		auto raw = store.find(seq);
+		if (raw.empty() || replay.parse(raw) != ParseResult::Complete)
+		{
+			replay.reset();
+			if (gap == 0)
+				gap = seq;
+			continue;
+		}
+
+		if (gap != 0)
+		{
+			send_gap_fill(gap, seq);
+			gap = 0;
+		}
+
+		begin(replay.get_msg_type(), seq);
+		encoder.add(PossDupFlag, true);
+		encoder.add(OrigSendingTime, replay.find(SendingTime));
+		for (size_t i = 3; i < replay.get_field_count(); i++)
+		{
+			const auto & field = replay.get_field(i);
+			switch (field.tag)
+			{
+			case MsgSeqNum:
+			case PossDupFlag:
+			case SenderCompID:
+			case SendingTime:
+			case TargetCompID:
+			case OrigSendingTime:
+			case CheckSum:
+				break;
+			default:
+				encoder.add(field.tag, field.value);
+			}
+		}
+		replay.reset();
+		write(encoder.finish());
+	}
+
+	if (gap != 0)
+		send_gap_fill(gap, end_seq + 1);
+}
+
+void Session::receive()
+{
+	while (fd >= 0)
+	{
+		auto n = recv(fd, input.get() + input_size, std::min(read_size, input_capacity - input_size), 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0 && errno == EAGAIN)
+			return;
+
+		if (n <= 0)
+		{
+			fail();
+			return;
+		}
+
+		input_size += n;
+		std::string_view raw(input.get(), input_size);
+		while (true)
+		{
+			auto result = parser.parse(raw);
+			if (result == ParseResult::Incomplete)
+				break;
+
+			if (result == ParseResult::Error || !handle_message())
+			{
+				fail();
+				return;
+			}
+			parser.reset();
+			if (fd < 0)
+				return;
+		}
+
+		input_size = raw.size();
+		std::memmove(input.get(), raw.data(), raw.size());
+	}
+}
+
+bool Session::handle_message()
+{
+	last_received = Clock::now();
+	test_request_pending = false;
+	if (parser.find(SenderCompID) != options.target_comp_id || parser.find(TargetCompID) != options.sender_comp_id)
+		return false;
+
+	uint64_t seq;
+	if (!parser.find(MsgSeqNum, seq))
+		return false;
+
+	auto msg_type = parser.get_msg_type();
+	if (msg_type == "A")
+	{
+		if (status != Status::LogonSent)
+			return false;
+
+		if (parser.find(ResetSeqNumFlag) == "Y")
+			store.set_next_inbound(1);
+		change(Status::Active);
+		mark(LogonTimer, std::chrono::milliseconds{-1});
+		mark(HeartbeatTimer, options.heartbeat_interval);
+		mark(InboundTimer, options.heartbeat_interval + options.heartbeat_interval / 5);
+		if (fd < 0)
+			return true;
+	}
+	else if (status == Status::LogonSent)
+		return false;
+
+	if (msg_type == "4" && parser.find(GapFillFlag) != "Y")
+	{
+		uint64_t new_seq;
+		if (!parser.find(NewSeqNo, new_seq))
+			return false;
+
+		// Going back would accept again what was processed already
+		if (auto expected = store.next_inbound(); new_seq < expected)
+		{
+			send_logout("NewSeqNo too low, expecting " + std::to_string(expected));
+			flush();
+			return false;
+		}
+
+		store.set_next_inbound(new_seq);
+		if (resend_target != 0 && new_seq > resend_target)
+			resend_target = 0;
+		return true;
+	}
+
+	auto expected = store.next_inbound();
+	if (seq < expected)
+	{
+		if (parser.find(PossDupFlag) == "Y")
+			return true;
+
+		send_logout("MsgSeqNum too low, expecting " + std::to_string(expected));
+		flush();
+		return false;
+	}
+
+	if (seq > expected)
+	{
+		if (resend_target == 0)
+		{
+			begin("2", store.next_outbound());
+			encoder.add(BeginSeqNo, expected);
+			encoder.add(EndSeqNo, 0);
+			transmit(true);
+			resend_target = seq;
+		}
+
+		// Served even through the gap, lest both sides wait on each other
+		if (msg_type == "2" || msg_type == "5")
+			handle_admin(msg_type);
+		return true;
+	}
+
+	store.set_next_inbound(seq + 1);
+	if (resend_target != 0 && seq >= resend_target)
+		resend_target = 0;
+
+	if (msg_type.size() == 1 && (msg_type[0] <= '5' || msg_type[0] == 'A'))
+		handle_admin(msg_type);
+	else if (on_message)
+		on_message(parser);
+	return true;
+}
+
+void Session::handle_admin(std::string_view msg_type)
+{
+	switch (msg_type[0])
+	{
+	case '1':
+		send_heartbeat(parser.find(TestReqID));
+		break;
+	case '2':
+	{
+		uint64_t begin_seq;
+		uint64_t end_seq;
+		if (parser.find(BeginSeqNo, begin_seq) && parser.find(EndSeqNo, end_seq))
+			resend(begin_seq, end_seq);
+		break;
+	}
+	case '3':
+		if (on_message)
+			on_message(parser);
+		break;
+	case '4':
+	{
+		uint64_t new_seq;
+		if (parser.find(NewSeqNo, new_seq) && new_seq > store.next_inbound())
+			store.set_next_inbound(new_seq);
+		break;
+	}
+	case '5':
+		if (status != Status::LogoutSent)
+		{
+			send_logout({});
+			flush();
+		}
+		fail();
+		break;
+	default:
+		break;
+	}
+}
+
+void Session::expire(int timer)
+{
+	auto now = Clock::now();
+	auto interval = options.heartbeat_interval;
+	switch (timer)
+	{
+	case LogonTimer:
+		fail();
+		break;
+	case HeartbeatTimer:
+		if (now - last_sent >= interval)
+		{
+			send_heartbeat({});
+			mark(HeartbeatTimer, interval);
+		}
+		else
+			mark(HeartbeatTimer, interval - (now - last_sent));
+		break;
+	case InboundTimer:
+	{
+		auto limit = interval + interval / 5;
+		if (now - last_received < limit)
+			mark(InboundTimer, limit - (now - last_received));
+		else if (test_request_pending)
+			fail();
+		else
+		{
+			begin("1", store.next_outbound());
+			encoder.add(TestReqID, ++test_request_count);
+			transmit(true);
+			test_request_pending = true;
+			mark(InboundTimer, limit);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void Session::mark(Timer timer, Clock::duration timeout)
+{
+	auto ms = timeout < Clock::duration::zero() ? -1 : std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+	if (fd >= 0)
+		poller_mark(timer, static_cast<int>(ms), handle, poller);
+}
+
+void Session::change(Status status_)
+{
+	status = status_;
+	if (on_status)
+		on_status(status);
+}
+
+void Session::flush()
+{
+	if (status != Status::Connecting)
+		flush_output(fd, output, output_offset);
+}
+
+void Session::fail()
+{
+	if (fd < 0)
+		return;
+
+	poller_del(fd, poller);
+	::close(fd);
+	fd = -1;
+	handle = nullptr;
+	change(Status::Disconnected);
+}
+
+void Session::on_readable(handle_t *, void * context)
+{
+	static_cast<Session *>(context)->receive();
+}
+
+void Session::on_writable(handle_t *, void * context)
+{
+	auto session = static_cast<Session *>(context);
+	if (session->status == Status::Connecting)
+	{
+		if (!is_established(session->fd))
+		{
+			session->fail();
+			return;
+		}
+		session->change(Status::LogonSent);
+		session->send_logon();
+		return;
+	}
+	session->flush();
+}
+
+void Session::on_timeout(handle_t *, void * context, int ack)
+{
+	static_cast<Session *>(context)->expire(ack);
+}
+
+}
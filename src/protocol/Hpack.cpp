@@ -0,0 +1,525 @@
+#include <array>
+#include <utility>
+
+#include "Hpack.h"
+
+namespace extra::protocol::hpack
+{
+namespace
+{
+struct HuffmanCode
+{
+	uint32_t code;
+	uint8_t length;
+};
+
+constexpr HuffmanCode huffman_table[257] = {
+	{0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+	{0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+	{0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+	{0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+	{0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+	{0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+	{0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+	{0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+	{0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+	{0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+	{0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+	{0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+	{0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+	{0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+	{0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+	{0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+	{0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+	{0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+	{0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+	{0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+	{0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+	{0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+	{0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+	{0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+	{0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+	{0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+	{0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+	{0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+	{0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+	{0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+	{0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+	{0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+	{0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+	{0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+	{0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+	{0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+	{0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+	{0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+	{0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+	{0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+	{0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+	{0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+	{0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+	{0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+	{0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+	{0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+	{0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+	{0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+	{0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+	{0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+	{0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+	{0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+	{0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+	{0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+	{0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+	{0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+	{0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+	{0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+	{0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+	{0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+	{0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+	{0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+	{0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+	{0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+	{0x3fffffff, 30}, // EOS
+};
+
+constexpr std::pair<std::string_view, std::string_view> static_table[61] = {
+	{":authority", ""},
+	{":method", "GET"},
+	{":method", "POST"},
+	{":path", "/"},
+	{":path", "/index.html"},
+	{":scheme", "http"},
+	{":scheme", "https"},
+	{":status", "200"},
+	{":status", "204"},
+	{":status", "206"},
+	{":status", "304"},
+	{":status", "400"},
+	{":status", "404"},
+	{":status", "500"},
+	{"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"},
+	{"accept-language", ""},
+	{"accept-ranges", ""},
+	{"accept", ""},
+	{"access-control-allow-origin", ""},
+	{"age", ""},
+	{"allow", ""},
+	{"authorization", ""},
+	{"cache-control", ""},
+	{"content-disposition", ""},
+	{"content-encoding", ""},
+	{"content-language", ""},
+	{"content-length", ""},
+	{"content-location", ""},
+	{"content-range", ""},
+	{"content-type", ""},
+	{"cookie", ""},
+	{"date", ""},
+	{"etag", ""},
+	{"expect", ""},
+	{"expires", ""},
+	{"from", ""},
+	{"host", ""},
+	{"if-match", ""},
+	{"if-modified-since", ""},
+	{"if-none-match", ""},
+	{"if-range", ""},
+	{"if-unmodified-since", ""},
+	{"last-modified", ""},
+	{"link", ""},
+	{"location", ""},
+	{"max-forwards", ""},
+	{"proxy-authenticate", ""},
+	{"proxy-authorization", ""},
+	{"range", ""},
+	{"referer", ""},
+	{"refresh", ""},
+	{"retry-after", ""},
+	{"server", ""},
+	{"set-cookie", ""},
+	{"strict-transport-security", ""},
+	{"transfer-encoding", ""},
+	{"user-agent", ""},
+	{"vary", ""},
+	{"via", ""},
+	{"www-authenticate", ""},
+};
+
+constexpr size_t eos = 256;
+
+/**
+ * Binary trie of the Huffman codes, decoding walks one bit per step.
+ */
+class HuffmanTree
+{
+public:
+	struct Node
+	{
+		int16_t child[2];
+		int16_t symbol;
+	};
+
+private:
+	std::array<Node, 2 * 257> nodes;
+	size_t count;
+
+public:
+	HuffmanTree()
+		: nodes{}, count{1}
+	{
+		nodes[0] = {{0, 0}, -1};
+		for (size_t symbol = 0; symbol <= eos; symbol++)
+		{
+			const auto & [code, length] = huffman_table[symbol];
+			size_t node = 0;
+			for (int i = length - 1; i >= 0; i--)
+			{
+				int bit = (code >> i) & 1;
+				if (nodes[node].child[bit] == 0)
+				{
+					nodes[count] = {{0, 0}, -1};
+					nodes[node].child[bit] = static_cast<int16_t>(count++);
+				}
+				node = nodes[node].child[bit];
+			}
+			nodes[node].symbol = static_cast<int16_t>(symbol);
+		}
+	}
+
+	[[nodiscard]] const Node & operator[](size_t i) const
+	{
+		return nodes[i];
+	}
+};
+
+const HuffmanTree & huffman_tree()
+{
+	static const HuffmanTree tree;
+	return tree;
+}
+
+void encode_string(std::string & out, std::string_view s)
+{
+	if (auto length = huffman_length(s); length < s.size())
+	{
+		encode_integer(out, 0x80, 7, length);
+		huffman_encode(s, out);
+	}
+	else
+	{
+		encode_integer(out, 0x00, 7, s.size());
+		out += s;
+	}
+}
+
+/**
+ * Values that change on every request would only churn the dynamic table.
+ */
+bool worth_indexing(std::string_view name)
+{
+	return name != ":path" && name != "content-length" && name != "date" && name != "etag"
+	       && name != "if-none-match" && name != "if-modified-since";
+}
+}
+
+void huffman_encode(std::string_view in, std::string & out)
+{
+	uint64_t bits = 0;
+	int pending = 0;
+	for (auto c: in)
+	{
+		const auto & [code, length] = huffman_table[static_cast<uint8_t>(c)];
+		bits = (bits << length) | code;
+		pending += length;
+		while (pending >= 8)
+		{
+			pending -= 8;
+			out += static_cast<char>(bits >> pending);
+		}
+	}
+
+	if (pending > 0)
+		out += static_cast<char>((bits << (8 - pending)) | (0xFF >> pending));
+}
+
+size_t huffman_length(std::string_view in)
+{
+	size_t bits = 0;
+	for (auto c: in)
+		bits += huffman_table[static_cast<uint8_t>(c)].length;
+	return (bits + 7) / 8;
+}
+
+bool huffman_decode(std::string_view in, std::string & out)
+{
+	const auto & tree = huffman_tree();
+	size_t node = 0;
+	int depth = 0;
+	bool ones = true;
+	for (auto c: in)
+	{
+		for (int i = 7; i >= 0; i--)
+		{
+			int bit = (static_cast<uint8_t>(c) >> i) & 1;
+			node = tree[node].child[bit];
+			if (node == 0)
+				return false;
+
+			depth++;
+			ones = ones && bit;
+			if (auto symbol = tree[node].symbol; symbol >= 0)
+			{
+				if (symbol == eos)
+					return false;
+
+				out += static_cast<char>(symbol);
+				node = 0;
+				depth = 0;
+				ones = true;
+			}
+		}
+	}
+	// Padding is the most significant bits of EOS, strictly shorter than 8 bits
+	return depth < 8 && ones;
+}
+
+void encode_integer(std::string & out, uint8_t first, int prefix, uint64_t value)
+{
+	uint64_t limit = (1u << prefix) - 1;
+	if (value < limit)
+	{
+		out += static_cast<char>(first | value);
+		return;
+	}
+
+	out += static_cast<char>(first | limit);
+	value -= limit;
+	while (value >= 0x80)
+	{
+		out += static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	out += static_cast<char>(value);
+}
+
+bool decode_integer(std::string_view & in, int prefix, uint64_t & value)
+{
+	if (in.empty())
+		return false;
+
+	uint64_t limit = (1u << prefix) - 1;
+	value = static_cast<uint8_t>(in.front()) & limit;
+	in.remove_prefix(1);
+	if (value < limit)
+		return true;
+
+	for (int shift = 0; shift <= 56; shift += 7)
+	{
+		if (in.empty())
+			return false;
+
+		auto b = static_cast<uint8_t>(in.front());
+		in.remove_prefix(1);
+		value += static_cast<uint64_t>(b & 0x7F) << shift;
+		if ((b & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+void Table::insert(std::string_view name, std::string_view value)
+{
+	auto entry_size = name.size() + value.size() + entry_overhead;
+	if (entry_size > max_size)
+	{
+		evict(0);
+		return;
+	}
+
+	evict(max_size - entry_size);
+	entries.push_front({std::string(name), std::string(value)});
+	size += entry_size;
+}
+
+void Table::set_max_size(size_t max_size_)
+{
+	max_size = max_size_;
+	evict(max_size);
+}
+
+bool Table::get(size_t index, std::string_view & name, std::string_view & value) const
+{
+	if (index == 0)
+		return false;
+
+	if (index <= static_count)
+	{
+		std::tie(name, value) = static_table[index - 1];
+		return true;
+	}
+
+	index -= static_count + 1;
+	if (index >= entries.size())
+		return false;
+
+	name = entries[index].name;
+	value = entries[index].value;
+	return true;
+}
+
+size_t Table::find(std::string_view name, std::string_view value, bool & value_match) const
+{
+	size_t name_index = 0;
+	for (size_t i = 0; i < static_count; i++)
+	{
+		if (static_table[i].first != name)
+			continue;
+
+		if (static_table[i].second == value)
+		{
+			value_match = true;
+			return i + 1;
+		}
+
+		if (name_index == 0)
+			name_index = i + 1;
+	}
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (entries[i].name != name)
+			continue;
+
+		if (entries[i].value == value)
+		{
+			value_match = true;
+			return static_count + 1 + i;
+		}
+
+		if (name_index == 0)
+			name_index = static_count + 1 + i;
+	}
+
+	value_match = false;
+	return name_index;
+}
+
+void Table::evict(size_t limit)
+{
+	while (size > limit)
+	{
+		size -= entries.back().name.size() + entries.back().value.size() + entry_overhead;
+		entries.pop_back();
+	}
+}
+
+bool Decoder::decode(std::string_view block, const Callback & on_header)
+{
+	while (!block.empty())
+	{
+		auto b = static_cast<uint8_t>(block.front());
+		uint64_t index;
+		std::string_view n;
+		std::string_view v;
+
+		if (b & 0x80)
+		{
+			if (!decode_integer(block, 7, index) || !table.get(index, n, v))
+				return false;
+
+			on_header(n, v);
+			continue;
+		}
+
+		if ((b & 0xE0) == 0x20)
+		{
+			if (!decode_integer(block, 5, index) || index > max_size_limit)
+				return false;
+
+			table.set_max_size(index);
+			continue;
+		}
+
+		bool indexing = (b & 0xC0) == 0x40;
+		if (!decode_integer(block, indexing ? 6 : 4, index))
+			return false;
+
+		if (index == 0)
+		{
+			name.clear();
+			if (!decode_string(block, name))
+				return false;
+		}
+		else
+		{
+			if (!table.get(index, n, v))
+				return false;
+			// Copied, inserting may evict the entry referred
+			name = n;
+		}
+
+		value.clear();
+		if (!decode_string(block, value))
+			return false;
+
+		on_header(name, value);
+		if (indexing)
+			table.insert(name, value);
+	}
+	return true;
+}
+
+bool Decoder::decode_string(std::string_view & block, std::string & out)
+{
+	if (block.empty())
+		return false;
+
+	bool huffman = static_cast<uint8_t>(block.front()) & 0x80;
+	uint64_t length;
+	if (!decode_integer(block, 7, length) || length > block.size())
+		return false;
+
+	auto s = block.substr(0, length);
+	block.remove_prefix(length);
+	if (huffman)
+		return huffman_decode(s, out);
+
+	out += s;
+	return true;
+}
+
+void Encoder::begin(std::string & out)
+{
+	if (size_update)
+	{
+		encode_integer(out, 0x20, 5, pending_max_size);
+		table.set_max_size(pending_max_size);
+		size_update = false;
+	}
+}
+
+void Encoder::encode(std::string & out, std::string_view name, std::string_view value, bool sensitive)
+{
+	bool value_match = false;
+	auto index = table.find(name, value, value_match);
+	if (value_match && !sensitive)
+	{
+		encode_integer(out, 0x80, 7, index);
+		return;
+	}
+
+	bool indexing = !sensitive && worth_indexing(name);
+	if (indexing)
+		encode_integer(out, 0x40, 6, index);
+	else
+		encode_integer(out, sensitive ? 0x10 : 0x00, 4, index);
+
+	if (index == 0)
+		encode_string(out, name);
+	encode_string(out, value);
+
+	if (indexing)
+		table.insert(name, value);
+}
+
+}
@@ -0,0 +1,741 @@
+#include <algorithm>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Connection.h"
+#include "Http2.h"
+
+namespace extra::protocol::http
+{
+namespace
+{
+void put16(std::string & output, uint16_t value)
+{
+	output += static_cast<char>(value >> 8);
+	output += static_cast<char>(value);
+}
+
+void put32(std::string & output, uint32_t value)
+{
+	put16(output, value >> 16);
+	put16(output, value);
+}
+
+uint16_t get16(const char * p)
+{
+	auto u = reinterpret_cast<const uint8_t *>(p);
+	return static_cast<uint16_t>(u[0] << 8 | u[1]);
+}
+
+uint32_t get32(const char * p)
+{
+	return static_cast<uint32_t>(get16(p)) << 16 | get16(p + 2);
+}
+
+h2::FrameHeader decode_frame_header(const char * p)
+{
+	auto u = reinterpret_cast<const uint8_t *>(p);
+	return {
+		static_cast<uint32_t>(u[0] << 16 | u[1] << 8 | u[2]),
+		static_cast<h2::FrameType>(u[3]),
+		u[4],
+		get32(p + 5) & 0x7fffffff,
+	};
+}
+
+/**
+ * Remove padding, and the priority fields of HEADERS.
+ */
+bool strip(const h2::FrameHeader & header, std::string_view & payload)
+{
+	if (header.flags & h2::Padded)
+	{
+		if (payload.empty())
+			return false;
+
+		size_t padding = static_cast<uint8_t>(payload.front());
+		payload.remove_prefix(1);
+		if (padding > payload.size())
+			return false;
+		payload.remove_suffix(padding);
+	}
+
+	if (header.type == h2::FrameType::Headers && (header.flags & h2::Priority))
+	{
+		if (payload.size() < 5)
+			return false;
+		payload.remove_prefix(5);
+	}
+	return true;
+}
+
+/**
+ * Call f(key, value) for each line of a header block built by HttpRequestBasic::append_header.
+ */
+template <typename F>
+void for_each_header(std::string_view block, F f)
+{
+	while (!block.empty())
+	{
+		auto end = block.find(CRLF);
+		auto line = block.substr(0, end);
+		block.remove_prefix(end == std::string_view::npos ? block.size() : end + CRLF.size());
+
+		auto colon = line.find(':');
+		if (colon == std::string_view::npos)
+			continue;
+
+		auto value = line.substr(colon + 1);
+		while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+			value.remove_prefix(1);
+		f(line.substr(0, colon), value);
+	}
+}
+
+/**
+ * Connection-specific headers are malformed in HTTP/2, RFC 9113 8.2.2.
+ */
+bool is_connection_specific(std::string_view name)
+{
+	return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+	       || name == "transfer-encoding" || name == "upgrade" || name == "host";
+}
+}
+
+namespace h2
+{
+void encode_frame_header(std::string & output, const FrameHeader & header)
+{
+	output += static_cast<char>(header.length >> 16);
+	put16(output, header.length);
+	output += static_cast<char>(header.type);
+	output += static_cast<char>(header.flags);
+	put32(output, header.stream_id);
+}
+
+void encode_frame(std::string & output, FrameType type, uint8_t flags, uint32_t stream_id, std::string_view payload)
+{
+	encode_frame_header(output, {static_cast<uint32_t>(payload.size()), type, flags, stream_id});
+	output += payload;
+}
+
+ParseResult FrameParser::parse(std::string_view & raw)
+{
+	if (buffer.empty() && raw.size() >= frame_header_length)
+	{
+		header = decode_frame_header(raw.data());
+		if (header.length > max_frame_size)
+			return ParseResult::Error;
+
+		if (raw.size() >= frame_header_length + header.length)
+		{
+			payload = raw.substr(frame_header_length, header.length);
+			raw.remove_prefix(frame_header_length + header.length);
+			complete = true;
+			return ParseResult::Complete;
+		}
+	}
+
+	if (buffer.size() < frame_header_length)
+	{
+		auto n = std::min(frame_header_length - buffer.size(), raw.size());
+		buffer.append(raw.substr(0, n));
+		raw.remove_prefix(n);
+		if (buffer.size() < frame_header_length)
+			return ParseResult::Incomplete;
+
+		header = decode_frame_header(buffer.data());
+		if (header.length > max_frame_size)
+			return ParseResult::Error;
+	}
+
+	auto total = frame_header_length + header.length;
+	auto n = std::min(total - buffer.size(), raw.size());
+	buffer.append(raw.substr(0, n));
+	raw.remove_prefix(n);
+	if (buffer.size() < total)
+		return ParseResult::Incomplete;
+
+	payload = std::string_view(buffer).substr(frame_header_length);
+	complete = true;
+	return ParseResult::Complete;
+}
+
+}
+
+Http2Client::Http2Client(poller_t * poller_, Options options_)
+	: poller{poller_}, options{options_}, fd{-1}, connected{false}, goaway{false}, authority{}, next_stream_id{1}
+	, peer_max_concurrent_streams{assumed_max_concurrent_streams}
+	, peer_initial_window_size{h2::default_window_size}, peer_max_frame_size{h2::default_max_frame_size}
+	, send_window{h2::default_window_size}, receive_window{h2::default_window_size}
+	, encoder{}, decoder{options.header_table_size}, parser{options.max_frame_size}
+	, continuation_stream{0}, continuation_end_stream{false}, header_block{}
+	, streams{}, pending{}, output{}, output_offset{0}
+	, input{new char[input_capacity]}
+{
+}
+
+Http2Client::~Http2Client()
+{
+	if (fd >= 0)
+	{
+		poller_del(fd, poller);
+		::close(fd);
+	}
+}
+
+bool Http2Client::connect(const std::string & address, uint16_t port)
+{
+	if (fd >= 0)
+		return false;
+
+	handle_param param{};
+	param.context = this;
+	param.on_readable = on_readable;
+	param.on_writable = on_writable;
+	fd = open_connection(address, port, param, poller);
+	if (fd < 0)
+		return false;
+
+	connected = false;
+	goaway = false;
+	authority = address + ':' + std::to_string(port);
+	next_stream_id = 1;
+	peer_max_concurrent_streams = assumed_max_concurrent_streams;
+	peer_initial_window_size = h2::default_window_size;
+	peer_max_frame_size = h2::default_max_frame_size;
+	send_window = h2::default_window_size;
+	receive_window = std::max(options.initial_window_size, h2::default_window_size);
+	encoder = hpack::Encoder{};
+	decoder = hpack::Decoder{options.header_table_size};
+	parser = h2::FrameParser{options.max_frame_size};
+	continuation_stream = 0;
+
+	std::string settings;
+	put16(settings, static_cast<uint16_t>(h2::Setting::EnablePush));
+	put32(settings, 0);
+	put16(settings, static_cast<uint16_t>(h2::Setting::InitialWindowSize));
+	put32(settings, options.initial_window_size);
+	put16(settings, static_cast<uint16_t>(h2::Setting::MaxFrameSize));
+	put32(settings, options.max_frame_size);
+	put16(settings, static_cast<uint16_t>(h2::Setting::HeaderTableSize));
+	put32(settings, options.header_table_size);
+
+	output = h2::preface;
+	output_offset = 0;
+	h2::encode_frame(output, h2::FrameType::Settings, 0, 0, settings);
+	if (receive_window > h2::default_window_size)
+	{
+		std::string increment;
+		put32(increment, receive_window - h2::default_window_size);
+		h2::encode_frame(output, h2::FrameType::WindowUpdate, 0, 0, increment);
+	}
+	return true;
+}
+
+bool Http2Client::send(const HttpRequestV2 & request, Callback callback, HttpResponseBasic::BodySink sink)
+{
+	if (fd < 0 || goaway || next_stream_id > h2::max_stream_id)
+		return false;
+
+	if (streams.size() >= peer_max_concurrent_streams)
+		pending.push_back({request, std::move(callback), std::move(sink)});
+	else
+		open_stream(request, std::move(callback), std::move(sink));
+	return true;
+}
+
+void Http2Client::open_stream(const HttpRequestV2 & request, Callback callback, HttpResponseBasic::BodySink sink)
+{
+	auto id = next_stream_id;
+	next_stream_id += 2;
+
+	std::string block;
+	encode_headers(request, block);
+
+	const auto & body = request.get_body();
+	std::string_view rest = block;
+	auto type = h2::FrameType::Headers;
+	uint8_t flags = body.empty() ? h2::EndStream : 0;
+	do
+	{
+		auto fragment = rest.substr(0, peer_max_frame_size);
+		rest.remove_prefix(fragment.size());
+		h2::encode_frame(output, type, flags | (rest.empty() ? h2::EndHeaders : 0), id, fragment);
+		type = h2::FrameType::Continuation;
+		flags = 0;
+	} while (!rest.empty());
+
+	auto stream = std::unique_ptr<Stream>(new Stream{
+		id, std::move(callback), {}, body, 0, peer_initial_window_size, options.initial_window_size
+	});
+	stream->response.set_body_sink(std::move(sink));
+	write_data(*streams.emplace(id, std::move(stream)).first->second);
+	flush();
+}
+
+void Http2Client::encode_headers(const HttpRequestV2 & request, std::string & block)
+{
+	std::string_view host = authority;
+	for_each_header(request.get_header_block(), [&host](std::string_view key, std::string_view value)
+	{
+		if (key.size() == 4 && strncasecmp(key.data(), "host", 4) == 0)
+			host = value;
+	});
+
+	encoder.begin(block);
+	encoder.encode(block, ":method", request.get_method());
+	encoder.encode(block, ":scheme", "http");
+	encoder.encode(block, ":authority", host);
+	encoder.encode(block, ":path", request.get_uri().empty() ? "/" : std::string_view(request.get_uri()));
+
+	std::string name;
+	for_each_header(request.get_header_block(), [this, &block, &name](std::string_view key, std::string_view value)
+	{
+		name.assign(key);
+		std::transform(name.begin(), name.end(), name.begin(), [](char c)
+		{
+			return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+		});
+		if (is_connection_specific(name) || (name == "te" && value != "trailers"))
+			return;
+
+		encoder.encode(block, name, value, name == "authorization" || name == "proxy-authorization");
+	});
+}
+
+void Http2Client::write_data(Stream & stream)
+{
+	while (stream.body_offset < stream.body.size() && send_window > 0 && stream.send_window > 0)
+	{
+		auto n = std::min({
+			stream.body.size() - stream.body_offset, static_cast<size_t>(send_window),
+			static_cast<size_t>(stream.send_window), static_cast<size_t>(peer_max_frame_size)
+		});
+		bool last = stream.body_offset + n == stream.body.size();
+		h2::encode_frame(output, h2::FrameType::Data, last ? h2::EndStream : 0, stream.id,
+			std::string_view(stream.body).substr(stream.body_offset, n));
+		stream.body_offset += n;
+		send_window -= n;
+		stream.send_window -= n;
+	}
+}
+
+void Http2Client::dispatch_pending()
+{
+	while (fd >= 0 && !goaway && !pending.empty() && streams.size() < peer_max_concurrent_streams
+	       && next_stream_id <= h2::max_stream_id)
+	{
+		auto next = std::move(pending.front());
+		pending.pop_front();
+		open_stream(next.request, std::move(next.callback), std::move(next.sink));
+	}
+}
+
+void Http2Client::receive()
+{
+	while (fd >= 0)
+	{
+		auto n = recv(fd, input.get(), input_capacity, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0 && errno == EAGAIN)
+			break;
+
+		if (n <= 0)
+		{
+			fail(State::NetworkError, NoError);
+			return;
+		}
+
+		std::string_view raw(input.get(), n);
+		while (!raw.empty())
+		{
+			auto result = parser.parse(raw);
+			if (result == ParseResult::Incomplete)
+				break;
+
+			if (result == ParseResult::Error)
+			{
+				connection_error(h2::ErrorCode::FrameSizeError);
+				return;
+			}
+
+			bool alive = process(parser.get_header(), parser.get_payload());
+			parser.reset();
+			if (!alive)
+				return;
+		}
+	}
+	flush();
+}
+
+bool Http2Client::process(const h2::FrameHeader & header, std::string_view payload)
+{
+	using h2::FrameType;
+
+	if (continuation_stream != 0 && (header.type != FrameType::Continuation || header.stream_id != continuation_stream))
+	{
+		connection_error(h2::ErrorCode::ProtocolError);
+		return false;
+	}
+
+	switch (header.type)
+	{
+	case FrameType::Data:
+	{
+		if (header.stream_id == 0 || !strip(header, payload))
+			break;
+
+		if (header.length > receive_window)
+		{
+			connection_error(h2::ErrorCode::FlowControlError);
+			return false;
+		}
+		receive_window -= header.length;
+
+		// Data of streams reset or completed still counts against the connection window
+		if (auto iter = streams.find(header.stream_id); iter != streams.end())
+		{
+			auto & stream = *iter->second;
+			if (header.length > stream.receive_window)
+			{
+				connection_error(h2::ErrorCode::FlowControlError);
+				return false;
+			}
+			stream.receive_window -= header.length;
+			if (!stream.response.append_body(payload))
+			{
+				// Over the body length limit, only this stream is given up
+				std::string code;
+				put32(code, static_cast<uint32_t>(h2::ErrorCode::Cancel));
+				h2::encode_frame(output, h2::FrameType::RstStream, 0, header.stream_id, code);
+				reset_stream(header.stream_id, State::NetworkError, ParseError);
+				dispatch_pending();
+			}
+			else if (header.flags & h2::EndStream)
+				complete(header.stream_id);
+			else
+				window_update(header.stream_id, stream.receive_window, options.initial_window_size);
+		}
+		window_update(0, receive_window, std::max(options.initial_window_size, h2::default_window_size));
+		return fd >= 0;
+	}
+
+	case FrameType::Headers:
+		if (header.stream_id == 0 || !strip(header, payload))
+			break;
+
+		header_block.assign(payload);
+		if (header.flags & h2::EndHeaders)
+			return finish_headers(header.stream_id, header.flags & h2::EndStream);
+
+		continuation_stream = header.stream_id;
+		continuation_end_stream = header.flags & h2::EndStream;
+		return true;
+
+	case FrameType::Continuation:
+		if (continuation_stream == 0)
+			break;
+
+		header_block += payload;
+		if (header.flags & h2::EndHeaders)
+		{
+			continuation_stream = 0;
+			return finish_headers(header.stream_id, continuation_end_stream);
+		}
+		return true;
+
+	case FrameType::RstStream:
+		if (header.stream_id == 0 || payload.size() != 4)
+			break;
+
+		reset_stream(header.stream_id, State::NetworkError, NoError);
+		dispatch_pending();
+		return fd >= 0;
+
+	case FrameType::Settings:
+		if (header.stream_id != 0 || payload.size() % 6 != 0 || ((header.flags & h2::Ack) && !payload.empty()))
+			break;
+
+		if (header.flags & h2::Ack)
+			return true;
+
+		h2::encode_frame(output, FrameType::Settings, h2::Ack, 0, {});
+		return apply_settings(payload);
+
+	case FrameType::Ping:
+		if (header.stream_id != 0 || payload.size() != 8)
+			break;
+
+		if (!(header.flags & h2::Ack))
+			h2::encode_frame(output, FrameType::Ping, h2::Ack, 0, payload);
+		return true;
+
+	case FrameType::Goaway:
+	{
+		if (header.stream_id != 0 || payload.size() < 8)
+			break;
+
+		// Streams above the last one were not processed, nothing is sent any more
+		goaway = true;
+		auto last_stream_id = get32(payload.data()) & 0x7fffffff;
+		std::vector<uint32_t> unprocessed;
+		for (const auto & [id, _]: streams)
+		{
+			if (id > last_stream_id)
+				unprocessed.push_back(id);
+		}
+		for (auto id: unprocessed)
+			reset_stream(id, State::NetworkError, NoError);
+
+		auto waiting = std::move(pending);
+		pending.clear();
+		for (auto & p: waiting)
+		{
+			if (p.callback)
+				p.callback(State::NetworkError, NoError, nullptr);
+		}
+		return fd >= 0;
+	}
+
+	case FrameType::WindowUpdate:
+	{
+		if (payload.size() != 4)
+			break;
+
+		auto increment = get32(payload.data()) & 0x7fffffff;
+		if (increment == 0)
+			break;
+
+		if (header.stream_id == 0)
+		{
+			send_window += increment;
+			if (send_window > h2::max_window_size)
+			{
+				connection_error(h2::ErrorCode::FlowControlError);
+				return false;
+			}
+			for (auto & [_, stream]: streams)
+				write_data(*stream);
+		}
+		else if (auto iter = streams.find(header.stream_id); iter != streams.end())
+		{
+			auto & stream = *iter->second;
+			stream.send_window += increment;
+			if (stream.send_window > h2::max_window_size)
+			{
+				connection_error(h2::ErrorCode::FlowControlError);
+				return false;
+			}
+			write_data(stream);
+		}
+		return true;
+	}
+
+	case FrameType::PushPromise:
+		// Disabled by SETTINGS_ENABLE_PUSH
+		break;
+
+	default:
+		// PRIORITY and unknown frame types are ignored
+		return true;
+	}
+
+	connection_error(h2::ErrorCode::ProtocolError);
+	return false;
+}
+
+bool Http2Client::finish_headers(uint32_t stream_id, bool end_stream)
+{
+	// Decoded even for unknown streams, the dynamic table has to stay in sync
+	auto iter = streams.find(stream_id);
+	auto stream = iter == streams.end() ? nullptr : iter->second.get();
+	bool informational = false;
+	bool decoded = decoder.decode(header_block, [stream, &informational](std::string_view name, std::string_view value)
+	{
+		if (stream == nullptr)
+			return;
+
+		if (name == ":status")
+		{
+			informational = !value.empty() && value.front() == '1';
+			stream->response.set_status_line(VersionString<Version::_2>, value);
+		}
+		else if (name.empty() || name.front() != ':')
+			stream->response.add_header(name, value);
+	});
+	header_block.clear();
+
+	if (!decoded)
+	{
+		connection_error(h2::ErrorCode::CompressionError);
+		return false;
+	}
+
+	if (stream != nullptr && informational)
+		stream->response.reset();
+	else if (stream != nullptr && end_stream)
+		complete(stream_id);
+	return fd >= 0;
+}
+
+bool Http2Client::apply_settings(std::string_view payload)
+{
+	for (; !payload.empty(); payload.remove_prefix(6))
+	{
+		auto value = get32(payload.data() + 2);
+		switch (static_cast<h2::Setting>(get16(payload.data())))
+		{
+		case h2::Setting::HeaderTableSize:
+			encoder.set_max_size(std::min<size_t>(value, hpack::Table::default_max_size));
+			break;
+
+		case h2::Setting::MaxConcurrentStreams:
+			peer_max_concurrent_streams = value;
+			break;
+
+		case h2::Setting::InitialWindowSize:
+			if (value > h2::max_window_size)
+			{
+				connection_error(h2::ErrorCode::FlowControlError);
+				return false;
+			}
+			for (auto & [_, stream]: streams)
+				stream->send_window += static_cast<int64_t>(value) - peer_initial_window_size;
+			peer_initial_window_size = value;
+			break;
+
+		case h2::Setting::MaxFrameSize:
+			if (value < h2::default_max_frame_size || value > h2::max_frame_size_limit)
+			{
+				connection_error(h2::ErrorCode::ProtocolError);
+				return false;
+			}
+			peer_max_frame_size = value;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	for (auto & [_, stream]: streams)
+		write_data(*stream);
+	dispatch_pending();
+	return fd >= 0;
+}
+
+void Http2Client::complete(uint32_t stream_id)
+{
+	auto iter = streams.find(stream_id);
+	if (iter == streams.end())
+		return;
+
+	auto stream = std::move(iter->second);
+	streams.erase(iter);
+
+	// A response may come before the whole request body, stop sending it
+	if (stream->body_offset < stream->body.size())
+	{
+		std::string code;
+		put32(code, static_cast<uint32_t>(h2::ErrorCode::NoError));
+		h2::encode_frame(output, h2::FrameType::RstStream, 0, stream_id, code);
+	}
+
+	if (stream->callback)
+		stream->callback(State::Success, NoError, &stream->response);
+	dispatch_pending();
+}
+
+void Http2Client::reset_stream(uint32_t stream_id, State state, Error error)
+{
+	auto iter = streams.find(stream_id);
+	if (iter == streams.end())
+		return;
+
+	auto stream = std::move(iter->second);
+	streams.erase(iter);
+	if (stream->callback)
+		stream->callback(state, error, nullptr);
+}
+
+void Http2Client::window_update(uint32_t stream_id, int64_t & window, uint32_t target)
+{
+	if (window > target / 2)
+		return;
+
+	std::string increment;
+	put32(increment, static_cast<uint32_t>(target - window));
+	h2::encode_frame(output, h2::FrameType::WindowUpdate, 0, stream_id, increment);
+	window = target;
+}
+
+void Http2Client::flush()
+{
+	if (connected)
+		flush_output(fd, output, output_offset);
+}
+
+void Http2Client::connection_error(h2::ErrorCode code)
+{
+	std::string payload;
+	put32(payload, 0);
+	put32(payload, static_cast<uint32_t>(code));
+	h2::encode_frame(output, h2::FrameType::Goaway, 0, 0, payload);
+	flush();
+	fail(State::NetworkError, ParseError);
+}
+
+void Http2Client::fail(State state, Error error)
+{
+	if (fd < 0)
+		return;
+
+	poller_del(fd, poller);
+	::close(fd);
+	fd = -1;
+	connected = false;
+	output.clear();
+	output_offset = 0;
+
+	auto failed = std::move(streams);
+	streams.clear();
+	auto waiting = std::move(pending);
+	pending.clear();
+	for (auto & [_, stream]: failed)
+	{
+		if (stream->callback)
+			stream->callback(state, error, nullptr);
+	}
+	for (auto & p: waiting)
+	{
+		if (p.callback)
+			p.callback(state, error, nullptr);
+	}
+}
+
+void Http2Client::on_readable(handle_t *, void * context)
+{
+	static_cast<Http2Client *>(context)->receive();
+}
+
+void Http2Client::on_writable(handle_t *, void * context)
+{
+	auto client = static_cast<Http2Client *>(context);
+	if (!client->connected)
+	{
+		if (!is_established(client->fd))
+		{
+			client->fail(State::NetworkError, NoError);
+			return;
+		}
+		client->connected = true;
+	}
+	client->flush();
+}
+
+}
@@ -1,11 +1,59 @@
+#include <charconv>
+
 #include "HttpBasic.h"
+#include "Inflater.h"
 
 namespace extra::protocol::http
 {
-bool HttpResponseBasic::parse(std::string_view & raw)
+namespace
+{
+bool equal_ignore_case(std::string_view lhs, std::string_view rhs)
+{
+	return lhs.size() == rhs.size() && strncasecmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+std::string_view trim(std::string_view sv)
+{
+	auto first = sv.find_first_not_of(" \t");
+	if (first == std::string_view::npos)
+		return {};
+
+	return sv.substr(first, sv.find_last_not_of(" \t") - first + 1);
+}
+}
+
+HttpResponseBasic::HttpResponseBasic()
+	: version{}, status{}, phrase{}, headers{}, body{}
+	, line{}, key{}, spare_headers{}, header_count{0}, content_length{content_length_unknown}, body_received{0}
+	, chunk_remaining{0}, sink{}, inflater{}, content_decoding{true}, decoding{false}, head_request{false}
+	, chunked{false}
+	, parsing{ParsingStatusLine}, will_parse{ParsingStatusLine}
 {
+	line.reserve(line_initial_capacity);
+}
+
+HttpResponseBasic::~HttpResponseBasic() = default;
+
+HttpResponseBasic::HttpResponseBasic(HttpResponseBasic &&) noexcept = default;
+
+HttpResponseBasic & HttpResponseBasic::operator=(HttpResponseBasic &&) noexcept = default;
+
+bool HttpResponseBasic::is_content_decoding_supported()
+{
+#ifdef EXTRA_WITH_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+ParseResult HttpResponseBasic::parse(std::string_view & raw)
+{
+	if (parsing == ParsingFailed)
+		return ParseResult::Error;
+
 	bool good = true;
-	while (good && !raw.empty())
+	while (good && !raw.empty() && !is_complete())
 	{
 		switch (parsing)
 		{
@@ -24,9 +72,48 @@ bool HttpResponseBasic::parse(std::string_view & raw)
 		case ParsingBody:
 			good = parse_body(raw);
 			break;
+
+		case ParsingChunkSize:
+			good = parse_chunk_size(raw);
+			break;
+
+		case ParsingChunkData:
+			good = parse_chunk_data(raw);
+			break;
+
+		case ParsingTrailer:
+			good = parse_trailer(raw);
+			break;
+
+		case ParsingCR:
+			good = parse_cr(raw);
+			break;
+
+		case ParsingDone:
+		case ParsingFailed:
+			good = false;
+			break;
 		}
 	}
-	return good;
+
+	if (!good)
+	{
+		parsing = ParsingFailed;
+		return ParseResult::Error;
+	}
+	return is_complete() ? ParseResult::Complete : ParseResult::Incomplete;
+}
+
+bool HttpResponseBasic::parse_cr(std::string_view & raw)
+{
+	if (raw.front() == CR)
+	{
+		raw.remove_prefix(1);
+		parsing = ParsingLF;
+		return true;
+	}
+	else
+		return false;
 }
 
 bool HttpResponseBasic::parse_lf(std::string_view & raw)
@@ -105,18 +192,35 @@ bool HttpResponseBasic::parse_header(std::string_view & raw)
 
 	if (line.empty())
 	{
+		// Interim responses are dropped and the final one parsed in their place, 101 ends HTTP/1.x
+		if (status.size() == 3 && status.starts_with('1') && status != "101")
+		{
+			bool head = head_request;
+			reset();
+			head_request = head;
+			parsing = ParsingLF;
+			return true;
+		}
+
 		body.reserve(body_initial_capacity);
-		will_parse = ParsingBody;
+		if (!resolve_content_length() || !resolve_content_encoding())
+			return false;
+
+		will_parse = chunked ? ParsingChunkSize : ParsingBody;
 		return true;
 	}
 
+	// Each line may extend a value, so lines rather than distinct keys are counted
+	if (++header_count > header_count_limit)
+		return false;
+
 	if (line.front() != ' ' && line.front() != '\t')
 	{
 		pos = line.find(':');
 		if (pos == std::string::npos)
 			return false;
 
-		key = line.substr(0, pos);
+		key.assign(line, 0, pos);
 		pos++;
 	}
 	else
@@ -125,14 +229,15 @@ bool HttpResponseBasic::parse_header(std::string_view & raw)
 	pos = line.find_first_not_of(" \t", pos);
 	if (pos != std::string::npos)
 	{
-		auto value = line.substr(pos);
+		auto value = std::string_view(line).substr(pos);
+		value = value.substr(0, value.find_last_not_of(" \t") + 1);
 		if (auto iter = headers.find(key); iter != headers.end())
 		{
 			iter->second += ", ";
 			iter->second += value;
 		}
 		else
-			headers.insert({key, std::move(value)});
+			insert_header(value);
 	}
 
 	line.clear();
@@ -141,34 +246,334 @@ bool HttpResponseBasic::parse_header(std::string_view & raw)
 	return true;
 }
 
+/**
+ * Reuse a header node released by reset() if any.
+ */
+void HttpResponseBasic::insert_header(std::string_view value)
+{
+	if (spare_headers.empty())
+	{
+		headers.emplace(key, value);
+		return;
+	}
+
+	auto node = std::move(spare_headers.back());
+	spare_headers.pop_back();
+	node.key() = key;
+	node.mapped() = value;
+	headers.insert(std::move(node));
+}
+
+/**
+ * Called once all headers are parsed. Responses without Content-Length are delimited by close,
+ * except those never having a body, whose Content-Length if any describes the representation.
+ * Chunked framing overrides Content-Length, other transfer codings are not supported.
+ */
+bool HttpResponseBasic::resolve_content_length()
+{
+	if (head_request || status.starts_with('1') || status == "204" || status == "304")
+		content_length = 0;
+	else if (const auto iter = headers.find("Transfer-Encoding"); iter != headers.end())
+	{
+		if (!equal_ignore_case(trim(iter->second), "chunked"))
+			return false;
+
+		chunked = true;
+		content_length = content_length_unlimited;
+		return true;
+	}
+	else if (const auto iter = headers.find("Content-Length"); iter != headers.end())
+	{
+		// Digits only, strtoul() would take a sign or leading spaces
+		const auto & value = iter->second;
+		size_t l = 0;
+		auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), l);
+		if (value.empty() || error != std::errc{} || end != value.data() + value.size())
+			return false;
+
+		content_length = l;
+	}
+	else
+		content_length = content_length_unlimited;
+
+	return content_length == content_length_unlimited || sink || content_length <= body_length_limit;
+}
+
+/**
+ * Content-Length counts the encoded body, so progress is tracked in body_received, not body.size().
+ */
 bool HttpResponseBasic::parse_body(std::string_view & raw)
 {
-	if (content_length == content_length_unknown)
+	if (content_length < body_received)
+		return false;
+
+	auto pos = std::min(raw.size(), content_length - body_received);
+	auto data = raw.substr(0, pos);
+	raw.remove_prefix(pos);
+	body_received += pos;
+	if (!consume(data))
+		return false;
+
+	// The encoded stream must end exactly with the body
+	return !decoding || body_received != content_length || inflater->is_finished();
+}
+
+/**
+ * Chunk extensions are ignored. The last chunk must end an encoded stream, as Content-Length does.
+ */
+bool HttpResponseBasic::parse_chunk_size(std::string_view & raw)
+{
+	auto pos = std::min(raw.find(CR), raw.size());
+	if (line.size() + pos > header_length_limit)
+		return false;
+
+	line += raw.substr(0, pos);
+	raw.remove_prefix(pos);
+	if (raw.empty())
+		return true;
+
+	raw.remove_prefix(1);
+	parsing = ParsingLF;
+
+	auto sv = trim(std::string_view(line).substr(0, line.find(';')));
+	size_t size = 0;
+	auto [end, error] = std::from_chars(sv.data(), sv.data() + sv.size(), size, 16);
+	if (sv.empty() || error != std::errc{} || end != sv.data() + sv.size())
+		return false;
+
+	line.clear();
+	chunk_remaining = size;
+	will_parse = size > 0 ? ParsingChunkData : ParsingTrailer;
+	return size > 0 || !decoding || inflater->is_finished();
+}
+
+bool HttpResponseBasic::parse_chunk_data(std::string_view & raw)
+{
+	auto pos = std::min(raw.size(), chunk_remaining);
+	auto data = raw.substr(0, pos);
+	raw.remove_prefix(pos);
+	chunk_remaining -= pos;
+	if (chunk_remaining == 0)
 	{
-		if (const auto iter = headers.find("Content-Length"); iter != headers.end())
+		parsing = ParsingCR;
+		will_parse = ParsingChunkSize;
+	}
+	return consume(data);
+}
+
+/**
+ * Trailer fields are counted against the header limits and dropped.
+ */
+bool HttpResponseBasic::parse_trailer(std::string_view & raw)
+{
+	auto pos = std::min(raw.find(CR), raw.size());
+	if (line.size() + pos > header_length_limit)
+		return false;
+
+	line += raw.substr(0, pos);
+	raw.remove_prefix(pos);
+	if (raw.empty())
+		return true;
+
+	raw.remove_prefix(1);
+	parsing = ParsingLF;
+	will_parse = line.empty() ? ParsingDone : ParsingTrailer;
+	line.clear();
+	return will_parse == ParsingDone || ++header_count <= header_count_limit;
+}
+
+/**
+ * Decode a piece of the body if encoded and hand it over.
+ */
+bool HttpResponseBasic::consume(std::string_view data)
+{
+	if (!decoding)
+		return deliver(data);
+
+	inflater->input(data);
+	for (std::string_view out; ; )
+	{
+		if (!inflater->output(out))
+			return false;
+
+		if (out.empty())
+			break;
+
+		if (!deliver(out))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Called after the framing is known. Unknown codings and identity are passed through untouched.
+ */
+bool HttpResponseBasic::resolve_content_encoding()
+{
+	decoding = false;
+	if (!content_decoding || content_length == 0)
+		return true;
+
+	const auto iter = headers.find("Content-Encoding");
+	if (iter == headers.end())
+		return true;
+
+	Inflater::Format format;
+	auto coding = trim(iter->second);
+	if (equal_ignore_case(coding, "gzip") || equal_ignore_case(coding, "x-gzip"))
+		format = Inflater::Format::Gzip;
+	else if (equal_ignore_case(coding, "deflate"))
+		format = Inflater::Format::Deflate;
+	else
+		return true;
+
+	if (!inflater)
+		inflater = std::make_unique<Inflater>();
+	decoding = inflater->reset(format);
+	return true;
+}
+
+bool HttpResponseBasic::deliver(std::string_view data)
+{
+	if (sink)
+	{
+		sink(data);
+		return true;
+	}
+
+	if (body.size() + data.size() > body_length_limit)
+		return false;
+
+	body += data;
+	return true;
+}
+
+bool HttpResponseBasic::inflater_finished() const
+{
+	return inflater->is_finished();
+}
+
+
+/**
+ * Scans for the end of head with memchr based find(), resuming from where the last call stopped,
+ * so a head split across N reads is scanned once rather than N times.
+ */
+ParseResult HttpRequestParser::parse(std::string_view & raw)
+{
+	if (failed)
+		return ParseResult::Error;
+
+	base = raw.data();
+	if (head_length == 0)
+	{
+		constexpr std::string_view terminator = "\r\n\r\n";
+		auto pos = raw.find(terminator, scanned < terminator.size() ? 0 : scanned - terminator.size() + 1);
+		if (pos == std::string_view::npos)
 		{
-			const auto & value = iter->second;
-			char * e = nullptr;
-			size_t l = std::strtoul(value.data(), &e, 10);
-			if (e != value.data() + value.size())
-				return false;
+			scanned = raw.size();
+			failed = raw.size() > head_length_limit;
+			return failed ? ParseResult::Error : ParseResult::Incomplete;
+		}
 
-			content_length = l;
+		head_length = pos + terminator.size();
+		if (head_length > head_length_limit || !parse_head(raw.substr(0, head_length)))
+		{
+			failed = true;
+			return ParseResult::Error;
 		}
-		else
-			content_length = content_length_unlimited;
 	}
 
-	if (content_length < body.size())
+	if (raw.size() < head_length + content_length)
+		return ParseResult::Incomplete;
+
+	raw.remove_prefix(head_length + content_length);
+	return ParseResult::Complete;
+}
+
+std::string_view HttpRequestParser::find_header(std::string_view key) const
+{
+	for (size_t i = 0; i < header_count; i++)
+	{
+		if (auto header = get_header(i); equal_ignore_case(header.key, key))
+			return header.value;
+	}
+	return {};
+}
+
+/**
+ * Obsolete line folding and Transfer-Encoding are rejected, as RFC 7230 allows for servers.
+ */
+bool HttpRequestParser::parse_head(std::string_view head)
+{
+	auto span_of = [&](std::string_view sv) -> Span
+	{
+		return {static_cast<uint32_t>(sv.data() - head.data()), static_cast<uint32_t>(sv.size())};
+	};
+
+	auto eol = head.find(CRLF);
+	auto line = head.substr(0, eol);
+	auto first = line.find(' ');
+	auto second = line.find(' ', first + 1);
+	if (first == 0 || first == std::string_view::npos || second == std::string_view::npos || second == first + 1)
 		return false;
 
-	auto pos = std::min(raw.size(), content_length - body.size());
-	if (body.size() + pos > body_length_limit)
+	method = span_of(line.substr(0, first));
+	uri = span_of(line.substr(first + 1, second - first - 1));
+	// Exactly one version ends the line, so a uri with a space in it is not split silently
+	auto v = line.substr(second + 1);
+	if (v != VersionString<Version::_1_0> && v != VersionString<Version::_1_1>)
 		return false;
 
-	body += raw.substr(0, pos);
-	raw.remove_prefix(pos);
-	return true;
+	version = span_of(v);
+
+	bool close = false;
+	bool keep_alive_token = false;
+	bool has_content_length = false;
+	for (size_t pos = eol + CRLF.size(); pos + CRLF.size() < head.size(); pos = eol + CRLF.size())
+	{
+		eol = head.find(CRLF, pos);
+		line = head.substr(pos, eol - pos);
+		if (line.front() == ' ' || line.front() == '\t')
+			return false;
+
+		auto colon = line.find(':');
+		if (colon == 0 || colon == std::string_view::npos || line[colon - 1] == ' ' || line[colon - 1] == '\t')
+			return false;
+
+		if (header_count == header_count_limit)
+			return false;
+
+		auto key = line.substr(0, colon);
+		auto value = trim(line.substr(colon + 1));
+		header_spans[header_count * 2] = span_of(key);
+		header_spans[header_count * 2 + 1] = {static_cast<uint32_t>(value.empty() ? 0 : value.data() - head.data()),
+		                                      static_cast<uint32_t>(value.size())};
+		header_count++;
+
+		if (equal_ignore_case(key, "Content-Length"))
+		{
+			size_t l = 0;
+			auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), l);
+			if (value.empty() || ec != std::errc{} || end != value.data() + value.size())
+				return false;
+
+			if (has_content_length && l != content_length)
+				return false;
+
+			has_content_length = true;
+			content_length = l;
+		}
+		else if (equal_ignore_case(key, "Transfer-Encoding"))
+			return false;
+		else if (equal_ignore_case(key, "Connection"))
+		{
+			close = close || equal_ignore_case(value, "close");
+			keep_alive_token = keep_alive_token || equal_ignore_case(value, "keep-alive");
+		}
+	}
+
+	keep_alive = v == VersionString<Version::_1_1> ? !close : keep_alive_token;
+	return content_length <= body_length_limit;
 }
 
 }
\ No newline at end of file
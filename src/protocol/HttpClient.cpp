@@ -0,0 +1,286 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Connection.h"
+#include "HttpClient.h"
+
+namespace extra::protocol::http
+{
+HttpClient::HttpClient(poller_t * poller_, Options options_)
+	: poller{poller_}, options{options_}, hosts{}, read_buffer{new char[read_buffer_size]}
+{
+	if (options.max_connections_per_host == 0)
+		options.max_connections_per_host = 1;
+
+	if (options.pipeline_depth == 0)
+		options.pipeline_depth = 1;
+}
+
+HttpClient::~HttpClient()
+{
+	for (auto & [_, host]: hosts)
+	{
+		for (auto & connection: host->connections)
+		{
+			poller_del(connection->fd, poller);
+			close(connection->fd);
+		}
+	}
+}
+
+bool HttpClient::send(const std::string & address, uint16_t port, const HttpRequestV1D1 & request, Callback callback)
+{
+	return send(address, port, request, std::move(callback), BodyOptions{});
+}
+
+bool HttpClient::send(const std::string & address, uint16_t port, const HttpRequestV1D1 & request, Callback callback,
+	BodyOptions body)
+{
+	auto & host = host_of(address, port);
+	if (auto connection = pick(host); connection != nullptr)
+	{
+		enqueue(*connection, request, std::move(callback), std::move(body));
+		return true;
+	}
+
+	if (host.connections.empty())
+		return false;
+
+	host.pending.push_back({request, std::move(callback), std::move(body)});
+	return true;
+}
+
+size_t HttpClient::connection_count() const
+{
+	size_t count = 0;
+	for (const auto & [_, host]: hosts)
+		count += host->connections.size();
+	return count;
+}
+
+HttpClient::Host & HttpClient::host_of(const std::string & address, uint16_t port)
+{
+	auto key = address + ':' + std::to_string(port);
+	auto & host = hosts[key];
+	if (!host)
+		host.reset(new Host{address, port, {}, {}});
+	return *host;
+}
+
+/**
+ * Prefer an idle connection, then a new one, then pipelining on the least loaded one.
+ * @return nullptr if the request has to wait
+ */
+HttpClient::Connection * HttpClient::pick(Host & host)
+{
+	Connection * least = nullptr;
+	for (auto & connection: host.connections)
+	{
+		if (connection->closed)
+			continue;
+
+		if (connection->in_flight.empty())
+			return connection.get();
+
+		if (connection->in_flight.size() < options.pipeline_depth
+		    && (least == nullptr || connection->in_flight.size() < least->in_flight.size()))
+			least = connection.get();
+	}
+
+	if (host.connections.size() < options.max_connections_per_host)
+	{
+		if (auto connection = open(host); connection != nullptr)
+			return connection;
+	}
+
+	return least;
+}
+
+HttpClient::Connection * HttpClient::open(Host & host)
+{
+	auto connection = std::unique_ptr<Connection>(new Connection{
+		this, &host, -1, false, false, {}, 0, {}, {}
+	});
+
+	handle_param param{};
+	param.context = connection.get();
+	param.on_readable = on_readable;
+	param.on_writable = on_writable;
+	connection->fd = open_connection(host.address, host.port, param, poller);
+	if (connection->fd < 0)
+		return nullptr;
+
+	host.connections.push_back(std::move(connection));
+	return host.connections.back().get();
+}
+
+void HttpClient::enqueue(Connection & connection, const HttpRequestV1D1 & request, Callback callback,
+	BodyOptions body)
+{
+	auto & output = connection.output;
+	auto offset = output.size();
+	output.resize(offset + request.size());
+	request.format_into(output.data() + offset, request.size());
+	connection.in_flight.push_back({std::move(callback), request.get_method() == MethodString<Method::Head>,
+		std::move(body)});
+	if (connection.in_flight.size() == 1)
+		prepare(connection);
+	if (connection.connected)
+		flush(connection);
+}
+
+void HttpClient::prepare(Connection & connection)
+{
+	auto & response = connection.response;
+	if (connection.in_flight.empty())
+	{
+		response.set_body_sink({});
+		return;
+	}
+
+	auto & front = connection.in_flight.front();
+	response.set_head_request(front.head);
+	response.set_body_sink(std::move(front.body.sink));
+	response.set_content_decoding(front.body.content_decoding);
+}
+
+/**
+ * On error the following EPOLLHUP fails requests in flight, meanwhile none are added.
+ */
+void HttpClient::flush(Connection & connection)
+{
+	if (!flush_output(connection.fd, connection.output, connection.output_offset))
+		connection.closed = true;
+}
+
+void HttpClient::receive(Connection & connection)
+{
+	auto buffer = read_buffer.get();
+	while (true)
+	{
+		auto n = recv(connection.fd, buffer, read_buffer_size, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0 && errno == EAGAIN)
+			return;
+
+		if (n <= 0)
+		{
+			if (n == 0 && !connection.in_flight.empty() && connection.response.eof())
+			{
+				auto callback = std::move(connection.in_flight.front().callback);
+				connection.in_flight.pop_front();
+				callback(State::Success, NoError, &connection.response);
+			}
+			fail(connection, State::NetworkError, NoError);
+			return;
+		}
+
+		std::string_view raw(buffer, n);
+		while (!raw.empty())
+		{
+			if (connection.in_flight.empty())
+			{
+				fail(connection, State::NetworkError, ParseError);
+				return;
+			}
+
+			auto result = connection.response.parse(raw);
+			if (result == ParseResult::Error)
+			{
+				fail(connection, State::NetworkError, ParseError);
+				return;
+			}
+
+			if (result == ParseResult::Incomplete)
+				continue;
+
+			auto callback = std::move(connection.in_flight.front().callback);
+			connection.in_flight.pop_front();
+			bool keep_alive = connection.response.is_keep_alive();
+			callback(State::Success, NoError, &connection.response);
+			connection.response.reset();
+			prepare(connection);
+
+			if (!keep_alive)
+			{
+				fail(connection, State::NetworkError, NoError);
+				return;
+			}
+
+			dispatch_pending(*connection.host);
+		}
+	}
+}
+
+/**
+ * Fail all requests in flight and drop the connection.
+ */
+void HttpClient::fail(Connection & connection, State state, Error error)
+{
+	connection.closed = true;
+	while (!connection.in_flight.empty())
+	{
+		auto callback = std::move(connection.in_flight.front().callback);
+		connection.in_flight.pop_front();
+		callback(state, error, nullptr);
+	}
+	remove(connection);
+}
+
+void HttpClient::remove(Connection & connection)
+{
+	auto & host = *connection.host;
+	poller_del(connection.fd, poller);
+	close(connection.fd);
+	std::erase_if(host.connections, [&](const auto & c) { return c.get() == &connection; });
+	dispatch_pending(host);
+}
+
+void HttpClient::dispatch_pending(Host & host)
+{
+	while (!host.pending.empty())
+	{
+		auto connection = pick(host);
+		if (connection == nullptr)
+		{
+			if (host.connections.empty())
+			{
+				auto callback = std::move(host.pending.front().callback);
+				host.pending.pop_front();
+				callback(State::NetworkError, NoError, nullptr);
+				continue;
+			}
+			return;
+		}
+
+		auto pending = std::move(host.pending.front());
+		host.pending.pop_front();
+		enqueue(*connection, pending.request, std::move(pending.callback), std::move(pending.body));
+	}
+}
+
+void HttpClient::on_readable(handle_t *, void * context)
+{
+	auto connection = static_cast<Connection *>(context);
+	connection->client->receive(*connection);
+}
+
+void HttpClient::on_writable(handle_t *, void * context)
+{
+	auto connection = static_cast<Connection *>(context);
+	auto client = connection->client;
+	if (!connection->connected)
+	{
+		if (!is_established(connection->fd))
+		{
+			client->fail(*connection, State::NetworkError, NoError);
+			return;
+		}
+		connection->connected = true;
+	}
+	client->flush(*connection);
+}
+
+}
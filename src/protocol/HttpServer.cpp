@@ -0,0 +1,263 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "HttpServer.h"
+
+namespace extra::protocol::http
+{
+HttpServer::HttpServer(poller_t * poller_, Handler handler_)
+	: poller{poller_}, handler{std::move(handler_)}, listener{-1}, port{0}, connections{}
+{
+}
+
+HttpServer::~HttpServer()
+{
+	for (auto & [fd, _]: connections)
+	{
+		poller_del(fd, poller);
+		close(fd);
+	}
+
+	if (listener >= 0)
+	{
+		poller_del(listener, poller);
+		close(listener);
+	}
+}
+
+bool HttpServer::listen(const std::string & address, uint16_t port_, int backlog)
+{
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port_);
+	if (listener >= 0 || inet_pton(AF_INET, address.data(), &sa.sin_addr) != 1)
+		return false;
+
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	socklen_t length = sizeof(sa);
+	if (bind(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) == 0
+	    && ::listen(fd, backlog) == 0
+	    && getsockname(fd, reinterpret_cast<sockaddr *>(&sa), &length) == 0)
+	{
+		handle_param param{};
+		param.fd = fd;
+		param.context = this;
+		param.on_readable = on_accept;
+		if (poller_add(&param, poller) != nullptr)
+		{
+			listener = fd;
+			port = ntohs(sa.sin_port);
+			return true;
+		}
+	}
+
+	close(fd);
+	return false;
+}
+
+void HttpServer::accept_all()
+{
+	while (true)
+	{
+		int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return;
+		}
+
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		auto connection = std::unique_ptr<Connection>(new Connection{
+			this, fd, std::make_unique<char[]>(input_initial_capacity), 0, 0, input_initial_capacity,
+			{}, 0, false, false, {}
+		});
+
+		handle_param param{};
+		param.fd = fd;
+		param.context = connection.get();
+		param.on_readable = on_readable;
+		param.on_writable = on_writable;
+		if (poller_add(&param, poller) == nullptr)
+		{
+			close(fd);
+			continue;
+		}
+
+		connections.emplace(fd, std::move(connection));
+	}
+}
+
+/**
+ * Drain the socket until EAGAIN, serving requests each time the buffer fills up. While more than
+ * output_size_limit is left unsent, neither goes on until on_writable finds the peer caught up.
+ */
+bool HttpServer::receive(Connection & connection)
+{
+	while (true)
+	{
+		serve(connection);
+		if (unsent(connection) > output_size_limit)
+		{
+			if (!flush(connection))
+				return false;
+
+			if (unsent(connection) > output_size_limit)
+			{
+				connection.paused = true;
+				return true;
+			}
+			continue;
+		}
+
+		if (connection.closing)
+			break;
+
+		if (connection.input_end == connection.input_capacity)
+		{
+			if (connection.input_begin > 0)
+			{
+				std::memmove(connection.input.get(), connection.input.get() + connection.input_begin,
+					connection.input_end - connection.input_begin);
+				connection.input_end -= connection.input_begin;
+				connection.input_begin = 0;
+			}
+			else if (connection.input_capacity < input_capacity_limit)
+			{
+				auto capacity = std::min(connection.input_capacity * 2, input_capacity_limit);
+				auto input = std::make_unique<char[]>(capacity);
+				std::memcpy(input.get(), connection.input.get(), connection.input_end);
+				connection.input = std::move(input);
+				connection.input_capacity = capacity;
+			}
+			else
+			{
+				remove(connection);
+				return false;
+			}
+		}
+
+		auto n = recv(connection.fd, connection.input.get() + connection.input_end,
+			connection.input_capacity - connection.input_end, 0);
+		if (n > 0)
+		{
+			connection.input_end += n;
+			continue;
+		}
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0 && errno == EAGAIN)
+			break;
+
+		remove(connection);
+		return false;
+	}
+
+	return flush(connection);
+}
+
+void HttpServer::serve(Connection & connection)
+{
+	while (!connection.closing && unsent(connection) <= output_size_limit)
+	{
+		std::string_view raw(connection.input.get() + connection.input_begin,
+			connection.input_end - connection.input_begin);
+		auto size = raw.size();
+		auto result = connection.parser.parse(raw);
+		if (result == ParseResult::Incomplete)
+			break;
+
+		if (result == ParseResult::Error)
+		{
+			HttpResponseWriter writer(connection.output, false);
+			writer.set_status<Status::_400>();
+			writer.finish();
+			connection.closing = true;
+			break;
+		}
+
+		connection.input_begin += size - raw.size();
+		HttpResponseWriter writer(connection.output, connection.parser.is_keep_alive());
+		handler(connection.parser, writer);
+		writer.finish();
+		connection.closing = !writer.is_keep_alive();
+		connection.parser.reset();
+	}
+
+	if (connection.input_begin == connection.input_end)
+		connection.input_begin = connection.input_end = 0;
+}
+
+bool HttpServer::flush(Connection & connection)
+{
+	auto & output = connection.output;
+	while (connection.output_offset < output.size())
+	{
+		auto n = ::send(connection.fd, output.data() + connection.output_offset,
+			output.size() - connection.output_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n > 0)
+			connection.output_offset += n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && errno == EAGAIN)
+			return true;
+		else
+		{
+			remove(connection);
+			return false;
+		}
+	}
+
+	output.clear();
+	connection.output_offset = 0;
+	if (connection.closing)
+	{
+		remove(connection);
+		return false;
+	}
+	return true;
+}
+
+void HttpServer::remove(Connection & connection)
+{
+	int fd = connection.fd;
+	poller_del(fd, poller);
+	close(fd);
+	connections.erase(fd);
+}
+
+void HttpServer::on_accept(handle_t *, void * context)
+{
+	static_cast<HttpServer *>(context)->accept_all();
+}
+
+void HttpServer::on_readable(handle_t *, void * context)
+{
+	auto connection = static_cast<Connection *>(context);
+	connection->server->receive(*connection);
+}
+
+void HttpServer::on_writable(handle_t *, void * context)
+{
+	auto connection = static_cast<Connection *>(context);
+	auto server = connection->server;
+	if (server->flush(*connection) && connection->paused && unsent(*connection) <= output_size_limit)
+	{
+		connection->paused = false;
+		server->receive(*connection);
+	}
+}
+
+}
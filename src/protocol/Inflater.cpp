@@ -0,0 +1,147 @@
+#include <cstdint>
+
+#ifdef EXTRA_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "Inflater.h"
+
+namespace extra::protocol::http
+{
+#ifdef EXTRA_WITH_ZLIB
+struct Inflater::Stream
+{
+	z_stream z;
+	bool initialized;
+};
+
+Inflater::Inflater()
+	: stream{std::make_unique<Stream>()}, window{std::make_unique<char[]>(window_size)}
+	, format{Format::Gzip}, detect{false}, head{}, head_size{0}, rest{}, pending{false}, finished{false}
+{
+	stream->z = {};
+	stream->initialized = inflateInit2(&stream->z, 15 + 16) == Z_OK;
+}
+
+Inflater::~Inflater()
+{
+	if (stream->initialized)
+		inflateEnd(&stream->z);
+}
+
+bool Inflater::reset(Format format_)
+{
+	if (!stream->initialized)
+		return false;
+
+	format = format_;
+	detect = format == Format::Deflate;
+	head_size = 0;
+	rest = {};
+	pending = false;
+	finished = false;
+	stream->z.avail_in = 0;
+	return detect || inflateReset2(&stream->z, 15 + 16) == Z_OK;
+}
+
+void Inflater::input(std::string_view in)
+{
+	stream->z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+	stream->z.avail_in = in.size();
+}
+
+/**
+ * Fills the window at most once per call, so output is handed over 64K at a time while the encoded
+ * piece is consumed in place.
+ */
+bool Inflater::output(std::string_view & out)
+{
+	out = {};
+	auto & z = stream->z;
+	if (detect)
+	{
+		// Deflate is zlib wrapped by the RFC, yet some servers send it raw. The zlib header is told by
+		// method, window size and check bits of its two bytes, which may come in separate pieces.
+		for (; head_size < sizeof(head) && z.avail_in > 0; z.avail_in--)
+			head[head_size++] = static_cast<char>(*z.next_in++);
+		if (head_size < sizeof(head))
+			return true;
+
+		auto cmf = static_cast<uint8_t>(head[0]);
+		auto flg = static_cast<uint8_t>(head[1]);
+		bool wrapped = (cmf & 0x0f) == Z_DEFLATED && (cmf >> 4) <= 7 && (cmf << 8 | flg) % 31 == 0;
+		if (inflateReset2(&z, wrapped ? 15 : -15) != Z_OK)
+			return false;
+		detect = false;
+		rest = {reinterpret_cast<const char *>(z.next_in), z.avail_in};
+		z.next_in = reinterpret_cast<Bytef *>(head);
+		z.avail_in = sizeof(head);
+	}
+
+	while (z.avail_in > 0 || pending || !rest.empty())
+	{
+		if (z.avail_in == 0 && !rest.empty())
+		{
+			z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(rest.data()));
+			z.avail_in = rest.size();
+			rest = {};
+		}
+
+		if (finished)
+		{
+			// Concatenated gzip members make one body, as with gzip -d
+			if (format != Format::Gzip || inflateReset(&z) != Z_OK)
+				return false;
+			finished = false;
+		}
+
+		z.next_out = reinterpret_cast<Bytef *>(window.get());
+		z.avail_out = window_size;
+		auto result = inflate(&z, Z_NO_FLUSH);
+		if (result == Z_STREAM_END)
+			finished = true;
+		else if (result != Z_OK && result != Z_BUF_ERROR)
+			return false;
+
+		size_t produced = window_size - z.avail_out;
+		pending = z.avail_out == 0 && !finished;
+		if (produced > 0)
+		{
+			out = {window.get(), produced};
+			return true;
+		}
+
+		if (result == Z_BUF_ERROR)
+			break;
+	}
+	return true;
+}
+#else
+struct Inflater::Stream
+{
+};
+
+Inflater::Inflater()
+	: stream{}, window{}, format{Format::Gzip}, detect{false}, head{}, head_size{0}, rest{}, pending{false}
+	, finished{false}
+{
+}
+
+Inflater::~Inflater() = default;
+
+bool Inflater::reset(Format)
+{
+	return false;
+}
+
+void Inflater::input(std::string_view)
+{
+}
+
+bool Inflater::output(std::string_view & out)
+{
+	out = {};
+	return false;
+}
+#endif
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+
+namespace extra::protocol::http
+{
+/**
+ * Streaming decoder of gzip and deflate Content-Encoding, a thin layer over zlib. Without zlib,
+ * reset() fails and bodies are left encoded.
+ */
+class Inflater
+{
+public:
+	enum class Format
+	{
+		Gzip,
+		Deflate,
+	};
+
+	Inflater();
+
+	~Inflater();
+
+	Inflater(const Inflater &) = delete;
+
+	Inflater & operator=(const Inflater &) = delete;
+
+	/**
+	 * Start a new body. The zlib state is reused, not reallocated.
+	 * @return false if decoding is not available
+	 */
+	bool reset(Format format);
+
+	/**
+	 * Set the next piece of encoded body, which must stay valid until output() drains it.
+	 */
+	void input(std::string_view in);
+
+	/**
+	 * Decode the next piece of output into the internal window.
+	 * @param out empty once input is consumed and nothing is pending
+	 * @return false on corrupt data, or data after the end of a deflate stream
+	 */
+	bool output(std::string_view & out);
+
+	/**
+	 * @return true once the encoded stream has ended with its checksum verified
+	 */
+	[[nodiscard]] bool is_finished() const
+	{
+		return finished;
+	}
+
+private:
+	struct Stream;
+
+	constexpr static size_t window_size = 64 * 1024;
+
+	std::unique_ptr<Stream> stream;
+	std::unique_ptr<char[]> window;
+	Format format;
+	bool detect;
+	/* First two bytes of a deflate body, telling a zlib header, then fed ahead of rest */
+	char head[2];
+	size_t head_size;
+	std::string_view rest;
+	bool pending;
+	bool finished;
+};
+}
@@ -0,0 +1,706 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Json.h"
+
+namespace extra::protocol::json
+{
+namespace
+{
+struct Masks
+{
+	uint64_t quote;
+	uint64_t backslash;
+	uint64_t op;
+	uint64_t whitespace;
+};
+
+/**
+ * One bit per byte of a 64 byte block. Brackets are matched with a single compare each for both
+ * kinds, as '[' and ']' differ from '{' and '}' by the 0x20 bit only.
+ */
+Masks classify(const char * block)
+{
+	Masks m{};
+#if defined(__AVX2__)
+	for (int k = 0; k < 2; k++)
+	{
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32 * k));
+		auto eq = [&v](char c) { return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)); };
+		auto lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		auto brackets = _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')),
+			_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}')));
+		auto op = _mm256_or_si256(brackets, _mm256_or_si256(eq(':'), eq(',')));
+		auto whitespace = _mm256_or_si256(_mm256_or_si256(eq(' '), eq('\t')), _mm256_or_si256(eq('\n'), eq('\r')));
+		auto bits = [](__m256i x) { return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(x))); };
+		m.quote |= bits(eq('"')) << (32 * k);
+		m.backslash |= bits(eq('\\')) << (32 * k);
+		m.op |= bits(op) << (32 * k);
+		m.whitespace |= bits(whitespace) << (32 * k);
+	}
+#elif defined(__SSE2__)
+	for (int k = 0; k < 4; k++)
+	{
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * k));
+		auto eq = [&v](char c) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); };
+		auto lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		auto brackets = _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('}')));
+		auto op = _mm_or_si128(brackets, _mm_or_si128(eq(':'), eq(',')));
+		auto whitespace = _mm_or_si128(_mm_or_si128(eq(' '), eq('\t')), _mm_or_si128(eq('\n'), eq('\r')));
+		auto bits = [](__m128i x) { return static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(x))); };
+		m.quote |= bits(eq('"')) << (16 * k);
+		m.backslash |= bits(eq('\\')) << (16 * k);
+		m.op |= bits(op) << (16 * k);
+		m.whitespace |= bits(whitespace) << (16 * k);
+	}
+#else
+	for (int k = 0; k < 64; k++)
+	{
+		uint64_t bit = 1ull << k;
+		switch (block[k])
+		{
+		case '"':
+			m.quote |= bit;
+			break;
+		case '\\':
+			m.backslash |= bit;
+			break;
+		case '{': case '}': case '[': case ']': case ':': case ',':
+			m.op |= bit;
+			break;
+		case ' ': case '\t': case '\n': case '\r':
+			m.whitespace |= bit;
+			break;
+		default:
+			break;
+		}
+	}
+#endif
+	return m;
+}
+
+/**
+ * Bit i of the result is the parity of bits 0 to i, turning quote positions into string interiors.
+ */
+uint64_t prefix_xor(uint64_t x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+bool is_whitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * Number grammar of RFC 8259: an optional minus, an integer without leading zeros, then optional
+ * fraction and exponent, each with at least one digit.
+ */
+bool is_number(std::string_view s)
+{
+	size_t i = s.starts_with('-') ? 1 : 0;
+	auto digits = [&s, &i]
+	{
+		auto first = i;
+		while (i < s.size() && is_digit(s[i]))
+			i++;
+		return i - first;
+	};
+
+	if (i < s.size() && s[i] == '0')
+		i++;
+	else if (digits() == 0)
+		return false;
+
+	if (i < s.size() && s[i] == '.' && (++i, digits() == 0))
+		return false;
+
+	if (i < s.size() && (s[i] == 'e' || s[i] == 'E'))
+	{
+		if (++i < s.size() && (s[i] == '+' || s[i] == '-'))
+			i++;
+		if (digits() == 0)
+			return false;
+	}
+	return i == s.size();
+}
+
+/**
+ * A closed string without raw control characters, which must be escaped.
+ */
+bool is_string(std::string_view s)
+{
+	return s.size() >= 2 && s.back() == '"'
+		&& std::none_of(s.begin(), s.end(), [](char c) { return static_cast<unsigned char>(c) < 0x20; });
+}
+
+bool hex4(std::string_view s, size_t i, uint32_t & value)
+{
+	if (i + 4 > s.size())
+		return false;
+
+	value = 0;
+	for (size_t k = i; k < i + 4; k++)
+	{
+		char c = s[k];
+		uint32_t d;
+		if (is_digit(c))
+			d = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			d = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			d = c - 'A' + 10;
+		else
+			return false;
+		value = value << 4 | d;
+	}
+	return true;
+}
+
+void append_utf8(std::string & out, uint32_t cp)
+{
+	if (cp < 0x80)
+		out += static_cast<char>(cp);
+	else if (cp < 0x800)
+	{
+		out += static_cast<char>(0xC0 | cp >> 6);
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+	else if (cp < 0x10000)
+	{
+		out += static_cast<char>(0xE0 | cp >> 12);
+		out += static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+	else
+	{
+		out += static_cast<char>(0xF0 | cp >> 18);
+		out += static_cast<char>(0x80 | (cp >> 12 & 0x3F));
+		out += static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+		out += static_cast<char>(0x80 | (cp & 0x3F));
+	}
+}
+
+bool unescape(std::string_view s, std::string & out)
+{
+	out.clear();
+	while (true)
+	{
+		auto pos = s.find('\\');
+		out += s.substr(0, pos);
+		if (pos == std::string_view::npos)
+			return true;
+
+		if (pos + 1 == s.size())
+			return false;
+
+		size_t consumed = 2;
+		switch (s[pos + 1])
+		{
+		case '"': out += '"'; break;
+		case '\\': out += '\\'; break;
+		case '/': out += '/'; break;
+		case 'b': out += '\b'; break;
+		case 'f': out += '\f'; break;
+		case 'n': out += '\n'; break;
+		case 'r': out += '\r'; break;
+		case 't': out += '\t'; break;
+		case 'u':
+		{
+			uint32_t cp;
+			if (!hex4(s, pos + 2, cp))
+				return false;
+			consumed = 6;
+
+			if (cp >= 0xD800 && cp < 0xDC00)
+			{
+				uint32_t low;
+				if (s.substr(pos + 6, 2) != "\\u" || !hex4(s, pos + 8, low) || low < 0xDC00 || low >= 0xE000)
+					return false;
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				consumed = 12;
+			}
+			else if (cp >= 0xDC00 && cp < 0xE000)
+				return false;
+
+			append_utf8(out, cp);
+			break;
+		}
+		default:
+			return false;
+		}
+		s.remove_prefix(pos + consumed);
+	}
+}
+}
+
+bool parse_fixed(std::string_view s, int scale, int64_t & value)
+{
+	if (scale < 0 || s.empty())
+		return false;
+
+	bool negative = s.front() == '-';
+	if (negative)
+		s.remove_prefix(1);
+
+	uint64_t v = 0;
+	auto push = [&v](char c) { return !__builtin_mul_overflow(v, 10, &v) && !__builtin_add_overflow(v, c - '0', &v); };
+
+	size_t i = 0;
+	for (; i < s.size() && is_digit(s[i]); i++)
+	{
+		if (!push(s[i]))
+			return false;
+	}
+	// No leading zeros, as in JSON numbers
+	if (i == 0 || (i > 1 && s.front() == '0'))
+		return false;
+
+	int fraction = 0;
+	if (i < s.size() && s[i] == '.')
+	{
+		auto first = ++i;
+		for (; i < s.size() && is_digit(s[i]); i++)
+		{
+			if (fraction < scale)
+			{
+				if (!push(s[i]))
+					return false;
+				fraction++;
+			}
+			else if (s[i] != '0')
+				return false;
+		}
+		if (i == first)
+			return false;
+	}
+
+	if (i != s.size())
+		return false;
+
+	for (; fraction < scale; fraction++)
+	{
+		if (__builtin_mul_overflow(v, 10, &v))
+			return false;
+	}
+
+	if (v > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+		return false;
+
+	value = negative ? -static_cast<int64_t>(v) : static_cast<int64_t>(v);
+	return true;
+}
+
+Type Value::type() const
+{
+	if (document == nullptr)
+		return Type::Invalid;
+
+	switch (document->json[document->structurals[i]])
+	{
+	case '{':
+		return Type::Object;
+	case '[':
+		return Type::Array;
+	case '"':
+		return Type::String;
+	case 't':
+		return Type::True;
+	case 'f':
+		return Type::False;
+	case 'n':
+		return Type::Null;
+	default:
+		return Type::Number;
+	}
+}
+
+std::string_view Value::raw() const
+{
+	if (document == nullptr)
+		return {};
+
+	auto t = type();
+	if (t != Type::Object && t != Type::Array)
+		return document->token(i);
+
+	auto first = document->structurals[i];
+	return document->json.substr(first, document->structurals[document->jumps[i]] - first + 1);
+}
+
+bool Value::get(std::string_view & value) const
+{
+	if (type() != Type::String)
+		return false;
+
+	auto t = document->token(i);
+	value = t.substr(1, t.size() - 2);
+	return true;
+}
+
+bool Value::get_string(std::string & value) const
+{
+	std::string_view s;
+	return get(s) && unescape(s, value);
+}
+
+bool Value::get(int64_t & value) const
+{
+	if (type() != Type::Number)
+		return false;
+
+	auto t = document->token(i);
+	auto [end, error] = std::from_chars(t.data(), t.data() + t.size(), value);
+	return error == std::errc{} && end == t.data() + t.size();
+}
+
+bool Value::get(uint64_t & value) const
+{
+	if (type() != Type::Number)
+		return false;
+
+	auto t = document->token(i);
+	auto [end, error] = std::from_chars(t.data(), t.data() + t.size(), value);
+	return error == std::errc{} && end == t.data() + t.size();
+}
+
+bool Value::get(double & value) const
+{
+	if (type() != Type::Number)
+		return false;
+
+	auto t = document->token(i);
+	auto [end, error] = std::from_chars(t.data(), t.data() + t.size(), value);
+	return error == std::errc{} && end == t.data() + t.size();
+}
+
+bool Value::get(bool & value) const
+{
+	auto t = type();
+	if (t != Type::True && t != Type::False)
+		return false;
+
+	value = t == Type::True;
+	return true;
+}
+
+bool Value::get_fixed(int64_t & value, int scale) const
+{
+	auto t = type();
+	if (t == Type::Number)
+		return parse_fixed(document->token(i), scale, value);
+
+	std::string_view s;
+	return t == Type::String && get(s) && parse_fixed(s, scale, value);
+}
+
+Object Value::get_object() const
+{
+	if (type() != Type::Object)
+		return {};
+
+	return {document, i + 1, document->jumps[i]};
+}
+
+Array Value::get_array() const
+{
+	if (type() != Type::Array)
+		return {};
+
+	return {document, i + 1, document->jumps[i]};
+}
+
+Value Value::operator[](std::string_view key) const
+{
+	return get_object().find(key);
+}
+
+Value Value::operator[](size_t index) const
+{
+	for (auto value: get_array())
+	{
+		if (index-- == 0)
+			return value;
+	}
+	return {};
+}
+
+uint32_t Value::next() const
+{
+	return document->jumps[i] + 1;
+}
+
+Object::Field Object::Iterator::operator*() const
+{
+	auto key = document->token(i);
+	return {key.substr(1, key.size() - 2), {document, i + 2}};
+}
+
+Object::Iterator & Object::Iterator::operator++()
+{
+	auto n = Value(document, i + 2).next();
+	i = document->json[document->structurals[n]] == ',' ? n + 1 : n;
+	return *this;
+}
+
+Value Object::find(std::string_view key) const
+{
+	for (const auto & [k, v]: *this)
+	{
+		if (k == key)
+			return v;
+	}
+	return {};
+}
+
+Array::Iterator & Array::Iterator::operator++()
+{
+	auto n = Value(document, i).next();
+	i = document->json[document->structurals[n]] == ',' ? n + 1 : n;
+	return *this;
+}
+
+Document::Document()
+	: json{}, buffer{}, structurals{}, structural_count{0}, jumps{}, stack{}
+	, indexed{0}, in_string{0}, escape{false}, scalar{0}, valid{false}
+{
+}
+
+bool Document::parse(std::string_view json_)
+{
+	reset_index();
+	json = json_;
+	if (json.size() >= std::numeric_limits<uint32_t>::max())
+		return false;
+
+	index(true);
+	valid = in_string == 0 && build();
+	return valid;
+}
+
+void Document::clear()
+{
+	reset_index();
+	buffer.clear();
+	json = buffer;
+}
+
+void Document::append(std::string_view fragment)
+{
+	buffer += fragment;
+	json = buffer;
+	index(false);
+}
+
+bool Document::finish()
+{
+	json = buffer;
+	if (json.size() >= std::numeric_limits<uint32_t>::max())
+		return false;
+
+	index(true);
+	valid = in_string == 0 && build();
+	return valid;
+}
+
+void Document::reset_index()
+{
+	structural_count = 0;
+	indexed = 0;
+	in_string = 0;
+	escape = false;
+	scalar = 0;
+	valid = false;
+}
+
+void Document::index(bool final)
+{
+	for (; indexed + block_size <= json.size(); indexed += block_size)
+		index_block(json.data() + indexed, indexed);
+
+	if (final && indexed < json.size())
+	{
+		char block[block_size];
+		std::memset(block, ' ', sizeof(block));
+		std::memcpy(block, json.data() + indexed, json.size() - indexed);
+		index_block(block, indexed);
+		indexed = json.size();
+	}
+}
+
+/**
+ * Escapes are resolved bit by bit, but only in blocks having a backslash, rare in market data.
+ */
+void Document::index_block(const char * block, size_t base)
+{
+	auto [quote, backslash, op, whitespace] = classify(block);
+
+	if (backslash != 0 || escape)
+	{
+		uint64_t escaped = 0;
+		for (int k = 0; k < 64; k++)
+		{
+			if (escape)
+			{
+				escaped |= 1ull << k;
+				escape = false;
+			}
+			else if (backslash >> k & 1)
+				escape = true;
+		}
+		quote &= ~escaped;
+	}
+
+	// Opening quotes are inside, closing ones are not
+	uint64_t inside = prefix_xor(quote) ^ in_string;
+	in_string = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+
+	uint64_t scalars = ~(op | whitespace | quote);
+	uint64_t starts = scalars & ~(scalars << 1 | scalar);
+	scalar = scalars >> 63;
+
+	// Room for a whole block is kept so positions are stored without checks
+	uint64_t bits = ((op | starts) & ~inside) | (quote & inside);
+	if (structurals.size() < structural_count + block_size)
+		structurals.resize(std::max(structurals.size() * 2, structural_count + block_size));
+
+	auto out = structurals.data() + structural_count;
+	structural_count += __builtin_popcountll(bits);
+	while (bits != 0)
+	{
+		*out++ = static_cast<uint32_t>(base + __builtin_ctzll(bits));
+		bits &= bits - 1;
+	}
+}
+
+/**
+ * Check the grammar over the index, linking each bracket to its match in jumps. Scalars are checked
+ * here too, one pass over their few bytes, so that accessors only have to decode.
+ */
+bool Document::build()
+{
+	enum
+	{
+		ExpectValue,
+		ExpectValueOrClose,
+		ExpectKey,
+		ExpectKeyOrClose,
+		ExpectColon,
+		ExpectCommaOrClose,
+		ExpectNothing,
+	} expect = ExpectValue;
+
+	auto n = static_cast<uint32_t>(structural_count);
+	jumps.resize(n);
+	stack.clear();
+	for (uint32_t i = 0; i < n; i++)
+	{
+		jumps[i] = i;
+		char c = json[structurals[i]];
+		if (c == '}' || c == ']')
+		{
+			if (expect != ExpectCommaOrClose && expect != ExpectKeyOrClose && expect != ExpectValueOrClose)
+				return false;
+
+			if (stack.empty() || (json[structurals[stack.back()]] == '{') != (c == '}'))
+				return false;
+
+			jumps[stack.back()] = i;
+			stack.pop_back();
+			expect = stack.empty() ? ExpectNothing : ExpectCommaOrClose;
+			continue;
+		}
+
+		switch (expect)
+		{
+		case ExpectKey:
+		case ExpectKeyOrClose:
+		{
+			if (c != '"' || !is_string(token(i)))
+				return false;
+			expect = ExpectColon;
+			break;
+		}
+
+		case ExpectColon:
+			if (c != ':')
+				return false;
+			expect = ExpectValue;
+			break;
+
+		case ExpectCommaOrClose:
+			if (c != ',')
+				return false;
+			expect = json[structurals[stack.back()]] == '{' ? ExpectKey : ExpectValue;
+			break;
+
+		case ExpectValue:
+		case ExpectValueOrClose:
+		{
+			if (c == '{' || c == '[')
+			{
+				stack.push_back(i);
+				expect = c == '{' ? ExpectKeyOrClose : ExpectValueOrClose;
+				break;
+			}
+
+			auto t = token(i);
+			bool good;
+			switch (c)
+			{
+			case '"':
+				good = is_string(t);
+				break;
+			case 't':
+				good = t == "true";
+				break;
+			case 'f':
+				good = t == "false";
+				break;
+			case 'n':
+				good = t == "null";
+				break;
+			default:
+				good = is_number(t);
+				break;
+			}
+			if (!good)
+				return false;
+			expect = stack.empty() ? ExpectNothing : ExpectCommaOrClose;
+			break;
+		}
+
+		case ExpectNothing:
+			return false;
+		}
+	}
+	return expect == ExpectNothing;
+}
+
+std::string_view Document::token(uint32_t i) const
+{
+	size_t first = structurals[i];
+	size_t last = i + 1 < structural_count ? structurals[i + 1] : json.size();
+	while (last > first && is_whitespace(json[last - 1]))
+		last--;
+	return json.substr(first, last - first);
+}
+
+}
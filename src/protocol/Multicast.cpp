@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "Multicast.h"
+
+namespace extra::protocol::multicast
+{
+namespace
+{
+/* MoldUDP64 count of the end of session */
+constexpr uint16_t end_of_session = 0xFFFF;
+
+uint16_t count_of(const binary::MoldUdp64 & header)
+{
+	return header.count() == end_of_session ? 0 : header.count();
+}
+
+/**
+ * @return nanoseconds of the hardware timestamp if any, else of the software one, 0 without
+ */
+uint64_t timestamp_of(const msghdr & header)
+{
+	for (auto cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<msghdr *>(&header), cmsg))
+	{
+		if (cmsg->cmsg_level != SOL_SOCKET)
+			continue;
+
+		timespec ts[3]{};
+		if (cmsg->cmsg_type == SCM_TIMESTAMPNS)
+			std::memcpy(ts, CMSG_DATA(cmsg), sizeof(timespec));
+		else if (cmsg->cmsg_type == SCM_TIMESTAMPING)
+		{
+			std::memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+			if (ts[2].tv_sec != 0 || ts[2].tv_nsec != 0)
+				ts[0] = ts[2];
+		}
+		else
+			continue;
+
+		return static_cast<uint64_t>(ts[0].tv_sec) * 1000000000 + static_cast<uint64_t>(ts[0].tv_nsec);
+	}
+	return 0;
+}
+}
+
+Receiver::Receiver(poller_t * poller_, Options options_, PacketCallback on_packet_, GapCallback on_gap_)
+	: poller{poller_}, options{std::move(options_)}, on_packet{std::move(on_packet_)}, on_gap{std::move(on_gap_)}
+	, sockets{{this, 0, -1, nullptr, 0, 0}, {this, 1, -1, nullptr, 0, 0}}
+	, buffers{new char[options.batch * options.packet_size]}, controls{new char[options.batch * control_size]}
+	, messages{new mmsghdr[options.batch]}, iov{new iovec[options.batch]}
+	, hold_buffers{new char[options.hold * options.packet_size]}, held{}, free_slots{}, holding{false}, next{0}
+	, stats{}
+{
+	held.reserve(options.hold);
+	free_slots.reserve(options.hold);
+	for (size_t i = 0; i < options.batch; i++)
+	{
+		iov[i] = iovec{buffers.get() + i * options.packet_size, options.packet_size};
+		messages[i] = mmsghdr{};
+		messages[i].msg_hdr.msg_iov = &iov[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+		messages[i].msg_hdr.msg_control = controls.get() + i * control_size;
+	}
+}
+
+Receiver::~Receiver()
+{
+	close();
+}
+
+bool Receiver::open()
+{
+	close();
+	if (options.a.group.empty() || options.batch == 0 || options.packet_size < binary::MoldUdp64::length
+		|| options.hold == 0)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	if (!open_line(sockets[0], options.a) || (!options.b.group.empty() && !open_line(sockets[1], options.b)))
+	{
+		auto error = errno;
+		close();
+		errno = error;
+		return false;
+	}
+
+	next = 0;
+	stats = Stats{};
+	return true;
+}
+
+void Receiver::close()
+{
+	for (auto & socket: sockets)
+	{
+		if (socket.fd < 0)
+			continue;
+
+		// Marks go with the handle
+		poller_del(socket.fd, poller);
+		::close(socket.fd);
+		socket.fd = -1;
+		socket.handle = nullptr;
+		socket.port = 0;
+		socket.next = 0;
+	}
+	held.clear();
+	free_slots.clear();
+	for (size_t i = options.hold; i > 0; i--)
+		free_slots.push_back(i - 1);
+	holding = false;
+}
+
+bool Receiver::open_line(Socket & socket, const Line & line)
+{
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(line.port);
+	ip_mreq_source join{};
+	if (inet_pton(AF_INET, line.group.c_str(), &sa.sin_addr) != 1
+		|| inet_pton(AF_INET, line.interface.c_str(), &join.imr_interface) != 1
+		|| (!line.source.empty() && inet_pton(AF_INET, line.source.c_str(), &join.imr_sourceaddr) != 1))
+	{
+		errno = EINVAL;
+		return false;
+	}
+	join.imr_multiaddr = sa.sin_addr;
+
+	socket.fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (socket.fd < 0)
+		return false;
+
+	// Other receivers of the group on the host bind it too
+	int one = 1;
+	setsockopt(socket.fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (options.receive_buffer > 0)
+		setsockopt(socket.fd, SOL_SOCKET, SO_RCVBUF, &options.receive_buffer, sizeof(options.receive_buffer));
+
+	// Software stamps as well, for lines whose NIC stamps nothing
+	int stamping = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE
+		| SOF_TIMESTAMPING_SOFTWARE;
+	bool stamped = options.hardware_timestamps
+		? setsockopt(socket.fd, SOL_SOCKET, SO_TIMESTAMPING, &stamping, sizeof(stamping)) == 0
+		: setsockopt(socket.fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) == 0;
+
+	socklen_t length = sizeof(sa);
+	bool joined = line.source.empty()
+		? setsockopt(socket.fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &join, sizeof(ip_mreq)) == 0
+		: setsockopt(socket.fd, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP, &join, sizeof(join)) == 0;
+	if (!stamped || bind(socket.fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0
+		|| getsockname(socket.fd, reinterpret_cast<sockaddr *>(&sa), &length) != 0 || !joined)
+		return false;
+
+	handle_param param{};
+	param.fd = socket.fd;
+	param.context = &socket;
+	param.on_readable = on_readable;
+	param.on_timeout = on_timeout;
+	socket.handle = poller_add(&param, poller);
+	socket.port = ntohs(sa.sin_port);
+	return socket.handle != nullptr;
+}
+
+void Receiver::receive(Socket & socket)
+{
+	auto batch = static_cast<unsigned>(options.batch);
+	while (socket.fd >= 0)
+	{
+		for (unsigned i = 0; i < batch; i++)
+			messages[i].msg_hdr.msg_controllen = control_size;
+
+		auto n = recvmmsg(socket.fd, messages.get(), batch, MSG_DONTWAIT, nullptr);
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		for (int i = 0; i < n; i++)
+		{
+			const auto & header = messages[i].msg_hdr;
+			if (!(header.msg_flags & MSG_TRUNC))
+				arrive(socket.line, buffers.get() + i * options.packet_size, messages[i].msg_len, timestamp_of(header));
+		}
+
+		// Each datagram queued after this one is a new edge
+		if (n < static_cast<int>(batch))
+			return;
+	}
+}
+
+void Receiver::arrive(int line, const char * data, size_t size, uint64_t received_ns)
+{
+	if (size < binary::MoldUdp64::length)
+		return;
+
+	binary::MoldUdp64 header{data};
+	auto sequence = header.sequence();
+	auto end = sequence + count_of(header);
+	auto & socket = sockets[line];
+	auto & line_stats = stats.lines[line];
+	line_stats.packets++;
+	if (socket.next != 0 && sequence > socket.next)
+	{
+		line_stats.gaps++;
+		line_stats.missing += sequence - socket.next;
+	}
+	socket.next = std::max(socket.next, end);
+
+	if (next == 0)
+		next = sequence;
+
+	// A full hold gives up on its first gap to make room
+	if (sequence > next && free_slots.empty())
+		release(true);
+
+	if (end <= next)
+	{
+		if (end > sequence)
+			line_stats.duplicates++;
+	}
+	else if (sequence <= next)
+		deliver(line, data, size, received_ns);
+	else
+		hold(line, data, size, received_ns);
+
+	if (!held.empty())
+		release(false);
+}
+
+void Receiver::hold(int line, const char * data, size_t size, uint64_t received_ns)
+{
+	auto sequence = binary::MoldUdp64{data}.sequence();
+	auto position = std::find_if(held.begin(), held.end(), [sequence](const Held & h) { return h.sequence > sequence; });
+	auto slot = free_slots.back();
+	free_slots.pop_back();
+	std::memcpy(hold_buffers.get() + slot * options.packet_size, data, size);
+	held.insert(position, Held{sequence, slot, size, line, received_ns});
+}
+
+void Receiver::release(bool force)
+{
+	while (!held.empty())
+	{
+		auto & first = held.front();
+		if (first.sequence > next)
+		{
+			// Lines not open are beyond every gap
+			bool passed = std::all_of(std::begin(sockets), std::end(sockets), [this](const Socket & s)
+			{
+				return s.fd < 0 || s.next > next;
+			});
+			if (!force && !passed)
+				break;
+
+			stats.gaps++;
+			stats.lost += first.sequence - next;
+			auto gap = next;
+			next = first.sequence;
+			if (on_gap)
+				on_gap(gap, next);
+			force = false;
+			continue;
+		}
+
+		auto line = first.line;
+		auto data = hold_buffers.get() + first.slot * options.packet_size;
+		auto size = first.size;
+		auto received_ns = first.received_ns;
+		free_slots.push_back(first.slot);
+		held.erase(held.begin());
+		// Free again, but not written before the next arrival
+		binary::MoldUdp64 header{data};
+		if (header.sequence() + count_of(header) > next)
+			deliver(line, data, size, received_ns);
+		else if (count_of(header) > 0)
+			stats.lines[line].duplicates++;
+	}
+
+	// Armed by the first packet held while none were, and again once it fires with packets left
+	if (holding != !held.empty() && sockets[0].handle)
+	{
+		holding = !held.empty();
+		auto ms = std::chrono::ceil<std::chrono::milliseconds>(options.hold_timeout).count();
+		poller_mark(0, holding ? static_cast<int>(std::max<int64_t>(ms, 1)) : -1, sockets[0].handle, poller);
+	}
+}
+
+void Receiver::deliver(int line, const char * data, size_t size, uint64_t received_ns)
+{
+	binary::MoldUdp64 header{data};
+	auto sequence = header.sequence();
+	auto count = count_of(header);
+	std::string_view raw(data + binary::MoldUdp64::length, size - binary::MoldUdp64::length);
+	// Messages delivered already, the other line having framed them otherwise
+	while (sequence < next && count > 0 && raw.size() >= 2)
+	{
+		auto length = binary::load<uint16_t, std::endian::big>(raw.data());
+		if (raw.size() < 2u + length)
+			return;
+
+		raw.remove_prefix(2 + length);
+		sequence++;
+		count--;
+	}
+
+	next = sequence + count;
+	if (count == 0)
+		return;
+
+	stats.delivered++;
+	if (on_packet)
+		on_packet(Packet{header.session(), sequence, count, raw, line, received_ns});
+}
+
+void Receiver::on_readable(handle_t *, void * context)
+{
+	auto socket = static_cast<Socket *>(context);
+	socket->receiver->receive(*socket);
+}
+
+void Receiver::on_timeout(handle_t *, void * context, int)
+{
+	auto receiver = static_cast<Socket *>(context)->receiver;
+	receiver->holding = false;
+	receiver->release(true);
+}
+
+}
@@ -0,0 +1,686 @@
+#include <random>
+
+#include <sys/socket.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Connection.h"
+#include "WebSocket.h"
+
+namespace extra::protocol::ws
+{
+namespace
+{
+constexpr std::string_view guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/**
+ * SHA-1 is only needed for Sec-WebSocket-Accept, a plain implementation is enough.
+ */
+std::array<uint8_t, 20> sha1(std::string_view data)
+{
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+	auto rotl = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+
+	std::string padded(data);
+	padded += static_cast<char>(0x80);
+	while (padded.size() % 64 != 56)
+		padded += '\0';
+	uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+	for (int i = 7; i >= 0; i--)
+		padded += static_cast<char>(bits >> (i * 8));
+
+	for (size_t chunk = 0; chunk < padded.size(); chunk += 64)
+	{
+		uint32_t w[80];
+		for (int i = 0; i < 16; i++)
+		{
+			auto p = reinterpret_cast<const uint8_t *>(padded.data() + chunk + i * 4);
+			w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+		}
+		for (int i = 16; i < 80; i++)
+			w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (int i = 0; i < 80; i++)
+		{
+			uint32_t f, k;
+			if (i < 20)
+				f = (b & c) | (~b & d), k = 0x5A827999;
+			else if (i < 40)
+				f = b ^ c ^ d, k = 0x6ED9EBA1;
+			else if (i < 60)
+				f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+			else
+				f = b ^ c ^ d, k = 0xCA62C1D6;
+
+			uint32_t t = rotl(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rotl(b, 30);
+			b = a;
+			a = t;
+		}
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	std::array<uint8_t, 20> digest{};
+	for (int i = 0; i < 20; i++)
+		digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - (i % 4) * 8));
+	return digest;
+}
+
+std::string base64(const uint8_t * data, size_t size)
+{
+	constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string s;
+	s.reserve((size + 2) / 3 * 4);
+	for (size_t i = 0; i < size; i += 3)
+	{
+		uint32_t v = uint32_t(data[i]) << 16;
+		if (i + 1 < size)
+			v |= uint32_t(data[i + 1]) << 8;
+		if (i + 2 < size)
+			v |= data[i + 2];
+
+		s += alphabet[(v >> 18) & 63];
+		s += alphabet[(v >> 12) & 63];
+		s += i + 1 < size ? alphabet[(v >> 6) & 63] : '=';
+		s += i + 2 < size ? alphabet[v & 63] : '=';
+	}
+	return s;
+}
+
+bool equal_ignore_case(std::string_view lhs, std::string_view rhs)
+{
+	return lhs.size() == rhs.size() && strncasecmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+/**
+ * UTF-8 as RFC 3629, without overlong forms, surrogates or code points beyond U+10FFFF.
+ * ASCII is skipped 8 bytes per step.
+ */
+bool is_utf8(std::string_view s)
+{
+	auto p = reinterpret_cast<const uint8_t *>(s.data());
+	auto end = p + s.size();
+	while (p < end)
+	{
+		if (end - p >= 8)
+		{
+			uint64_t v;
+			std::memcpy(&v, p, sizeof(v));
+			if ((v & 0x8080808080808080ull) == 0)
+			{
+				p += 8;
+				continue;
+			}
+		}
+
+		if (*p < 0x80)
+		{
+			p++;
+			continue;
+		}
+
+		// Bounds of the second byte narrowed for the lead bytes that could start invalid sequences
+		size_t n;
+		uint8_t low = 0x80;
+		uint8_t high = 0xBF;
+		if (*p >= 0xC2 && *p <= 0xDF)
+			n = 1;
+		else if (*p >= 0xE0 && *p <= 0xEF)
+		{
+			n = 2;
+			low = *p == 0xE0 ? 0xA0 : low;
+			high = *p == 0xED ? 0x9F : high;
+		}
+		else if (*p >= 0xF0 && *p <= 0xF4)
+		{
+			n = 3;
+			low = *p == 0xF0 ? 0x90 : low;
+			high = *p == 0xF4 ? 0x8F : high;
+		}
+		else
+			return false;
+
+		if (static_cast<size_t>(end - p) <= n || p[1] < low || p[1] > high)
+			return false;
+
+		for (size_t i = 2; i <= n; i++)
+		{
+			if ((p[i] & 0xC0) != 0x80)
+				return false;
+		}
+		p += n + 1;
+	}
+	return true;
+}
+}
+
+std::string make_key()
+{
+	std::random_device rd;
+	uint8_t nonce[16];
+	for (auto & b: nonce)
+		b = static_cast<uint8_t>(rd());
+	return base64(nonce, sizeof(nonce));
+}
+
+std::string accept_key(std::string_view key)
+{
+	std::string s(key);
+	s += guid;
+	auto digest = sha1(s);
+	return base64(digest.data(), digest.size());
+}
+
+void make_handshake(http::HttpRequestV1D1 & request, std::string_view host, std::string_view uri, std::string_view key)
+{
+	request.set_method<http::Method::Get>();
+	request.set_uri(std::string(uri));
+	request.append_header("Host", std::string(host));
+	request.append_header("Upgrade", "websocket");
+	request.append_header("Connection", "Upgrade");
+	request.append_header("Sec-WebSocket-Key", std::string(key));
+	request.append_header("Sec-WebSocket-Version", "13");
+}
+
+bool verify_handshake(const http::HttpResponseV1D1 & response, std::string_view key)
+{
+	const auto & headers = response.get_headers();
+	auto upgrade = headers.find("Upgrade");
+	auto accept = headers.find("Sec-WebSocket-Accept");
+	return response.get_status() == "101"
+	       && upgrade != headers.end() && equal_ignore_case(upgrade->second, "websocket")
+	       && accept != headers.end() && accept->second == accept_key(key);
+}
+
+void apply_mask(char * out, const char * in, size_t size, const uint8_t (& key)[4], size_t phase)
+{
+	uint8_t k[4];
+	for (size_t i = 0; i < 4; i++)
+		k[i] = key[(phase + i) % 4];
+
+	uint32_t k32;
+	std::memcpy(&k32, k, sizeof(k32));
+	uint64_t k64 = (uint64_t(k32) << 32) | k32;
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	const __m256i k256 = _mm256_set1_epi32(static_cast<int>(k32));
+	for (; i + 32 <= size; i += 32)
+	{
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_xor_si256(v, k256));
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i k128 = _mm_set1_epi32(static_cast<int>(k32));
+	for (; i + 16 <= size; i += 16)
+	{
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_xor_si128(v, k128));
+	}
+#endif
+
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t v;
+		std::memcpy(&v, in + i, sizeof(v));
+		v ^= k64;
+		std::memcpy(out + i, &v, sizeof(v));
+	}
+
+	for (; i < size; i++)
+		out[i] = static_cast<char>(in[i] ^ k[i % 4]);
+}
+
+void encode_frame(std::string & output, Opcode opcode, std::string_view payload, bool fin, const uint8_t (* key)[4])
+{
+	uint8_t header[14];
+	size_t n = 0;
+	header[n++] = static_cast<uint8_t>((fin ? 0x80 : 0) | static_cast<uint8_t>(opcode));
+	uint8_t mask_bit = key ? 0x80 : 0;
+	if (payload.size() < 126)
+		header[n++] = mask_bit | static_cast<uint8_t>(payload.size());
+	else if (payload.size() <= 0xFFFF)
+	{
+		header[n++] = mask_bit | 126;
+		header[n++] = static_cast<uint8_t>(payload.size() >> 8);
+		header[n++] = static_cast<uint8_t>(payload.size());
+	}
+	else
+	{
+		header[n++] = mask_bit | 127;
+		for (int i = 7; i >= 0; i--)
+			header[n++] = static_cast<uint8_t>(static_cast<uint64_t>(payload.size()) >> (i * 8));
+	}
+
+	if (key)
+	{
+		std::memcpy(header + n, *key, 4);
+		n += 4;
+	}
+
+	output.append(reinterpret_cast<const char *>(header), n);
+	auto offset = output.size();
+	output.resize(offset + payload.size());
+	if (key)
+		apply_mask(output.data() + offset, payload.data(), payload.size(), *key);
+	else
+		std::memcpy(output.data() + offset, payload.data(), payload.size());
+}
+
+FrameParser::FrameParser(bool from_client_)
+	: header{}, header_size{0}, header_length{2}
+	, fin{false}, opcode{Opcode::Continuation}, masked{false}, key{}, payload_length{0}, payload_received{0}
+	, message_opcode{Opcode::Continuation}, message{}, control{}, payload{}, completed{Opcode::Continuation}
+	, complete{false}, failed{false}, from_client{from_client_}, close_code{0}
+{
+}
+
+ParseResult FrameParser::parse(std::string_view & raw)
+{
+	while (!failed && !complete && !raw.empty())
+	{
+		if (header_size < header_length)
+			failed = !parse_header(raw);
+		else
+			failed = !parse_payload(raw);
+	}
+
+	if (!failed && complete)
+		failed = !validate();
+
+	if (failed)
+	{
+		close_code = close_code == 0 ? 1002 : close_code;
+		return ParseResult::Error;
+	}
+	return complete ? ParseResult::Complete : ParseResult::Incomplete;
+}
+
+bool FrameParser::parse_header(std::string_view & raw)
+{
+	auto n = std::min(raw.size(), header_length - header_size);
+	std::memcpy(header + header_size, raw.data(), n);
+	header_size += n;
+	raw.remove_prefix(n);
+	if (header_size < header_length)
+		return true;
+
+	if (header_length == 2)
+	{
+		auto length = header[1] & 0x7F;
+		header_length += (length == 126 ? 2 : length == 127 ? 8 : 0) + (header[1] & 0x80 ? 4 : 0);
+		if (header_length > 2)
+			return true;
+	}
+
+	if (header[0] & 0x70) // RSV without extension
+		return false;
+
+	fin = header[0] & 0x80;
+	opcode = static_cast<Opcode>(header[0] & 0x0F);
+	masked = header[1] & 0x80;
+	if (masked != from_client) // Only clients mask, as RFC 6455 5.1
+		return false;
+
+	size_t pos = 2;
+	payload_length = header[1] & 0x7F;
+	if (payload_length == 126)
+	{
+		payload_length = (size_t(header[2]) << 8) | header[3];
+		pos += 2;
+	}
+	else if (payload_length == 127)
+	{
+		payload_length = 0;
+		for (int i = 0; i < 8; i++)
+			payload_length = (payload_length << 8) | header[2 + i];
+		pos += 8;
+	}
+
+	if (masked)
+		std::memcpy(key, header + pos, 4);
+
+	payload_received = 0;
+	switch (opcode)
+	{
+	case Opcode::Close:
+	case Opcode::Ping:
+	case Opcode::Pong:
+		if (!fin || payload_length > 125)
+			return false;
+		control.clear();
+		break;
+
+	case Opcode::Text:
+	case Opcode::Binary:
+		if (message_opcode != Opcode::Continuation)
+			return false;
+		if (payload_length > message_length_limit)
+		{
+			close_code = 1009;
+			return false;
+		}
+		message.clear();
+		message_opcode = opcode;
+		break;
+
+	case Opcode::Continuation:
+		if (message_opcode == Opcode::Continuation)
+			return false;
+		if (message.size() + payload_length > message_length_limit)
+		{
+			close_code = 1009;
+			return false;
+		}
+		break;
+
+	default:
+		return false;
+	}
+
+	if (payload_length == 0)
+		finish_frame();
+	return true;
+}
+
+bool FrameParser::parse_payload(std::string_view & raw)
+{
+	auto n = std::min(raw.size(), payload_length - payload_received);
+	bool is_control = static_cast<uint8_t>(opcode) & 0x08;
+
+	if (payload_received == 0 && n == payload_length && fin && !masked && opcode != Opcode::Continuation)
+	{
+		// Whole unmasked frame at hand, no copy
+		payload = raw.substr(0, n);
+		raw.remove_prefix(n);
+		completed = opcode;
+		complete = true;
+		if (!is_control)
+			message_opcode = Opcode::Continuation;
+		header_size = 0;
+		header_length = 2;
+		return true;
+	}
+
+	auto & target = is_control ? control : message;
+	auto offset = target.size();
+	target.append(raw.data(), n);
+	if (masked)
+		apply_mask(target.data() + offset, target.data() + offset, n, key, payload_received);
+
+	payload_received += n;
+	raw.remove_prefix(n);
+	if (payload_received == payload_length)
+		finish_frame();
+	return true;
+}
+
+void FrameParser::finish_frame()
+{
+	header_size = 0;
+	header_length = 2;
+	if (static_cast<uint8_t>(opcode) & 0x08)
+	{
+		completed = opcode;
+		payload = control;
+		complete = true;
+	}
+	else if (fin)
+	{
+		completed = message_opcode;
+		payload = message;
+		complete = true;
+		message_opcode = Opcode::Continuation;
+	}
+}
+
+/**
+ * Checked once complete, as a fragment may end in the middle of a character. A close payload is empty
+ * or a status code followed by a reason.
+ */
+bool FrameParser::validate()
+{
+	if (completed == Opcode::Close && payload.size() == 1)
+		return false;
+
+	std::string_view text;
+	if (completed == Opcode::Text)
+		text = payload;
+	else if (completed == Opcode::Close)
+		text = payload.substr(std::min<size_t>(2, payload.size()));
+
+	if (is_utf8(text))
+		return true;
+
+	close_code = 1007;
+	return false;
+}
+
+WebSocketClient::WebSocketClient(poller_t * poller_, MessageCallback on_message_, StateCallback on_state_)
+	: poller{poller_}, on_message{std::move(on_message_)}, on_state{std::move(on_state_)}
+	, fd{-1}, connected{false}, open{false}, closing{false}, key{}, mask_state{std::random_device{}() | 1ull}
+	, pending{}, output{}, output_offset{0}
+	, input{new char[input_capacity]}
+	, handshake{}, parser{}
+{
+}
+
+WebSocketClient::~WebSocketClient()
+{
+	if (fd >= 0)
+	{
+		poller_del(fd, poller);
+		::close(fd);
+	}
+}
+
+bool WebSocketClient::connect(const std::string & address, uint16_t port, std::string_view uri)
+{
+	if (fd >= 0)
+		return false;
+
+	handle_param param{};
+	param.context = this;
+	param.on_readable = on_readable;
+	param.on_writable = on_writable;
+	fd = open_connection(address, port, param, poller);
+	if (fd < 0)
+		return false;
+
+	key = make_key();
+	http::HttpRequestV1D1 request;
+	make_handshake(request, address + ':' + std::to_string(port), uri, key);
+	output.resize(request.size());
+	request.format_into(output.data(), output.size());
+	return true;
+}
+
+bool WebSocketClient::send(Opcode opcode, std::string_view payload)
+{
+	if (fd < 0 || closing)
+		return false;
+
+	uint8_t k[4];
+	next_mask(k);
+	encode_frame(open ? output : pending, opcode, payload, true, &k);
+	if (open)
+		flush();
+	return true;
+}
+
+void WebSocketClient::close(uint16_t code)
+{
+	if (fd < 0 || closing)
+		return;
+
+	char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code)};
+	send(Opcode::Close, {payload, sizeof(payload)});
+	closing = true;
+}
+
+/**
+ * xorshift64*, masking only has to defeat cache poisoning by intermediaries.
+ */
+void WebSocketClient::next_mask(uint8_t (& k)[4])
+{
+	mask_state ^= mask_state >> 12;
+	mask_state ^= mask_state << 25;
+	mask_state ^= mask_state >> 27;
+	auto v = static_cast<uint32_t>((mask_state * 0x2545F4914F6CDD1Dull) >> 32);
+	std::memcpy(k, &v, sizeof(k));
+}
+
+void WebSocketClient::receive()
+{
+	while (fd >= 0)
+	{
+		auto n = recv(fd, input.get(), input_capacity, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0 && errno == EAGAIN)
+			return;
+
+		if (n <= 0)
+		{
+			fail();
+			return;
+		}
+
+		std::string_view raw(input.get(), n);
+		if (!process(raw))
+			return;
+	}
+}
+
+bool WebSocketClient::process(std::string_view & raw)
+{
+	if (!open)
+	{
+		auto result = handshake.parse(raw);
+		if (result == ParseResult::Incomplete)
+			return true;
+
+		if (result == ParseResult::Error || !verify_handshake(handshake, key))
+		{
+			fail();
+			return false;
+		}
+
+		open = true;
+		output += pending;
+		pending.clear();
+		pending.shrink_to_fit();
+		flush();
+		if (on_state)
+			on_state(State::Success);
+	}
+
+	while (fd >= 0 && !raw.empty())
+	{
+		auto result = parser.parse(raw);
+		if (result == ParseResult::Incomplete)
+			break;
+
+		if (result == ParseResult::Error)
+		{
+			// Tell the server why before failing the connection, as RFC 6455 7.1.7
+			if (!closing)
+			{
+				auto code = parser.get_close_code();
+				char reason[2] = {static_cast<char>(code >> 8), static_cast<char>(code)};
+				uint8_t k[4];
+				next_mask(k);
+				encode_frame(output, Opcode::Close, {reason, sizeof(reason)}, true, &k);
+				flush();
+			}
+			fail();
+			return false;
+		}
+
+		auto opcode = parser.get_opcode();
+		auto payload = parser.get_payload();
+		switch (opcode)
+		{
+		case Opcode::Ping:
+			if (!closing)
+			{
+				uint8_t k[4];
+				next_mask(k);
+				encode_frame(output, Opcode::Pong, payload, true, &k);
+				flush();
+			}
+			break;
+
+		case Opcode::Close:
+			if (!closing)
+			{
+				uint8_t k[4];
+				next_mask(k);
+				encode_frame(output, Opcode::Close, payload.substr(0, 2), true, &k);
+				closing = true;
+				flush();
+			}
+			break;
+
+		default:
+			if (on_message)
+				on_message(opcode, payload);
+			break;
+		}
+		parser.reset();
+	}
+	return fd >= 0;
+}
+
+void WebSocketClient::flush()
+{
+	if (connected)
+		flush_output(fd, output, output_offset);
+}
+
+void WebSocketClient::fail()
+{
+	if (fd < 0)
+		return;
+
+	poller_del(fd, poller);
+	::close(fd);
+	fd = -1;
+	open = false;
+	if (on_state)
+		on_state(State::NetworkError);
+}
+
+void WebSocketClient::on_readable(handle_t *, void * context)
+{
+	static_cast<WebSocketClient *>(context)->receive();
+}
+
+void WebSocketClient::on_writable(handle_t *, void * context)
+{
+	auto client = static_cast<WebSocketClient *>(context);
+	if (!client->connected)
+	{
+		if (!is_established(client->fd))
+		{
+			client->fail();
+			return;
+		}
+		client->connected = true;
+	}
+	client->flush();
+}
+
+}
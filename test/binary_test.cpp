@@ -0,0 +1,247 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "extra/Itch.h"
+
+using namespace extra::protocol;
+using extra::protocol::binary::Framing;
+using extra::protocol::binary::Layout;
+using extra::protocol::binary::MoldUdp64;
+using extra::protocol::binary::Overloaded;
+using extra::protocol::binary::load;
+using extra::protocol::binary::to_channel;
+using namespace extra::protocol::itch;
+
+namespace
+{
+/**
+ * Big-endian writer of test messages.
+ */
+class Writer
+{
+public:
+	std::string bytes;
+
+	Writer & u(uint64_t value, size_t size)
+	{
+		for (size_t i = size; i > 0; i--)
+			bytes += static_cast<char>(value >> (8 * (i - 1)));
+		return *this;
+	}
+
+	Writer & c(char value)
+	{
+		bytes += value;
+		return *this;
+	}
+
+	Writer & alpha(std::string_view value, size_t size)
+	{
+		bytes += value;
+		bytes.append(size - value.size(), ' ');
+		return *this;
+	}
+};
+
+std::string header(char type, uint16_t locate, uint64_t timestamp)
+{
+	return Writer{}.c(type).u(locate, 2).u(0, 2).u(timestamp, 6).bytes;
+}
+
+std::string add_order(uint64_t reference, char side, uint32_t shares, std::string_view stock, uint32_t price)
+{
+	return header('A', 7, 34200000000000 + reference) + Writer{}.u(reference, 8).c(side).u(shares, 4).alpha(stock, 8)
+		.u(price, 4).bytes;
+}
+
+std::string order_executed(uint64_t reference, uint32_t shares, uint64_t match)
+{
+	return header('E', 7, 34200000000001) + Writer{}.u(reference, 8).u(shares, 4).u(match, 8).bytes;
+}
+
+std::string order_delete(uint64_t reference)
+{
+	return header('D', 7, 34200000000002) + Writer{}.u(reference, 8).bytes;
+}
+
+std::string block(const std::string & message)
+{
+	return Writer{}.u(message.size(), 2).bytes + message;
+}
+
+struct Book
+{
+	std::vector<uint64_t> added;
+	std::vector<uint64_t> executed;
+	std::vector<uint64_t> deleted;
+};
+}
+
+TEST(Binary, Load_0)
+{
+	const char bytes[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+	EXPECT_EQ((load<uint16_t, std::endian::big>(bytes)), 0x0102);
+	EXPECT_EQ((load<uint16_t, std::endian::little>(bytes)), 0x0201);
+	EXPECT_EQ((load<uint32_t, std::endian::big>(bytes + 1)), 0x02030405u);
+	EXPECT_EQ((load<int64_t, std::endian::little>(bytes)), 0x0807060504030201);
+	EXPECT_EQ((load<char, std::endian::big>(bytes + 7)), 0x08);
+
+	Layout<8, std::endian::little> little(bytes);
+	EXPECT_EQ((little.get_uint<1, 3>()), 0x040302u);
+	Layout<8> big(bytes);
+	EXPECT_EQ((big.get_uint<1, 3>()), 0x020304u);
+}
+
+TEST(Binary, Itch_0)
+{
+	auto message = add_order(42, 'B', 300, "AAPL", 1895000);
+	AddOrder view(message.data());
+	EXPECT_EQ(view.stock_locate(), 7);
+	EXPECT_EQ(view.timestamp(), 34200000000042u);
+	EXPECT_EQ(view.order_reference(), 42u);
+	EXPECT_EQ(view.side(), 'B');
+	EXPECT_EQ(view.shares(), 300u);
+	EXPECT_EQ(view.stock(), "AAPL");
+	EXPECT_EQ(view.price(), 1895000u);
+	EXPECT_EQ(message.size(), AddOrder::length);
+	EXPECT_EQ(order_executed(1, 1, 1).size(), OrderExecuted::length);
+	EXPECT_EQ(order_delete(1).size(), OrderDelete::length);
+}
+
+TEST(Binary, Decode_0)
+{
+	std::string packet = Writer{}.alpha("SESSION01", 10).u(1000, 8).u(5, 2).bytes;
+	packet += block(add_order(1, 'B', 100, "AAPL", 1895000));
+	packet += block(add_order(2, 'S', 200, "MSFT", 4201000));
+	// Not in the handler, skipped
+	packet += block(header('S', 0, 1) + "O");
+	// Unknown type, skipped
+	packet += block("zzz");
+	packet += block(order_executed(1, 100, 77));
+	packet += block(order_delete(2));
+
+	MoldUdp64 mold(packet.data());
+	EXPECT_EQ(mold.session(), "SESSION01 ");
+	EXPECT_EQ(mold.sequence(), 1000u);
+	EXPECT_EQ(mold.count(), 5u);
+
+	Book book;
+	auto handler = Overloaded{
+		[&](const AddOrder & m) { book.added.push_back(m.order_reference()); },
+		[&](const OrderExecuted & m) { book.executed.push_back(m.match_number()); },
+		[&](const OrderDelete & m) { book.deleted.push_back(m.order_reference()); },
+	};
+	std::string_view raw(packet);
+	raw.remove_prefix(MoldUdp64::length);
+	EXPECT_EQ(Decoder::decode(raw, handler), ParseResult::Complete);
+	EXPECT_TRUE(raw.empty());
+	EXPECT_EQ(book.added, (std::vector<uint64_t>{1, 2}));
+	EXPECT_EQ(book.executed, (std::vector<uint64_t>{77}));
+	EXPECT_EQ(book.deleted, (std::vector<uint64_t>{2}));
+
+	// A stream split anywhere resumes at the partial message
+	std::string stream;
+	for (uint64_t i = 0; i < 50; i++)
+		stream += block(i % 2 ? order_delete(i) : add_order(i, 'B', 1, "AAPL", 1));
+	Book split;
+	auto count = Overloaded{
+		[&](const AddOrder & m) { split.added.push_back(m.order_reference()); },
+		[&](const OrderDelete & m) { split.added.push_back(m.order_reference()); },
+	};
+	std::string buffer;
+	for (size_t i = 0; i < stream.size(); i += 7)
+	{
+		buffer += stream.substr(i, 7);
+		std::string_view rest(buffer);
+		auto result = Decoder::decode(rest, count);
+		EXPECT_NE(result, ParseResult::Error);
+		EXPECT_EQ(result == ParseResult::Complete, rest.empty());
+		buffer.erase(0, buffer.size() - rest.size());
+	}
+	EXPECT_TRUE(buffer.empty());
+	ASSERT_EQ(split.added.size(), 50u);
+	EXPECT_EQ(split.added[49], 49u);
+}
+
+TEST(Binary, Decode_1)
+{
+	// Shorter than the layout
+	auto truncated = block(add_order(1, 'B', 1, "AAPL", 1).substr(0, 20));
+	std::string_view raw(truncated);
+	size_t calls = 0;
+	auto handler = [&](const AddOrder &) { calls++; };
+	EXPECT_EQ(Decoder::decode(raw, handler), ParseResult::Error);
+	EXPECT_EQ(raw.size(), truncated.size());
+	EXPECT_EQ(calls, 0u);
+
+	// Longer is fine, layouts may grow at the end
+	auto longer = block(add_order(1, 'B', 1, "AAPL", 1) + "ext");
+	raw = longer;
+	EXPECT_EQ(Decoder::decode(raw, handler), ParseResult::Complete);
+	EXPECT_EQ(calls, 1u);
+
+	using Packed = binary::Decoder<Framing::Packed, AddOrder, OrderDelete>;
+	std::string packed = add_order(1, 'B', 1, "AAPL", 1) + order_delete(1) + order_delete(2).substr(0, 10);
+	raw = packed;
+	std::vector<char> types;
+	auto record = [&](const auto & m) { types.push_back(m.type); };
+	EXPECT_EQ(Packed::decode(raw, record), ParseResult::Incomplete);
+	EXPECT_EQ(raw.size(), 10u);
+	EXPECT_EQ(types, (std::vector<char>{'A', 'D'}));
+
+	packed = order_delete(3) + "?";
+	raw = packed;
+	EXPECT_EQ(Packed::decode(raw, record), ParseResult::Error);
+	EXPECT_EQ(raw, "?");
+}
+
+TEST(Binary, Channel_0)
+{
+	struct Quote
+	{
+		uint64_t reference;
+		uint64_t timestamp;
+		uint32_t price;
+		int32_t shares;
+		char stock[8];
+	};
+
+	extra::kernel::Channel<Quote> channel("extra-binary-test", 0, 128);
+	ASSERT_TRUE(channel.create());
+
+	auto publish = to_channel(channel, Overloaded{
+		[](const AddOrder & m, Quote & q)
+		{
+			q.reference = m.order_reference();
+			q.timestamp = m.timestamp();
+			q.price = m.price();
+			q.shares = static_cast<int32_t>(m.shares()) * (m.side() == 'B' ? 1 : -1);
+			std::memcpy(q.stock, m.get_bytes().data() + 24, sizeof(q.stock));
+		},
+		[](const OrderDelete & m, Quote & q)
+		{
+			q = Quote{m.order_reference(), m.timestamp(), 0, 0, {}};
+		},
+	});
+
+	std::string stream = block(add_order(1, 'B', 100, "AAPL", 1895000)) + block(order_executed(1, 100, 1))
+		+ block(add_order(2, 'S', 5, "MSFT", 4201000)) + block(order_delete(1));
+	std::string_view raw(stream);
+	EXPECT_EQ(Decoder::decode(raw, publish), ParseResult::Complete);
+
+	auto it = channel.read_iterator();
+	ASSERT_TRUE(it.next());
+	EXPECT_EQ(it->reference, 1u);
+	EXPECT_EQ(it->shares, 100);
+	EXPECT_EQ(std::string_view(it->stock, 8), "AAPL    ");
+	ASSERT_TRUE(it.next());
+	EXPECT_EQ(it->reference, 2u);
+	EXPECT_EQ(it->shares, -5);
+	EXPECT_EQ(it->price, 4201000u);
+	ASSERT_TRUE(it.next());
+	EXPECT_EQ(it->reference, 1u);
+	EXPECT_EQ(it->price, 0u);
+	EXPECT_FALSE(it.next());
+}
@@ -0,0 +1,160 @@
+#include "gtest/gtest.h"
+#include "extra/HttpCache.h"
+#include "extra/HttpServer.h"
+#include "helper.h"
+
+namespace
+{
+struct Instruments
+{
+	std::string body;
+};
+}
+
+TEST(HttpCache, Revalidate_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		// Serves the uri and a version, the version is the ETag, /dated uses Last-Modified instead
+		int version = 1;
+		std::vector<std::string> conditions;
+		HttpServer server(poller, [&](const HttpRequestParser & request, HttpResponseWriter & response)
+		{
+			auto etag = "\"v" + std::to_string(version) + "\"";
+			auto date = "Mon, 19 Oct 2026 08:00:0" + std::to_string(version) + " GMT";
+			conditions.push_back(std::string(request.find_header("If-None-Match")) + "|"
+			                     + std::string(request.find_header("If-Modified-Since")));
+			bool dated = request.get_uri() == "/dated";
+			if (dated ? request.find_header("If-Modified-Since") == date : request.find_header("If-None-Match") == etag)
+			{
+				response.set_status<Status::_304>();
+				response.finish();
+				return;
+			}
+			if (request.get_uri() == "/volatile")
+				response.append_header("Cache-Control", "no-store");
+			response.append_header(dated ? "Last-Modified" : "ETag", dated ? date : etag);
+			response.set_body_once(std::string(request.get_uri()) + " " + std::to_string(version));
+		});
+		ASSERT_TRUE(server.listen("127.0.0.1", 0));
+
+		HttpClient client(poller);
+		size_t parsed = 0;
+		HttpCache<Instruments> cache(client, [&parsed](const HttpResponseV1D1 & response)
+		{
+			parsed++;
+			return std::make_shared<const Instruments>(Instruments{response.get_body()});
+		});
+
+		auto get = [&](const std::string & uri, std::string_view status)
+		{
+			HttpRequestV1D1 req;
+			req.set_method<Method::Get>();
+			req.set_uri(uri);
+			std::shared_ptr<const Instruments> object;
+			bool done = false;
+			EXPECT_TRUE(cache.send("127.0.0.1", server.get_port(), req,
+				[&](State state, Error error, const HttpResponseV1D1 * response, std::shared_ptr<const Instruments> o)
+				{
+					EXPECT_EQ(state, State::Success);
+					EXPECT_EQ(error, NoError);
+					EXPECT_EQ(response->get_status(), status);
+					object = std::move(o);
+					done = true;
+				}));
+			EXPECT_TRUE(run_until(poller, [&] { return done; }));
+			return object;
+		};
+
+		auto first = get("/instruments", "200");
+		ASSERT_NE(first, nullptr);
+		EXPECT_EQ(first->body, "/instruments 1");
+		auto second = get("/instruments", "304");
+		EXPECT_EQ(second, first);
+		EXPECT_EQ(parsed, 1u);
+		EXPECT_EQ(conditions.back(), "\"v1\"|");
+
+		version = 2;
+		auto third = get("/instruments", "200");
+		ASSERT_NE(third, nullptr);
+		EXPECT_EQ(third->body, "/instruments 2");
+		EXPECT_EQ(get("/instruments", "304"), third);
+
+		ASSERT_NE(get("/dated", "200"), nullptr);
+		EXPECT_EQ(get("/dated", "304")->body, "/dated 2");
+		EXPECT_EQ(conditions.back(), "|Mon, 19 Oct 2026 08:00:02 GMT");
+
+		// Not stored, sent unconditionally
+		get("/volatile", "200");
+		get("/volatile", "200");
+		EXPECT_EQ(conditions.back(), "|");
+
+		EXPECT_EQ(cache.size(), 2u);
+		EXPECT_EQ(cache.hit_count(), 3u);
+		EXPECT_EQ(cache.miss_count(), 5u);
+		EXPECT_EQ(parsed, 5u);
+	}
+	poller_destroy(poller);
+}
+
+TEST(HttpCache, Capacity_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		HttpServer server(poller, [](const HttpRequestParser & request, HttpResponseWriter & response)
+		{
+			if (request.find_header("If-None-Match") == "\"same\"")
+			{
+				response.set_status<Status::_304>();
+				response.finish();
+				return;
+			}
+			response.append_header("ETag", "\"same\"");
+			response.set_body_once(std::string(100, 'x'));
+		});
+		ASSERT_TRUE(server.listen("127.0.0.1", 0));
+
+		HttpClient client(poller);
+		HttpCache<std::string> cache(client, [](const HttpResponseV1D1 & response)
+		{
+			return std::make_shared<const std::string>(response.get_body());
+		}, {.capacity = 400});
+
+		std::vector<std::string> statuses;
+		auto send = [&](const std::string & uri)
+		{
+			HttpRequestV1D1 req;
+			req.set_method<Method::Get>();
+			req.set_uri(uri);
+			auto before = statuses.size();
+			cache.send("127.0.0.1", server.get_port(), req,
+				[&](State, Error, const HttpResponseV1D1 * response, std::shared_ptr<const std::string> object)
+				{
+					ASSERT_NE(object, nullptr);
+					statuses.push_back(response->get_status());
+				});
+			EXPECT_TRUE(run_until(poller, [&] { return statuses.size() == before + 1; }));
+		};
+
+		// Each entry costs about 130 bytes, so three fit
+		for (auto uri: {"/a", "/b", "/c", "/a", "/d", "/b"})
+			send(uri);
+		EXPECT_EQ(statuses, (std::vector<std::string>{"200", "200", "200", "304", "200", "200"}));
+		EXPECT_EQ(cache.size(), 3u);
+		EXPECT_LE(cache.used_bytes(), 400u);
+
+		cache.clear();
+		EXPECT_EQ(cache.used_bytes(), 0u);
+		send("/a");
+		EXPECT_EQ(statuses.back(), "200");
+	}
+	poller_destroy(poller);
+}
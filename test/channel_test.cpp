@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include "gtest/gtest.h"
 #include "extra/Channel.h"
 
@@ -43,3 +45,98 @@ TEST(Shm, T0)
 	}
 	EXPECT_EQ(length, expected_id);
 }
+
+namespace
+{
+using extra::kernel::Field;
+using extra::kernel::Payload;
+
+using OrderV1 = Payload<"Order", Field<"id", long, 0>, Field<"price", long, 8>, Field<"volume", int, 16>>;
+using OrderV2 = Payload<"Order", Field<"id", long, 0>, Field<"price", long, 8>, Field<"volume", int, 16>,
+	Field<"side", char, 20, 2>, Field<"venue", char[8], 24, 2>>;
+using OrderV3 = Payload<"Order", Field<"id", long, 0>, Field<"price", long, 8>, Field<"volume", int, 16>,
+	Field<"side", char, 20, 2>, Field<"venue", char[8], 24, 2>, Field<"timestamp", long, 32, 3>>;
+using Reordered = Payload<"Order", Field<"id", long, 0>, Field<"volume", int, 8>, Field<"price", long, 16>>;
+using Retyped = Payload<"Order", Field<"id", long, 0>, Field<"price", double, 8>, Field<"volume", int, 16>>;
+
+static_assert(std::is_trivially_copyable_v<OrderV2> && std::is_standard_layout_v<OrderV2>);
+static_assert(sizeof(OrderV1) == 24 && sizeof(OrderV2) == 32 && sizeof(OrderV3) == 40);
+static_assert(OrderV2::version == 2 && OrderV2::since<"venue">() == 2);
+static_assert(OrderV1::hash(1) == OrderV2::hash(1) && OrderV2::hash(2) == OrderV3::hash(2));
+static_assert(OrderV1::hash(1) != Reordered::hash(1) && OrderV1::hash(1) != Retyped::hash(1));
+}
+
+TEST(Shm, Schema_0)
+{
+	extra::kernel::Channel<OrderV2> writer("extra-schema-test", 0, 16);
+	ASSERT_TRUE(writer.create());
+	EXPECT_EQ(writer.schema_version(), 2u);
+	for (long i = 0; i < 3; i++)
+	{
+		auto it = writer.write_iterator();
+		it->get<"id">() = i;
+		it->get<"price">() = 100 + i;
+		it->get<"volume">() = 10;
+		it->get<"side">() = 'B';
+		std::memcpy(it->get<"venue">(), "XNAS", 5);
+	}
+
+	EXPECT_TRUE(writer.writable());
+
+	extra::kernel::Channel<OrderV1> older("extra-schema-test", 0, 16);
+	ASSERT_TRUE(older.attach());
+	EXPECT_FALSE(older.writable());
+	auto o = older.read_iterator();
+	for (long i = 0; i < 3; i++)
+	{
+		ASSERT_TRUE(o.next());
+		EXPECT_EQ(o->get<"id">(), i);
+		EXPECT_EQ(o->get<"price">(), 100 + i);
+	}
+	EXPECT_FALSE(o.next());
+
+	extra::kernel::Channel<OrderV3> newer("extra-schema-test", 0, 16);
+	ASSERT_TRUE(newer.attach());
+	EXPECT_EQ(newer.schema_version(), 2u);
+	EXPECT_FALSE(newer.writable());
+	auto n = newer.read_iterator();
+	ASSERT_TRUE(n.next());
+	EXPECT_STREQ(n->get<"venue">(), "XNAS");
+	EXPECT_GT(OrderV3::since<"timestamp">(), newer.schema_version());
+
+	extra::kernel::Channel<Reordered> reordered("extra-schema-test", 0, 16);
+	EXPECT_FALSE(reordered.attach());
+	extra::kernel::Channel<Retyped> retyped("extra-schema-test", 0, 16);
+	EXPECT_FALSE(retyped.attach());
+
+	// A plain struct of the same size is not trusted either
+	struct Plain
+	{
+		long id;
+		long price;
+		int volume;
+		char side;
+		char venue[8];
+	};
+	static_assert(sizeof(Plain) == sizeof(OrderV2));
+	extra::kernel::Channel<Plain> plain("extra-schema-test", 0, 16);
+	EXPECT_FALSE(plain.attach());
+
+	// Writing takes the version of the creator, newer cells would overrun its links
+	extra::kernel::Channel<OrderV3> newer_writer("extra-schema-test", 0, 16);
+	EXPECT_FALSE(newer_writer.attach(true));
+	extra::kernel::Channel<OrderV1> older_writer("extra-schema-test", 0, 16);
+	EXPECT_FALSE(older_writer.attach(true));
+	extra::kernel::Channel<OrderV2> same("extra-schema-test", 0, 16);
+	ASSERT_TRUE(same.attach(true));
+	EXPECT_TRUE(same.writable());
+	{
+		auto it = same.write_iterator();
+		it->get<"id">() = 3;
+	}
+	ASSERT_TRUE(o.next());
+	EXPECT_EQ(o->get<"id">(), 3);
+
+	// Still there after failed attaches
+	ASSERT_TRUE(older.attach());
+}
@@ -0,0 +1,346 @@
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "extra/HttpClient.h"
+#include "helper.h"
+
+namespace
+{
+/**
+ * Blocking HTTP/1.1 stand-in server on loopback, echoing the uri of each request as body, but only its
+ * Content-Length to HEAD. Uris under /chunked are answered chunked, after a 100 Continue, those under
+ * /large with 2 MiB of the uri repeated, and those under /gzip as if gzip encoded.
+ */
+class LoopbackServer
+{
+private:
+	int listener;
+	uint16_t port;
+	std::atomic<int> accepted;
+	std::vector<std::thread> threads;
+
+public:
+	LoopbackServer()
+		: listener{-1}, port{0}, accepted{0}
+	{
+		listener = listen_loopback(SOCK_STREAM, port);
+		threads.emplace_back([this] { serve(); });
+	}
+
+	~LoopbackServer()
+	{
+		shutdown(listener, SHUT_RDWR);
+		close(listener);
+		for (auto & t: threads)
+			t.join();
+	}
+
+	[[nodiscard]] uint16_t get_port() const
+	{
+		return port;
+	}
+
+	[[nodiscard]] int get_accepted() const
+	{
+		return accepted.load();
+	}
+
+private:
+	void serve()
+	{
+		std::vector<std::thread> workers;
+		while (true)
+		{
+			int fd = accept(listener, nullptr, nullptr);
+			if (fd < 0)
+				break;
+
+			accepted++;
+			workers.emplace_back([fd] { echo(fd); });
+		}
+		for (auto & t: workers)
+			t.join();
+	}
+
+	static void echo(int fd)
+	{
+		std::string input;
+		char buffer[4096];
+		ssize_t n;
+		while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+		{
+			input.append(buffer, n);
+			std::string output;
+			for (auto end = input.find("\r\n\r\n"); end != std::string::npos; end = input.find("\r\n\r\n"))
+			{
+				auto first = input.find(' ') + 1;
+				auto uri = input.substr(first, input.find(' ', first) - first);
+				if (uri.starts_with("/chunked"))
+				{
+					char size[16];
+					snprintf(size, sizeof(size), "%zx", uri.size());
+					output += "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+					output += std::string(size) + "\r\n" + uri + "\r\n0\r\n\r\n";
+				}
+				else if (uri.starts_with("/large"))
+				{
+					std::string body;
+					while (body.size() < 2 * 1024 * 1024)
+						body += uri;
+					output += "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+				}
+				else if (uri.starts_with("/gzip"))
+				{
+					output += "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: "
+						+ std::to_string(uri.size()) + "\r\n\r\n" + uri;
+				}
+				else
+				{
+					output += "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(uri.size()) + "\r\n\r\n";
+					if (!input.starts_with("HEAD "))
+						output += uri;
+				}
+				input.erase(0, end + 4);
+			}
+			::send(fd, output.data(), output.size(), MSG_NOSIGNAL);
+		}
+		close(fd);
+	}
+};
+}
+
+TEST(HttpClient, Pipelining_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	LoopbackServer server;
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		HttpClient client(poller, {.max_connections_per_host = 1, .pipeline_depth = 16});
+
+		std::vector<std::string> bodies;
+		for (int round = 0; round < 2; round++)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				HttpRequestV1D1 req;
+				req.set_method<Method::Get>();
+				req.set_uri("/" + std::to_string(round) + "/" + std::to_string(i));
+				bool sent = client.send("127.0.0.1", server.get_port(), req,
+					[&](State state, Error error, HttpResponseV1D1 * response)
+					{
+						EXPECT_EQ(state, State::Success);
+						EXPECT_EQ(error, NoError);
+						ASSERT_NE(response, nullptr);
+						bodies.push_back(response->get_body());
+					});
+				EXPECT_TRUE(sent);
+			}
+			EXPECT_TRUE(run_until(poller, [&] { return bodies.size() == 16u * (round + 1); }));
+		}
+
+		ASSERT_EQ(bodies.size(), 32u);
+		for (int i = 0; i < 32; i++)
+			EXPECT_EQ(bodies[i], "/" + std::to_string(i / 16) + "/" + std::to_string(i % 16));
+
+		EXPECT_EQ(client.connection_count(), 1u);
+		EXPECT_EQ(server.get_accepted(), 1);
+	}
+	poller_destroy(poller);
+}
+
+TEST(HttpClient, Head_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	LoopbackServer server;
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		HttpClient client(poller, {.max_connections_per_host = 1, .pipeline_depth = 16});
+
+		// Pipelined on one connection, each GET right behind a HEAD whose Content-Length is not followed
+		std::vector<std::pair<std::string, std::string>> responses;
+		for (int i = 0; i < 4; i++)
+		{
+			HttpRequestV1D1 req;
+			if (i % 2 == 0)
+				req.set_method<Method::Head>();
+			else
+				req.set_method<Method::Get>();
+			req.set_uri("/" + std::to_string(i));
+			client.send("127.0.0.1", server.get_port(), req,
+				[&](State state, Error, HttpResponseV1D1 * response)
+				{
+					EXPECT_EQ(state, State::Success);
+					ASSERT_NE(response, nullptr);
+					responses.emplace_back(response->get_headers().at("Content-Length"), response->get_body());
+				});
+		}
+		EXPECT_TRUE(run_until(poller, [&] { return responses.size() == 4; }));
+		EXPECT_EQ(responses, (std::vector<std::pair<std::string, std::string>>{{"2", ""}, {"2", "/1"}, {"2", ""},
+			{"2", "/3"}}));
+		EXPECT_EQ(client.connection_count(), 1u);
+		EXPECT_EQ(server.get_accepted(), 1);
+	}
+	poller_destroy(poller);
+}
+
+TEST(HttpClient, Chunked_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	LoopbackServer server;
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		HttpClient client(poller, {.max_connections_per_host = 1, .pipeline_depth = 16});
+
+		// Chunked responses end on their last chunk and keep the connection, interim ones are skipped
+		std::vector<std::string> bodies;
+		for (auto uri: {"/chunked/0", "/1", "/chunked/2"})
+		{
+			HttpRequestV1D1 req;
+			req.set_method<Method::Get>();
+			req.set_uri(uri);
+			client.send("127.0.0.1", server.get_port(), req,
+				[&](State state, Error, HttpResponseV1D1 * response)
+				{
+					EXPECT_EQ(state, State::Success);
+					ASSERT_NE(response, nullptr);
+					EXPECT_EQ(response->get_status(), "200");
+					bodies.push_back(response->get_body());
+				});
+		}
+		EXPECT_TRUE(run_until(poller, [&] { return bodies.size() == 3; }));
+		EXPECT_EQ(bodies, (std::vector<std::string>{"/chunked/0", "/1", "/chunked/2"}));
+		EXPECT_EQ(client.connection_count(), 1u);
+		EXPECT_EQ(server.get_accepted(), 1);
+	}
+	poller_destroy(poller);
+}
+
+TEST(HttpClient, Body_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	LoopbackServer server;
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		HttpClient client(poller, {.max_connections_per_host = 1, .pipeline_depth = 16});
+		auto get = [](const char * uri)
+		{
+			HttpRequestV1D1 req;
+			req.set_method<Method::Get>();
+			req.set_uri(uri);
+			return req;
+		};
+
+		// Only the request with a sink takes a body over the limit, the next ones get theirs kept again
+		size_t sunk = 0;
+		std::vector<std::string> bodies;
+		auto keep = [&](State state, Error, HttpResponseV1D1 * response)
+		{
+			EXPECT_EQ(state, State::Success);
+			ASSERT_NE(response, nullptr);
+			bodies.push_back(response->get_body());
+		};
+		client.send("127.0.0.1", server.get_port(), get("/large/0"), keep,
+			{.sink = [&](std::string_view piece) { sunk += piece.size(); }});
+		client.send("127.0.0.1", server.get_port(), get("/gzip/1"), keep, {.sink = {}, .content_decoding = false});
+		client.send("127.0.0.1", server.get_port(), get("/2"), keep);
+		EXPECT_TRUE(run_until(poller, [&] { return bodies.size() == 3; }));
+		EXPECT_EQ(bodies, (std::vector<std::string>{"", "/gzip/1", "/2"}));
+		EXPECT_EQ(sunk, 2 * 1024 * 1024u);
+
+		std::vector<State> states;
+		auto state_of = [&](State state, Error, HttpResponseV1D1 *) { states.push_back(state); };
+		client.send("127.0.0.1", server.get_port(), get("/large/3"), state_of);
+		EXPECT_TRUE(run_until(poller, [&] { return states.size() == 1; }));
+		if (HttpResponseBasic::is_content_decoding_supported())
+		{
+			client.send("127.0.0.1", server.get_port(), get("/gzip/4"), state_of);
+			EXPECT_TRUE(run_until(poller, [&] { return states.size() == 2; }));
+		}
+		for (auto state: states)
+			EXPECT_EQ(state, State::NetworkError);
+	}
+	poller_destroy(poller);
+}
+
+TEST(HttpClient, Pool_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	LoopbackServer server;
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		HttpClient client(poller, {.max_connections_per_host = 2, .pipeline_depth = 1});
+
+		size_t done = 0;
+		for (int i = 0; i < 8; i++)
+		{
+			HttpRequestV1D1 req;
+			req.set_method<Method::Get>();
+			req.set_uri("/" + std::to_string(i));
+			client.send("127.0.0.1", server.get_port(), req,
+				[&](State state, Error, HttpResponseV1D1 * response)
+				{
+					EXPECT_EQ(state, State::Success);
+					ASSERT_NE(response, nullptr);
+					done++;
+				});
+		}
+		EXPECT_TRUE(run_until(poller, [&] { return done == 8; }));
+		EXPECT_EQ(client.connection_count(), 2u);
+		EXPECT_EQ(server.get_accepted(), 2);
+	}
+	poller_destroy(poller);
+}
+
+TEST(HttpClient, Refused_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	uint16_t port;
+	{
+		LoopbackServer server;
+		port = server.get_port();
+	}
+
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		HttpClient client(poller);
+		HttpRequestV1D1 req;
+		req.set_method<Method::Get>();
+		req.set_uri("/");
+		bool failed = false;
+		client.send("127.0.0.1", port, req,
+			[&](State state, Error, HttpResponseV1D1 * response)
+			{
+				EXPECT_EQ(state, State::NetworkError);
+				EXPECT_EQ(response, nullptr);
+				failed = true;
+			});
+		EXPECT_TRUE(run_until(poller, [&] { return failed; }));
+		EXPECT_EQ(client.connection_count(), 0u);
+	}
+	poller_destroy(poller);
+}
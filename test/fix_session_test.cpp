@@ -0,0 +1,446 @@
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "extra/FixSession.h"
+#include "helper.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::fix;
+using namespace std::chrono_literals;
+
+namespace
+{
+/**
+ * Non-blocking acceptor stand-in on loopback, polled from the test loop along with the poller.
+ */
+class Acceptor
+{
+private:
+	int listener;
+	uint16_t port;
+	Parser parser;
+	std::string input;
+
+public:
+	int fd;
+	bool closed;
+	uint64_t seq;
+	Encoder encoder;
+	std::vector<std::string> received;
+
+	Acceptor()
+		: listener{-1}, port{0}, parser{}, input{}, fd{-1}
+		, closed{false}, seq{1}, encoder{"FIX.4.4", "VENUE", "CLIENT"}, received{}
+	{
+		listener = listen_loopback(SOCK_STREAM | SOCK_NONBLOCK, port);
+	}
+
+	~Acceptor()
+	{
+		if (fd >= 0)
+			close(fd);
+		close(listener);
+	}
+
+	[[nodiscard]] uint16_t get_port() const
+	{
+		return port;
+	}
+
+	void poll()
+	{
+		if (fd < 0)
+		{
+			fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK);
+			closed = false;
+			if (fd < 0)
+				return;
+		}
+
+		char buffer[4096];
+		ssize_t n;
+		while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+			input.append(buffer, n);
+		if (n == 0)
+			closed = true;
+
+		std::string_view raw = input;
+		while (parser.parse(raw) == ParseResult::Complete)
+		{
+			received.emplace_back(parser.get_message());
+			parser.reset();
+		}
+		input.erase(0, input.size() - raw.size());
+	}
+
+	void drop()
+	{
+		close(fd);
+		fd = -1;
+		input.clear();
+	}
+
+	Encoder & begin(std::string_view msg_type)
+	{
+		return begin(msg_type, seq++);
+	}
+
+	Encoder & begin(std::string_view msg_type, uint64_t seq_num)
+	{
+		encoder.begin(msg_type, seq_num, "20261019-08:00:00.000");
+		return encoder;
+	}
+
+	void send()
+	{
+		auto message = encoder.finish();
+		::send(fd, message.data(), message.size(), MSG_NOSIGNAL);
+	}
+
+	void logon()
+	{
+		begin("A").add(EncryptMethod, 0);
+		encoder.add(HeartBtInt, 1);
+		send();
+	}
+};
+
+std::string field(const std::string & message, uint32_t tag)
+{
+	Parser parser;
+	std::string_view raw = message;
+	if (parser.parse(raw) != ParseResult::Complete)
+		return "<malformed>";
+	return std::string(parser.find(tag));
+}
+
+/**
+ * Run the poller and the acceptor in turn until predicate holds.
+ */
+template <typename Predicate>
+bool run_until(poller_t * poller, Acceptor & acceptor, Predicate predicate)
+{
+	return run_until(poller, [&]
+	{
+		acceptor.poll();
+		return predicate();
+	});
+}
+
+class FixSessionTest : public testing::Test
+{
+protected:
+	std::string path;
+	poller_t * poller;
+	Acceptor acceptor;
+	SequenceStore store;
+	std::vector<std::string> messages;
+	std::vector<Session::Status> statuses;
+
+	void SetUp() override
+	{
+		char name[] = "/tmp/extra_fix_store_XXXXXX";
+		close(mkstemp(name));
+		path = name;
+		poller = poller_create();
+		ASSERT_NE(poller, nullptr);
+		ASSERT_TRUE(store.open(path, SequenceStore::Options{1024, 1024 * 1024}));
+	}
+
+	void TearDown() override
+	{
+		poller_destroy(poller);
+		store.close();
+		unlink(path.c_str());
+	}
+
+	Session::Options options(std::chrono::milliseconds heartbeat_interval = 30s)
+	{
+		Session::Options o;
+		o.sender_comp_id = "CLIENT";
+		o.target_comp_id = "VENUE";
+		o.heartbeat_interval = heartbeat_interval;
+		return o;
+	}
+
+	std::unique_ptr<Session> make_session(Session::Options o)
+	{
+		return std::make_unique<Session>(poller, store, std::move(o), [this](const Parser & parser)
+		{
+			messages.emplace_back(parser.get_message());
+		}, [this](Session::Status status)
+		{
+			statuses.push_back(status);
+		});
+	}
+
+	/**
+	 * Connect and answer the Logon.
+	 */
+	void log_on(Session & session)
+	{
+		ASSERT_TRUE(session.connect("127.0.0.1", acceptor.get_port()));
+		auto first = acceptor.received.size();
+		ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() > first; }));
+		EXPECT_EQ(field(acceptor.received[first], MsgType), "A");
+		acceptor.logon();
+		ASSERT_TRUE(run_until(poller, acceptor, [&] { return session.get_status() == Session::Status::Active; }));
+	}
+
+	void send_order(Session & session, std::string_view id)
+	{
+		auto & encoder = session.prepare("D");
+		encoder.add(ClOrdID, id);
+		encoder.add(Symbol, "BTC-USDT");
+		encoder.add(Side, '1');
+		ASSERT_TRUE(session.send());
+	}
+};
+}
+
+TEST(SequenceStore, Store_0)
+{
+	char name[] = "/tmp/extra_fix_store_XXXXXX";
+	close(mkstemp(name));
+	{
+		SequenceStore store;
+		ASSERT_TRUE(store.open(name, SequenceStore::Options{4, 16}));
+		EXPECT_EQ(store.next_inbound(), 1u);
+		EXPECT_EQ(store.next_outbound(), 1u);
+		store.store("first");
+		store.store({});
+		store.store("second-message");
+		store.store("third");
+		store.store("beyond the index");
+		store.set_next_inbound(7);
+		EXPECT_EQ(store.next_outbound(), 6u);
+		EXPECT_EQ(store.find(1), "first");
+		EXPECT_EQ(store.find(2), "");
+		// Out of bytes
+		EXPECT_EQ(store.find(3), "");
+		EXPECT_EQ(store.find(4), "third");
+		EXPECT_EQ(store.find(5), "");
+		EXPECT_EQ(store.find(6), "");
+		EXPECT_TRUE(store.sync());
+	}
+	{
+		SequenceStore store;
+		ASSERT_TRUE(store.open(name));
+		EXPECT_EQ(store.next_inbound(), 7u);
+		EXPECT_EQ(store.next_outbound(), 6u);
+		EXPECT_EQ(store.find(4), "third");
+		store.reset();
+		EXPECT_EQ(store.next_outbound(), 1u);
+		EXPECT_EQ(store.find(1), "");
+		store.store("again");
+		EXPECT_EQ(store.find(1), "again");
+	}
+	unlink(name);
+
+	SequenceStore store;
+	EXPECT_FALSE(store.open("/proc/version"));
+	EXPECT_FALSE(store.is_open());
+}
+
+TEST_F(FixSessionTest, Logon_0)
+{
+	auto session = make_session(options());
+	log_on(*session);
+	EXPECT_EQ(field(acceptor.received[0], HeartBtInt), "30");
+	EXPECT_EQ(field(acceptor.received[0], MsgSeqNum), "1");
+
+	send_order(*session, "ord-1");
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 2; }));
+	EXPECT_EQ(field(acceptor.received[1], MsgSeqNum), "2");
+	EXPECT_EQ(field(acceptor.received[1], ClOrdID), "ord-1");
+
+	acceptor.begin("8").add(ClOrdID, "ord-1");
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return messages.size() == 1; }));
+	EXPECT_EQ(field(messages[0], ClOrdID), "ord-1");
+	EXPECT_EQ(store.next_inbound(), 3u);
+	EXPECT_EQ(store.next_outbound(), 3u);
+
+	session->logout("bye");
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 3; }));
+	EXPECT_EQ(field(acceptor.received[2], MsgType), "5");
+	acceptor.begin("5");
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return session->get_status() == Session::Status::Disconnected; }));
+	EXPECT_EQ(statuses, (std::vector<Session::Status>{Session::Status::Connecting, Session::Status::LogonSent,
+		Session::Status::Active, Session::Status::LogoutSent, Session::Status::Disconnected}));
+}
+
+TEST_F(FixSessionTest, ResendRequest_0)
+{
+	auto session = make_session(options());
+	log_on(*session);
+	send_order(*session, "ord-1");
+	acceptor.begin("1").add(TestReqID, "t");
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 3; }));
+	send_order(*session, "ord-2");
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 4; }));
+	auto original = acceptor.received[3];
+
+	// Logon 1, order 2, heartbeat 3, order 4
+	acceptor.begin("2").add(BeginSeqNo, 1);
+	acceptor.encoder.add(EndSeqNo, 0);
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 8; }));
+	const auto & r = acceptor.received;
+	EXPECT_EQ(field(r[4], MsgType), "4");
+	EXPECT_EQ(field(r[4], MsgSeqNum), "1");
+	EXPECT_EQ(field(r[4], GapFillFlag), "Y");
+	EXPECT_EQ(field(r[4], NewSeqNo), "2");
+	EXPECT_EQ(field(r[5], MsgType), "D");
+	EXPECT_EQ(field(r[5], MsgSeqNum), "2");
+	EXPECT_EQ(field(r[5], PossDupFlag), "Y");
+	EXPECT_EQ(field(r[5], ClOrdID), "ord-1");
+	EXPECT_EQ(field(r[5], OrigSendingTime), field(acceptor.received[1], SendingTime));
+	EXPECT_EQ(field(r[6], MsgType), "4");
+	EXPECT_EQ(field(r[6], MsgSeqNum), "3");
+	EXPECT_EQ(field(r[6], NewSeqNo), "4");
+	EXPECT_EQ(field(r[7], MsgSeqNum), "4");
+	EXPECT_EQ(field(r[7], Symbol), "BTC-USDT");
+	EXPECT_EQ(field(r[7], OrigSendingTime), field(original, SendingTime));
+	EXPECT_EQ(store.next_outbound(), 5u);
+
+	send_order(*session, "ord-3");
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 9; }));
+	EXPECT_EQ(field(r[8], MsgSeqNum), "5");
+}
+
+TEST_F(FixSessionTest, InboundGap_0)
+{
+	auto session = make_session(options());
+	log_on(*session);
+
+	// 2 and 3 lost
+	acceptor.begin("8", 4).add(ClOrdID, "ord-4");
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 2; }));
+	EXPECT_EQ(field(acceptor.received[1], MsgType), "2");
+	EXPECT_EQ(field(acceptor.received[1], BeginSeqNo), "2");
+	EXPECT_EQ(field(acceptor.received[1], EndSeqNo), "0");
+
+	// Still recovering, no second request
+	acceptor.begin("8", 5).add(ClOrdID, "ord-5");
+	acceptor.send();
+	acceptor.begin("4", 2).add(PossDupFlag, true);
+	acceptor.encoder.add(GapFillFlag, true);
+	acceptor.encoder.add(NewSeqNo, 3);
+	acceptor.send();
+	for (uint64_t seq: {3, 4, 5})
+	{
+		acceptor.begin("8", seq).add(PossDupFlag, true);
+		acceptor.encoder.add(ClOrdID, "ord-" + std::to_string(seq));
+		acceptor.send();
+	}
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return messages.size() == 3; }));
+	EXPECT_EQ(field(messages[0], ClOrdID), "ord-3");
+	EXPECT_EQ(field(messages[2], ClOrdID), "ord-5");
+	EXPECT_EQ(store.next_inbound(), 6u);
+	EXPECT_EQ(acceptor.received.size(), 2u);
+
+	// Duplicate without PossDupFlag
+	acceptor.begin("8", 5).add(ClOrdID, "ord-5");
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return session->get_status() == Session::Status::Disconnected; }));
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 3; }));
+	EXPECT_EQ(field(acceptor.received[2], MsgType), "5");
+	EXPECT_EQ(messages.size(), 3u);
+}
+
+TEST_F(FixSessionTest, SequenceReset_0)
+{
+	auto session = make_session(options());
+	log_on(*session);
+
+	// Reset mode moves the inbound number on whatever MsgSeqNum says
+	acceptor.begin("4", 7).add(NewSeqNo, 10);
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return store.next_inbound() == 10; }));
+	acceptor.begin("8", 10).add(ClOrdID, "ord-10");
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return messages.size() == 1; }));
+
+	// Not back to numbers processed already, nor are they accepted again
+	acceptor.begin("4", 11).add(NewSeqNo, 10);
+	acceptor.send();
+	acceptor.begin("8", 10).add(ClOrdID, "ord-10");
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return session->get_status() == Session::Status::Disconnected; }));
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 2; }));
+	EXPECT_EQ(field(acceptor.received[1], MsgType), "5");
+	EXPECT_EQ(field(acceptor.received[1], Text), "NewSeqNo too low, expecting 11");
+	EXPECT_EQ(store.next_inbound(), 11u);
+	EXPECT_EQ(messages.size(), 1u);
+}
+
+TEST_F(FixSessionTest, Heartbeat_0)
+{
+	auto session = make_session(options(100ms));
+	log_on(*session);
+	EXPECT_EQ(field(acceptor.received[0], HeartBtInt), "1");
+
+	acceptor.begin("1").add(TestReqID, "probe");
+	acceptor.send();
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return acceptor.received.size() == 2; }));
+	EXPECT_EQ(field(acceptor.received[1], MsgType), "0");
+	EXPECT_EQ(field(acceptor.received[1], TestReqID), "probe");
+
+	// Idle output gets a Heartbeat, silent input a TestRequest then the connection dropped
+	ASSERT_TRUE(run_until(poller, acceptor, [&] { return session->get_status() == Session::Status::Disconnected; }));
+	bool heartbeat = false;
+	bool test_request = false;
+	for (size_t i = 2; i < acceptor.received.size(); i++)
+	{
+		heartbeat |= field(acceptor.received[i], MsgType) == "0" && field(acceptor.received[i], TestReqID).empty();
+		test_request |= field(acceptor.received[i], MsgType) == "1";
+	}
+	EXPECT_TRUE(heartbeat);
+	EXPECT_TRUE(test_request);
+}
+
+TEST_F(FixSessionTest, Recovery_0)
+{
+	{
+		auto session = make_session(options());
+		log_on(*session);
+		send_order(*session, "ord-1");
+		acceptor.begin("8").add(ClOrdID, "ord-1");
+		acceptor.send();
+		ASSERT_TRUE(run_until(poller, acceptor, [&] { return messages.size() == 1; }));
+	}
+	store.close();
+	acceptor.drop();
+	ASSERT_TRUE(store.open(path));
+	EXPECT_EQ(store.next_inbound(), 3u);
+	EXPECT_EQ(store.next_outbound(), 3u);
+	EXPECT_EQ(field(std::string(store.find(2)), ClOrdID), "ord-1");
+
+	auto first = acceptor.received.size();
+	auto session = make_session(options());
+	log_on(*session);
+	EXPECT_EQ(field(acceptor.received[first], MsgSeqNum), "3");
+
+	auto reset = options();
+	reset.reset_on_logon = true;
+	session = make_session(reset);
+	acceptor.drop();
+	acceptor.seq = 1;
+	first = acceptor.received.size();
+	log_on(*session);
+	EXPECT_EQ(field(acceptor.received[first], MsgSeqNum), "1");
+	EXPECT_EQ(field(acceptor.received[first], ResetSeqNumFlag), "Y");
+	EXPECT_EQ(store.next_inbound(), 2u);
+}
@@ -0,0 +1,177 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "extra/Fix.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::fix;
+
+namespace
+{
+/**
+ * Frame a body the slow way, replacing '|' with SOH.
+ */
+std::string frame(std::string body)
+{
+	for (auto & c: body)
+	{
+		if (c == '|')
+			c = SOH;
+	}
+	std::string message = "8=FIX.4.4" + std::string(1, SOH) + "9=" + std::to_string(body.size()) + SOH + body;
+	unsigned sum = 0;
+	for (auto c: message)
+		sum += static_cast<unsigned char>(c);
+	char trailer[8];
+	std::snprintf(trailer, sizeof(trailer), "10=%03u", sum % 256);
+	return message + trailer + SOH;
+}
+}
+
+TEST(Fix, Checksum_0)
+{
+	std::string s;
+	for (int i = 0; i < 300; i++)
+	{
+		unsigned sum = 0;
+		for (auto c: s)
+			sum += static_cast<unsigned char>(c);
+		EXPECT_EQ(checksum(s), sum % 256) << i;
+		s += static_cast<char>(i * 37 + 200);
+	}
+}
+
+TEST(Fix, Timestamp_0)
+{
+	char out[timestamp_length];
+	format_timestamp(std::chrono::system_clock::time_point(std::chrono::milliseconds(1792396800123)), out);
+	EXPECT_EQ(std::string_view(out, sizeof(out)), "20261019-08:00:00.123");
+}
+
+TEST(Fix, Encode_0)
+{
+	Encoder encoder("FIX.4.4", "CLIENT", "VENUE");
+	for (uint64_t seq: {1, 12345678})
+	{
+		encoder.begin("D", seq, "20261019-08:00:00.000");
+		encoder.add(ClOrdID, "ord-1");
+		encoder.add(Symbol, "BTC-USDT");
+		encoder.add(Side, '1');
+		encoder.add(OrderQty, 250);
+		encoder.add_fixed(Price, 400000200, 8);
+		encoder.add_fixed(44, -1250, 2);
+		encoder.add_fixed(44, 7000, 3);
+		encoder.add(PossDupFlag, false);
+		EXPECT_EQ(encoder.finish(), frame("35=D|49=CLIENT|56=VENUE|34=" + std::to_string(seq)
+		                                  + "|52=20261019-08:00:00.000|11=ord-1|55=BTC-USDT|54=1|38=250"
+		                                    "|44=4.000002|44=-12.5|44=7|43=N|"));
+	}
+}
+
+TEST(Fix, Parse_0)
+{
+	auto message = frame("35=8|49=VENUE|56=CLIENT|34=7|52=20261019-08:00:00.000|37=o1|17=e1|150=F|39=2|55=BTC-USDT"
+	                     "|54=2|453=2|448=A|447=D|452=1|448=B|447=D|452=3|44=4.0000020|32=-3|20001=custom|");
+	Parser parser;
+	std::string_view raw = message;
+	ASSERT_EQ(parser.parse(raw), ParseResult::Complete);
+	EXPECT_TRUE(raw.empty());
+	EXPECT_EQ(parser.get_message(), message);
+	EXPECT_EQ(parser.get_msg_type(), "8");
+	EXPECT_EQ(parser.find(BeginString), "FIX.4.4");
+	EXPECT_EQ(parser.find(SenderCompID), "VENUE");
+	EXPECT_EQ(parser.find(CheckSum), message.substr(message.size() - 4, 3));
+	EXPECT_EQ(parser.find(20001), "custom");
+	EXPECT_TRUE(parser.find(58).empty());
+
+	uint64_t seq;
+	ASSERT_TRUE(parser.find(MsgSeqNum, seq));
+	EXPECT_EQ(seq, 7u);
+	int64_t i;
+	ASSERT_TRUE(parser.find(32, i));
+	EXPECT_EQ(i, -3);
+	EXPECT_FALSE(parser.find(Symbol, i));
+	ASSERT_TRUE(parser.find_fixed(Price, i, 8));
+	EXPECT_EQ(i, 400000200);
+
+	// Repeating group walked from its first field
+	std::vector<std::string_view> parties;
+	for (auto k = parser.find_index(448); k < parser.get_field_count() && parser.get_field(k).tag != Price; k++)
+	{
+		if (parser.get_field(k).tag == 448)
+			parties.push_back(parser.get_field(k).value);
+	}
+	EXPECT_EQ(parties, (std::vector<std::string_view>{"A", "B"}));
+
+	// Tags of the last message are forgotten
+	parser.reset();
+	auto heartbeat = frame("35=0|49=VENUE|56=CLIENT|34=8|52=20261019-08:00:01.000|");
+	raw = heartbeat;
+	ASSERT_EQ(parser.parse(raw), ParseResult::Complete);
+	EXPECT_TRUE(parser.find(Symbol).empty());
+	EXPECT_EQ(parser.find_index(448), parser.get_field_count());
+}
+
+TEST(Fix, Streamed_0)
+{
+	std::string stream;
+	for (int i = 0; i < 20; i++)
+		stream += frame("35=D|34=" + std::to_string(i) + "|95=7|96=a\x01=b|c=|58=" + std::string(i * 10 + 1, 'x') + "|");
+
+	for (size_t split: {1, 7, 64, 1448})
+	{
+		Parser parser;
+		std::string buffer;
+		std::vector<uint64_t> seqs;
+		for (size_t offset = 0; offset < stream.size(); offset += split)
+		{
+			buffer += stream.substr(offset, split);
+			std::string_view raw = buffer;
+			while (true)
+			{
+				auto result = parser.parse(raw);
+				ASSERT_NE(result, ParseResult::Error) << split;
+				if (result == ParseResult::Incomplete)
+					break;
+
+				uint64_t seq;
+				ASSERT_TRUE(parser.find(MsgSeqNum, seq));
+				seqs.push_back(seq);
+				EXPECT_EQ(parser.find(96), "a\x01=b\x01" "c=");
+				EXPECT_EQ(parser.find(Text).size(), seq * 10 + 1);
+				parser.reset();
+			}
+			buffer.erase(0, buffer.size() - raw.size());
+		}
+		ASSERT_EQ(seqs.size(), 20u) << split;
+		for (uint64_t i = 0; i < seqs.size(); i++)
+			EXPECT_EQ(seqs[i], i);
+	}
+}
+
+TEST(Fix, Invalid_0)
+{
+	auto good = frame("35=0|34=1|");
+	auto bad_checksum = good;
+	bad_checksum[bad_checksum.size() - 2] = bad_checksum[bad_checksum.size() - 2] == '0' ? '1' : '0';
+	auto bad_length = good;
+	bad_length.replace(bad_length.find("9=") + 2, 2, "9");
+
+	std::vector<std::string> messages{bad_checksum, bad_length, frame("34=1|35=0|"), frame("35=0|34=|"),
+		frame("35=0|x4=1|"), frame("35=0|34 1|"), frame("35=0|95=9|96=short|"), "9=5" + good,
+		std::string("8=FIX.4.4") + SOH + "9=x" + SOH, "8=" + std::string(40, 'F')};
+	Parser parser;
+	for (const auto & message: messages)
+	{
+		parser.reset();
+		std::string_view raw = message;
+		EXPECT_EQ(parser.parse(raw), ParseResult::Error) << message;
+	}
+
+	parser.reset();
+	std::string_view raw = std::string_view(good).substr(0, 12);
+	EXPECT_EQ(parser.parse(raw), ParseResult::Incomplete);
+	raw = good;
+	EXPECT_EQ(parser.parse(raw), ParseResult::Complete);
+}
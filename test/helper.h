@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "extra/poller.h"
+
+/**
+ * Run the poller until predicate holds, 5 seconds at most.
+ * @return predicate() once done
+ */
+template <typename Predicate>
+bool run_until(poller_t * poller, Predicate predicate)
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (!predicate() && std::chrono::steady_clock::now() < deadline)
+		poller_go(poller);
+	return predicate();
+}
+
+/**
+ * Listening TCP socket on a loopback port picked by the kernel, for stand-in servers.
+ * @param type SOCK_STREAM, optionally with SOCK_NONBLOCK
+ * @return socket, -1 on error
+ */
+inline int listen_loopback(int type, uint16_t & port)
+{
+	int fd = socket(AF_INET, type, 0);
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(sa);
+	if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)) != 0 || listen(fd, 64) != 0
+		|| getsockname(fd, reinterpret_cast<sockaddr *>(&sa), &length) != 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	port = ntohs(sa.sin_port);
+	return fd;
+}
@@ -0,0 +1,481 @@
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "extra/Http2.h"
+#include "helper.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::http;
+
+namespace
+{
+/* A byte over the body length limit of responses */
+constexpr size_t huge_length = 1024 * 1024 + 1;
+
+std::string unhex(std::string_view hex)
+{
+	std::string bytes;
+	for (size_t i = 0; i + 1 < hex.size(); i += 2)
+		bytes += static_cast<char>(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16));
+	return bytes;
+}
+
+std::string to_hex(std::string_view bytes)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	for (auto c: bytes)
+	{
+		hex += digits[static_cast<uint8_t>(c) >> 4];
+		hex += digits[static_cast<uint8_t>(c) & 0xf];
+	}
+	return hex;
+}
+
+/**
+ * Blocking HTTP/2 stand-in server on loopback, allowing 2 concurrent streams.
+ *
+ * Requests are answered in pairs, in reverse order of completion. /large gets a 200000 byte body
+ * and those under /huge one a byte over the body length limit, sent within the client's windows, other paths
+ * get "path:request body length".
+ */
+class LoopbackServer
+{
+private:
+	struct Request
+	{
+		uint32_t id;
+		std::string path;
+		size_t body_length;
+	};
+
+	int listener;
+	uint16_t port;
+	std::thread thread;
+
+	int fd;
+	std::string input;
+	h2::FrameParser parser;
+	hpack::Decoder decoder;
+	hpack::Encoder encoder;
+	std::map<uint32_t, Request> open;
+	std::vector<Request> completed;
+	int64_t send_window;
+	std::map<uint32_t, int64_t> stream_windows;
+
+public:
+	LoopbackServer()
+		: listener{-1}, port{0}, fd{-1}, send_window{h2::default_window_size}
+	{
+		listener = listen_loopback(SOCK_STREAM, port);
+		thread = std::thread([this] { serve(); });
+	}
+
+	~LoopbackServer()
+	{
+		shutdown(listener, SHUT_RDWR);
+		close(listener);
+		thread.join();
+	}
+
+	[[nodiscard]] uint16_t get_port() const
+	{
+		return port;
+	}
+
+private:
+	void serve()
+	{
+		fd = accept(listener, nullptr, nullptr);
+		if (fd < 0)
+			return;
+
+		char buffer[h2::preface.size()];
+		if (recv(fd, buffer, sizeof(buffer), MSG_WAITALL) != sizeof(buffer) || h2::preface != std::string_view(buffer, sizeof(buffer)))
+		{
+			close(fd);
+			return;
+		}
+
+		std::string settings;
+		settings += {0, static_cast<char>(h2::Setting::MaxConcurrentStreams), 0, 0, 0, 2};
+		write(h2::FrameType::Settings, 0, 0, settings);
+
+		h2::FrameHeader header{};
+		std::string payload;
+		while (read_frame(header, payload) && handle(header, payload))
+		{
+			while (completed.size() >= 2)
+			{
+				auto first = completed[0];
+				auto second = completed[1];
+				completed.erase(completed.begin(), completed.begin() + 2);
+				if (!respond(second) || !respond(first))
+					break;
+			}
+		}
+		close(fd);
+	}
+
+	void write(h2::FrameType type, uint8_t flags, uint32_t id, std::string_view payload)
+	{
+		std::string frame;
+		h2::encode_frame(frame, type, flags, id, payload);
+		::send(fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+	}
+
+	void window_update(uint32_t id, uint32_t increment)
+	{
+		std::string payload;
+		payload += {static_cast<char>(increment >> 24), static_cast<char>(increment >> 16),
+		            static_cast<char>(increment >> 8), static_cast<char>(increment)};
+		write(h2::FrameType::WindowUpdate, 0, id, payload);
+	}
+
+	bool read_frame(h2::FrameHeader & header, std::string & payload)
+	{
+		while (true)
+		{
+			std::string_view raw = input;
+			auto result = parser.parse(raw);
+			if (result == ParseResult::Complete)
+			{
+				header = parser.get_header();
+				payload = parser.get_payload();
+				parser.reset();
+				input.erase(0, input.size() - raw.size());
+				return true;
+			}
+			input.erase(0, input.size() - raw.size());
+
+			char buffer[4096];
+			auto n = recv(fd, buffer, sizeof(buffer), 0);
+			if (result == ParseResult::Error || n <= 0)
+				return false;
+			input.append(buffer, n);
+		}
+	}
+
+	bool handle(const h2::FrameHeader & header, std::string_view payload)
+	{
+		switch (header.type)
+		{
+		case h2::FrameType::Settings:
+			if (!(header.flags & h2::Ack))
+				write(h2::FrameType::Settings, h2::Ack, 0, {});
+			break;
+
+		case h2::FrameType::Headers:
+		{
+			Request request{header.stream_id, {}, 0};
+			decoder.decode(payload, [&request](std::string_view name, std::string_view value)
+			{
+				if (name == ":path")
+					request.path = value;
+			});
+			if (header.flags & h2::EndStream)
+				completed.push_back(request);
+			else
+				open[header.stream_id] = request;
+			break;
+		}
+
+		case h2::FrameType::Data:
+			open[header.stream_id].body_length += payload.size();
+			if (!payload.empty())
+			{
+				window_update(0, payload.size());
+				window_update(header.stream_id, payload.size());
+			}
+			if (header.flags & h2::EndStream)
+			{
+				completed.push_back(open[header.stream_id]);
+				open.erase(header.stream_id);
+			}
+			break;
+
+		case h2::FrameType::WindowUpdate:
+		{
+			auto p = reinterpret_cast<const uint8_t *>(payload.data());
+			int64_t increment = p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+			if (header.stream_id == 0)
+				send_window += increment;
+			else
+				stream_windows.try_emplace(header.stream_id, h2::default_window_size).first->second += increment;
+			break;
+		}
+
+		case h2::FrameType::Goaway:
+			return false;
+
+		default:
+			break;
+		}
+		return true;
+	}
+
+	bool respond(const Request & request)
+	{
+		std::string block;
+		encoder.begin(block);
+		encoder.encode(block, ":status", "200");
+		encoder.encode(block, "content-type", "text/plain");
+		write(h2::FrameType::Headers, h2::EndHeaders, request.id, block);
+
+		auto body = request.path == "/large"
+		            ? std::string(200000, 'x')
+		            : request.path.starts_with("/huge")
+		            ? std::string(huge_length, 'x')
+		            : request.path + ':' + std::to_string(request.body_length);
+		auto & window = stream_windows.try_emplace(request.id, h2::default_window_size).first->second;
+		size_t offset = 0;
+		while (offset < body.size())
+		{
+			auto n = std::min<int64_t>({static_cast<int64_t>(body.size() - offset), send_window, window, h2::default_max_frame_size});
+			if (n <= 0)
+			{
+				h2::FrameHeader header{};
+				std::string payload;
+				if (!read_frame(header, payload) || !handle(header, payload))
+					return false;
+				continue;
+			}
+
+			offset += n;
+			send_window -= n;
+			window -= n;
+			write(h2::FrameType::Data, offset == body.size() ? h2::EndStream : 0, request.id, body.substr(offset - n, n));
+		}
+		return true;
+	}
+};
+}
+
+TEST(Hpack, Integer_0)
+{
+	std::string out;
+	hpack::encode_integer(out, 0x00, 5, 10);
+	hpack::encode_integer(out, 0x00, 5, 1337);
+	hpack::encode_integer(out, 0x00, 8, 42);
+	EXPECT_EQ(to_hex(out), "0a1f9a0a2a");
+
+	std::string_view in = out;
+	uint64_t value;
+	ASSERT_TRUE(hpack::decode_integer(in, 5, value));
+	EXPECT_EQ(value, 10u);
+	ASSERT_TRUE(hpack::decode_integer(in, 5, value));
+	EXPECT_EQ(value, 1337u);
+	ASSERT_TRUE(hpack::decode_integer(in, 8, value));
+	EXPECT_EQ(value, 42u);
+	EXPECT_FALSE(hpack::decode_integer(in, 5, value));
+}
+
+TEST(Hpack, Huffman_0)
+{
+	std::string out;
+	hpack::huffman_encode("www.example.com", out);
+	EXPECT_EQ(to_hex(out), "f1e3c2e5f23a6ba0ab90f4ff");
+	EXPECT_EQ(hpack::huffman_length("www.example.com"), out.size());
+
+	std::string decoded;
+	ASSERT_TRUE(hpack::huffman_decode(out, decoded));
+	EXPECT_EQ(decoded, "www.example.com");
+
+	std::string all;
+	for (int c = 0; c < 256; c++)
+		all += static_cast<char>(c);
+	out.clear();
+	decoded.clear();
+	hpack::huffman_encode(all, out);
+	ASSERT_TRUE(hpack::huffman_decode(out, decoded));
+	EXPECT_EQ(decoded, all);
+
+	// Padding longer than 7 bits
+	decoded.clear();
+	EXPECT_FALSE(hpack::huffman_decode(unhex("1fff"), decoded));
+}
+
+/**
+ * RFC 7541 C.4, requests with Huffman coding sharing one dynamic table.
+ */
+TEST(Hpack, Requests_0)
+{
+	using Headers = std::vector<std::pair<std::string, std::string>>;
+	const std::pair<Headers, std::string_view> requests[] = {
+		{{{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}},
+			"828684418cf1e3c2e5f23a6ba0ab90f4ff"},
+		{{{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"},
+			{"cache-control", "no-cache"}},
+			"828684be5886a8eb10649cbf"},
+		{{{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, {":authority", "www.example.com"},
+			{"custom-key", "custom-value"}},
+			"828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"},
+	};
+
+	hpack::Encoder encoder;
+	hpack::Decoder decoder;
+	for (const auto & [headers, hex]: requests)
+	{
+		std::string block;
+		encoder.begin(block);
+		for (const auto & [name, value]: headers)
+			encoder.encode(block, name, value);
+		EXPECT_EQ(to_hex(block), hex);
+
+		Headers decoded;
+		ASSERT_TRUE(decoder.decode(unhex(hex), [&decoded](std::string_view name, std::string_view value)
+		{
+			decoded.emplace_back(name, value);
+		}));
+		EXPECT_EQ(decoded, headers);
+	}
+	EXPECT_EQ(encoder.get_table().get_size(), 164u);
+	EXPECT_EQ(decoder.get_table().get_size(), 164u);
+}
+
+TEST(Hpack, Decode_0)
+{
+	hpack::Decoder decoder(256);
+	auto ignore = [](std::string_view, std::string_view) {};
+	// Index 63 with an empty dynamic table
+	EXPECT_FALSE(decoder.decode(unhex("bf07"), ignore));
+	// Size update above the advertised limit
+	EXPECT_FALSE(decoder.decode(unhex("3fe201"), ignore));
+	// Literal longer than the block
+	EXPECT_FALSE(decoder.decode(unhex("400a6b6579"), ignore));
+	EXPECT_TRUE(decoder.decode(unhex("3fc101"), ignore));
+	EXPECT_EQ(decoder.get_table().get_max_size(), 224u);
+}
+
+TEST(Http2, FrameParse_0)
+{
+	std::string stream;
+	h2::encode_frame(stream, h2::FrameType::Ping, 0, 0, "12345678");
+	h2::encode_frame(stream, h2::FrameType::Data, h2::EndStream, 3, "hello");
+
+	// Frames whole in the view and frames split at every byte
+	for (size_t split = 1; split <= stream.size(); split++)
+	{
+		h2::FrameParser parser;
+		std::vector<std::pair<h2::FrameType, std::string>> frames;
+		for (size_t i = 0; i < stream.size(); i += split)
+		{
+			std::string_view raw = std::string_view(stream).substr(i, split);
+			while (!raw.empty() && parser.parse(raw) == ParseResult::Complete)
+			{
+				frames.emplace_back(parser.get_header().type, parser.get_payload());
+				parser.reset();
+			}
+		}
+		ASSERT_EQ(frames.size(), 2u);
+		EXPECT_EQ(frames[0].first, h2::FrameType::Ping);
+		EXPECT_EQ(frames[0].second, "12345678");
+		EXPECT_EQ(frames[1].first, h2::FrameType::Data);
+		EXPECT_EQ(frames[1].second, "hello");
+	}
+
+	h2::FrameParser parser;
+	std::string large;
+	h2::encode_frame(large, h2::FrameType::Data, 0, 1, std::string(h2::default_max_frame_size + 1, 'x'));
+	std::string_view raw = large;
+	EXPECT_EQ(parser.parse(raw), ParseResult::Error);
+}
+
+TEST(Http2, Multiplexing_0)
+{
+	LoopbackServer server;
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		Http2Client::Options options;
+		options.initial_window_size = h2::default_window_size;
+		Http2Client client(poller, options);
+		ASSERT_TRUE(client.connect("127.0.0.1", server.get_port()));
+
+		std::vector<std::string> order;
+		std::map<std::string, std::string> bodies;
+		auto request = [&](const std::string & uri, std::string body)
+		{
+			HttpRequestV2 r;
+			r.set_method<Method::Get>();
+			r.set_uri(uri);
+			r.append_header("Host", "example.com");
+			r.append_header("Connection", "keep-alive");
+			r.set_body_once(std::move(body));
+			return client.send(r, [&order, &bodies, uri](State state, Error, HttpResponseV2 * response)
+			{
+				ASSERT_EQ(state, State::Success);
+				EXPECT_EQ(response->get_status(), "200");
+				EXPECT_EQ(response->get_headers().at("Content-Type"), "text/plain");
+				order.push_back(uri);
+				bodies[uri] = response->get_body();
+			});
+		};
+
+		ASSERT_TRUE(request("/a", {}));
+		ASSERT_TRUE(request("/b", std::string(100000, 'b')));
+		ASSERT_TRUE(run_until(poller, [&order] { return order.size() == 2; }));
+		EXPECT_EQ(order, (std::vector<std::string>{"/b", "/a"}));
+		EXPECT_EQ(bodies["/a"], "/a:0");
+		EXPECT_EQ(bodies["/b"], "/b:100000");
+
+		for (auto uri: {"/large", "/c", "/d", "/e"})
+			ASSERT_TRUE(request(uri, {}));
+		EXPECT_EQ(client.stream_count(), 2u);
+		EXPECT_EQ(client.pending_count(), 2u);
+
+		ASSERT_TRUE(run_until(poller, [&order] { return order.size() == 6; }));
+		EXPECT_EQ(order, (std::vector<std::string>{"/b", "/a", "/c", "/large", "/e", "/d"}));
+		EXPECT_EQ(bodies["/large"].size(), 200000u);
+		EXPECT_EQ(client.stream_count(), 0u);
+		EXPECT_TRUE(client.is_connected());
+	}
+	poller_destroy(poller);
+}
+
+TEST(Http2, BodyLimit_0)
+{
+	LoopbackServer server;
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		Http2Client::Options options;
+		options.initial_window_size = h2::default_window_size;
+		Http2Client client(poller, options);
+		ASSERT_TRUE(client.connect("127.0.0.1", server.get_port()));
+
+		std::map<std::string, std::pair<State, std::string>> results;
+		auto request = [&](const std::string & uri, HttpResponseBasic::BodySink sink)
+		{
+			HttpRequestV2 r;
+			r.set_method<Method::Get>();
+			r.set_uri(uri);
+			return client.send(r, [&results, uri](State state, Error, HttpResponseV2 * response)
+			{
+				results[uri] = {state, response ? response->get_body() : "-"};
+			}, std::move(sink));
+		};
+
+		// The stream over the limit is reset, the connection and other streams go on
+		size_t sunk = 0;
+		ASSERT_TRUE(request("/huge", {}));
+		ASSERT_TRUE(request("/huge?sink", [&sunk](std::string_view piece) { sunk += piece.size(); }));
+		ASSERT_TRUE(request("/a", {}));
+		ASSERT_TRUE(request("/b", {}));
+		ASSERT_TRUE(run_until(poller, [&results] { return results.size() == 4; }));
+		EXPECT_EQ(results["/huge"], std::make_pair(State::NetworkError, std::string("-")));
+		EXPECT_EQ(results["/huge?sink"], std::make_pair(State::Success, std::string()));
+		EXPECT_EQ(sunk, huge_length);
+		EXPECT_EQ(results["/a"], std::make_pair(State::Success, std::string("/a:0")));
+		EXPECT_EQ(results["/b"], std::make_pair(State::Success, std::string("/b:0")));
+		EXPECT_TRUE(client.is_connected());
+	}
+	poller_destroy(poller);
+}
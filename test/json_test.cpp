@@ -0,0 +1,141 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "extra/Json.h"
+
+using namespace extra::protocol::json;
+
+TEST(Json, Fixed_0)
+{
+	int64_t value;
+	ASSERT_TRUE(parse_fixed("4.00000200", 8, value));
+	EXPECT_EQ(value, 400000200);
+	ASSERT_TRUE(parse_fixed("-12.5", 2, value));
+	EXPECT_EQ(value, -1250);
+	ASSERT_TRUE(parse_fixed("7", 3, value));
+	EXPECT_EQ(value, 7000);
+	ASSERT_TRUE(parse_fixed("0.1000", 1, value));
+	EXPECT_EQ(value, 1);
+
+	EXPECT_FALSE(parse_fixed("0.15", 1, value));
+	EXPECT_FALSE(parse_fixed("1e5", 2, value));
+	EXPECT_FALSE(parse_fixed(".5", 2, value));
+	EXPECT_FALSE(parse_fixed("5.", 2, value));
+	EXPECT_FALSE(parse_fixed("", 2, value));
+	EXPECT_FALSE(parse_fixed("00.1", 2, value));
+	EXPECT_FALSE(parse_fixed("-01", 2, value));
+	EXPECT_FALSE(parse_fixed("99999999999999999999", 0, value));
+	EXPECT_FALSE(parse_fixed("999999999999", 8, value));
+}
+
+TEST(Json, BookSnapshot_0)
+{
+	std::string_view body = R"({"lastUpdateId":1027024,"nested":{"skip":[1,[2,{"a":3}]]},)"
+	                        R"("bids":[["4.00000000","431.00000000"],["3.99","1"]],"asks":[],"ok":true,"err":null})";
+	Document document;
+	ASSERT_TRUE(document.parse(body));
+	auto root = document.root();
+	EXPECT_EQ(root.type(), Type::Object);
+
+	uint64_t id;
+	ASSERT_TRUE(root["lastUpdateId"].get(id));
+	EXPECT_EQ(id, 1027024u);
+
+	std::vector<std::pair<int64_t, int64_t>> bids;
+	for (auto level: root["bids"].get_array())
+	{
+		int64_t price, quantity;
+		ASSERT_TRUE(level[size_t{0}].get_fixed(price, 8));
+		ASSERT_TRUE(level[size_t{1}].get_fixed(quantity, 8));
+		bids.emplace_back(price, quantity);
+	}
+	EXPECT_EQ(bids, (std::vector<std::pair<int64_t, int64_t>>{{400000000, 43100000000}, {399000000, 100000000}}));
+	EXPECT_TRUE(root["asks"].get_array().empty());
+
+	bool ok = false;
+	ASSERT_TRUE(root["ok"].get(ok));
+	EXPECT_TRUE(ok);
+	EXPECT_TRUE(root["err"].is_null());
+	EXPECT_EQ(root["nested"]["skip"].raw(), R"([1,[2,{"a":3}]])");
+	EXPECT_FALSE(root["missing"].is_valid());
+	EXPECT_FALSE(root["ok"].get(id));
+
+	std::vector<std::string_view> keys;
+	for (const auto & [key, value]: root.get_object())
+		keys.push_back(key);
+	EXPECT_EQ(keys, (std::vector<std::string_view>{"lastUpdateId", "nested", "bids", "asks", "ok", "err"}));
+}
+
+TEST(Json, Strings_0)
+{
+	// Escaped quotes and backslashes straddling 64 byte blocks
+	std::string body = "[\"" + std::string(60, 'x') + "\\\"\\\\\",\"\\u00e9\\ud83d\\ude00\\n\",  \"a,b:{\"  ]";
+	Document document;
+	ASSERT_TRUE(document.parse(body));
+
+	std::string s;
+	ASSERT_TRUE(document.root()[size_t{0}].get_string(s));
+	EXPECT_EQ(s, std::string(60, 'x') + "\"\\");
+	ASSERT_TRUE(document.root()[size_t{1}].get_string(s));
+	EXPECT_EQ(s, "\xc3\xa9\xf0\x9f\x98\x80\n");
+	std::string_view raw;
+	ASSERT_TRUE(document.root()[size_t{2}].get(raw));
+	EXPECT_EQ(raw, "a,b:{");
+	EXPECT_FALSE(document.root()[size_t{3}].is_valid());
+}
+
+TEST(Json, Streamed_0)
+{
+	std::string body = R"({"orders":[)";
+	for (int i = 0; i < 50; i++)
+		body += R"({"id":)" + std::to_string(i) + R"(,"price":"1.5","side":"BUY\"X"},)";
+	body.back() = ']';
+	body += '}';
+
+	for (size_t split: {1, 3, 64, 100, 1000})
+	{
+		Document document;
+		document.clear();
+		for (size_t i = 0; i < body.size(); i += split)
+			document.append(std::string_view(body).substr(i, split));
+		ASSERT_TRUE(document.finish()) << split;
+
+		int64_t sum = 0;
+		for (auto order: document.root()["orders"].get_array())
+		{
+			int64_t id, price;
+			ASSERT_TRUE(order["id"].get(id));
+			ASSERT_TRUE(order["price"].get_fixed(price, 4));
+			EXPECT_EQ(price, 15000);
+			sum += id;
+		}
+		EXPECT_EQ(sum, 49 * 50 / 2);
+	}
+}
+
+TEST(Json, Invalid_0)
+{
+	Document document;
+	for (std::string_view body: {"", "{", "[1,]", "{\"a\"}", "{\"a\":1,}", "[1 2]", "{\"a\":1]", "\"open",
+		"[tru]", "{1:2}", "[] []", "[\"a\"b]", "{\"a\" 1}", "01", "1.", "-", "[0x10]", "{\"a\":01}", "[1x]", "[.5]",
+		"[1e]", "[1e+]", "[-01]", "[+1]", "[\"a\tb\"]", "{\"a\nb\":1}"})
+	{
+		EXPECT_FALSE(document.parse(body)) << body;
+		EXPECT_FALSE(document.root().is_valid());
+	}
+
+	for (std::string_view body: {"0", "-0", "-0.5e-3", "1E+2", "[10, 1.25]", " [ ] ", "{}", "[[],{}]", "\"s\"",
+		"{\"a\":{\"b\":[null,false]}}"})
+		EXPECT_TRUE(document.parse(body)) << body;
+
+	ASSERT_TRUE(document.parse("[1e3, 1.5, -3]"));
+	int64_t i;
+	double d;
+	EXPECT_FALSE(document.root()[size_t{0}].get(i));
+	EXPECT_FALSE(document.root()[size_t{1}].get(i));
+	ASSERT_TRUE(document.root()[size_t{1}].get(d));
+	EXPECT_EQ(d, 1.5);
+	ASSERT_TRUE(document.root()[size_t{2}].get(i));
+	EXPECT_EQ(i, -3);
+}
@@ -0,0 +1,327 @@
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "extra/Itch.h"
+#include "extra/Multicast.h"
+#include "helper.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::multicast;
+
+namespace
+{
+constexpr const char * group_a = "239.255.50.1";
+constexpr const char * group_b = "239.255.50.2";
+
+void put(std::string & s, uint64_t value, size_t size)
+{
+	for (size_t i = size; i > 0; i--)
+		s += static_cast<char>(value >> (8 * (i - 1)));
+}
+
+/**
+ * MoldUDP64 packet of messages numbered from sequence, each its number in 4 bytes.
+ */
+std::string packet(uint64_t sequence, uint16_t count)
+{
+	std::string p = "SESSION001";
+	put(p, sequence, 8);
+	put(p, count, 2);
+	for (uint64_t i = sequence; i < sequence + count; i++)
+	{
+		put(p, 4, 2);
+		put(p, i, 4);
+	}
+	return p;
+}
+
+/**
+ * Sends to both lines of a receiver over loopback.
+ */
+class Sender
+{
+private:
+	int fd;
+	sockaddr_in lines[2];
+
+public:
+	explicit Sender(const Receiver & receiver)
+		: fd{socket(AF_INET, SOCK_DGRAM, 0)}, lines{}
+	{
+		in_addr loopback{htonl(INADDR_LOOPBACK)};
+		setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &loopback, sizeof(loopback));
+		int one = 1;
+		setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &one, sizeof(one));
+		for (int line = 0; line < 2; line++)
+		{
+			lines[line].sin_family = AF_INET;
+			lines[line].sin_port = htons(receiver.get_port(line));
+			inet_pton(AF_INET, line == 0 ? group_a : group_b, &lines[line].sin_addr);
+		}
+	}
+
+	~Sender()
+	{
+		close(fd);
+	}
+
+	void send(int line, const std::string & data)
+	{
+		sendto(fd, data.data(), data.size(), 0, reinterpret_cast<const sockaddr *>(&lines[line]), sizeof(sockaddr_in));
+	}
+};
+
+/**
+ * Run the poller until the lines received packets in all.
+ */
+bool run_until(poller_t * poller, const Receiver & receiver, uint64_t packets)
+{
+	const auto & stats = receiver.get_stats();
+	return run_until(poller, [&] { return stats.lines[0].packets + stats.lines[1].packets >= packets; })
+		&& stats.lines[0].packets + stats.lines[1].packets == packets;
+}
+
+struct Delivered
+{
+	uint64_t sequence;
+	uint16_t count;
+	int line;
+	std::string messages;
+};
+
+class MulticastTest : public testing::Test
+{
+protected:
+	poller_t * poller = nullptr;
+	std::vector<Delivered> delivered;
+	std::vector<std::pair<uint64_t, uint64_t>> gaps;
+	uint64_t received_ns = 0;
+
+	void SetUp() override
+	{
+		poller = poller_create();
+		ASSERT_NE(poller, nullptr);
+	}
+
+	void TearDown() override
+	{
+		poller_destroy(poller);
+	}
+
+	Receiver::Options options(bool b)
+	{
+		Receiver::Options options;
+		options.a.group = group_a;
+		options.a.interface = "127.0.0.1";
+		// Beyond the steps of a test on a loaded host
+		options.hold_timeout = std::chrono::milliseconds(200);
+		if (b)
+		{
+			options.b.group = group_b;
+			options.b.interface = "127.0.0.1";
+		}
+		return options;
+	}
+
+	Receiver::PacketCallback on_packet()
+	{
+		return [this](const Packet & packet)
+		{
+			EXPECT_EQ(packet.session, "SESSION001");
+			delivered.push_back(Delivered{packet.sequence, packet.count, packet.line, std::string(packet.messages)});
+			received_ns = packet.received_ns;
+		};
+	}
+
+	Receiver::GapCallback on_gap()
+	{
+		return [this](uint64_t first, uint64_t last)
+		{
+			gaps.emplace_back(first, last);
+		};
+	}
+
+	std::vector<uint64_t> sequences() const
+	{
+		std::vector<uint64_t> result;
+		for (const auto & d: delivered)
+			result.push_back(d.sequence);
+		return result;
+	}
+};
+}
+
+TEST_F(MulticastTest, Sequence_0)
+{
+	Receiver receiver(poller, options(false), on_packet(), on_gap());
+	ASSERT_TRUE(receiver.open());
+	EXPECT_NE(receiver.get_port(0), 0);
+	EXPECT_EQ(receiver.get_port(1), 0);
+	Sender sender(receiver);
+
+	// Heartbeats go unseen, the stream starting at the first packet
+	for (auto [sequence, count]: {std::pair{5, 2}, {7, 0}, {7, 1}, {8, 3}})
+		sender.send(0, packet(sequence, count));
+	ASSERT_TRUE(run_until(poller, receiver, 4));
+	EXPECT_EQ(sequences(), (std::vector<uint64_t>{5, 7, 8}));
+	EXPECT_EQ(delivered[0].messages, packet(5, 2).substr(binary::MoldUdp64::length));
+	EXPECT_EQ(receiver.next_sequence(), 11u);
+
+	// Stamped by the kernel at most a little before now
+	timespec now{};
+	clock_gettime(CLOCK_REALTIME, &now);
+	auto now_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+	EXPECT_GT(received_ns, now_ns - 5000000000);
+	EXPECT_LE(received_ns, now_ns);
+
+	// No other line to fill a gap
+	sender.send(0, packet(13, 1));
+	ASSERT_TRUE(run_until(poller, receiver, 5));
+	EXPECT_EQ(gaps, (std::vector<std::pair<uint64_t, uint64_t>>{{11, 13}}));
+	EXPECT_EQ(receiver.get_stats().lines[0].gaps, 1u);
+	EXPECT_EQ(receiver.get_stats().lines[0].missing, 2u);
+	EXPECT_EQ(receiver.get_stats().delivered, 4u);
+
+	Receiver::Options invalid = options(false);
+	invalid.a.group = "239.255.50";
+	Receiver other(poller, invalid, on_packet());
+	EXPECT_FALSE(other.open());
+	EXPECT_EQ(errno, EINVAL);
+}
+
+TEST_F(MulticastTest, Arbitration_0)
+{
+	Receiver receiver(poller, options(true), on_packet(), on_gap());
+	ASSERT_TRUE(receiver.open());
+	Sender sender(receiver);
+	uint64_t sent = 0;
+	auto send = [&](int line, uint64_t sequence, uint16_t count)
+	{
+		sender.send(line, packet(sequence, count));
+		ASSERT_TRUE(run_until(poller, receiver, ++sent));
+	};
+
+	// A loses 3, held until B fills it, B copies dropped
+	send(0, 1, 2);
+	send(1, 1, 2);
+	send(0, 4, 2);
+	EXPECT_EQ(sequences(), (std::vector<uint64_t>{1}));
+	send(1, 3, 1);
+	send(1, 4, 2);
+	EXPECT_EQ(sequences(), (std::vector<uint64_t>{1, 3, 4}));
+	EXPECT_EQ(delivered[1].line, 1);
+	EXPECT_EQ(delivered[2].line, 0);
+	EXPECT_TRUE(gaps.empty());
+	const auto & stats = receiver.get_stats();
+	EXPECT_EQ(stats.lines[0].gaps, 1u);
+	EXPECT_EQ(stats.lines[0].missing, 1u);
+	EXPECT_EQ(stats.lines[1].duplicates, 2u);
+
+	// Both lose 6, reported once B is beyond it too
+	send(0, 7, 1);
+	send(1, 7, 1);
+	EXPECT_EQ(gaps, (std::vector<std::pair<uint64_t, uint64_t>>{{6, 7}}));
+	EXPECT_EQ(sequences(), (std::vector<uint64_t>{1, 3, 4, 7}));
+
+	// Framed otherwise on B, only the messages not delivered yet
+	send(0, 8, 2);
+	send(1, 9, 2);
+	ASSERT_EQ(delivered.size(), 6u);
+	EXPECT_EQ(delivered.back().sequence, 10u);
+	EXPECT_EQ(delivered.back().count, 1);
+	EXPECT_EQ(delivered.back().messages, packet(10, 1).substr(binary::MoldUdp64::length));
+
+	// B silent, the gap given up on after hold_timeout
+	send(0, 12, 1);
+	EXPECT_EQ(sequences().back(), 10u);
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (gaps.size() < 2 && std::chrono::steady_clock::now() < deadline)
+		poller_go(poller);
+	EXPECT_EQ(gaps.back(), (std::pair<uint64_t, uint64_t>{11, 12}));
+	EXPECT_EQ(sequences().back(), 12u);
+	EXPECT_EQ(stats.gaps, 2u);
+	EXPECT_EQ(stats.lost, 2u);
+}
+
+TEST_F(MulticastTest, Hold_0)
+{
+	auto o = options(true);
+	o.hold = 2;
+	Receiver receiver(poller, o, on_packet(), on_gap());
+	ASSERT_TRUE(receiver.open());
+	Sender sender(receiver);
+	uint64_t sent = 0;
+	auto send = [&](int line, uint64_t sequence)
+	{
+		sender.send(line, packet(sequence, 1));
+		ASSERT_TRUE(run_until(poller, receiver, ++sent));
+	};
+
+	// A full hold gives up on the gap of its first packet
+	send(1, 1);
+	send(0, 3);
+	send(0, 4);
+	EXPECT_TRUE(gaps.empty());
+	send(0, 5);
+	EXPECT_EQ(gaps, (std::vector<std::pair<uint64_t, uint64_t>>{{2, 3}}));
+	EXPECT_EQ(sequences(), (std::vector<uint64_t>{1, 3, 4, 5}));
+
+	// Too late
+	send(1, 2);
+	EXPECT_EQ(receiver.get_stats().lines[1].duplicates, 1u);
+	EXPECT_EQ(sequences().back(), 5u);
+}
+
+TEST_F(MulticastTest, Channel_0)
+{
+	struct Record
+	{
+		uint64_t sequence;
+		uint64_t timestamp;
+		char event;
+		uint64_t received_ns;
+	};
+
+	extra::kernel::Channel<Record> channel("extra-multicast-test", 0, 16);
+	ASSERT_TRUE(channel.create());
+	auto publish = decode_to_channel<itch::Decoder>(channel, [](const itch::SystemEvent & m, const Packet & p, Record & r)
+	{
+		r = Record{p.sequence, m.timestamp(), m.event_code(), p.received_ns};
+	});
+	Receiver receiver(poller, options(false), publish);
+	ASSERT_TRUE(receiver.open());
+	Sender sender(receiver);
+
+	std::string p = "SESSION001";
+	put(p, 1, 8);
+	put(p, 2, 2);
+	for (char event: {'O', 'S'})
+	{
+		put(p, 12, 2);
+		p += 'S';
+		put(p, 0, 4);
+		put(p, 34200000000000, 6);
+		p += event;
+	}
+	sender.send(0, p);
+	ASSERT_TRUE(run_until(poller, receiver, 1));
+
+	auto it = channel.read_iterator();
+	ASSERT_TRUE(it.next());
+	EXPECT_EQ(it->event, 'O');
+	EXPECT_EQ(it->timestamp, 34200000000000u);
+	EXPECT_GT(it->received_ns, 0u);
+	ASSERT_TRUE(it.next());
+	EXPECT_EQ(it->event, 'S');
+	EXPECT_FALSE(it.next());
+}
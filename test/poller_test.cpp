@@ -0,0 +1,630 @@
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "extra/poller.h"
+#include "helper.h"
+
+namespace
+{
+/**
+ * Buffered end of a socket pair, consuming newline terminated lines.
+ */
+struct Peer
+{
+	int fd = -1;
+	handle_t * handle = nullptr;
+	std::vector<std::string> lines;
+	size_t writable = 0;
+	int error = 0;
+	bool closed = false;
+	bool echo = false;
+	int cork = 0;
+	// Bytes passed before without a newline
+	size_t scanned = 0;
+
+	static size_t on_data(handle_t * handle, void * context, const char * data, size_t size)
+	{
+		auto peer = static_cast<Peer *>(context);
+		size_t consumed = 0;
+		for (size_t i = peer->scanned; i < size; i++)
+		{
+			if (data[i] != '\n')
+				continue;
+
+			peer->lines.emplace_back(data + consumed, i - consumed);
+			if (peer->echo)
+				poller_send(data + consumed, i + 1 - consumed, handle);
+			consumed = i + 1;
+		}
+		peer->scanned = size - consumed;
+		return consumed;
+	}
+
+	static void on_writable(handle_t *, void * context)
+	{
+		static_cast<Peer *>(context)->writable++;
+	}
+
+	static void on_error(handle_t *, void * context, int error)
+	{
+		static_cast<Peer *>(context)->error = error;
+	}
+
+	static void on_close(handle_t *, void * context)
+	{
+		static_cast<Peer *>(context)->closed = true;
+	}
+
+	bool add(int fd_, poller_t * poller)
+	{
+		fd = fd_;
+		handle_param param{};
+		param.fd = fd;
+		param.context = this;
+		param.on_writable = on_writable;
+		param.on_data = on_data;
+		param.on_error = on_error;
+		param.on_close = on_close;
+		param.cork = cork;
+		handle = poller_add(&param, poller);
+		return handle != nullptr;
+	}
+};
+
+class PollerTest : public testing::TestWithParam<int>
+{
+protected:
+	poller_t * poller = nullptr;
+	int fds[2] = {-1, -1};
+	Peer a;
+	Peer b;
+
+	void SetUp() override
+	{
+		poller = poller_create_ex(GetParam());
+		ASSERT_NE(poller, nullptr);
+		ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+		ASSERT_TRUE(a.add(fds[0], poller));
+		ASSERT_TRUE(b.add(fds[1], poller));
+	}
+
+	void TearDown() override
+	{
+		poller_destroy(poller);
+		for (auto fd: fds)
+		{
+			if (fd >= 0)
+				close(fd);
+		}
+	}
+};
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, PollerTest, testing::Values(0, POLLER_URING));
+
+TEST_P(PollerTest, Buffered_0)
+{
+	ASSERT_TRUE(run_until(poller, [&] { return a.writable == 1 && b.writable == 1; }));
+	b.echo = true;
+
+	// Split lines are kept until complete
+	ASSERT_EQ(poller_send("hel", 3, a.handle), 0);
+	ASSERT_EQ(poller_send("lo\nwor", 6, a.handle), 0);
+	ASSERT_TRUE(run_until(poller, [&] { return b.lines.size() == 1; }));
+	ASSERT_EQ(poller_send("ld\n", 3, a.handle), 0);
+	ASSERT_TRUE(run_until(poller, [&] { return a.lines.size() == 2; }));
+	EXPECT_EQ(a.lines, (std::vector<std::string>{"hello", "world"}));
+
+	// More than the socket takes is queued, then written out on EPOLLOUT while the peer reads
+	std::string bulk;
+	for (int i = 0; i < 100000; i++)
+		bulk += "line " + std::to_string(i) + "\n";
+	b.echo = false;
+	ASSERT_EQ(poller_send(bulk.data(), bulk.size(), a.handle), 0);
+	ASSERT_TRUE(run_until(poller, [&] { return b.lines.size() == 100002; }));
+	EXPECT_EQ(b.lines.back(), "line 99999");
+	// io_uring queues all output, so the two sends before count as well
+	EXPECT_TRUE(run_until(poller, [&] { return a.writable == (poller_flags(poller) & POLLER_URING ? 4u : 2u); }));
+
+	// Larger than a buffer, unconsumed
+	std::string big(3 * 65536, 'x');
+	big += '\n';
+	ASSERT_EQ(poller_send(big.data(), big.size(), b.handle), 0);
+	ASSERT_TRUE(run_until(poller, [&] { return a.lines.size() == 3; }));
+	EXPECT_EQ(a.lines.back().size(), 3 * 65536u);
+
+	shutdown(fds[1], SHUT_WR);
+	ASSERT_TRUE(run_until(poller, [&] { return a.closed; }));
+	EXPECT_EQ(a.error, 0);
+	EXPECT_EQ(poller_send("x\n", 2, a.handle), -1);
+	EXPECT_EQ(errno, EPIPE);
+	EXPECT_FALSE(b.closed);
+}
+
+TEST_P(PollerTest, Buffered_1)
+{
+	// A line beyond the limit ends the connection
+	ASSERT_TRUE(run_until(poller, [&] { return a.writable == 1 && b.writable == 1; }));
+	std::string chunk(1024 * 1024, 'x');
+	for (int i = 0; i < 20 && a.error == 0; i++)
+	{
+		auto writable = b.writable;
+		ASSERT_EQ(poller_send(chunk.data(), chunk.size(), b.handle), 0);
+		run_until(poller, [&] { return a.error != 0 || b.writable > writable; });
+	}
+	EXPECT_EQ(a.error, EMSGSIZE);
+	EXPECT_TRUE(a.lines.empty());
+
+	poller_del(fds[0], poller);
+	close(fds[0]);
+	fds[0] = -1;
+	ASSERT_TRUE(run_until(poller, [&] { return b.closed || b.error != 0; }));
+}
+
+TEST_P(PollerTest, Raw_0)
+{
+	struct Raw
+	{
+		int fd;
+		std::string received;
+		size_t writable = 0;
+
+		static void on_readable(handle_t *, void * context)
+		{
+			auto raw = static_cast<Raw *>(context);
+			char buffer[16];
+			ssize_t n;
+			while ((n = read(raw->fd, buffer, sizeof(buffer))) > 0)
+				raw->received.append(buffer, n);
+		}
+
+		static void on_writable(handle_t *, void * context)
+		{
+			static_cast<Raw *>(context)->writable++;
+		}
+	};
+
+	int raw_fds[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, raw_fds), 0);
+	Raw raw{raw_fds[0], {}, 0};
+	handle_param param{};
+	param.fd = raw_fds[0];
+	param.context = &raw;
+	param.on_readable = Raw::on_readable;
+	param.on_writable = Raw::on_writable;
+	ASSERT_NE(poller_add(&param, poller), nullptr);
+	ASSERT_TRUE(run_until(poller, [&] { return raw.writable == 1; }));
+
+	// One edge per write, drained by the callback
+	ASSERT_EQ(write(raw_fds[1], "first ", 6), 6);
+	ASSERT_TRUE(run_until(poller, [&] { return raw.received.size() == 6; }));
+	ASSERT_EQ(write(raw_fds[1], "second", 6), 6);
+	ASSERT_TRUE(run_until(poller, [&] { return raw.received.size() == 12; }));
+	EXPECT_EQ(raw.received, "first second");
+
+	poller_del(raw_fds[0], poller);
+	ASSERT_EQ(write(raw_fds[1], "third", 5), 5);
+	for (int i = 0; i < 100; i++)
+		poller_go(poller);
+	EXPECT_EQ(raw.received.size(), 12u);
+	close(raw_fds[0]);
+	close(raw_fds[1]);
+}
+
+TEST_P(PollerTest, Block_0)
+{
+	using namespace std::chrono;
+
+	ASSERT_TRUE(run_until(poller, [&] { return a.writable == 1 && b.writable == 1; }));
+	poller_config config{};
+	config.mode = POLLER_BLOCK;
+	config.timeout = 50;
+	ASSERT_EQ(poller_set_config(&config, poller), 0);
+	// Signals cut waits short, so does the task work of io_uring rings closed by earlier tests
+	auto elapsed = [&]
+	{
+		auto begin = steady_clock::now();
+		for (int i = 0; i < 10; i++)
+		{
+			errno = 0;
+			poller_go(poller);
+			if (errno != EINTR)
+				break;
+		}
+		return steady_clock::now() - begin;
+	};
+
+	// Nothing to do
+	EXPECT_GE(elapsed(), milliseconds(45));
+	poller_stats stats{};
+	poller_get_stats(&stats, poller);
+	EXPECT_GE(stats.idle_ns, 45000000u);
+
+	// Up to the next mark due
+	config.timeout = -1;
+	ASSERT_EQ(poller_set_config(&config, poller), 0);
+	ASSERT_EQ(poller_mark(1, 20, a.handle, poller), 0);
+	auto blocked = elapsed();
+	EXPECT_GE(blocked, milliseconds(19));
+	EXPECT_LT(blocked, milliseconds(1000));
+
+	// Until an event
+	ASSERT_EQ(poller_send("x\n", 2, a.handle), 0);
+	config.timeout = 2000;
+	ASSERT_EQ(poller_set_config(&config, poller), 0);
+	ASSERT_TRUE(run_until(poller, [&] { return b.lines.size() == 1; }));
+
+	// Spinning for a while after work
+	config.mode = POLLER_ADAPTIVE;
+	config.spin = 1000000;
+	ASSERT_EQ(poller_set_config(&config, poller), 0);
+	ASSERT_EQ(poller_send("y\n", 2, a.handle), 0);
+	ASSERT_TRUE(run_until(poller, [&] { return b.lines.size() == 2; }));
+	EXPECT_LT(elapsed(), milliseconds(100));
+
+	poller_get_stats(&stats, poller);
+	EXPECT_GT(stats.events, 0u);
+	EXPECT_GT(stats.busy_ns, 0u);
+	EXPECT_GT(stats.wakeups, stats.events / 1024);
+
+	config.mode = 3;
+	EXPECT_EQ(poller_set_config(&config, poller), -1);
+	EXPECT_EQ(errno, EINVAL);
+}
+
+TEST_P(PollerTest, Table_0)
+{
+	struct Raw
+	{
+		poller_t * poller;
+		int fd;
+		int readable = 0;
+		// Deletes and adds again the fd of other when called
+		Raw * other = nullptr;
+		Raw * replacement = nullptr;
+
+		static void on_readable(handle_t *, void * context)
+		{
+			auto raw = static_cast<Raw *>(context);
+			raw->readable++;
+			if (raw->other)
+			{
+				poller_del(raw->other->fd, raw->poller);
+				raw->replacement->add();
+				raw->other = nullptr;
+			}
+		}
+
+		handle_t * add()
+		{
+			handle_param param{};
+			param.fd = fd;
+			param.context = this;
+			param.on_readable = on_readable;
+			return poller_add(&param, poller);
+		}
+	};
+
+	// Far above the initial table
+	int high[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, high), 0);
+	ASSERT_EQ(dup2(high[0], 5000), 5000);
+	close(high[0]);
+	Peer c;
+	ASSERT_TRUE(c.add(5000, poller));
+	Raw duplicate{poller, 5000};
+	EXPECT_EQ(duplicate.add(), nullptr);
+	EXPECT_EQ(errno, EEXIST);
+	ASSERT_EQ(write(high[1], "far\n", 4), 4);
+	ASSERT_TRUE(run_until(poller, [&] { return c.lines.size() == 1; }));
+	EXPECT_EQ(c.lines[0], "far");
+
+	// An event of a handle deleted earlier in the batch does not reach the one added in its place
+	int x[2];
+	int y[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, x), 0);
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, y), 0);
+	Raw second{poller, y[0]};
+	Raw replacement{poller, y[0]};
+	Raw first{poller, x[0], 0, &second, &replacement};
+	ASSERT_NE(first.add(), nullptr);
+	ASSERT_NE(second.add(), nullptr);
+	for (int i = 0; i < 10; i++)
+		poller_go(poller);
+	ASSERT_EQ(write(x[1], "1", 1), 1);
+	ASSERT_EQ(write(y[1], "2", 1), 1);
+	ASSERT_TRUE(run_until(poller, [&] { return first.readable == 1; }));
+	EXPECT_EQ(second.readable, 0);
+	EXPECT_EQ(replacement.readable, 0);
+	ASSERT_TRUE(run_until(poller, [&] { return replacement.readable == 1; }));
+
+	poller_del(5000, poller);
+	poller_del(x[0], poller);
+	poller_del(y[0], poller);
+	for (int fd: {5000, high[1], x[0], x[1], y[0], y[1]})
+		close(fd);
+}
+
+TEST_P(PollerTest, Slab_0)
+{
+	ASSERT_EQ(poller_reserve(16, 64, poller), 0);
+	// A connection added, marked, fed a line and deleted
+	auto churn = [&]
+	{
+		int pair[2];
+		ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair), 0);
+		Peer c;
+		ASSERT_TRUE(c.add(pair[0], poller));
+		for (int ack = 0; ack < 8; ack++)
+			ASSERT_EQ(poller_mark(ack, 60000, c.handle, poller), 0);
+		ASSERT_EQ(write(pair[1], "x\n", 2), 2);
+		ASSERT_TRUE(run_until(poller, [&] { return c.lines.size() == 1; }));
+		poller_del(pair[0], poller);
+		for (int i = 0; i < 10; i++)
+			poller_go(poller);
+		close(pair[0]);
+		close(pair[1]);
+	};
+
+	// The first may allocate its input buffer, kept for the next
+	churn();
+	poller_stats stats{};
+	poller_get_stats(&stats, poller);
+	auto allocations = stats.allocations;
+	EXPECT_GT(allocations, 0u);
+	for (int i = 0; i < 100; i++)
+		churn();
+	poller_get_stats(&stats, poller);
+	EXPECT_EQ(stats.allocations, allocations);
+
+	// Beyond the reserve, the pools grow
+	for (int ack = 0; ack < 200; ack++)
+		ASSERT_EQ(poller_mark(ack, 60000, a.handle, poller), 0);
+	poller_get_stats(&stats, poller);
+	EXPECT_GT(stats.allocations, allocations);
+}
+
+TEST_P(PollerTest, Submit_0)
+{
+	using namespace std::chrono;
+
+	struct Task
+	{
+		int producer;
+		int seq;
+		std::vector<int> * last;
+		size_t * ran;
+
+		static void run(void * context)
+		{
+			auto task = static_cast<Task *>(context);
+			// In order of each producer
+			EXPECT_EQ((*task->last)[task->producer] + 1, task->seq);
+			(*task->last)[task->producer] = task->seq;
+			(*task->ran)++;
+		}
+	};
+
+	constexpr int producers = 4;
+	constexpr int count = 10000;
+	std::vector<int> last(producers, -1);
+	size_t ran = 0;
+	std::vector<Task> tasks;
+	for (int producer = 0; producer < producers; producer++)
+	{
+		for (int seq = 0; seq < count; seq++)
+			tasks.push_back(Task{producer, seq, &last, &ran});
+	}
+
+	poller_config config{};
+	config.mode = POLLER_BLOCK;
+	config.timeout = 1000;
+	ASSERT_EQ(poller_set_config(&config, poller), 0);
+	std::vector<std::thread> threads;
+	for (int producer = 0; producer < producers; producer++)
+	{
+		threads.emplace_back([&, producer]
+		{
+			for (int seq = 0; seq < count; seq++)
+			{
+				// Full until the loop catches up
+				while (poller_submit(Task::run, &tasks[producer * count + seq], poller) != 0)
+				{
+					EXPECT_EQ(errno, EAGAIN);
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	EXPECT_TRUE(run_until(poller, [&] { return ran == producers * count; }));
+	for (auto & thread: threads)
+		thread.join();
+	EXPECT_EQ(last, std::vector<int>(producers, count - 1));
+
+	// Blocked until submitted to
+	bool woken = false;
+	config.timeout = 5000;
+	ASSERT_EQ(poller_set_config(&config, poller), 0);
+	std::thread late([&]
+	{
+		std::this_thread::sleep_for(milliseconds(20));
+		EXPECT_EQ(poller_submit([](void * context) { *static_cast<bool *>(context) = true; }, &woken, poller), 0);
+	});
+	auto begin = steady_clock::now();
+	while (!woken && steady_clock::now() - begin < seconds(5))
+		poller_go(poller);
+	late.join();
+	EXPECT_TRUE(woken);
+	EXPECT_LT(steady_clock::now() - begin, milliseconds(2000));
+}
+
+TEST_P(PollerTest, Cork_0)
+{
+	bool uring = poller_flags(poller) & POLLER_URING;
+	poller_stats stats{};
+	auto writes = [&]
+	{
+		poller_get_stats(&stats, poller);
+		return stats.writes;
+	};
+	ASSERT_TRUE(run_until(poller, [&] { return a.writable == 1 && b.writable == 1; }));
+
+	// Corked for a second, a burst goes out in one write by the next poller_go()
+	poller_del(fds[0], poller);
+	Peer corked;
+	corked.cork = 1000000;
+	ASSERT_TRUE(corked.add(fds[0], poller));
+	ASSERT_TRUE(run_until(poller, [&] { return corked.writable == 1; }));
+	auto before = writes();
+	for (int i = 0; i < 100; i++)
+		ASSERT_EQ(poller_send("message\n", 8, corked.handle), 0);
+	EXPECT_EQ(writes(), before);
+	ASSERT_TRUE(run_until(poller, [&] { return b.lines.size() == 100; }));
+	EXPECT_EQ(writes(), before + 1);
+
+	// Flushed now
+	ASSERT_EQ(poller_send("now\n", 4, corked.handle), 0);
+	ASSERT_EQ(poller_flush(corked.handle), 0);
+	EXPECT_EQ(writes(), before + 2);
+	ASSERT_TRUE(run_until(poller, [&] { return b.lines.size() == 101; }));
+	EXPECT_EQ(writes(), before + 2);
+	if (uring)
+		return;
+
+	// Past the budget, by the next send
+	poller_del(fds[0], poller);
+	Peer hurried;
+	hurried.cork = 1;
+	ASSERT_TRUE(hurried.add(fds[0], poller));
+	ASSERT_TRUE(run_until(poller, [&] { return hurried.writable == 1; }));
+	before = writes();
+	ASSERT_EQ(poller_send("late", 4, hurried.handle), 0);
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	ASSERT_EQ(poller_send("\n", 1, hurried.handle), 0);
+	EXPECT_EQ(writes(), before + 1);
+	ASSERT_TRUE(run_until(poller, [&] { return b.lines.size() == 102; }));
+	EXPECT_EQ(b.lines.back(), "late");
+
+	// Datagrams keep their boundaries, in one sendmmsg()
+	int pair[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, pair), 0);
+	Peer datagrams;
+	datagrams.cork = 1000000;
+	ASSERT_TRUE(datagrams.add(pair[0], poller));
+	ASSERT_TRUE(run_until(poller, [&] { return datagrams.writable == 1; }));
+	before = writes();
+	for (const char * message: {"one", "two", "three"})
+		ASSERT_EQ(poller_send(message, strlen(message), datagrams.handle), 0);
+	poller_go(poller);
+	EXPECT_EQ(writes(), before + 1);
+	char received[16];
+	for (const char * message: {"one", "two", "three"})
+	{
+		ASSERT_EQ(recv(pair[1], received, sizeof(received), 0), static_cast<ssize_t>(strlen(message)));
+		EXPECT_EQ(std::string(received, strlen(message)), message);
+	}
+	poller_del(pair[0], poller);
+	close(pair[0]);
+	close(pair[1]);
+}
+
+TEST(Poller, Mark_0)
+{
+	struct Marks
+	{
+		std::vector<int> acks;
+
+		static void on_timeout(handle_t *, void * context, int ack)
+		{
+			static_cast<Marks *>(context)->acks.push_back(ack);
+		}
+	};
+
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	int fds[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+	Marks marks;
+	handle_param param{};
+	param.fd = fds[0];
+	param.context = &marks;
+	param.on_timeout = Marks::on_timeout;
+	auto handle = poller_add(&param, poller);
+	ASSERT_NE(handle, nullptr);
+
+	ASSERT_EQ(poller_mark(1, 30, handle, poller), 0);
+	ASSERT_EQ(poller_mark(2, 10, handle, poller), 0);
+	ASSERT_EQ(poller_mark(3, 20, handle, poller), 0);
+	// Re-armed later, and disarmed
+	ASSERT_EQ(poller_mark(2, 40, handle, poller), 0);
+	ASSERT_EQ(poller_mark(3, -1, handle, poller), 0);
+	ASSERT_TRUE(run_until(poller, [&] { return marks.acks.size() == 2; }));
+	EXPECT_EQ(marks.acks, (std::vector<int>{1, 2}));
+
+	ASSERT_EQ(poller_mark(4, 0, handle, poller), 0);
+	poller_del(fds[0], poller);
+	EXPECT_EQ(poller_mark(5, 0, handle, poller), -1);
+	poller_go(poller);
+	EXPECT_EQ(marks.acks.size(), 2u);
+
+	poller_destroy(poller);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+TEST(Poller, Mark_1)
+{
+	struct Marks
+	{
+		std::vector<std::pair<int, std::chrono::steady_clock::time_point>> fired;
+
+		static void on_timeout(handle_t *, void * context, int ack)
+		{
+			static_cast<Marks *>(context)->fired.emplace_back(ack, std::chrono::steady_clock::now());
+		}
+	};
+
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	int fds[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+	Marks marks;
+	handle_param param{};
+	param.fd = fds[0];
+	param.context = &marks;
+	param.on_timeout = Marks::on_timeout;
+	auto handle = poller_add(&param, poller);
+	ASSERT_NE(handle, nullptr);
+
+	// Across the first two levels of the wheel, marked out of order
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < 100; i++)
+		ASSERT_EQ(poller_mark(i, (i * 37) % 100 * 3, handle, poller), 0);
+	// Beyond the wheel, then moved into it, and disarmed
+	ASSERT_EQ(poller_mark(100, 24 * 3600 * 1000, handle, poller), 0);
+	ASSERT_EQ(poller_mark(100, 150, handle, poller), 0);
+	ASSERT_EQ(poller_mark(101, 24 * 3600 * 1000, handle, poller), 0);
+	ASSERT_EQ(poller_mark(101, -1, handle, poller), 0);
+	ASSERT_TRUE(run_until(poller, [&] { return marks.fired.size() == 101; }));
+
+	int previous = -1;
+	for (auto [ack, at]: marks.fired)
+	{
+		int timeout = ack == 100 ? 150 : (ack * 37) % 100 * 3;
+		EXPECT_GE(at - begin, std::chrono::milliseconds(timeout)) << ack;
+		EXPECT_LE(previous, timeout) << ack;
+		previous = timeout;
+	}
+
+	poller_destroy(poller);
+	close(fds[0]);
+	close(fds[1]);
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "extra/HttpBasic.h"
+#include "extra/HttpTemplate.h"
 
 TEST(HttpV1D0, RequestFormat_0)
 {
@@ -34,6 +35,84 @@ TEST(HttpV1D0, RequestFormat_1)
 	EXPECT_EQ(actual, expected);
 }
 
+TEST(HttpV1D1, RequestFormatInto_0)
+{
+	using namespace extra::protocol::http;
+	HttpRequestV1D1 req;
+	req.set_method<Method::Post>();
+	req.set_uri("/order");
+	req.append_header("Content-Type", "application/json");
+	req.set_body_once("{\"qty\":1}");
+	std::string expected =
+		"POST /order HTTP/1.1\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: 9\r\n"
+		"\r\n"
+		"{\"qty\":1}";
+
+	EXPECT_EQ(req.size(), expected.size());
+
+	char small[16];
+	EXPECT_EQ(req.format_into(small, sizeof(small)), 0);
+
+	char buffer[256];
+	auto n = req.format_into(buffer, sizeof(buffer));
+	EXPECT_EQ(std::string_view(buffer, n), expected);
+
+	struct iovec iov[HttpRequestV1D1::iov_count];
+	n = req.format_iov(iov);
+	EXPECT_EQ(n, expected.size());
+	std::string gathered;
+	for (const auto & v: iov)
+		gathered.append(static_cast<const char *>(v.iov_base), v.iov_len);
+	EXPECT_EQ(gathered, expected);
+	EXPECT_EQ(req.format(), expected);
+}
+
+TEST(HttpV1D1, RequestTemplate_0)
+{
+	using namespace extra::protocol::http;
+	HttpRequestTemplate<Method::Post, Version::_1_1> tpl("/api/v3/order");
+	tpl.append_header("Content-Type", "application/json");
+	auto timestamp = tpl.append_slot("X-Timestamp", 13);
+	auto signature = tpl.append_slot("X-Signature", 8);
+	tpl.seal();
+
+	tpl.patch(timestamp, "1700000000000");
+	tpl.patch(signature, "abcd");
+	EXPECT_EQ(tpl.format("?test=1", "{}"),
+		"POST /api/v3/order?test=1 HTTP/1.1\r\n"
+		"Content-Type: application/json\r\n"
+		"X-Timestamp: 1700000000000\r\n"
+		"X-Signature: abcd    \r\n"
+		"Content-Length: 2\r\n"
+		"\r\n"
+		"{}");
+
+	tpl.patch(signature, "01234567");
+	std::string body = "{\"qty\":10}";
+	std::string expected =
+		"POST /api/v3/order HTTP/1.1\r\n"
+		"Content-Type: application/json\r\n"
+		"X-Timestamp: 1700000000000\r\n"
+		"X-Signature: 01234567\r\n"
+		"Content-Length: 10\r\n"
+		"\r\n"
+		"{\"qty\":10}";
+
+	char buffer[256];
+	auto n = tpl.format_into(buffer, sizeof(buffer), {}, body);
+	EXPECT_EQ(std::string_view(buffer, n), expected);
+
+	struct iovec iov[decltype(tpl)::iov_count];
+	n = tpl.format_iov(iov, {}, body);
+	std::string gathered;
+	for (const auto & v: iov)
+		gathered.append(static_cast<const char *>(v.iov_base), v.iov_len);
+	EXPECT_EQ(n, expected.size());
+	EXPECT_EQ(gathered, expected);
+}
+
 TEST(HttpV1D0, ResponseParse_0)
 {
 	std::string s =
@@ -72,3 +151,403 @@ TEST(HttpV1D0, ResponseParse_0)
 	EXPECT_NE(iter, headers.end());
 	EXPECT_EQ(iter->second, "D, E");
 }
+
+TEST(HttpV1D1, ResponseParse_1)
+{
+	std::string s =
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Length: 5\r\n"
+		"X-Trailing: value  \r\n"
+		"\r\n"
+		"first"
+		"HTTP/1.1 204 No Content\r\n"
+		"\r\n"
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Length: 6\r\n"
+		"\r\n"
+		"second";
+
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+	HttpResponseV1D1 resp;
+
+	std::string_view raw = s;
+	EXPECT_EQ(resp.parse(raw), ParseResult::Complete);
+	EXPECT_EQ(resp.get_body(), "first");
+	EXPECT_EQ(resp.get_headers().find("x-trailing")->second, "value");
+	EXPECT_TRUE(raw.starts_with("HTTP/1.1 204"));
+
+	resp.reset();
+	EXPECT_EQ(resp.parse(raw), ParseResult::Complete);
+	EXPECT_EQ(resp.get_status(), "204");
+	EXPECT_TRUE(resp.get_body().empty());
+	EXPECT_TRUE(resp.get_headers().empty());
+
+	// Split into single bytes
+	resp.reset();
+	for (size_t i = 0; i + 1 < raw.size(); i++)
+	{
+		std::string_view one = raw.substr(i, 1);
+		EXPECT_EQ(resp.parse(one), ParseResult::Incomplete);
+		EXPECT_TRUE(one.empty());
+	}
+	std::string_view last = raw.substr(raw.size() - 1);
+	EXPECT_EQ(resp.parse(last), ParseResult::Complete);
+	EXPECT_EQ(resp.get_body(), "second");
+	EXPECT_EQ(resp.get_headers().find("Content-Length")->second, "6");
+
+	// Content-Length of a 304 is that of the representation, no body follows
+	resp.reset();
+	std::string_view not_modified = "HTTP/1.1 304 Not Modified\r\nContent-Length: 1024\r\n\r\nHTTP/1.1";
+	EXPECT_EQ(resp.parse(not_modified), ParseResult::Complete);
+	EXPECT_EQ(not_modified, "HTTP/1.1");
+}
+
+TEST(HttpV1D1, ResponseParse_2)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+	HttpResponseV1D1 resp;
+
+	std::string_view raw = "HTTP/1.1 200 OK\r\nContent-Length: abc\r\n\r\n";
+	EXPECT_EQ(resp.parse(raw), ParseResult::Error);
+	std::string_view more = "x";
+	EXPECT_EQ(resp.parse(more), ParseResult::Error);
+
+	resp.reset();
+	raw = "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nx";
+	EXPECT_EQ(resp.parse(raw), ParseResult::Complete);
+
+	for (auto length: {"+1", "-1", "0x1", "1 1", "99999999999999999999999"})
+	{
+		resp.reset();
+		std::string s = "HTTP/1.1 200 OK\r\nContent-Length: ";
+		s += length;
+		s += "\r\n\r\nx";
+		raw = s;
+		EXPECT_EQ(resp.parse(raw), ParseResult::Error) << length;
+	}
+
+	resp.reset();
+	std::string many = "HTTP/1.1 200 OK\r\n";
+	for (int i = 0; i < 200; i++)
+		many += "X-Repeated: value\r\n";
+	raw = many;
+	EXPECT_EQ(resp.parse(raw), ParseResult::Error);
+
+	// Keys differing after an embedded NUL are distinct
+	resp.reset();
+	using namespace std::string_literals;
+	auto nul = "HTTP/1.1 200 OK\r\na\0b: 1\r\na\0c: 2\r\nContent-Length: 0\r\n\r\n"s;
+	raw = nul;
+	EXPECT_EQ(resp.parse(raw), ParseResult::Complete);
+	EXPECT_EQ(resp.get_headers().size(), 3u);
+}
+
+TEST(HttpV1D1, RequestParse_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	std::string s =
+		"POST /order?id=1 HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Type:application/json \r\n"
+		"Content-Length: 9\r\n"
+		"\r\n"
+		"{\"qty\":1}"
+		"GET /status HTTP/1.0\r\n"
+		"\r\n";
+
+	HttpRequestParser parser;
+	std::string_view raw = s;
+	EXPECT_EQ(parser.parse(raw), ParseResult::Complete);
+	EXPECT_EQ(parser.get_method(), "POST");
+	EXPECT_EQ(parser.get_uri(), "/order?id=1");
+	EXPECT_EQ(parser.get_version(), "HTTP/1.1");
+	EXPECT_EQ(parser.get_header_count(), 3u);
+	EXPECT_EQ(parser.find_header("content-type"), "application/json");
+	EXPECT_EQ(parser.get_body(), "{\"qty\":1}");
+	EXPECT_TRUE(parser.is_keep_alive());
+
+	parser.reset();
+	EXPECT_EQ(parser.parse(raw), ParseResult::Complete);
+	EXPECT_EQ(parser.get_method(), "GET");
+	EXPECT_FALSE(parser.is_keep_alive());
+	EXPECT_TRUE(raw.empty());
+
+	// Split at every position of the first request, consuming nothing until complete
+	for (size_t i = 1; i < s.find("GET /status"); i++)
+	{
+		parser.reset();
+		std::string_view part = std::string_view(s).substr(0, i);
+		auto size = part.size();
+		EXPECT_EQ(parser.parse(part), ParseResult::Incomplete);
+		EXPECT_EQ(part.size(), size);
+
+		std::string_view whole = s;
+		EXPECT_EQ(parser.parse(whole), ParseResult::Complete);
+		EXPECT_EQ(parser.get_body(), "{\"qty\":1}");
+	}
+
+	for (std::string_view bad: {
+		"GET HTTP/1.1\r\n\r\n",
+		"GET / HTTP/2\r\n\r\n",
+		"GET / HTTP/1.x\r\n\r\n",
+		"GET / HTTP/1.10\r\n\r\n",
+		"GET / HTTP/1.1 x\r\n\r\n",
+		"GET / HTTP/1.1 \r\n\r\n",
+		"GET /a b HTTP/1.1\r\n\r\n",
+		"GET / HTTP/1.1\r\nHost : a\r\n\r\n",
+		"GET / HTTP/1.1\r\nA: b\r\n folded\r\n\r\n",
+		"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n",
+		"POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+	})
+	{
+		parser.reset();
+		EXPECT_EQ(parser.parse(bad), ParseResult::Error) << bad;
+	}
+}
+
+TEST(HttpV1D1, ResponseWrite_0)
+{
+	using namespace extra::protocol::http;
+
+	std::string output;
+	{
+		HttpResponseWriter writer(output, true);
+		writer.set_status<Status::_404>();
+		writer.append_header("Content-Type", "text/plain");
+		writer.set_body_once("none");
+	}
+	{
+		HttpResponseWriter writer(output, false);
+		writer.finish();
+	}
+	EXPECT_EQ(output,
+		"HTTP/1.1 404 Not Found\r\n"
+		"Content-Type: text/plain\r\n"
+		"Content-Length: 4\r\n"
+		"\r\n"
+		"none"
+		"HTTP/1.1 200 OK\r\n"
+		"Connection: close\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n");
+	EXPECT_EQ(status_line<Version::_1_1>(Status::_503), "HTTP/1.1 503 Service Unavailable\r\n");
+}
+
+TEST(HttpV1D1, ResponseParse_3)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+	using namespace std::string_literals;
+	if (!HttpResponseBasic::is_content_decoding_supported())
+		GTEST_SKIP() << "built without zlib";
+
+	std::string text;
+	for (int i = 0; i < 20; i++)
+		text += "The quick brown fox jumps over the lazy dog. ";
+	auto deflated =
+		"\x0b\xc9\x48\x55\x28\x2c\xcd\x4c\xce\x56\x48\x2a\xca\x2f\xcf\x53\x48\xcb\xaf\x50\xc8\x2a\xcd\x2d\x28\x56"
+		"\xc8\x2f\x4b\x2d\x52\x28\x01\x4a\xe7\x24\x56\x55\x2a\xa4\xe4\xa7\xeb\x29\x84\x8c\x2a\x1e\x55\x3c\xaa\x98"
+		"\xda\x8a\x01"s;
+	auto gzip = "\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\x03"s + deflated + "\xe6\x4a\x66\xb0\x84\x03\x00\x00"s;
+	auto zlib = "\x78\x9c"s + deflated + "\x47\xa5\x43\x1c"s;
+	auto message = [](std::string_view coding, const std::string & body)
+	{
+		return "HTTP/1.1 200 OK\r\nContent-Encoding: "s + std::string(coding) + "\r\nContent-Length: "
+		       + std::to_string(body.size()) + "\r\n\r\n" + body;
+	};
+
+	HttpResponseV1D1 resp;
+	std::vector<std::pair<std::string_view, std::string>> cases{
+		{"gzip", gzip}, {"X-GZIP", gzip}, {"deflate", zlib}, {"deflate", deflated}};
+	for (const auto & [coding, body]: cases)
+	{
+		auto s = message(coding, body);
+		for (size_t split: {s.size(), size_t{1}})
+		{
+			resp.reset();
+			auto result = ParseResult::Incomplete;
+			for (size_t i = 0; i < s.size(); i += split)
+			{
+				std::string_view raw = std::string_view(s).substr(i, split);
+				result = resp.parse(raw);
+			}
+			ASSERT_EQ(result, ParseResult::Complete) << coding << split;
+			EXPECT_EQ(resp.get_body(), text) << coding << split;
+		}
+	}
+
+	// Raw deflate starting as a zlib header would, but for its check bits: stored blocks, the first 0x08
+	auto stored = "\x08\x05\x00\xfa\xffhello\x01\x00\x00\xff\xff"s;
+	auto m = message("deflate", stored);
+	for (size_t split: {m.size(), size_t{1}})
+	{
+		resp.reset();
+		auto result = ParseResult::Incomplete;
+		for (size_t i = 0; i < m.size(); i += split)
+		{
+			std::string_view raw = std::string_view(m).substr(i, split);
+			result = resp.parse(raw);
+		}
+		ASSERT_EQ(result, ParseResult::Complete) << split;
+		EXPECT_EQ(resp.get_body(), "hello") << split;
+	}
+
+	// Chunked, the gzip stream spread over chunks of any size
+	auto chunked = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n\r\n"s;
+	for (size_t i = 0; i < gzip.size(); i += 7)
+	{
+		auto piece = gzip.substr(i, 7);
+		chunked += std::to_string(piece.size()) + "\r\n" + piece + "\r\n";
+	}
+	chunked += "0\r\n\r\n";
+	resp.reset();
+	std::string_view whole = chunked;
+	EXPECT_EQ(resp.parse(whole), ParseResult::Complete);
+	EXPECT_EQ(resp.get_body(), text);
+
+	// Concatenated gzip members delimited by close
+	resp.reset();
+	auto s = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n\r\n"s + gzip + gzip;
+	std::string_view raw = s;
+	EXPECT_EQ(resp.parse(raw), ParseResult::Incomplete);
+	EXPECT_TRUE(resp.eof());
+	EXPECT_EQ(resp.get_body(), text + text);
+
+	// Truncated by close
+	resp.reset();
+	s = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n\r\n"s + gzip.substr(0, 40);
+	raw = s;
+	EXPECT_EQ(resp.parse(raw), ParseResult::Incomplete);
+	EXPECT_FALSE(resp.eof());
+
+	// Stream ending before or after Content-Length, or corrupt
+	for (const auto & body: {gzip.substr(0, 40), gzip + "x", "\x1f\x8b\x08\x00junk"s})
+	{
+		resp.reset();
+		s = message("gzip", body);
+		raw = s;
+		EXPECT_EQ(resp.parse(raw), ParseResult::Error);
+	}
+
+	// Identity, unknown codings, or decoding turned off leave the body as received
+	for (auto coding: {"identity", "br"})
+	{
+		resp.reset();
+		s = message(coding, gzip);
+		raw = s;
+		EXPECT_EQ(resp.parse(raw), ParseResult::Complete);
+		EXPECT_EQ(resp.get_body(), gzip);
+	}
+	resp.set_content_decoding(false);
+	resp.reset();
+	s = message("gzip", gzip);
+	raw = s;
+	EXPECT_EQ(resp.parse(raw), ParseResult::Complete);
+	EXPECT_EQ(resp.get_body(), gzip);
+
+	// Sink receives decoded pieces and lifts the body length limit
+	std::string received;
+	resp.set_content_decoding(true);
+	resp.set_body_sink([&received](std::string_view piece)
+	{
+		received += piece;
+	});
+	resp.reset();
+	raw = s;
+	EXPECT_EQ(resp.parse(raw), ParseResult::Complete);
+	EXPECT_TRUE(resp.get_body().empty());
+	EXPECT_EQ(received, text);
+
+	resp.reset();
+	s = "HTTP/1.1 200 OK\r\nContent-Length: 2000000\r\n\r\n" + std::string(2000000, 'x');
+	raw = s;
+	EXPECT_EQ(resp.parse(raw), ParseResult::Complete);
+	EXPECT_EQ(received.size(), text.size() + 2000000);
+}
+
+TEST(HttpV1D1, ResponseParse_4)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+	using namespace std::string_literals;
+
+	// Interim responses skipped, then chunks with an extension and a trailer, on a kept connection
+	std::string s =
+		"HTTP/1.1 100 Continue\r\n"
+		"\r\n"
+		"HTTP/1.1 103 Early Hints\r\n"
+		"Link: </style.css>; rel=preload\r\n"
+		"\r\n"
+		"HTTP/1.1 200 OK\r\n"
+		"Transfer-Encoding: Chunked\r\n"
+		"Content-Length: 100\r\n"
+		"\r\n"
+		"5;name=value\r\n"
+		"hello\r\n"
+		"19 \r\n"
+		", abcdefghijklmnopqrstuvw\r\n"
+		"0\r\n"
+		"X-Checksum: 1\r\n"
+		"\r\n"
+		"HTTP/1.1";
+
+	HttpResponseV1D1 resp;
+	for (size_t split: {s.size(), size_t{1}})
+	{
+		resp.reset();
+		std::string_view raw = s;
+		auto result = ParseResult::Incomplete;
+		while (result == ParseResult::Incomplete && !raw.empty())
+		{
+			auto piece = raw.substr(0, split);
+			auto size = piece.size();
+			result = resp.parse(piece);
+			raw.remove_prefix(size - piece.size());
+		}
+		ASSERT_EQ(result, ParseResult::Complete) << split;
+		EXPECT_EQ(raw, "HTTP/1.1") << split;
+		EXPECT_EQ(resp.get_status(), "200");
+		EXPECT_EQ(resp.get_body(), "hello, abcdefghijklmnopqrstuvw");
+		EXPECT_EQ(resp.get_headers().count("Link"), 0u);
+		EXPECT_EQ(resp.get_headers().count("X-Checksum"), 0u);
+		EXPECT_TRUE(resp.is_keep_alive());
+	}
+
+	// Switching protocols ends HTTP/1.x, whatever follows is left to the caller
+	resp.reset();
+	std::string_view raw = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n\x81\x00";
+	EXPECT_EQ(resp.parse(raw), ParseResult::Complete);
+	EXPECT_EQ(resp.get_status(), "101");
+	EXPECT_EQ(raw, "\x81\x00");
+
+	// Truncated chunked body is not complete at close
+	resp.reset();
+	raw = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel";
+	EXPECT_EQ(resp.parse(raw), ParseResult::Incomplete);
+	EXPECT_FALSE(resp.eof());
+
+	// Bad chunk sizes, data not followed by CRLF, and transfer codings other than chunked
+	for (auto body: {"x\r\n", "-1\r\n", "\r\n", "0x5\r\n", "5\r\nhelloX\r\n", "fffffffffffffffff\r\n"})
+	{
+		resp.reset();
+		s = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"s + body;
+		raw = s;
+		EXPECT_EQ(resp.parse(raw), ParseResult::Error) << body;
+	}
+	resp.reset();
+	raw = "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n0\r\n\r\n";
+	EXPECT_EQ(resp.parse(raw), ParseResult::Error);
+
+	// Chunks add up against the body length limit as Content-Length does
+	resp.reset();
+	s = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+	for (int i = 0; i < 2; i++)
+		s += "80000\r\n" + std::string(0x80000, 'x') + "\r\n";
+	s += "1\r\nx\r\n0\r\n\r\n";
+	raw = s;
+	EXPECT_EQ(resp.parse(raw), ParseResult::Error);
+}
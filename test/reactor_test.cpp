@@ -0,0 +1,312 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "extra/reactor.h"
+
+namespace
+{
+template <typename Predicate>
+bool wait_until(Predicate predicate)
+{
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (!predicate() && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	return predicate();
+}
+
+sockaddr_in loopback()
+{
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return sa;
+}
+
+int connect_to(const sockaddr_in & sa)
+{
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd >= 0 && connect(fd, reinterpret_cast<const sockaddr *>(&sa), sizeof(sa)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Loops the connections were accepted on, and their descriptors to close.
+ */
+struct Accepted
+{
+	reactor_t * reactor = nullptr;
+	std::mutex mutex;
+	std::vector<int> loops;
+	std::vector<int> fds;
+
+	static void on_accept(int fd, poller_t * poller, void * context)
+	{
+		auto accepted = static_cast<Accepted *>(context);
+		int loop = reactor_current(accepted->reactor);
+		// On the thread of the loop of the poller
+		EXPECT_EQ(reactor_poller(loop, accepted->reactor), poller);
+		std::lock_guard lock(accepted->mutex);
+		accepted->loops.push_back(loop);
+		accepted->fds.push_back(fd);
+	}
+
+	size_t size()
+	{
+		std::lock_guard lock(mutex);
+		return loops.size();
+	}
+
+	~Accepted()
+	{
+		for (int fd: fds)
+			close(fd);
+	}
+};
+
+std::vector<int> count_by_loop(const std::vector<int> & loops, int count)
+{
+	std::vector<int> counts(count);
+	for (int loop: loops)
+		counts.at(loop)++;
+	return counts;
+}
+}
+
+TEST(Reactor, RoundRobin_0)
+{
+	reactor_config config{};
+	config.loops = 3;
+	config.poller.mode = POLLER_BLOCK;
+	config.poller.timeout = 100;
+	auto reactor = reactor_create(&config);
+	ASSERT_NE(reactor, nullptr);
+	EXPECT_EQ(reactor_loops(reactor), 3);
+	EXPECT_EQ(reactor_current(reactor), -1);
+
+	Accepted accepted;
+	accepted.reactor = reactor;
+	auto sa = loopback();
+	ASSERT_EQ(reactor_listen(reinterpret_cast<sockaddr *>(&sa), sizeof(sa), Accepted::on_accept, &accepted, reactor), 0);
+	EXPECT_NE(sa.sin_port, 0);
+	ASSERT_EQ(reactor_start(reactor), 0);
+
+	std::vector<int> clients;
+	for (int i = 0; i < 6; i++)
+		clients.push_back(connect_to(sa));
+	EXPECT_TRUE(wait_until([&] { return accepted.size() == 6; }));
+	reactor_destroy(reactor);
+	EXPECT_EQ(count_by_loop(accepted.loops, 3), (std::vector<int>{2, 2, 2}));
+	for (int fd: clients)
+		close(fd);
+}
+
+TEST(Reactor, ReusePort_0)
+{
+	struct Started
+	{
+		std::atomic<int> started{0};
+		std::atomic<int> stopped{0};
+
+		static void on_start(int, poller_t *, void * context)
+		{
+			static_cast<Started *>(context)->started++;
+		}
+
+		static void on_stop(int, poller_t *, void * context)
+		{
+			static_cast<Started *>(context)->stopped++;
+		}
+	};
+
+	Started started;
+	reactor_config config{};
+	config.loops = 2;
+	config.flags = POLLER_URING;
+	config.poller.mode = POLLER_BLOCK;
+	config.poller.timeout = -1;
+	config.policy = REACTOR_REUSEPORT;
+	config.on_start = Started::on_start;
+	config.on_stop = Started::on_stop;
+	config.context = &started;
+	auto reactor = reactor_create(&config);
+	ASSERT_NE(reactor, nullptr);
+
+	Accepted accepted;
+	accepted.reactor = reactor;
+	auto sa = loopback();
+	ASSERT_EQ(reactor_listen(reinterpret_cast<sockaddr *>(&sa), sizeof(sa), Accepted::on_accept, &accepted, reactor), 0);
+	ASSERT_EQ(reactor_start(reactor), 0);
+	EXPECT_EQ(reactor_listen(reinterpret_cast<sockaddr *>(&sa), sizeof(sa), Accepted::on_accept, &accepted, reactor), -1);
+	EXPECT_EQ(errno, EBUSY);
+
+	// Spread by the kernel from the ports of the clients
+	std::vector<int> clients;
+	for (int i = 0; i < 64; i++)
+		clients.push_back(connect_to(sa));
+	EXPECT_TRUE(wait_until([&] { return accepted.size() == 64; }));
+	EXPECT_TRUE(wait_until([&] { return started.started == 2; }));
+	reactor_destroy(reactor);
+	EXPECT_EQ(started.stopped, 2);
+	auto counts = count_by_loop(accepted.loops, 2);
+	EXPECT_GT(counts[0], 0);
+	EXPECT_GT(counts[1], 0);
+	for (int fd: clients)
+		close(fd);
+}
+
+TEST(Reactor, Hash_0)
+{
+	struct Pick
+	{
+		static int pick(int, void *)
+		{
+			return 1;
+		}
+	};
+
+	reactor_config config{};
+	config.loops = 4;
+	config.poller.mode = POLLER_BLOCK;
+	config.poller.timeout = -1;
+	config.policy = REACTOR_HASH;
+	auto reactor = reactor_create(&config);
+	ASSERT_NE(reactor, nullptr);
+	Accepted accepted;
+	accepted.reactor = reactor;
+	auto sa = loopback();
+	ASSERT_EQ(reactor_listen(reinterpret_cast<sockaddr *>(&sa), sizeof(sa), Accepted::on_accept, &accepted, reactor), 0);
+	ASSERT_EQ(reactor_start(reactor), 0);
+
+	// The same peer to the same loop, dispatched again
+	int client = connect_to(sa);
+	ASSERT_TRUE(wait_until([&] { return accepted.size() == 1; }));
+	int fd;
+	int loop;
+	{
+		std::lock_guard lock(accepted.mutex);
+		fd = accepted.fds[0];
+		loop = accepted.loops[0];
+		accepted.fds.clear();
+	}
+	EXPECT_EQ(reactor_dispatch(fd, Accepted::on_accept, &accepted, reactor), loop);
+	EXPECT_TRUE(wait_until([&] { return accepted.size() == 2; }));
+	EXPECT_EQ(accepted.loops[1], loop);
+	reactor_destroy(reactor);
+	close(client);
+
+	config.pick = Pick::pick;
+	reactor = reactor_create(&config);
+	ASSERT_NE(reactor, nullptr);
+	ASSERT_EQ(reactor_start(reactor), 0);
+	accepted.reactor = reactor;
+	EXPECT_EQ(reactor_dispatch(fd, Accepted::on_accept, &accepted, reactor), 1);
+	EXPECT_TRUE(wait_until([&] { return accepted.size() == 3; }));
+	EXPECT_EQ(accepted.loops.back(), 1);
+	reactor_destroy(reactor);
+	accepted.fds.resize(1);
+
+	config.loops = 0;
+	EXPECT_EQ(reactor_create(&config), nullptr);
+	EXPECT_EQ(errno, EINVAL);
+}
+
+TEST(Reactor, Migrate_0)
+{
+	// Echoes lines with the loop it runs on, moving to the next loop after the first
+	struct Echo
+	{
+		reactor_t * reactor;
+		int fd = -1;
+		int lines = 0;
+
+		static size_t on_data(handle_t * handle, void * context, const char * data, size_t size)
+		{
+			auto echo = static_cast<Echo *>(context);
+			if (data[size - 1] != '\n')
+				return 0;
+
+			int loop = reactor_current(echo->reactor);
+			char reply[] = {static_cast<char>('0' + loop), '\n'};
+			poller_send(reply, sizeof(reply), handle);
+			if (++echo->lines == 1)
+			{
+				EXPECT_EQ(reactor_migrate(echo->fd, (loop + 1) % reactor_loops(echo->reactor), add, echo, echo->reactor), 0);
+			}
+			return size;
+		}
+
+		static void add(int fd, poller_t * poller, void * context)
+		{
+			auto echo = static_cast<Echo *>(context);
+			echo->fd = fd;
+			handle_param param{};
+			param.fd = fd;
+			param.context = echo;
+			param.on_data = on_data;
+			EXPECT_NE(poller_add(&param, poller), nullptr);
+		}
+	};
+
+	reactor_config config{};
+	config.loops = 2;
+	config.poller.mode = POLLER_BLOCK;
+	config.poller.timeout = -1;
+	auto reactor = reactor_create(&config);
+	ASSERT_NE(reactor, nullptr);
+	ASSERT_EQ(reactor_start(reactor), 0);
+	EXPECT_EQ(reactor_migrate(0, 1, Echo::add, nullptr, reactor), -1);
+	EXPECT_EQ(errno, EINVAL);
+
+	int fds[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+	ASSERT_EQ(fcntl(fds[0], F_SETFL, O_NONBLOCK), 0);
+	Echo echo{reactor};
+	int first = reactor_dispatch(fds[0], Echo::add, &echo, reactor);
+	ASSERT_GE(first, 0);
+	char reply[2];
+	for (int i = 0; i < 2; i++)
+	{
+		ASSERT_EQ(write(fds[1], "x\n", 2), 2);
+		ASSERT_EQ(read(fds[1], reply, sizeof(reply)), 2);
+		EXPECT_EQ(reply[0], '0' + (first + i) % 2);
+	}
+	reactor_destroy(reactor);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+TEST(Reactor, Destroy_0)
+{
+	reactor_config config{};
+	config.loops = 2;
+	auto reactor = reactor_create(&config);
+	ASSERT_NE(reactor, nullptr);
+
+	// Handed to loops never taking them, as to one stopped first, closed rather than leaked
+	int fds[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+	Accepted accepted;
+	accepted.reactor = reactor;
+	EXPECT_GE(reactor_dispatch(fds[0], Accepted::on_accept, &accepted, reactor), 0);
+	reactor_destroy(reactor);
+	EXPECT_EQ(accepted.size(), 0u);
+	EXPECT_EQ(fcntl(fds[0], F_GETFD), -1);
+	EXPECT_EQ(errno, EBADF);
+	char c;
+	EXPECT_EQ(read(fds[1], &c, 1), 0);
+	close(fds[1]);
+}
@@ -0,0 +1,160 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "extra/HttpClient.h"
+#include "extra/HttpServer.h"
+#include "helper.h"
+
+TEST(HttpServer, Serve_0)
+{
+	using namespace extra::protocol;
+	using namespace extra::protocol::http;
+
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		HttpServer server(poller, [](const HttpRequestParser & request, HttpResponseWriter & response)
+		{
+			if (request.get_uri() == "/missing")
+			{
+				response.set_status<Status::_404>();
+				response.finish();
+				return;
+			}
+			response.append_header("X-Method", request.get_method());
+			response.set_body_once(request.get_body().empty() ? request.get_uri() : request.get_body());
+		});
+		ASSERT_TRUE(server.listen("127.0.0.1", 0));
+
+		HttpClient client(poller, {.max_connections_per_host = 1, .pipeline_depth = 8});
+		std::vector<std::string> results;
+		auto callback = [&](State state, Error, HttpResponseV1D1 * response)
+		{
+			ASSERT_EQ(state, State::Success);
+			results.push_back(response->get_status() + " " + response->get_body());
+		};
+
+		for (int i = 0; i < 8; i++)
+		{
+			HttpRequestV1D1 req;
+			req.set_method<Method::Get>();
+			req.set_uri("/" + std::to_string(i));
+			client.send("127.0.0.1", server.get_port(), req, callback);
+		}
+
+		HttpRequestV1D1 post;
+		post.set_method<Method::Post>();
+		post.set_uri("/echo");
+		post.set_body_once("payload");
+		client.send("127.0.0.1", server.get_port(), post, callback);
+
+		HttpRequestV1D1 missing;
+		missing.set_method<Method::Get>();
+		missing.set_uri("/missing");
+		client.send("127.0.0.1", server.get_port(), missing, callback);
+
+		EXPECT_TRUE(run_until(poller, [&] { return results.size() == 10; }));
+		ASSERT_EQ(results.size(), 10u);
+		for (int i = 0; i < 8; i++)
+			EXPECT_EQ(results[i], "200 /" + std::to_string(i));
+		EXPECT_EQ(results[8], "200 payload");
+		EXPECT_EQ(results[9], "404 ");
+		EXPECT_EQ(server.connection_count(), 1u);
+	}
+	poller_destroy(poller);
+}
+
+TEST(HttpServer, BadRequest_0)
+{
+	using namespace extra::protocol::http;
+
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		HttpServer server(poller, [](const HttpRequestParser &, HttpResponseWriter &) {});
+		ASSERT_TRUE(server.listen("127.0.0.1", 0));
+
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		sockaddr_in sa{};
+		sa.sin_family = AF_INET;
+		sa.sin_port = htons(server.get_port());
+		sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		connect(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa));
+		EXPECT_TRUE(run_until(poller, [&] { return server.connection_count() == 1; }));
+
+		std::string_view bad = "GARBAGE\r\n\r\n";
+		EXPECT_EQ(::send(fd, bad.data(), bad.size(), 0), static_cast<ssize_t>(bad.size()));
+
+		std::string received;
+		char buffer[256];
+		EXPECT_TRUE(run_until(poller, [&]
+		{
+			auto n = recv(fd, buffer, sizeof(buffer), 0);
+			if (n > 0)
+				received.append(buffer, n);
+			return n == 0;
+		}));
+		EXPECT_TRUE(received.starts_with("HTTP/1.1 400 Bad Request\r\n"));
+		EXPECT_EQ(server.connection_count(), 0u);
+		close(fd);
+	}
+	poller_destroy(poller);
+}
+
+TEST(HttpServer, SlowReader_0)
+{
+	using namespace extra::protocol::http;
+
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		// Each response alone is over output_size_limit
+		std::string large(17 * 1024 * 1024, 'x');
+		HttpServer server(poller, [&](const HttpRequestParser &, HttpResponseWriter & response)
+		{
+			response.set_body_once(large);
+		});
+		ASSERT_TRUE(server.listen("127.0.0.1", 0));
+
+		std::string one;
+		HttpResponseWriter writer(one, true);
+		writer.set_body_once(large);
+		writer.finish();
+
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		int size = 4096;
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+		sockaddr_in sa{};
+		sa.sin_family = AF_INET;
+		sa.sin_port = htons(server.get_port());
+		sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr *>(&sa), sizeof(sa)), 0);
+		EXPECT_TRUE(run_until(poller, [&] { return server.connection_count() == 1; }));
+
+		// Pipelined requests, none read for a while: the server waits rather than dropping the peer
+		std::string requests;
+		for (int i = 0; i < 3; i++)
+			requests += "GET / HTTP/1.1\r\n\r\n";
+		EXPECT_EQ(::send(fd, requests.data(), requests.size(), 0), static_cast<ssize_t>(requests.size()));
+		for (int i = 0; i < 1000; i++)
+			poller_go(poller);
+		EXPECT_EQ(server.connection_count(), 1);
+
+		std::vector<char> buffer(64 * 1024);
+		size_t received = 0;
+		EXPECT_TRUE(run_until(poller, [&]
+		{
+			auto n = recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+			received += n > 0 ? n : 0;
+			return received >= one.size() * 3;
+		}));
+		EXPECT_EQ(received, one.size() * 3);
+		EXPECT_EQ(server.connection_count(), 1);
+		close(fd);
+		EXPECT_TRUE(run_until(poller, [&] { return server.connection_count() == 0; }));
+	}
+	poller_destroy(poller);
+}
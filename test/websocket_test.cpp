@@ -0,0 +1,282 @@
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "extra/WebSocket.h"
+#include "helper.h"
+
+using namespace extra::protocol;
+using namespace extra::protocol::ws;
+
+namespace
+{
+/**
+ * Blocking WebSocket echo server on loopback, pinging the client once after the upgrade.
+ */
+class EchoServer
+{
+private:
+	int listener;
+	uint16_t port;
+	std::thread thread;
+
+public:
+	std::atomic<bool> pong_received{false};
+
+	EchoServer()
+		: listener{-1}, port{0}
+	{
+		listener = listen_loopback(SOCK_STREAM, port);
+		thread = std::thread([this] { serve(); });
+	}
+
+	~EchoServer()
+	{
+		shutdown(listener, SHUT_RDWR);
+		close(listener);
+		thread.join();
+	}
+
+	[[nodiscard]] uint16_t get_port() const
+	{
+		return port;
+	}
+
+private:
+	void serve()
+	{
+		int fd = accept(listener, nullptr, nullptr);
+		if (fd < 0)
+			return;
+
+		std::string input;
+		char buffer[4096];
+		http::HttpRequestParser request;
+		ssize_t n;
+		while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+		{
+			input.append(buffer, n);
+			std::string_view raw = input;
+			if (request.parse(raw) == ParseResult::Complete)
+			{
+				std::string output;
+				http::HttpResponseWriter writer(output, true);
+				writer.set_status<http::Status::_101>();
+				writer.append_header("Upgrade", "websocket");
+				writer.append_header("Connection", "Upgrade");
+				writer.append_header("Sec-WebSocket-Accept", accept_key(request.find_header("Sec-WebSocket-Key")));
+				output += "\r\n";
+				encode_frame(output, Opcode::Ping, "hb");
+				::send(fd, output.data(), output.size(), MSG_NOSIGNAL);
+				input.erase(0, input.size() - raw.size());
+				break;
+			}
+		}
+
+		FrameParser parser(true);
+		do
+		{
+			std::string_view raw = input;
+			std::string output;
+			while (!raw.empty() && parser.parse(raw) == ParseResult::Complete)
+			{
+				if (parser.get_opcode() == Opcode::Pong)
+					pong_received = parser.get_payload() == "hb";
+				else if (parser.get_opcode() == Opcode::Close)
+				{
+					encode_frame(output, Opcode::Close, parser.get_payload());
+					::send(fd, output.data(), output.size(), MSG_NOSIGNAL);
+					close(fd);
+					return;
+				}
+				else
+					encode_frame(output, parser.get_opcode(), parser.get_payload());
+				parser.reset();
+			}
+			::send(fd, output.data(), output.size(), MSG_NOSIGNAL);
+			input.clear();
+		} while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0 && (input.assign(buffer, n), true));
+		close(fd);
+	}
+};
+}
+
+TEST(WebSocket, AcceptKey_0)
+{
+	EXPECT_EQ(accept_key("dGhlIHNhbXBsZSBub25jZQ=="), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+	EXPECT_EQ(make_key().size(), 24u);
+}
+
+TEST(WebSocket, Mask_0)
+{
+	const uint8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+	std::string in(200, '\0');
+	for (size_t i = 0; i < in.size(); i++)
+		in[i] = static_cast<char>(i * 7);
+
+	for (size_t size = 0; size < 100; size++)
+	{
+		for (size_t phase = 0; phase < 4; phase++)
+		{
+			std::string out(size, '\0');
+			apply_mask(out.data(), in.data(), size, key, phase);
+			for (size_t i = 0; i < size; i++)
+				ASSERT_EQ(out[i], static_cast<char>(in[i] ^ key[(phase + i) % 4])) << size << " " << phase;
+		}
+	}
+}
+
+TEST(WebSocket, FrameParse_0)
+{
+	const uint8_t key[4] = {1, 2, 3, 4};
+	std::string big(70000, 'x');
+	auto encode = [&](const uint8_t (* k)[4])
+	{
+		std::string wire;
+		encode_frame(wire, Opcode::Text, "Hel", false, k);
+		encode_frame(wire, Opcode::Ping, "p", true, k);
+		encode_frame(wire, Opcode::Continuation, "lo", true, k);
+		encode_frame(wire, Opcode::Binary, big, true, k);
+		encode_frame(wire, Opcode::Text, "", true, k);
+		return wire;
+	};
+
+	// Masked as sent by a client, then unmasked as by a server
+	for (auto [wire, from_client]: {std::make_pair(encode(&key), true), std::make_pair(encode(nullptr), false)})
+	{
+		for (size_t step: {wire.size(), size_t(1), size_t(3)})
+		{
+			FrameParser parser(from_client);
+			std::vector<std::pair<Opcode, std::string>> messages;
+			for (size_t i = 0; i < wire.size(); i += step)
+			{
+				std::string_view raw = std::string_view(wire).substr(i, step);
+				while (!raw.empty())
+				{
+					auto result = parser.parse(raw);
+					ASSERT_NE(result, ParseResult::Error);
+					if (result == ParseResult::Complete)
+					{
+						messages.emplace_back(parser.get_opcode(), parser.get_payload());
+						parser.reset();
+					}
+				}
+			}
+			ASSERT_EQ(messages.size(), 4u);
+			EXPECT_EQ(messages[0], std::make_pair(Opcode::Ping, std::string("p")));
+			EXPECT_EQ(messages[1], std::make_pair(Opcode::Text, std::string("Hello")));
+			EXPECT_EQ(messages[2], std::make_pair(Opcode::Binary, big));
+			EXPECT_EQ(messages[3], std::make_pair(Opcode::Text, std::string()));
+		}
+	}
+
+	FrameParser parser;
+	std::string unexpected;
+	encode_frame(unexpected, Opcode::Continuation, "x");
+	std::string_view raw = unexpected;
+	EXPECT_EQ(parser.parse(raw), ParseResult::Error);
+	EXPECT_EQ(parser.get_close_code(), 1002);
+}
+
+TEST(WebSocket, FrameParse_1)
+{
+	using namespace std::string_literals;
+	const uint8_t key[4] = {1, 2, 3, 4};
+	auto parse = [](const std::string & wire, bool from_client = false)
+	{
+		FrameParser parser(from_client);
+		std::string_view raw = wire;
+		auto result = parser.parse(raw);
+		return std::make_pair(result, result == ParseResult::Error ? parser.get_close_code() : uint16_t{0});
+	};
+	auto frame = [](Opcode opcode, std::string_view payload, const uint8_t (* k)[4] = nullptr)
+	{
+		std::string wire;
+		encode_frame(wire, opcode, payload, true, k);
+		return wire;
+	};
+	auto error = [](uint16_t code)
+	{
+		return std::make_pair(ParseResult::Error, code);
+	};
+	auto complete = std::make_pair(ParseResult::Complete, uint16_t{0});
+
+	// Only clients mask, RFC 6455 5.1
+	EXPECT_EQ(parse(frame(Opcode::Text, "x", &key)), error(1002));
+	EXPECT_EQ(parse(frame(Opcode::Ping, "", &key)), error(1002));
+	EXPECT_EQ(parse(frame(Opcode::Text, "x"), true), error(1002));
+	EXPECT_EQ(parse(frame(Opcode::Text, "x", &key), true), complete);
+
+	// Text must be UTF-8, binary need not
+	EXPECT_EQ(parse(frame(Opcode::Text, "h\xc3\xa9llo \xe2\x82\xac \xf0\x9d\x84\x9e, ascii past 8 bytes")), complete);
+	for (auto text: {"\xff", "\x80", "\xc0\xaf", "\xc3", "\xe0\x80\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80",
+		"\xf8\x88\x80\x80\x80", "\xe2\x82", "12345678\xc3(", "\xe2\x28\xa1"})
+	{
+		EXPECT_EQ(parse(frame(Opcode::Text, text)), error(1007)) << text;
+		EXPECT_EQ(parse(frame(Opcode::Binary, text)), complete) << text;
+	}
+
+	// A character split over fragments is whole once reassembled
+	std::string wire;
+	encode_frame(wire, Opcode::Text, "\xe2\x82", false);
+	encode_frame(wire, Opcode::Continuation, "\xac");
+	EXPECT_EQ(parse(wire), complete);
+
+	// Close reason after the status code, which takes two bytes
+	EXPECT_EQ(parse(frame(Opcode::Close, "")), complete);
+	EXPECT_EQ(parse(frame(Opcode::Close, "\x03\xe8ok"s)), complete);
+	EXPECT_EQ(parse(frame(Opcode::Close, "\x03\xe8\xc0\xaf"s)), error(1007));
+	EXPECT_EQ(parse(frame(Opcode::Close, "\x03"s)), error(1002));
+}
+
+TEST(WebSocket, Client_0)
+{
+	struct Tick
+	{
+		size_t size;
+		char text[32];
+	};
+
+	EchoServer server;
+	extra::kernel::Channel<Tick> channel("extra-websocket-test", 0, 128);
+	ASSERT_TRUE(channel.create());
+
+	auto poller = poller_create();
+	ASSERT_NE(poller, nullptr);
+	{
+		std::vector<State> states;
+		size_t received = 0;
+		auto to_tick = to_channel(channel, [&](Opcode, std::string_view payload, Tick & tick)
+		{
+			tick.size = payload.size();
+			std::memcpy(tick.text, payload.data(), std::min(payload.size(), sizeof(tick.text)));
+			received++;
+		});
+		WebSocketClient client(poller, to_tick, [&](State state) { states.push_back(state); });
+		ASSERT_TRUE(client.connect("127.0.0.1", server.get_port(), "/feed"));
+
+		for (int i = 0; i < 100; i++)
+			EXPECT_TRUE(client.send(Opcode::Text, "tick " + std::to_string(i)));
+
+		EXPECT_TRUE(run_until(poller, [&] { return received == 100 && server.pong_received; }));
+		ASSERT_EQ(states.size(), 1u);
+		EXPECT_EQ(states[0], State::Success);
+
+		auto it = channel.read_iterator();
+		for (int i = 0; i < 100; i++)
+		{
+			ASSERT_TRUE(it.next());
+			EXPECT_EQ(std::string_view(it->text, it->size), "tick " + std::to_string(i));
+		}
+
+		client.close();
+		EXPECT_TRUE(run_until(poller, [&] { return states.size() == 2; }));
+		EXPECT_EQ(states.back(), State::NetworkError);
+		EXPECT_FALSE(client.is_open());
+	}
+	poller_destroy(poller);
+}